@@ -3,6 +3,8 @@
 #include <iostream>
 #include <random>
 #include <thread>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "gtest/gtest.h"
 
@@ -12,7 +14,17 @@
 #include "zbs_entropy.hpp"
 #include "zbs_mixed_len.hpp"
 
+#include <terark/zbs/block_zip_blob_store.hpp>
+#include <terark/zbs/column_blob_store.hpp>
+#include <terark/zbs/dict_zip_blob_store.hpp>
+#include <terark/zbs/entropy_zip_blob_store.hpp>
 #include <terark/zbs/mixed_len_blob_store.hpp>
+#include <terark/zbs/multi_len_blob_store.hpp>
+#include <terark/zbs/zip_offset_blob_store.hpp>
+#include <terark/zbs/zip_reorder_map.hpp>
+#include <terark/zbs/ZstdStream.hpp>
+#include <terark/io/FileMemStream.hpp>
+#include <terark/io/FileStream.hpp>
 
 // inline void print_bytes(const std::string &str) {
 //   const char *c = str.c_str();
@@ -213,3 +225,784 @@ TEST(ZBS_TEST, MIXED_LEN_BLOB_STORE) {
 
   // Read Data and Validate
 }
+
+/**
+ * ZstdOutputStream/ZstdInputStream round trip: streaming, zstd workers,
+ * and seekable frames which are compressed/decompressed in parallel,
+ * frames larger than max frame size are decompressed by streaming
+ */
+TEST(ZBS_TEST, ZSTD_STREAM_WORKERS_AND_FRAMES) {
+  const size_t num = 8 << 20;
+  std::string data(num, '\0');
+  std::mt19937 rng(1);
+  for (size_t i = 0; i < num; ++i) data[i] = "abcdefgh"[rng() % 8];
+  const char* fname = "/tmp/zbs_test_zstd_stream.zst";
+  struct { int workers; size_t frameSize, maxFrameSize; } cases[] = {
+      {0, 0, 0}, {2, 0, 0}, {0, 1 << 20, 0}, {3, 1 << 20, 0}, {3, 333333, 0},
+      {3, 1 << 20, 512 << 10}, {3, 0, 512 << 10}};
+  for (auto c : cases) {
+    {
+      terark::FileStream fp(fname, "wb");
+      terark::ZstdOutputStream os(&fp);
+      os.setWorkers(c.workers);
+      os.setFrameSize(c.frameSize);
+      for (size_t pos = 0; pos < num;) {
+        size_t len = std::min<size_t>(rng() % 300000, num - pos);
+        os.write(data.data() + pos, len);
+        pos += len;
+      }
+      os.close();
+    }
+    terark::FileStream fp(fname, "rb");
+    terark::ZstdInputStream is(&fp);
+    is.setWorkers(c.workers);
+    if (c.maxFrameSize) is.setMaxFrameSize(c.maxFrameSize);
+    std::string got(num, '\0');
+    for (size_t pos = 0; pos < num;) {
+      size_t len = std::min<size_t>(rng() % 300000 + 1, num - pos);
+      size_t n = is.read(&got[pos], len);
+      ASSERT_GT(n, 0);
+      pos += n;
+    }
+    ASSERT_EQ(got, data);
+  }
+  ::remove(fname);
+}
+
+/**
+ * DictZipBlobStore purge/reorder by parallel chunks must produce the same
+ * file as by one thread, with/without entropy and zipped offsets
+ */
+TEST(ZBS_TEST, DICT_ZIP_PURGE_REORDER_PARALLEL) {
+  using namespace terark;
+  const size_t num = 200000;
+  std::mt19937_64 rng(1);
+  std::vector<std::string> recs(num);
+  for (size_t i = 0; i < num; ++i) {
+    recs[i] = "rec" + std::to_string(i % 977) + ":";
+    for (size_t j = rng() % 64; j; --j) recs[i] += char('a' + rng() % 6);
+  }
+  febitvec isDel(num);
+  for (size_t i = 0; i < num; ++i)
+    if (rng() % 5 == 0 || i / 1000 % 7 == 3) isDel.set1(i);
+  std::vector<size_t> newToOld(num);
+  for (size_t i = 0; i < num; ++i) newToOld[i] = i;
+  for (size_t i = 0; i + 1000 <= num; i += 1000)
+    std::reverse(newToOld.begin() + i, newToOld.begin() + i + 1000);
+  for (size_t i = 0; i < num / 10; ++i)
+    std::swap(newToOld[rng() % num], newToOld[rng() % num]);
+  const char* fname = "/tmp/zbs_test_purge.zbs";
+  const char* mapFname = "/tmp/zbs_test_purge.map";
+  const char* newFname = "/tmp/zbs_test_purge.new";
+  {
+    ZReorderMap::Builder builder(num, 1, mapFname, "wb");
+    for (size_t oldId : newToOld) builder.push_back(oldId);
+    builder.finish();
+  }
+  for (int entropy = 0; entropy < 2; ++entropy) {
+    for (int zipOffsets = 0; zipOffsets < 2; ++zipOffsets) {
+      DictZipBlobStore::Options opt;
+      opt.embeddedDict = true;
+      opt.offsetArrayBlockUnits = zipOffsets ? 128 : 0;
+      if (entropy) opt.entropyAlgo = DictZipBlobStore::Options::kHuffmanO1;
+      {
+        std::unique_ptr<DictZipBlobStore::ZipBuilder> builder(
+            DictZipBlobStore::createZipBuilder(opt));
+        for (size_t i = 0; i < num; i += 7) builder->addSample(recs[i]);
+        builder->finishSample();
+        builder->prepare(num, fname);
+        for (auto& rec : recs) builder->addRecord(rec);
+        builder->finish(DictZipBlobStore::ZipBuilder::FinishFreeDict);
+      }
+      std::unique_ptr<DictZipBlobStore> store(
+          dynamic_cast<DictZipBlobStore*>(BlobStore::load_from_mmap(fname, false)));
+      ASSERT_TRUE(store != nullptr);
+      std::string purged[2], reordered[2], purgedByFunc;
+      for (int t = 0; t < 2; ++t) {
+        DictZipBlobStore_setPurgeThreads(t ? 5 : 1);
+        store->purge_zip_data(isDel.bldata(), 0, [&](const void* d, size_t n) {
+          purged[t].append((const char*)d, n);
+        });
+        ZReorderMap reorder(mapFname);
+        store->reorder_zip_data(reorder, [&](const void* d, size_t n) {
+          reordered[t].append((const char*)d, n);
+        }, std::string(fname) + ".reorder-tmp");
+      }
+      // isDel as a function is always called by the calling thread
+      const auto tid = std::this_thread::get_id();
+      bool otherThread = false;
+      store->purge_zip_data([&](size_t id) {
+        otherThread |= std::this_thread::get_id() != tid;
+        return isDel[id];
+      }, [&](const void* d, size_t n) { purgedByFunc.append((const char*)d, n); });
+      DictZipBlobStore_setPurgeThreads(0);
+      ASSERT_FALSE(otherThread);
+      ASSERT_EQ(purged[0], purged[1]);
+      ASSERT_EQ(purged[0], purgedByFunc);
+      ASSERT_EQ(reordered[0], reordered[1]);
+      auto load = [](const std::string& mem, const char* fpath) {
+        FileStream(fpath, "wb").ensureWrite(mem.data(), mem.size());
+        return BlobStore::load_from_mmap(fpath, false);
+      };
+      valvec<byte_t> rec;
+      std::unique_ptr<BlobStore> p(load(purged[1], newFname));
+      for (size_t i = 0, k = 0; i < num; ++i) {
+        if (isDel[i]) continue;
+        p->get_record(k++, &rec);
+        ASSERT_EQ(std::string((char*)rec.data(), rec.size()), recs[i]);
+      }
+      p.reset();
+      std::unique_ptr<BlobStore> r(load(reordered[1], newFname));
+      for (size_t i = 0; i < num; ++i) {
+        r->get_record(i, &rec);
+        ASSERT_EQ(std::string((char*)rec.data(), rec.size()), recs[newToOld[i]]);
+      }
+    }
+  }
+  ::remove(fname);
+  ::remove(mapFname);
+  ::remove(newFname);
+}
+
+/**
+ * Two MultiThread DictZip builders of different priority share the global
+ * pipeline concurrently, tasks of each builder in the pipeline never exceed
+ * its threadBudget, shares of weights are tested in test_weighted_round_robin
+ */
+TEST(ZBS_TEST, DICT_ZIP_SCHEDULER_BUDGET) {
+  using namespace terark;
+  const size_t num = 100000;
+  std::mt19937_64 rng(2);
+  std::vector<std::string> recs(num);
+  for (size_t i = 0; i < num; ++i) {
+    recs[i] = "key" + std::to_string(i % 1013) + ":";
+    for (size_t j = rng() % 100; j; --j) recs[i] += char('a' + rng() % 8);
+  }
+  const DictZipBlobStore::Options::Priority prio[2] = {
+    DictZipBlobStore::Options::kPriorityHigh,
+    DictZipBlobStore::Options::kPriorityLow,
+  };
+  const int budget[2] = {1, 2};
+  std::string fname[2];
+  DictZipBlobStore::ZipStat stat[2];
+  bool multi[2] = {false, false};
+  auto build = [&](int k) {
+    DictZipBlobStore::Options opt;
+    opt.embeddedDict = true;
+    opt.priority = prio[k];
+    opt.threadBudget = budget[k];
+    opt.recordsPerBatch = 100; // many small tasks
+    opt.bytesPerBatch = 8 * 1024;
+    fname[k] = "/tmp/zbs_test_sched_" + std::to_string(k) + ".zbs";
+    std::unique_ptr<DictZipBlobStore::ZipBuilder> builder(
+        DictZipBlobStore::createZipBuilder(opt));
+    multi[k] = builder->isMultiThread();
+    for (size_t i = k; i < num; i += 7) builder->addSample(recs[i]);
+    builder->finishSample();
+    builder->prepare(num, fname[k]);
+    for (auto& rec : recs) builder->addRecord(rec);
+    builder->finish(DictZipBlobStore::ZipBuilder::FinishFreeDict);
+    stat[k] = builder->getZipStat();
+  };
+  std::thread thr(build, 1);
+  build(0);
+  thr.join();
+  for (int k = 0; k < 2; ++k) {
+    if (multi[k]) { // env DictZipBlobStore_zipThreads=0 is SingleThread
+      ASSERT_GT(stat[k].builderThroughBytes, 0u);
+      ASSERT_GT(stat[k].pipelineMaxInflight, 0u);
+      ASSERT_LE(stat[k].pipelineMaxInflight, size_t(budget[k]));
+    }
+    std::unique_ptr<BlobStore> store(BlobStore::load_from_mmap(fname[k], false));
+    ASSERT_EQ(store->num_records(), num);
+    valvec<byte_t> rec;
+    for (size_t i = 0; i < num; ++i) {
+      store->get_record(i, &rec);
+      ASSERT_EQ(std::string((char*)rec.data(), rec.size()), recs[i]);
+    }
+    store.reset();
+    ::remove(fname[k].c_str());
+  }
+}
+
+/**
+ * ZReorderMap random access: operator[], seek, chunked iterators, and the
+ * in memory builder produces the same map as the file builder
+ */
+TEST(ZBS_TEST, ZREORDER_MAP_RANDOM_ACCESS) {
+  using namespace terark;
+  std::mt19937_64 rng(3);
+  const char* mapFname = "/tmp/zbs_test_reorder.map";
+  for (size_t num : {0, 1, 7, 1000, 300000}) {
+    for (int sign : {1, -1}) {
+      // runs of random lengths, single values and empty tail cases
+      std::vector<size_t> newToOld;
+      while (newToOld.size() < num) {
+        size_t base = rng() % (num * 4 + 1) + num;
+        size_t len = std::min<size_t>(rng() % 4 ? rng() % 300 + 1 : 1,
+                                      num - newToOld.size());
+        for (size_t j = 0; j < len; ++j) newToOld.push_back(base + sign * j);
+      }
+      {
+        ZReorderMap::Builder builder(num, sign, mapFname, "wb");
+        for (size_t oldId : newToOld) builder.push_back(oldId);
+        builder.finish();
+      }
+      ZReorderMap::Builder memBuilder(num, sign);
+      for (size_t oldId : newToOld) memBuilder.push_back(oldId);
+      memBuilder.finish();
+      ZReorderMap fileMap(mapFname);
+      ZReorderMap memMap(memBuilder);
+      for (ZReorderMap* m : {&fileMap, &memMap}) {
+        ASSERT_EQ(m->size(), num);
+        size_t n = 0;
+        for (; !m->eof(); ++*m, ++n) {
+          ASSERT_EQ(m->index(), n);
+          ASSERT_EQ(**m, newToOld[n]);
+        }
+        ASSERT_EQ(n, num);
+        for (size_t k = 0; k < std::min<size_t>(num, 2000); ++k) {
+          size_t i = rng() % num;
+          ASSERT_EQ((*m)[i], newToOld[i]);
+        }
+        if (num) {
+          m->seek(num - 1);
+          ASSERT_EQ(**m, newToOld.back());
+          ++*m;
+          ASSERT_TRUE(m->eof());
+        }
+        m->seek(num);
+        ASSERT_TRUE(m->eof());
+        // chunked parallel iteration
+        const size_t chunks = 4;
+        std::vector<std::thread> thr;
+        std::atomic<size_t> mismatch(0);
+        for (size_t c = 0; c < chunks; ++c) {
+          thr.emplace_back([&, c]() {
+            size_t end = num * (c + 1) / chunks;
+            auto it = m->iter(num * c / chunks);
+            for (size_t i = num * c / chunks; i < end; ++i, ++it)
+              if (*it != newToOld[i]) mismatch++;
+          });
+        }
+        for (auto& t : thr) t.join();
+        ASSERT_EQ(mismatch.load(), 0);
+      }
+      const size_t runs = memMap.num_runs();
+      ASSERT_EQ(fileMap.num_runs(), runs);
+      // movable, data and sample index are taken over
+      ZReorderMap moved(std::move(fileMap));
+      ASSERT_EQ(moved.size(), num);
+      ASSERT_EQ(moved.num_runs(), runs);
+      memMap = std::move(moved);
+      ASSERT_EQ(memMap.num_runs(), runs);
+      memMap.rewind();
+      for (size_t n = 0; n < num; ++n, ++memMap) ASSERT_EQ(*memMap, newToOld[n]);
+      ASSERT_TRUE(memMap.eof());
+    }
+  }
+  ::remove(mapFname);
+}
+
+namespace {
+
+// json like records, every 1000th record is empty
+std::vector<std::string> gen_records(std::mt19937_64& rng, size_t num) {
+  const char* words[] = {"alpha", "beta", "gamma", "delta", "epsilon"};
+  std::vector<std::string> recs;
+  for (size_t i = 0; i < num; ++i) {
+    std::string r = "{\"id\":" + std::to_string(i) + ",\"name\":\"";
+    for (size_t j = rng() % 8; j > 0; --j)
+      r += words[rng() % 5];
+    r += "\"}";
+    if (i % 1000 == 999) r.clear();
+    recs.push_back(std::move(r));
+  }
+  return recs;
+}
+
+// save_mmap of a loaded store is byte identical to the built file
+void check_save_mmap(const terark::AbstractBlobStore* store,
+                     const char* fname, const char* newFname) {
+  using namespace terark;
+  store->save_mmap(newFname);
+  MmapWholeFile a(fname), b(newFname);
+  ASSERT_EQ(fstring((char*)a.base, a.size), fstring((char*)b.base, b.size));
+}
+
+void check_pread(const terark::BlobStore* store, const char* fname,
+                 const std::vector<std::string>& recs, size_t step) {
+  using namespace terark;
+  int fd = ::open(fname, O_RDONLY);
+  ASSERT_TRUE(fd >= 0);
+  valvec<byte_t> rec;
+  for (size_t i = 0; i < recs.size(); i += step) {
+    store->pread_record(nullptr, fd, 0, i, &rec);
+    ASSERT_EQ(std::string((char*)rec.data(), rec.size()), recs[i]);
+  }
+  ::close(fd);
+}
+
+// reorder store to newFname by a reversed and shuffled map, check records
+// of newFname by get_record and CacheOffsets, newToOld is the map
+void check_reorder(const terark::AbstractBlobStore* store, std::mt19937_64& rng,
+                   const std::vector<std::string>& recs, const char* newFname,
+                   std::vector<size_t>* newToOld) {
+  using namespace terark;
+  const size_t num = recs.size();
+  newToOld->resize(num);
+  for (size_t i = 0; i < num; ++i) (*newToOld)[i] = num - 1 - i;
+  for (size_t i = 0; i < num / 10; ++i)
+    std::swap((*newToOld)[rng() % num], (*newToOld)[rng() % num]);
+  ZReorderMap::Builder mapBuilder(num, 1);
+  for (size_t oldId : *newToOld) mapBuilder.push_back(oldId);
+  mapBuilder.finish();
+  ZReorderMap reorder(mapBuilder);
+  {
+    FileStream fp(newFname, "wb");
+    store->reorder_zip_data(reorder, [&](const void* d, size_t n) {
+      fp.ensureWrite(d, n);
+    }, std::string(newFname) + ".reorder-tmp");
+  }
+  std::unique_ptr<BlobStore> store2(BlobStore::load_from_mmap(newFname, false));
+  ASSERT_EQ(store2->num_records(), num);
+  valvec<byte_t> rec;
+  BlobStore::CacheOffsets co;
+  for (size_t i = 0; i < num; ++i) {
+    const std::string& expected = recs[(*newToOld)[i]];
+    store2->get_record(i, &rec);
+    ASSERT_EQ(std::string((char*)rec.data(), rec.size()), expected);
+    store2->get_record(i, &co);
+    ASSERT_EQ(std::string((char*)co.recData.data(), co.recData.size()), expected);
+  }
+}
+
+} // namespace
+
+/**
+ * ColumnBlobStore: records are reassembled from per column codecs, a field
+ * can be read without decoding other columns, save_mmap, pread and reorder
+ */
+TEST(ZBS_TEST, COLUMN_BLOB_STORE) {
+  using namespace terark;
+  typedef ColumnBlobStore CBS;
+  std::mt19937_64 rng(47);
+  const char* fname = "/tmp/zbs_test_column.zbs";
+  const char* newFname = "/tmp/zbs_test_column.new";
+  // | id 4 | ts 8 | const 2 | nlen 1, name | plen 2, payload | tail |
+  const char* words[] = {"alpha", "beta", "gamma", "delta", "epsilon"};
+  const size_t num = 20000;
+  std::vector<std::string> recs;
+  uint64_t ts = 1700000000000;
+  for (size_t i = 0; i < num; ++i) {
+    std::string r;
+    uint32_t id = uint32_t(rng());
+    ts += rng() % 1000;
+    uint16_t c = 7;
+    r.append((char*)&id, 4).append((char*)&ts, 8).append((char*)&c, 2);
+    std::string name = std::string("user_") + words[rng() % 5] + "_" +
+                       std::to_string(rng() % 100);
+    r.push_back(char(name.size()));
+    r += name;
+    std::string payload;
+    for (size_t j = rng() % 200; j > 0; --j)
+      payload.push_back(words[rng() % 5][rng() % 4]);
+    uint16_t plen = uint16_t(payload.size());
+    r.append((char*)&plen, 2).append(payload);
+    r.append(rng() % 3, char('0' + i % 10));
+    recs.push_back(std::move(r));
+  }
+  CBS::Schema schema;
+  schema.add_uint(4).add_sorted_uint(8).add_uint(2)
+      .add_bytes(CBS::kDictZip).add_bytes(CBS::kEntropy).add_bytes(CBS::kZipOffset);
+  schema.split = [](fstring rec, fstring* f) {
+    const char* p = rec.data();
+    f[0] = fstring(p, 4); f[1] = fstring(p + 4, 8); f[2] = fstring(p + 12, 2);
+    p += 14;
+    f[3] = fstring(p, 1 + (byte_t)p[0]);
+    p = f[3].end();
+    f[4] = fstring(p, 2 + unaligned_load<uint16_t>(p));
+    f[5] = fstring(f[4].end(), rec.end());
+  };
+  {
+    CBS::MyBuilder builder(schema, fname);
+    for (auto& rec : recs) builder.addRecord(rec);
+    builder.finish();
+  }
+  std::unique_ptr<BlobStore> store(BlobStore::load_from_mmap(fname, false));
+  auto cbs = dynamic_cast<CBS*>(store.get());
+  ASSERT_TRUE(cbs != nullptr);
+  ASSERT_EQ(cbs->num_records(), num);
+  ASSERT_EQ(cbs->num_columns(), 6);
+  ASSERT_EQ(cbs->column(3).codec, CBS::kDictZip);
+  valvec<byte_t> rec, field;
+  for (size_t i = 0; i < num; ++i) {
+    cbs->get_record(i, &rec);
+    ASSERT_EQ(std::string((char*)rec.data(), rec.size()), recs[i]);
+  }
+  for (size_t k = 0; k < 1000; ++k) {
+    size_t i = rng() % num;
+    ASSERT_EQ(cbs->get_uint(i, 0), unaligned_load<uint32_t>(recs[i].data()));
+    ASSERT_EQ(cbs->get_uint(i, 1), unaligned_load<uint64_t>(recs[i].data() + 4));
+    ASSERT_EQ(cbs->get_uint(i, 2), 7);
+    field.erase_all();
+    cbs->get_field_append(i, 3, &field);
+    ASSERT_EQ(std::string((char*)field.data() + 1, field.size() - 1),
+              recs[i].substr(15, (byte_t)recs[i][14]));
+  }
+  check_pread(store.get(), fname, recs, 97);
+  check_save_mmap(cbs, fname, newFname);
+  std::vector<size_t> newToOld;
+  check_reorder(cbs, rng, recs, newFname, &newToOld);
+
+  // split by layout, and empty store
+  for (size_t n : {0, 1000}) {
+    CBS::Schema layout;
+    layout.add_uint(4).add_bytes(CBS::kDictZip).add_uint(1);
+    store.reset(); // fname is overwritten
+    {
+      CBS::MyBuilder builder(layout, fname);
+      for (size_t i = 0; i < n; ++i) {
+        std::string r = recs[i].substr(0, 4) + recs[i].substr(15, rng() % 8) + "x";
+        builder.addRecord(r);
+        recs[i] = r;
+      }
+      builder.finish();
+    }
+    store.reset(BlobStore::load_from_mmap(fname, false));
+    ASSERT_EQ(store->num_records(), n);
+    for (size_t i = 0; i < n; ++i) {
+      store->get_record(i, &rec);
+      ASSERT_EQ(std::string((char*)rec.data(), rec.size()), recs[i]);
+    }
+  }
+
+  // an invalid record is rejected before any column is written
+  {
+    CBS::Schema bad;
+    bad.add_bytes(CBS::kZipOffset).add_uint(2);
+    bad.split = [](fstring rec, fstring* f) {
+      f[0] = fstring(rec.data(), 1 + (byte_t)rec[0]);
+      f[1] = fstring(f[0].end(), rec.end());
+    };
+    store.reset();
+    std::vector<std::string> good = {std::string("\3abcXY"), std::string("\1zUV")};
+    {
+      CBS::MyBuilder builder(bad, fname);
+      builder.addRecord(good[0]);
+      bool caught = false;
+      try {
+        builder.addRecord(std::string("\2deXYZ")); // uint field is 3 bytes
+      } catch (const std::invalid_argument&) {
+        caught = true;
+      }
+      ASSERT_TRUE(caught);
+      builder.addRecord(good[1]);
+      builder.finish();
+    }
+    store.reset(BlobStore::load_from_mmap(fname, false));
+    ASSERT_EQ(store->num_records(), 2);
+    for (size_t i = 0; i < 2; ++i) {
+      store->get_record(i, &rec);
+      ASSERT_EQ(std::string((char*)rec.data(), rec.size()), good[i]);
+    }
+  }
+  store.reset();
+  ::remove(fname);
+  ::remove(newFname);
+}
+
+TEST(ZBS_TEST, BLOCK_ZIP_BLOB_STORE) {
+  using namespace terark;
+  typedef BlockZipBlobStore BZS;
+  std::mt19937_64 rng(48);
+  const char* fname = "/tmp/zbs_test_block_zip.zbs";
+  const char* newFname = "/tmp/zbs_test_block_zip.new";
+  const size_t num = 30000;
+  std::vector<std::string> recs = gen_records(rng, num);
+  recs[12345].assign(100000, 'x'); // larger than a block
+  ASSERT_TRUE(AbstractBlobStore::Builder::createBuilder("NoSuchBlobStore", fname, "") == nullptr);
+  for (const char* conf : {"", "block_records=32;block_bytes=4K;dict_size=4K",
+                           "block_records=200;compress_level=3;checksum_level=3"}) {
+    {
+      std::unique_ptr<AbstractBlobStore::Builder> builder(
+        AbstractBlobStore::Builder::createBuilder("BlockZipBlobStore", fname, conf));
+      ASSERT_TRUE(builder != nullptr);
+      for (auto& rec : recs) builder->addRecord(rec);
+      builder->finish();
+    }
+    std::unique_ptr<BlobStore> store(BlobStore::load_from_mmap(fname, false));
+    auto bzs = dynamic_cast<BZS*>(store.get());
+    ASSERT_TRUE(bzs != nullptr);
+    ASSERT_EQ(bzs->num_records(), num);
+    BZS::Options opt = BZS::Options::parse(conf);
+    ASSERT_EQ(bzs->get_options().block_records, opt.block_records);
+    ASSERT_EQ(bzs->get_options().dict_size > 0, opt.dict_size > 0);
+    valvec<byte_t> rec;
+    for (size_t i = 0; i < num; ++i) {
+      store->get_record(i, &rec);
+      ASSERT_EQ(std::string((char*)rec.data(), rec.size()), recs[i]);
+    }
+    BlobStore::CacheOffsets co;
+    for (size_t i = 0; i < num; ++i) {
+      store->get_record(i, &co);
+      ASSERT_EQ(std::string((char*)co.recData.data(), co.recData.size()), recs[i]);
+    }
+    for (size_t k = 0; k < 5000; ++k) {
+      size_t i = rng() % num;
+      if (k % 2) {
+        store->get_record(i, &rec);
+        ASSERT_EQ(std::string((char*)rec.data(), rec.size()), recs[i]);
+      } else {
+        store->get_record(i, &co);
+        ASSERT_EQ(std::string((char*)co.recData.data(), co.recData.size()), recs[i]);
+      }
+    }
+    check_pread(store.get(), fname, recs, 97);
+    // each reader thread has its own decoded blocks
+    std::vector<std::thread> readers;
+    std::atomic<size_t> errors(0);
+    for (size_t t = 0; t < 3; ++t) {
+      readers.emplace_back([&, t]() {
+        valvec<byte_t> r;
+        std::mt19937_64 rng2(t);
+        for (size_t k = 0; k < 20000; ++k) {
+          size_t i = t == 0 ? k % num : rng2() % num;
+          store->get_record(i, &r);
+          if (fstring(r) != recs[i]) errors++;
+        }
+      });
+    }
+    for (auto& t : readers) t.join();
+    ASSERT_EQ(errors.load(), 0);
+
+    check_save_mmap(bzs, fname, newFname);
+
+    // reorder keeps options and dict
+    std::vector<size_t> newToOld;
+    check_reorder(bzs, rng, recs, newFname, &newToOld);
+    std::unique_ptr<BlobStore> store2(BlobStore::load_from_mmap(newFname, false));
+    ASSERT_EQ(dynamic_cast<BZS*>(store2.get())->get_options().dict,
+              bzs->get_options().dict);
+  }
+
+  // empty store, dict training with no samples
+  {
+    BZS::Options opt;
+    opt.dict_size = 1024;
+    BZS::MyBuilder builder(fname, opt);
+    builder.finish();
+  }
+  std::unique_ptr<BlobStore> store(BlobStore::load_from_mmap(fname, false));
+  ASSERT_EQ(store->num_records(), 0);
+  store.reset();
+  ::remove(fname);
+  ::remove(newFname);
+}
+
+/**
+ * builders with threads > 0 must output the same file as the serial builder
+ */
+TEST(ZBS_TEST, PARALLEL_BUILD) {
+  using namespace terark;
+  std::mt19937_64 rng(49);
+  const char* fname = "/tmp/zbs_test_parallel_build.zbs";
+  const size_t num = 50000;
+  std::vector<std::string> recs = gen_records(rng, num);
+  auto read_file = [&]() {
+    std::string data;
+    FileStream fp(fname, "rb");
+    data.resize(fp.fsize());
+    fp.ensureRead(&data[0], data.size());
+    return data;
+  };
+  auto check_store = [&]() {
+    std::unique_ptr<BlobStore> store(BlobStore::load_from_mmap(fname, false));
+    ASSERT_EQ(store->num_records(), num);
+    valvec<byte_t> rec;
+    for (size_t i = 0; i < num; ++i) {
+      store->get_record(i, &rec);
+      ASSERT_EQ(std::string((char*)rec.data(), rec.size()), recs[i]);
+    }
+  };
+
+  for (int level : {0, 3}) {
+    for (int checksum : {2, 3}) {
+      std::string files[2];
+      for (int threads : {0, 3}) {
+        ZipOffsetBlobStore::Options opt;
+        opt.compress_level = level;
+        opt.checksum_level = checksum;
+        opt.threads = threads;
+        {
+          ZipOffsetBlobStore::MyBuilder builder(fname, 0, opt);
+          for (auto& rec : recs) builder.addRecord(rec);
+          builder.finish();
+        }
+        files[threads != 0] = read_file();
+        check_store();
+      }
+      ASSERT_EQ(files[0], files[1]);
+    }
+  }
+
+  // freq_hist_o1 is too large for stack
+  auto freq0 = std::make_unique<freq_hist_o1>();
+  auto freq1 = std::make_unique<freq_hist_o1>();
+  for (auto& rec : recs) freq0->add_record(rec);
+  freq0->finish();
+  {
+    EntropyZipBlobStore::FreqHistBuilder histBuilder(*freq1, 3);
+    for (auto& rec : recs) histBuilder.add_record(rec);
+    histBuilder.finish();
+  }
+  ASSERT_EQ(memcmp(&freq0->histogram(), &freq1->histogram(),
+                   sizeof(freq_hist_o1::histogram_t)), 0);
+  for (int checksum : {2, 3}) {
+    std::string files[2];
+    for (int threads : {0, 3}) {
+      *freq1 = *freq0; // normalised by the builder
+      {
+        EntropyZipBlobStore::MyBuilder builder(*freq1, 128, fname, 0, checksum,
+                                               0, false, threads);
+        for (auto& rec : recs) builder.addRecord(rec);
+        builder.finish();
+      }
+      files[threads != 0] = read_file();
+      check_store();
+    }
+    ASSERT_EQ(files[0], files[1]);
+    FileMemIO mem;
+    {
+      *freq1 = *freq0;
+      EntropyZipBlobStore::MyBuilder builder(*freq1, 128, mem, checksum,
+                                             0, false, 3);
+      for (auto& rec : recs) builder.addRecord(rec);
+      builder.finish();
+    }
+    valvec<byte_t> memData;
+    mem.seek(0);
+    mem.readAll(memData);
+    ASSERT_EQ(std::string((char*)memData.data(), memData.size()), files[0]);
+  }
+  ::remove(fname);
+}
+
+TEST(ZBS_TEST, MULTI_LEN_BLOB_STORE) {
+  using namespace terark;
+  typedef MultiLenBlobStore MLS;
+  std::mt19937_64 rng(50);
+  const char* fname = "/tmp/zbs_test_multi_len.zbs";
+  const char* newFname = "/tmp/zbs_test_multi_len.new";
+  const size_t num = 40000;
+  const size_t lens[] = {16, 8, 24, 40};
+  std::vector<std::string> recs;
+  std::map<size_t, size_t> lenHist;
+  size_t varBytes = 0, varCnt = 0;
+  for (size_t i = 0; i < num; ++i) {
+    size_t r = rng() % 100, len;
+    if (r < 40) len = lens[0];
+    else if (r < 65) len = lens[1];
+    else if (r < 80) len = lens[2];
+    else if (r < 92) len = lens[3];
+    else len = rng() % 300; // var tail, may hit fixed lens
+    std::string rec(len, '\0');
+    for (auto& c : rec) c = char(rng());
+    lenHist[len]++;
+    recs.push_back(std::move(rec));
+  }
+  valvec<size_t> fixedLens = MLS::choose_fixed_lens(lenHist);
+  ASSERT_GE(fixedLens.size(), 4);
+  for (size_t k = 0; k < 4; ++k) ASSERT_EQ(fixedLens[k], lens[k]);
+  for (auto& kv : lenHist) {
+    if (std::find(fixedLens.begin(), fixedLens.end(), kv.first) == fixedLens.end())
+      varBytes += kv.first * kv.second, varCnt += kv.second;
+  }
+  ASSERT_LT(varCnt, num / 10);
+  // zero copy: recData is set to store memory
+  auto get = [](const BlobStore* store, size_t i) {
+    valvec<byte_t> ref;
+    store->get_record_append(i, &ref);
+    std::string rec((char*)ref.data(), ref.size());
+    ref.risk_release_ownership();
+    return rec;
+  };
+  auto check = [&](const std::vector<std::string>& expected) {
+    std::unique_ptr<BlobStore> store(BlobStore::load_from_mmap(fname, false));
+    ASSERT_EQ(store->num_records(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      ASSERT_EQ(get(store.get(), i), expected[i]);
+    }
+    check_pread(store.get(), fname, expected, 37);
+  };
+  auto build = [&](const valvec<size_t>& fixed, const std::vector<std::string>& rs,
+                   int checksumLevel, int checksumType) {
+    size_t bytes = 0, cnt = 0;
+    for (auto& r : rs) {
+      if (std::find(fixed.begin(), fixed.end(), r.size()) == fixed.end())
+        bytes += r.size(), cnt++;
+    }
+    MLS::MyBuilder builder(fixed, bytes, cnt, fname, 0, checksumLevel, checksumType);
+    for (auto& r : rs) builder.addRecord(r);
+    builder.finish();
+  };
+  for (int checksumLevel : {2, 3}) {
+    for (int checksumType : {0, 1}) {
+      build(fixedLens, recs, checksumLevel, checksumType);
+      check(recs);
+    }
+  }
+  std::unique_ptr<BlobStore> store(BlobStore::load_from_mmap(fname, false));
+  auto mls = dynamic_cast<MLS*>(store.get());
+  ASSERT_TRUE(mls != nullptr);
+  ASSERT_EQ(mls->num_classes(), fixedLens.size());
+  size_t fixedNum = 0;
+  for (size_t k = 0; k < mls->num_classes(); ++k) {
+    ASSERT_EQ(mls->class_fixed_len(k), fixedLens[k]);
+    fixedNum += mls->class_num(k);
+  }
+  ASSERT_EQ(fixedNum + mls->var_num(), num);
+  {
+    // compare with MixedLenBlobStore, which has just one fixed len
+    size_t mixedVarBytes = 0, mixedVarCnt = 0;
+    for (auto& r : recs) {
+      if (r.size() != lens[0]) mixedVarBytes += r.size(), mixedVarCnt++;
+    }
+    {
+      MixedLenBlobStore::MyBuilder builder(lens[0], mixedVarBytes, mixedVarCnt, newFname);
+      for (auto& r : recs) builder.addRecord(r);
+      builder.finish();
+    }
+    std::unique_ptr<BlobStore> mixed(BlobStore::load_from_mmap(newFname, false));
+    ASSERT_LT(store->mem_size(), mixed->mem_size());
+  }
+
+  check_save_mmap(mls, fname, newFname);
+  std::vector<size_t> newToOld;
+  check_reorder(mls, rng, recs, newFname, &newToOld);
+  store.reset();
+  std::vector<std::string> reordered;
+  for (size_t oldId : newToOld) reordered.push_back(recs[oldId]);
+  ::rename(newFname, fname);
+  check(reordered);
+
+  // all fixed, no bitmap for the single class
+  std::vector<std::string> fixedRecs;
+  for (auto& r : recs) if (r.size() == lens[1]) fixedRecs.push_back(r);
+  build(valvec<size_t>{99, lens[1]}, fixedRecs, 2, 0);
+  check(fixedRecs);
+  store.reset(BlobStore::load_from_mmap(fname, false));
+  mls = dynamic_cast<MLS*>(store.get());
+  ASSERT_EQ(mls->num_classes(), 1);
+  ASSERT_EQ(mls->var_num(), 0);
+  ASSERT_EQ(store->mem_size(), fixedRecs.size() * (lens[1] + 4));
+  store.reset();
+
+  // all var, and empty store
+  build(valvec<size_t>(), recs, 3, 0);
+  check(recs);
+  build(fixedLens, std::vector<std::string>(), 3, 0);
+  check(std::vector<std::string>());
+  ::remove(fname);
+  ::remove(newFname);
+}
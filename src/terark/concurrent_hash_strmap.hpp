@@ -0,0 +1,383 @@
+#pragma once
+
+#include <terark/fstring.hpp>
+#include <terark/io/var_int.hpp>
+#include <terark/util/throw.hpp>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+
+namespace terark {
+
+/// Sharded and insert only string map, readers take no locks.
+///
+/// Designed for concurrent dictionary encoding of string columns:
+///   - find() never locks, never retries, because memory reachable by a
+///     reader is never moved or freed while the map is alive.
+///   - insert takes just the mutex of the shard selected by hash.
+///   - key & value are stored compactly in a per-shard append only string
+///     pool, a record is {Value, var_uint32 keylen, key bytes}, record is
+///     never moved, so fstring key and `const Value*` are stable.
+///   - the slot table of a shard is linear probing, a slot is an atomic
+///     uint64 {16 bits hash tag, 48 bits record pos + 1}, 0 is empty.
+///     On growing, the new table is fully built then published by one
+///     store, the old table is retired instead of freed because readers
+///     may be scanning it.
+///   - retired tables are reclaimed by epochs: a reader increments a
+///     counter of its thread slot for the current epoch parity before it
+///     loads the table, and decrements it when done. A retired table is
+///     freed once every slot counter of both parities has been seen 0
+///     after it was retired, so no reader can still hold it. Each grow
+///     flips the epoch, which lets the old parity drain, and then frees
+///     what it can without waiting. The sum of retired tables is less than
+///     the live table.
+/// Value is immutable after inserted, it is read concurrently.
+template<class Value = uint32_t, class HashFunc = fstring_func::hash_unalign>
+class concurrent_hash_strmap : HashFunc {
+	static_assert(std::is_trivially_copyable<Value>::value,
+				  "Value must be trivially copyable");
+	static const size_t MaxChunks = 256;
+	static const size_t FirstChunkSize = 64 * 1024;
+	static const size_t MaxChunkSize = 256 * 1024 * 1024;
+	static const uint64_t PosMask = (uint64_t(1) << 48) - 1;
+
+	struct Table {
+		size_t mask;
+		size_t maxload;
+		Table* retired_next;
+		size_t retired_gen;
+		std::atomic<uint64_t> slots[1]; // flexible
+	};
+	static const size_t EpochSlots = 64;
+	struct alignas(64) EpochSlot {
+		std::atomic<size_t> readers[2];
+	};
+	static size_t epoch_slot_id() {
+		static std::atomic<size_t> s_next(0);
+		static thread_local size_t t_slot = s_next++ % EpochSlots;
+		return t_slot;
+	}
+	class ReadGuard {
+		std::atomic<size_t>* m_cnt;
+	public:
+		explicit ReadGuard(const concurrent_hash_strmap* map) {
+			size_t e = map->m_epoch.load(std::memory_order_acquire);
+			m_cnt = &map->m_epoch_slots[epoch_slot_id()].readers[e & 1];
+			m_cnt->fetch_add(1, std::memory_order_seq_cst);
+		}
+		~ReadGuard() { m_cnt->fetch_sub(1, std::memory_order_release); }
+	};
+	struct alignas(64) Shard {
+		std::atomic<Table*>  tab;
+		std::atomic<byte_t*> chunks[MaxChunks];
+		std::atomic<size_t>  count;
+		// following fields are protected by mtx
+		std::mutex mtx;
+		size_t  chunk_num;
+		size_t  chunk_pos;  // used size of chunks[chunk_num-1]
+		size_t  chunk_cap;  // capacity of chunks[chunk_num-1]
+		size_t  pool_size;  // sum of all chunk capacity
+		size_t  chunk_used[MaxChunks];
+	};
+	Shard* m_shards;
+	size_t m_shard_mask;
+	size_t m_shard_bits;
+	uint8_t m_load_factor; // real load factor = m_load_factor / 256
+	mutable EpochSlot m_epoch_slots[EpochSlots];
+	std::atomic<size_t> m_epoch;
+	// following fields are protected by m_retired_mtx
+	mutable std::mutex m_retired_mtx;
+	Table* m_retired;
+	size_t m_retired_gen;    // gen of last retired table
+	size_t m_zero_seen_gen[2]; // tables of gen <= it were retired before
+	                           // readers[parity] are seen all 0
+
+	static uint64_t mix_hash(uint64_t h) {
+		uint64_t m = h * 0x9E3779B97F4A7C15ull;
+		return m ^ (m >> 32);
+	}
+	size_t start_pos(uint64_t m, const Table* t) const {
+		return size_t(m >> m_shard_bits) & t->mask;
+	}
+	static uint64_t tag_of(uint64_t m) { return m & ~PosMask; }
+
+	static byte_t* rec_ptr(const Shard& s, uint64_t e) {
+		uint64_t pos = (e & PosMask) - 1;
+		byte_t* chunk = s.chunks[pos >> 32].load(std::memory_order_relaxed);
+		return chunk + (pos & 0xFFFFFFFF);
+	}
+	static fstring rec_key(const byte_t* rec) {
+		const byte_t* p = rec + sizeof(Value);
+		size_t len = load_var_uint32(p, &p);
+		return fstring((const char*)p, len);
+	}
+
+	Table* new_table(size_t cap) const {
+		size_t slots = 16;
+		while (slots * m_load_factor / 256 < cap)
+			slots *= 2;
+		size_t bytes = sizeof(Table) + sizeof(std::atomic<uint64_t>) * (slots - 1);
+		Table* t = (Table*)calloc(1, bytes); // all slots are empty
+		TERARK_VERIFY_F(nullptr != t, "calloc(%zd) = NULL", bytes);
+		t->mask = slots - 1;
+		t->maxload = slots * m_load_factor / 256;
+		t->retired_next = NULL;
+		t->retired_gen = 0;
+		return t;
+	}
+
+	// called with s.mtx held
+	Table* grow(Shard& s, Table* old) {
+		Table* t = new_table(2 * old->maxload + 1);
+		for (size_t i = 0; i <= old->mask; ++i) {
+			uint64_t e = old->slots[i].load(std::memory_order_relaxed);
+			if (e) {
+				uint64_t m = mix_hash(HashFunc::operator()(rec_key(rec_ptr(s, e))));
+				size_t j = start_pos(m, t);
+				while (t->slots[j].load(std::memory_order_relaxed))
+					j = (j + 1) & t->mask;
+				t->slots[j].store(e, std::memory_order_relaxed);
+			}
+		}
+		// seq_cst: pairs with seq_cst counter increment of ReadGuard
+		s.tab.store(t, std::memory_order_seq_cst); // publish
+		std::lock_guard<std::mutex> lock(m_retired_mtx);
+		old->retired_gen = ++m_retired_gen;
+		old->retired_next = m_retired;
+		m_retired = old;
+		m_epoch.fetch_add(1, std::memory_order_seq_cst);
+		reclaim_quiesced();
+		return t;
+	}
+
+	// called with m_retired_mtx held, free tables which no reader can hold
+	void reclaim_quiesced() {
+		for (size_t p = 0; p < 2; ++p) {
+			bool zero = true;
+			for (size_t i = 0; i < EpochSlots && zero; ++i)
+				zero = 0 == m_epoch_slots[i].readers[p].load(std::memory_order_seq_cst);
+			if (zero)
+				m_zero_seen_gen[p] = m_retired_gen;
+		}
+		size_t safe_gen = std::min(m_zero_seen_gen[0], m_zero_seen_gen[1]);
+		for (Table** pp = &m_retired; *pp; ) {
+			Table* t = *pp;
+			if (t->retired_gen <= safe_gen) {
+				*pp = t->retired_next;
+				free(t);
+			} else {
+				pp = &t->retired_next;
+			}
+		}
+	}
+
+	// called with s.mtx held, return record pos + 1
+	uint64_t append(Shard& s, fstring key, const Value& val) {
+		byte_t lenbuf[8];
+		size_t lenlen = save_var_uint32(lenbuf, uint32_t(key.size())) - lenbuf;
+		size_t align = alignof(Value);
+		size_t pos = (s.chunk_pos + align - 1) & ~(align - 1);
+		size_t len = sizeof(Value) + lenlen + key.size();
+		if (0 == s.chunk_num || pos + len > s.chunk_cap) {
+			TERARK_VERIFY_LT(s.chunk_num, MaxChunks);
+			size_t cap = std::min(FirstChunkSize << std::min<size_t>(s.chunk_num, 16), MaxChunkSize);
+			cap = std::max(cap, len);
+			byte_t* chunk = (byte_t*)malloc(cap);
+			TERARK_VERIFY_F(nullptr != chunk, "malloc(%zd) = NULL", cap);
+			if (s.chunk_num)
+				s.chunk_used[s.chunk_num - 1] = s.chunk_pos;
+			s.chunks[s.chunk_num].store(chunk, std::memory_order_relaxed);
+			s.chunk_num++;
+			s.chunk_cap = cap;
+			s.pool_size += cap;
+			pos = 0;
+		}
+		byte_t* rec = s.chunks[s.chunk_num - 1].load(std::memory_order_relaxed) + pos;
+		memcpy(rec, &val, sizeof(Value));
+		memcpy(rec + sizeof(Value), lenbuf, lenlen);
+		memcpy(rec + sizeof(Value) + lenlen, key.data(), key.size());
+		s.chunk_pos = pos + len;
+		s.chunk_used[s.chunk_num - 1] = s.chunk_pos;
+		return (uint64_t(s.chunk_num - 1) << 32 | pos) + 1;
+	}
+
+	Shard& shard_of(uint64_t m) const { return m_shards[m & m_shard_mask]; }
+
+	/// @returns {slot, found entry or 0}
+	std::pair<size_t, uint64_t>
+	probe(const Shard& s, const Table* t, fstring key, uint64_t m) const {
+		const uint64_t tag = tag_of(m);
+		size_t i = start_pos(m, t);
+		for (;;) {
+			uint64_t e = t->slots[i].load(std::memory_order_acquire);
+			if (0 == e)
+				return {i, 0};
+			if (tag_of(e) == tag && rec_key(rec_ptr(s, e)) == key)
+				return {i, e};
+			i = (i + 1) & t->mask;
+		}
+	}
+
+	template<class ConsValue>
+	std::pair<const Value*, bool>
+	insert_impl(fstring key, ConsValue cons) {
+		TERARK_VERIFY_LT(key.size(), UINT32_MAX);
+		const uint64_t m = mix_hash(HashFunc::operator()(key));
+		Shard& s = shard_of(m);
+		{ // lock free check, most keys of dict encoding are existed
+			ReadGuard guard(this);
+			const Table* t = s.tab.load(std::memory_order_seq_cst);
+			uint64_t e = probe(s, t, key, m).second;
+			if (e)
+				return {(const Value*)rec_ptr(s, e), false};
+		}
+		std::lock_guard<std::mutex> lock(s.mtx);
+		Table* t = s.tab.load(std::memory_order_relaxed);
+		auto ie = probe(s, t, key, m);
+		if (ie.second)
+			return {(const Value*)rec_ptr(s, ie.second), false};
+		uint64_t e = append(s, key, cons()) | tag_of(m);
+		size_t cnt = s.count.load(std::memory_order_relaxed);
+		if (terark_unlikely(cnt >= t->maxload)) {
+			t = grow(s, t);
+			ie = probe(s, t, key, m);
+		}
+		t->slots[ie.first].store(e, std::memory_order_release);
+		s.count.store(cnt + 1, std::memory_order_relaxed);
+		return {(const Value*)rec_ptr(s, e), true};
+	}
+
+public:
+	explicit concurrent_hash_strmap(size_t shard_num = 64,
+									size_t init_cap = 0,
+									double load_factor = 0.5,
+									HashFunc hf = HashFunc())
+	  : HashFunc(hf) {
+		TERARK_VERIFY_GT(load_factor, 0.1);
+		TERARK_VERIFY_LT(load_factor, 0.9);
+		m_shard_bits = 0;
+		while ((size_t(1) << m_shard_bits) < shard_num)
+			m_shard_bits++;
+		shard_num = size_t(1) << m_shard_bits;
+		m_shard_mask = shard_num - 1;
+		m_load_factor = uint8_t(256 * load_factor);
+		m_shards = new Shard[shard_num];
+		for (auto& es : m_epoch_slots) {
+			es.readers[0].store(0, std::memory_order_relaxed);
+			es.readers[1].store(0, std::memory_order_relaxed);
+		}
+		m_epoch.store(0, std::memory_order_relaxed);
+		m_retired = NULL;
+		m_retired_gen = 0;
+		m_zero_seen_gen[0] = m_zero_seen_gen[1] = 0;
+		for (size_t i = 0; i < shard_num; ++i) {
+			Shard& s = m_shards[i];
+			s.tab.store(new_table(init_cap / shard_num), std::memory_order_relaxed);
+			s.count.store(0, std::memory_order_relaxed);
+			s.chunk_num = 0;
+			s.chunk_pos = 0;
+			s.chunk_cap = 0;
+			s.pool_size = 0;
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+	~concurrent_hash_strmap() {
+		while (Table* t = m_retired) {
+			m_retired = t->retired_next;
+			free(t);
+		}
+		for (size_t i = 0; i <= m_shard_mask; ++i) {
+			Shard& s = m_shards[i];
+			for (size_t j = 0; j < s.chunk_num; ++j)
+				free(s.chunks[j].load(std::memory_order_relaxed));
+			free(s.tab.load(std::memory_order_relaxed));
+		}
+		delete[] m_shards;
+	}
+	concurrent_hash_strmap(const concurrent_hash_strmap&) = delete;
+	concurrent_hash_strmap& operator=(const concurrent_hash_strmap&) = delete;
+
+	/// lock free and thread safe
+	/// @returns pointer to value, which is stable until map is destroyed
+	const Value* find(fstring key) const {
+		const uint64_t m = mix_hash(HashFunc::operator()(key));
+		const Shard& s = shard_of(m);
+		ReadGuard guard(this);
+		const Table* t = s.tab.load(std::memory_order_seq_cst);
+		uint64_t e = probe(s, t, key, m).second;
+		return e ? (const Value*)rec_ptr(s, e) : NULL;
+	}
+	bool exists(fstring key) const { return find(key) != NULL; }
+
+	/// thread safe, if key existed, val is ignored
+	/// @returns {pointer to value in map, inserted or not}
+	std::pair<const Value*, bool> insert(fstring key, const Value& val) {
+		return insert_impl(key, [&]() -> const Value& { return val; });
+	}
+
+	/// thread safe, cons() is called with the shard locked and only when
+	/// key is not existed, this is the way to allocate dict ids
+	template<class ConsValue>
+	std::pair<const Value*, bool> lazy_insert(fstring key, ConsValue cons) {
+		return insert_impl(key, [&]() -> Value { return cons(); });
+	}
+
+	/// approximate when there are concurrent writers
+	size_t size() const {
+		size_t sum = 0;
+		for (size_t i = 0; i <= m_shard_mask; ++i)
+			sum += m_shards[i].count.load(std::memory_order_relaxed);
+		return sum;
+	}
+	size_t shard_num() const { return m_shard_mask + 1; }
+
+	/// thread safe, each shard is locked when it is being visited
+	template<class OP> // op(fstring key, const Value& val)
+	void for_each(OP op) const {
+		for (size_t i = 0; i <= m_shard_mask; ++i) {
+			Shard& s = m_shards[i];
+			std::lock_guard<std::mutex> lock(s.mtx);
+			for (size_t j = 0; j < s.chunk_num; ++j) {
+				const byte_t* chunk = s.chunks[j].load(std::memory_order_relaxed);
+				const byte_t* end = chunk + s.chunk_used[j];
+				const byte_t* rec = chunk;
+				while (rec < end) {
+					fstring key = rec_key(rec);
+					op(key, *(const Value*)rec);
+					size_t pos = (const byte_t*)key.end() - chunk;
+					pos = (pos + alignof(Value) - 1) & ~(alignof(Value) - 1);
+					rec = chunk + pos;
+				}
+			}
+		}
+	}
+
+	/// thread safe and non-blocking, free retired slot tables which no
+	/// reader can hold, grow calls it automatically
+	void reclaim_retired() {
+		std::lock_guard<std::mutex> lock(m_retired_mtx);
+		m_epoch.fetch_add(1, std::memory_order_seq_cst);
+		reclaim_quiesced();
+	}
+
+	struct MemStat {
+		size_t pool_size;    // sum of string pool chunk capacity
+		size_t table_size;   // sum of live slot tables
+		size_t retired_size; // sum of retired slot tables
+	};
+	MemStat mem_stat() const {
+		MemStat ms = {0, 0, 0};
+		for (size_t i = 0; i <= m_shard_mask; ++i) {
+			Shard& s = m_shards[i];
+			std::lock_guard<std::mutex> lock(s.mtx);
+			ms.pool_size += s.pool_size;
+			ms.table_size += 8 * (s.tab.load(std::memory_order_relaxed)->mask + 1);
+		}
+		std::lock_guard<std::mutex> lock(m_retired_mtx);
+		for (Table* t = m_retired; t; t = t->retired_next)
+			ms.retired_size += 8 * (t->mask + 1);
+		return ms;
+	}
+};
+
+} // namespace terark
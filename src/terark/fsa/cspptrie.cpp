@@ -926,6 +926,11 @@ try
                 bool valval = parseBooleanRelaxed(valstr, false);
                 m_mempool_lock_free.m_vm_explicit_commit = valval;
             }
+            if (const char* valstr = fpath.strstr("numa_local=")) {
+                valstr += strlen("numa_local=");
+                bool valval = parseBooleanRelaxed(valstr, false);
+                m_mempool_lock_free.m_numa_local = valval;
+            }
         }
         if (const char* valstr = fpath.strstr("file_path=")) {
             valstr += strlen("file_path="); // file_path=... must be last
@@ -1184,6 +1189,7 @@ void PatriciaMem<Align>::mem_get_stat(MemStat* ms) const {
           });
         ms->huge_cnt  = m_mempool_lock_free.get_huge_stat(&ms->huge_size);
         ms->frag_size = m_mempool_lock_free.frag_size();
+        m_mempool_lock_free.get_numa_stat(&ms->numa_node_len);
         break;
     case   OneWriteMultiRead:
         m_mempool_fixed_cap.get_fastbin(&ms->fastbin);
@@ -1206,6 +1212,35 @@ void PatriciaMem<Align>::mem_get_stat(MemStat* ms) const {
     }
 }
 
+template<size_t Align>
+void PatriciaMem<Align>::get_token_pin_stat(valvec<TokenPinStat>* stat) const {
+    stat->erase_all();
+    if (m_writing_concurrent_level < SingleThreadShared) {
+        return; // there is no token queue
+    }
+    MemStat ms;
+    mem_get_stat(&ms);
+    auto self = const_cast<PatriciaMem*>(this);
+    self->m_head_mutex.lock();
+    const ullong newest = m_dummy.m_verseq;
+    for (auto t = m_dummy.m_next; t != &m_dummy; t = t->m_next) {
+        TokenPinStat& s = stat->emplace_back();
+        s.token   = t;
+        s.verseq  = t->m_verseq;
+        s.age_lag = newest - t->m_verseq;
+        s.is_head = t->m_flags.is_head;
+        s.is_iter = dynamic_cast<const Iterator*>(t) != nullptr;
+    }
+    self->m_head_mutex.unlock();
+    const ullong head_lag = stat->empty() ? 0 : (*stat)[0].age_lag;
+    for (auto& s : *stat) {
+        if (head_lag)
+            s.pinned_size = size_t(double(ms.lazy_free_sum) * s.age_lag / head_lag);
+        else
+            s.pinned_size = 0;
+    }
+}
+
 template<size_t Align>
 size_t PatriciaMem<Align>::slow_get_free_size() const {
     if (MultiWriteMultiRead == m_mempool_concurrent_level) {
@@ -3414,6 +3449,30 @@ void Patricia::TokenBase::rotate(Patricia* trie1, TokenState target) {
     trie->m_head_mutex.unlock();
 }
 
+// move this token to the queue tail with a new verseq, used by iterator
+// refresh, a non-head token is also moved, else it would pin its old
+// version when it becomes head later
+void Patricia::TokenBase::rotate_to_back(Patricia* trie1, TokenState target) {
+    auto trie = static_cast<MainPatricia*>(trie1);
+    trie->m_head_mutex.lock();
+    if (m_next == &trie->m_dummy) {
+        trie->m_head_mutex.unlock();
+        this->m_flags.state = target; // already the newest
+        return;
+    }
+    TERARK_ASSERT_LT(m_verseq, m_next->m_verseq);
+    this->remove_self();
+    this->add_to_back(trie);
+    if (m_flags.is_head) {
+        trie->m_dummy.m_min_verseq = this->m_verseq;
+        trie->m_dummy.m_next->m_flags.is_head = true; // new head
+    }
+    this->m_min_verseq = trie->m_dummy.m_min_verseq;
+    this->m_verseq = trie->m_dummy.m_verseq++;
+    this->m_flags = {target, false};
+    trie->m_head_mutex.unlock();
+}
+
 void Patricia::TokenBase::mt_acquire(Patricia* trie1) {
     TERARK_VERIFY_EQ(m_thread_id, ThisThreadID());
     auto trie = static_cast<MainPatricia*>(trie1);
@@ -3902,6 +3961,8 @@ public:
         }
     }
     bool seek_lower_bound_impl(fstring key);
+    int  refresh_token();
+    valvec<byte_t> m_refresh_key;
 };
 
 //static const size_t IterFlag_lower_bound_fast  = 1;
@@ -3992,6 +4053,24 @@ void MainPatricia::IterImpl::reset(const BaseDFA* dfa, size_t root) {
     reset1();
 }
 
+// re-acquire the token at current key boundary to let m_min_verseq advance
+// @returns 1: still on the same key
+//          0: the key was deleted and iter has moved to next key
+//         -1: there is no key >= current key, iter is reset
+int MainPatricia::IterImpl::refresh_token() {
+    m_refresh_countdown = m_refresh_interval;
+    auto trie = static_cast<MainPatricia*>(m_trie);
+    if (trie->m_writing_concurrent_level < SingleThreadShared) {
+        return 1; // there is no lazy free list
+    }
+    rotate_to_back(trie, AcquireDone);
+    m_refresh_key.assign(m_word.data(), m_word.size());
+    if (!seek_lower_bound_impl(m_refresh_key)) {
+        return -1;
+    }
+    return fstring(m_word) == fstring(m_refresh_key) ? 1 : 0;
+}
+
 bool MainPatricia::IterImpl::seek_begin() {
     assert(NULL != m_trie);
     return this->seek_lower_bound("");
@@ -4661,6 +4740,11 @@ bool MainPatricia::IterImpl::incr() {
     if (terark_unlikely(m_iter.empty())) {
         return false;
     }
+    if (terark_unlikely(m_refresh_interval) && 0 == --m_refresh_countdown) {
+        int ret = refresh_token();
+        if (ret <= 0) // -1: no more key, 0: moved to next key
+            return 0 == ret;
+    }
     auto trie = static_cast<MainPatricia*>(m_trie);
     auto a = reinterpret_cast<const PatriciaNode*>(trie->m_mempool.data());
     TERARK_ASSERT_EQ(calc_word_len(), m_word.size());
@@ -4772,6 +4856,12 @@ bool MainPatricia::IterImpl::decr() {
     if (m_iter.empty()) {
         return false;
     }
+    if (terark_unlikely(m_refresh_interval) && 0 == --m_refresh_countdown) {
+        // if current key was deleted, iter moved to next key, whose prev
+        // is still the prev of the deleted key
+        if (refresh_token() < 0)
+            return seek_end();
+    }
     TERARK_ASSERT_EQ(calc_word_len(), m_word.size());
     auto trie = static_cast<MainPatricia*>(m_trie);
     auto a = reinterpret_cast<const PatriciaNode*>(trie->m_mempool.data());
@@ -5065,6 +5155,20 @@ Patricia::create(size_t valsize, size_t maxMem, ConcurrentLevel concurrentLevel)
     return new MainPatricia(valsize, maxMem, concurrentLevel);
 }
 
+Patricia* Patricia::deep_copy(size_t root) const {
+    std::unique_ptr<MainPatricia> snap(
+        new MainPatricia(m_valsize, mem_size(), SingleThreadStrict));
+    SingleWriterToken wtoken;
+    wtoken.acquire(snap.get());
+    IteratorPtr iter(new_iter(root));
+    for (bool ok = iter->seek_begin(); ok; ok = iter->incr()) {
+        snap->insert(iter->word(), const_cast<void*>(iter->value()), &wtoken);
+    }
+    iter.reset(); // release source token asap
+    snap->set_readonly();
+    return snap.release();
+}
+
 Patricia::MemStat Patricia::mem_get_stat() const {
     MemStat ms;
     mem_get_stat(&ms);
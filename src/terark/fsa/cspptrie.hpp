@@ -75,6 +75,7 @@ public:
 
         void maybe_rotate(Patricia*, TokenState);
         void rotate(Patricia*, TokenState);
+        void rotate_to_back(Patricia*, TokenState);
         void remove_self();
         void add_to_back(Patricia*);
         void mt_acquire(Patricia*);
@@ -148,11 +149,25 @@ public:
     };
     class TERARK_DLL_EXPORT Iterator : public ADFA_LexIterator, public ReaderToken {
     protected:
+        size_t m_refresh_interval = 0;
+        size_t m_refresh_countdown = 0;
         Iterator(Patricia*);
         ~Iterator();
     public:
         void dispose() final;
         virtual void token_detach_iter() = 0;
+
+        /// re-acquire the token after every num_keys incr/decr and re-seek
+        /// by current key, so a long scan does not block lazy free of the
+        /// writers. keys inserted/deleted after iter start may be visible.
+        /// a non-head token is also moved to the queue tail, so it will not
+        /// pin old versions when it becomes head later.
+        /// 0 disables refresh, which is the default.
+        void set_token_refresh(size_t num_keys) {
+            m_refresh_interval = num_keys;
+            m_refresh_countdown = num_keys;
+        }
+        size_t get_token_refresh() const { return m_refresh_interval; }
     };
     using IteratorPtr = std::unique_ptr<Iterator, DisposeAsDelete>;
 
@@ -165,7 +180,26 @@ public:
         size_t huge_cnt;
         size_t lazy_free_sum;
         size_t lazy_free_cnt;
+        valvec<size_t> numa_node_len; // only for MultiWriteMultiRead
     };
+    struct TokenPinStat {
+        const TokenBase* token;
+        ullong verseq;     // smaller is older
+        ullong age_lag;    // versions since the token was acquired
+        size_t pinned_size; // lazy free bytes which can not be freed
+        bool   is_head;
+        bool   is_iter;
+    };
+    /// tokens in queue order, the head token pins all lazy free memory,
+    /// pinned_size of other tokens is estimated by age_lag ratio to head
+    virtual void get_token_pin_stat(valvec<TokenPinStat>*) const = 0;
+
+    /// deep copy all keys and values under root to a new readonly trie, it
+    /// is O(n) in time and memory, and the source token is held during the
+    /// whole copy. after the copy, a long scan on the copy does not block
+    /// lazy free of the source. there is no cheap copy-on-write snapshot:
+    /// writers modify nodes in place and the mempool has no page sharing
+    Patricia* deep_copy(size_t root = initial_state) const;
     static Patricia* create(size_t valsize,
                             size_t maxMem = 512<<10,
                             ConcurrentLevel = OneWriteMultiRead);
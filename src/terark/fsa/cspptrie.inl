@@ -283,6 +283,7 @@ public:
     size_t mem_frag_size() const final { return m_mempool.frag_size(); }
     using Patricia::mem_get_stat;
     void mem_get_stat(MemStat*) const final;
+    void get_token_pin_stat(valvec<TokenPinStat>*) const final;
 
     const Stat& trie_stat() const final { return m_stat; }
     const Stat& sync_stat() final;
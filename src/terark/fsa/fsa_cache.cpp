@@ -1,9 +1,38 @@
 #include "fsa_cache_detail.hpp"
+#include <thread>
 
 namespace terark {
 
+NTD_CacheEpoch::Slot NTD_CacheEpoch::s_slots[NTD_CacheEpoch::NumSlots];
+std::atomic<size_t> NTD_CacheEpoch::s_epoch(0);
+
+// a reader may have loaded the epoch before a flip, thus it is counted at
+// either parity, flip twice to wait for both parities
+void NTD_CacheEpoch::synchronize() {
+	static std::mutex mtx;
+	std::lock_guard<std::mutex> lock(mtx);
+	for (int pass = 0; pass < 2; ++pass) {
+		size_t old = s_epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+		for (size_t i = 0; i < NumSlots; ++i) {
+			while (s_slots[i].readers[old].load(std::memory_order_seq_cst))
+				std::this_thread::yield();
+		}
+	}
+}
+
 FSA_Cache::~FSA_Cache() {
 }
 
+bool FSA_Cache::start_fsa_cache_sampling(int, double) {
+	return false;
+}
+
+void FSA_Cache::stop_fsa_cache_sampling() {
+}
+
+bool FSA_Cache::rebuild_fsa_cache_by_sample(const char*) {
+	return false;
+}
+
 } // namespace terark
 
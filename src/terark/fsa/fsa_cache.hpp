@@ -11,9 +11,26 @@ public:
 	virtual bool has_fsa_cache() const = 0;
 	virtual bool build_fsa_cache(double cacheRatio, const char* walkMethod)=0;
 	virtual void print_fsa_cache_stat(FILE*) const = 0;
+
+	/// Adaptive cache: sample 1 of 2^sampleShift lookups of each thread,
+	/// record the states on the path of sampled keys by thread local
+	/// counters, cacheRatio is used by rebuild if there is no cache yet.
+	/// @return false if not supported
+	virtual bool start_fsa_cache_sampling(int sampleShift, double cacheRatio);
+	virtual void stop_fsa_cache_sampling();
+
+	/// rebuild cache to cover the hottest sampled states within the same
+	/// memory budget, then swap in the new cache atomically, counters are
+	/// reset. It is safe to call it in a background thread while other
+	/// threads are searching, the replaced cache is freed after searches
+	/// which may be using it are finished.
+	/// @return false if not supported or no samples
+	virtual bool rebuild_fsa_cache_by_sample(const char* walkMethod = NULL);
 };
 
 class NTD_CacheTrie; // forward declaration
+class NTD_CacheSampler;
+class NTD_CacheReadGuard;
 
 } // namespace terark
 
@@ -2,8 +2,14 @@
 
 #include "fsa_cache.hpp"
 #include "double_array_trie.hpp"
+#include <terark/gold_hash_map.hpp>
+#include <terark/thread/instance_tls.hpp>
 #include <terark/util/hugepage.hpp>
 #include <terark/util/profiling.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace terark {
 
@@ -65,6 +71,41 @@ public:
 	}
 	bool is_term(size_t s) const { return m_dfa->is_term(s); }
 	size_t total_states() const { return m_size; }
+	size_t map_state(size_t s) const { return s; }
+};
+
+// sub dfa of selected states, which must be closed under parent, states are
+// renumbered to [0, sel.size()) by the order in sel, sel[0] must be root
+template<class DFA>
+class SelectedStatesSubDFA {
+public:
+	typedef uint32_t state_id_t;
+	const static state_id_t nil_state = UINT32_MAX;
+	const static state_id_t max_state = UINT32_MAX-1;
+	const DFA* m_dfa;
+	const valvec<uint32_t>& m_sel; // sorted
+	SelectedStatesSubDFA(const DFA* trie, const valvec<uint32_t>& sel)
+	  : m_dfa(trie), m_sel(sel) {
+		assert(sel.size() >= 1);
+		assert(initial_state == sel[0]);
+	}
+	enum { sigma = 512 };
+	size_t get_all_move(size_t parent, CharTarget<size_t>* moves) const {
+		size_t n = m_dfa->get_all_move(m_sel[parent], moves);
+		size_t i = 0;
+		for (size_t j = 0; j < n; ++j) {
+			size_t t = lower_bound_a(m_sel, moves[j].target);
+			if (t < m_sel.size() && m_sel[t] == moves[j].target) {
+				moves[i].ch = moves[j].ch;
+				moves[i].target = t;
+				i++;
+			}
+		}
+		return i;
+	}
+	bool is_term(size_t s) const { return m_dfa->is_term(m_sel[s]); }
+	size_t total_states() const { return m_sel.size(); }
+	size_t map_state(size_t s) const { return m_sel[s]; }
 };
 
 class NTD_CacheTrie : public DoubleArrayTrie<NTD_CacheState> {
@@ -75,9 +116,13 @@ public:
 	size_t m_dfa_states;
 	double m_build_time;
 	template<class DFA_as_Trie>
-	NTD_CacheTrie(const DFA_as_Trie* trie, size_t size, const char* walkMethod) {
+	NTD_CacheTrie(const DFA_as_Trie* trie, size_t size, const char* walkMethod)
+	  : NTD_CacheTrie(trie, SmallStateIdSubDFA<DFA_as_Trie>(trie, size), walkMethod)
+	{}
+	template<class DFA_as_Trie, class SubDFA>
+	NTD_CacheTrie(const DFA_as_Trie* trie, const SubDFA& subdfa, const char* walkMethod) {
 		profiling pf;
-		const SmallStateIdSubDFA<DFA_as_Trie> subdfa(trie, size);
+		const size_t size = subdfa.total_states();
 		long long t1 = pf.now();
 		valvec<uint32_t> t2d;
 		valvec<uint32_t> d2t;
@@ -102,9 +147,11 @@ public:
 		valvec<byte_t> zp_data;
 		for(size_t i = 0; i < d2t.size(); ++i) {
 			size_t j = d2t[i];
+			if (j < size)
+				j = subdfa.map_state(j);
 			this->states[i].m_zp_offset = uint32_t(zp_data.size());
 			this->states[i].m_map_state = uint32_t(j);
-			if (j < size && trie->is_pzip(j)) {
+			if (d2t[i] < size && trie->is_pzip(j)) {
 				zp_data.append(trie->get_zpath_data(j, &mctx));
 			}
 		}
@@ -155,5 +202,150 @@ public:
 	const byte_t* get_zpath_data_base() const { return m_zp_data; }
 };
 
+/// Epoch based reclamation of NTD_CacheTrie replaced by rebuild, shared by
+/// all NestTrieDAWG in adaptive mode(NestTrieDAWG::m_sampler is set): a
+/// reader is counted in its thread's slot, at the parity of current epoch,
+/// before it loads NestTrieDAWG::m_cache. After swapping
+/// in a new cache, synchronize() flips the epoch and waits for the readers
+/// of the old parity to drain, twice, then no reader holds the old cache.
+class TERARK_DLL_EXPORT NTD_CacheEpoch {
+public:
+	static const size_t NumSlots = 64;
+	struct alignas(64) Slot {
+		std::atomic<size_t> readers[2];
+	};
+	static Slot s_slots[NumSlots];
+	static std::atomic<size_t> s_epoch;
+	static size_t slot_id() {
+		static std::atomic<size_t> s_next(0);
+		static thread_local size_t t_slot = s_next++ % NumSlots;
+		return t_slot;
+	}
+	static void synchronize();
+};
+
+/// NULL cnt means not entered
+class NTD_CacheReadGuard {
+	std::atomic<size_t>* m_cnt = NULL;
+public:
+	NTD_CacheReadGuard() = default;
+	NTD_CacheReadGuard(const NTD_CacheReadGuard&) = delete;
+	NTD_CacheReadGuard& operator=(const NTD_CacheReadGuard&) = delete;
+	void enter() {
+		assert(NULL == m_cnt);
+		size_t e = NTD_CacheEpoch::s_epoch.load(std::memory_order_relaxed);
+		m_cnt = &NTD_CacheEpoch::s_slots[NTD_CacheEpoch::slot_id()].readers[e & 1];
+		m_cnt->fetch_add(1, std::memory_order_seq_cst);
+	}
+	~NTD_CacheReadGuard() {
+		if (m_cnt)
+			m_cnt->fetch_sub(1, std::memory_order_release);
+	}
+	explicit operator bool() const { return NULL != m_cnt; }
+};
+
+/// access counters of adaptive FSA_Cache, each thread has its own shard,
+/// shard mutex is almost never contended: it is locked by the owner thread
+/// on a sampled lookup, and by collect/reset
+class NTD_CacheSampler {
+public:
+	static const size_t MaxDepth = 64; // hit depth >= MaxDepth is put here
+	struct Shard {
+		std::mutex mtx;
+		uint32_t tick = 0;
+		size_t samples = 0;
+		gold_hash_map<size_t, size_t> counts; // trie state => hits
+		size_t depth_hist[MaxDepth + 1] = {0}; // bytes matched by DA cache
+	};
+	struct ShardPtr { Shard* p = NULL; };
+
+	uint32_t m_mask; // sample if (tick & mask) == 0
+	bool m_enabled;
+	double m_cache_ratio;
+	mutable std::mutex m_shards_mtx;
+	std::mutex m_rebuild_mtx;
+	std::vector<std::unique_ptr<Shard> > m_shards;
+	// m_cache when the sampler was created, readers may have loaded it
+	// without epoch guard, thus it is not freed until NestTrieDAWG dtor
+	NTD_CacheTrie* m_unguarded_cache = NULL;
+	instance_tls<ShardPtr> m_tls;
+
+	NTD_CacheSampler(int sampleShift, double cacheRatio) {
+		m_mask = (uint32_t(1) << std::min(sampleShift, 31)) - 1;
+		m_enabled = true;
+		m_cache_ratio = cacheRatio;
+	}
+
+	/// @return NULL if this lookup is not sampled
+	Shard* sample_shard() {
+		ShardPtr& sp = m_tls.get();
+		Shard* sh = sp.p;
+		if (terark_unlikely(NULL == sh)) {
+			sh = new Shard();
+			std::lock_guard<std::mutex> lock(m_shards_mtx);
+			m_shards.emplace_back(sh);
+			sp.p = sh;
+		}
+		return (sh->tick++ & m_mask) ? NULL : sh;
+	}
+
+	/// @return (count, state) sorted by count desc, state asc
+	void collect(valvec<std::pair<size_t, size_t> >* hot,
+				 size_t* depth_hist, size_t* samples) const {
+		gold_hash_map<size_t, size_t> all;
+		std::fill_n(depth_hist, MaxDepth + 1, 0);
+		*samples = 0;
+		std::lock_guard<std::mutex> shards_lock(m_shards_mtx);
+		for (auto& sh : m_shards) {
+			std::lock_guard<std::mutex> lock(sh->mtx);
+			sh->counts.for_each([&](const std::pair<size_t, size_t>& kv) {
+				all[kv.first] += kv.second;
+			});
+			for (size_t d = 0; d <= MaxDepth; ++d)
+				depth_hist[d] += sh->depth_hist[d];
+			*samples += sh->samples;
+		}
+		hot->erase_all();
+		hot->reserve(all.size());
+		all.for_each([&](const std::pair<size_t, size_t>& kv) {
+			hot->emplace_back(kv.second, kv.first);
+		});
+		std::sort(hot->begin(), hot->end(),
+			[](const std::pair<size_t, size_t>& x,
+			   const std::pair<size_t, size_t>& y) {
+				return x.first != y.first ? x.first > y.first
+										  : x.second < y.second;
+			});
+	}
+	void reset() {
+		std::lock_guard<std::mutex> shards_lock(m_shards_mtx);
+		for (auto& sh : m_shards) {
+			std::lock_guard<std::mutex> lock(sh->mtx);
+			sh->counts.clear();
+			sh->samples = 0;
+			std::fill_n(sh->depth_hist, MaxDepth + 1, 0);
+		}
+	}
+	void print_stat(FILE* fp) const {
+		valvec<std::pair<size_t, size_t> > hot;
+		size_t hist[MaxDepth + 1], samples;
+		collect(&hot, hist, &samples);
+		fprintf(fp, "FSA_Cache sampling   : %s, 1/%u lookups, samples = %zd, sampled states = %zd\n",
+				m_enabled ? "on" : "off", m_mask + 1, samples, hot.size());
+		if (0 == samples)
+			return;
+		fprintf(fp, "FSA_Cache hit depth histogram(bytes matched in cache):\n");
+		size_t cum = 0;
+		for (size_t d = 0; d <= MaxDepth; ++d) {
+			if (0 == hist[d])
+				continue;
+			cum += hist[d];
+			fprintf(fp, "  %s%2zd : %10zd  %6.2f%%  cum %6.2f%%\n",
+					d == MaxDepth ? ">=" : "  ", d, hist[d],
+					100.0 * hist[d] / samples, 100.0 * cum / samples);
+		}
+	}
+};
+
 } // namespace terark
 
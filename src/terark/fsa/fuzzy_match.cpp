@@ -0,0 +1,169 @@
+/* vim: set tabstop=4 : */
+#include "fuzzy_match.hpp"
+#include <terark/util/throw.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace terark {
+
+// DFS over dfa, row(d) is the DP row of Levenshtein automaton after
+// consuming key[0, d), row(d)[i] is distance(key[0,d), query[0,i)),
+// capped at k+1, only the band |i - d| <= k is computed.
+class LevenshteinMatcher::Walker {
+public:
+	const BaseDFA* dfa;
+	const byte_t*  q;
+	size_t m; // query len
+	byte_t k;
+	bool   trans;
+	const OnMatch& on_match;
+	valvec<byte_t> key;
+	valvec<byte_t> rows; // (m+1) * (key.size()+1)
+	std::vector<valvec<CharTarget<size_t> > > moves; // per DFS level
+	MatchContext ctx;
+	size_t visited = 0;
+	size_t matched = 0;
+
+	Walker(const LevenshteinMatcher* lm, const BaseDFA* dfa1, const OnMatch& fn)
+	  : on_match(fn) {
+		dfa = dfa1;
+		q = (const byte_t*)lm->m_query.data();
+		m = lm->m_query.size();
+		k = byte_t(lm->m_max_dist);
+		trans = lm->m_transposition;
+		rows.resize_no_init(m + 1);
+		for (size_t i = 0; i <= m; ++i)
+			rows[i] = byte_t(std::min<size_t>(i, k + 1));
+	}
+	const byte_t* row(size_t d) const { return rows.data() + (m + 1) * d; }
+
+	// append c to key, compute its row, @return min of the row
+	byte_t push(byte_t c) {
+		const size_t d = key.size(); // row(d) is prev
+		rows.resize_no_init((m + 1) * (d + 2));
+		const byte_t* prev = row(d);
+		const byte_t* pp = d ? row(d - 1) : NULL;
+		byte_t* curr = rows.data() + (m + 1) * (d + 1);
+		const byte_t kk = k + 1;
+		const size_t lo = d + 1 > k ? d + 1 - k : 1;
+		const size_t hi = std::min(m, d + 1 + k);
+		std::fill_n(curr, m + 1, kk);
+		curr[0] = byte_t(std::min<size_t>(d + 1, kk));
+		byte_t rmin = curr[0];
+		const byte_t c0 = d ? key[d - 1] : 0;
+		for (size_t i = lo; i <= hi; ++i) {
+			byte_t v = byte_t(prev[i-1] + (q[i-1] != c));
+			v = std::min(v, byte_t(prev[i] + 1));
+			v = std::min(v, byte_t(curr[i-1] + 1));
+			if (trans && i >= 2 && d && q[i-1] == c0 && q[i-2] == c)
+				v = std::min(v, byte_t(pp[i-2] + 1));
+			v = std::min(v, kk);
+			curr[i] = v;
+			rmin = std::min(rmin, v);
+		}
+		key.push_back(c);
+		return rmin;
+	}
+
+	void visit(size_t s, size_t level) {
+		const size_t d0 = key.size();
+		visited++;
+		if (dfa->v_is_pzip(s)) {
+			fstring zp = dfa->v_get_zpath_data(s, &ctx);
+			for (size_t j = 0; j < zp.size(); ++j) {
+				if (push(zp[j]) > k) {
+					key.risk_set_size(d0);
+					return;
+				}
+			}
+		}
+		const size_t d = key.size();
+		if (dfa->v_is_term(s)) {
+			size_t dist = row(d)[m];
+			if (dist <= k) {
+				on_match(fstring(key.data(), d), s, dist);
+				matched++;
+			}
+		}
+		if (moves.size() <= level)
+			moves.resize(level + 1);
+		auto& mv = moves[level];
+		mv.resize_no_init(dfa->get_sigma());
+		size_t n = dfa->get_all_move(s, mv.data());
+		for (size_t i = 0; i < n; ++i) {
+			CharTarget<size_t> ct = moves[level][i];
+			if (push(byte_t(ct.ch)) <= k)
+				visit(ct.target, level + 1);
+			key.risk_set_size(d);
+		}
+		key.risk_set_size(d0);
+	}
+};
+
+LevenshteinMatcher::LevenshteinMatcher(fstring query, size_t max_dist,
+									   bool transposition)
+  : m_query(query.data(), query.size()) {
+	if (max_dist > MAX_DIST) {
+		THROW_STD(invalid_argument, "max_dist = %zd exceeds MAX_DIST = %zd",
+				  max_dist, MAX_DIST);
+	}
+	m_max_dist = max_dist;
+	m_transposition = transposition;
+	m_visited = 0;
+}
+
+LevenshteinMatcher::~LevenshteinMatcher() {}
+
+size_t LevenshteinMatcher::match(const BaseDFA* dfa, const OnMatch& fn,
+								 size_t root) const {
+	Walker w(this, dfa, fn);
+	w.visit(root, 0);
+	m_visited = w.visited;
+	return w.matched;
+}
+
+size_t LevenshteinMatcher::match_dawg(const BaseDFA* dfa,
+									  const OnMatchDAWG& fn,
+									  bool dict_rank) const {
+	const BaseDAWG* dawg = dfa->get_dawg();
+	if (NULL == dawg) {
+		THROW_STD(invalid_argument, "dfa is not a DAWG");
+	}
+	if (dict_rank)
+		return match(dfa, [&](fstring, size_t s, size_t dist) {
+			fn(dawg->state_to_dict_rank(s), dist);
+		});
+	else
+		return match(dfa, [&](fstring, size_t s, size_t dist) {
+			fn(dawg->v_state_to_word_id(s), dist);
+		});
+}
+
+size_t LevenshteinMatcher::distance(fstring x, fstring y, size_t max_dist,
+									bool transposition) {
+	const size_t m = y.size();
+	const size_t kk = max_dist + 1;
+	if (x.size() > y.size() + max_dist || y.size() > x.size() + max_dist)
+		return kk;
+	valvec<size_t> r0(m + 1), r1(m + 1), r2(m + 1);
+	for (size_t i = 0; i <= m; ++i)
+		r1[i] = i;
+	for (size_t d = 0; d < x.size(); ++d) {
+		const byte_t c = x[d];
+		r2[0] = d + 1;
+		for (size_t i = 1; i <= m; ++i) {
+			size_t v = r1[i-1] + (byte_t(y[i-1]) != c);
+			v = std::min(v, r1[i] + 1);
+			v = std::min(v, r2[i-1] + 1);
+			if (transposition && i >= 2 && d &&
+					byte_t(y[i-1]) == byte_t(x[d-1]) && byte_t(y[i-2]) == c)
+				v = std::min(v, r0[i-2] + 1);
+			r2[i] = v;
+		}
+		r0.swap(r1);
+		r1.swap(r2);
+	}
+	return std::min(r1[m], kk);
+}
+
+} // namespace terark
@@ -0,0 +1,59 @@
+/* vim: set tabstop=4 : */
+#pragma once
+#include "fsa.hpp"
+#include <terark/util/function.hpp>
+#include <string>
+
+namespace terark {
+
+/// Approximate search: intersect a Levenshtein automaton of query with a
+/// dfa(any BaseDFA: NestLoudsTrieDAWG, Patricia, DoubleArrayTrie...).
+///
+/// The Levenshtein automaton is simulated by a DP row per matched byte, the
+/// dfa is walked depth first by get_all_move, zpath bytes are consumed one
+/// by one, a subtree is pruned as soon as the min of the row exceeds
+/// max_dist, thus the visited nodes are limited to the neighborhood of query.
+///
+/// With transposition, distance is optimal string alignment distance(an
+/// adjacent swap costs 1).
+class TERARK_DLL_EXPORT LevenshteinMatcher {
+public:
+	/// generally max_dist is 1 or 2, visited nodes grows fast by max_dist
+	static const size_t MAX_DIST = 8;
+
+	/// word  : the matched key in dfa, valid only during the call
+	/// state : final state of word
+	/// dist  : edit distance to query
+	typedef function<void(fstring word, size_t state, size_t dist)> OnMatch;
+
+	/// dfa must have get_dawg(), nth is word id or dict rank
+	typedef function<void(size_t nth, size_t dist)> OnMatchDAWG;
+
+	/// @param max_dist must <= MAX_DIST
+	LevenshteinMatcher(fstring query, size_t max_dist, bool transposition = false);
+	~LevenshteinMatcher();
+
+	/// @return number of matches, nodes are visited in lexical order
+	size_t match(const BaseDFA*, const OnMatch&, size_t root = initial_state) const;
+
+	/// report word id(or dict rank if dict_rank is true) of matched keys
+	size_t match_dawg(const BaseDFA*, const OnMatchDAWG&, bool dict_rank = false) const;
+
+	/// number of visited dfa nodes of last match, for diagnosis
+	size_t visited_nodes() const { return m_visited; }
+
+	fstring query() const { return m_query; }
+	size_t  max_dist() const { return m_max_dist; }
+
+	/// plain DP distance, capped at max_dist + 1, for brute force and tests
+	static size_t distance(fstring x, fstring y, size_t max_dist, bool transposition);
+
+private:
+	class Walker; // defined in cpp
+	std::string m_query;
+	size_t m_max_dist;
+	bool   m_transposition;
+	mutable size_t m_visited;
+};
+
+} // namespace terark
@@ -4,6 +4,7 @@
 #include "nest_louds_trie_inline.hpp"
 #include "dfa_mmap_header.hpp"
 #include "tmplinst.hpp"
+#include <terark/util/atomic.hpp>
 
 namespace terark {
 
@@ -13,14 +14,19 @@ NestTrieDAWG<NestTrie, DawgType>::~NestTrieDAWG() {
 		IsTermRep::risk_release_ownership();
 	}
 	delete m_trie;
-	delete m_cache;
+	auto cache = m_cache.load(std::memory_order_relaxed);
+	if (m_sampler && m_sampler->m_unguarded_cache != cache)
+		delete m_sampler->m_unguarded_cache;
+	delete cache;
+	delete m_sampler;
 }
 
 template<class NestTrie, class DawgType>
 NestTrieDAWG<NestTrie, DawgType>::NestTrieDAWG() {
 	this->m_is_dag = true;
 	this->m_dyn_sigma = 256;
-	this->m_cache = NULL;
+	this->m_cache.store(NULL, std::memory_order_relaxed);
+	this->m_sampler = NULL;
 	m_trie = NULL;
 	m_zpNestLevel = 0;
 }
@@ -33,6 +39,7 @@ NestTrieDAWG(const NestTrieDAWG& y)
 , IsTermRep(y)
 , m_zpNestLevel(y.m_zpNestLevel)
 , m_cache(NULL) // don't copy
+, m_sampler(NULL)
 {
     assert(256 == y.m_dyn_sigma);
 	if (y.m_trie)
@@ -75,7 +82,9 @@ void NestTrieDAWG<NestTrie, DawgType>::swap(NestTrieDAWG& y) noexcept {
 	BaseDFA::risk_swap(y);
 	std::swap(n_words, y.n_words);
 	std::swap(m_zpNestLevel, y.m_zpNestLevel);
-	std::swap(m_cache, y.m_cache);
+	m_cache.store(y.m_cache.exchange(m_cache.load(std::memory_order_relaxed)),
+				  std::memory_order_relaxed);
+	std::swap(m_sampler, y.m_sampler);
 	IsTermRep::swap(y);
 }
 
@@ -159,6 +168,8 @@ template<class NestTrie, class DawgType>
 size_t
 NestTrieDAWG<NestTrie, DawgType>::index(fstring str) const noexcept {
     assert(m_trie->m_is_link.max_rank1() == this->m_zpath_states);
+    if (terark_unlikely(NULL != as_atomic(m_sampler).load(std::memory_order_relaxed)))
+        sample_index(str);
     if (this->m_zpath_states > 0)
         return index_impl_11(str); // try da cache
     else
@@ -204,9 +215,13 @@ index_impl(fstring str) const noexcept {
 #if defined(NLT_ALWAYS_HAS_GLOBAL_COMMON_PREFIX) // this is for MyTopling
 	trie->m_next_link.prefetch(0);
 #endif
-	if (TryDACache && terark_unlikely(NULL != m_cache)) {
-		auto da = m_cache->get_double_array();
-		auto zpBase = m_cache->get_zpath_data_base();
+	// m_cache may be replaced by rebuild_fsa_cache_by_sample, load it once,
+	// then it is not freed until the guard is released
+	NTD_CacheReadGuard guard;
+	auto cache = TryDACache ? load_cache(guard) : nullptr;
+	if (TryDACache && terark_unlikely(NULL != cache)) {
+		auto da = cache->get_double_array();
+		auto zpBase = cache->get_zpath_data_base();
 		while (true) {
 			if (HasLink) {
 				size_t offset0 = da[curr + 0].m_zp_offset;
@@ -235,7 +250,7 @@ index_impl(fstring str) const noexcept {
 				return null_word;
 			}
 			size_t child = da[curr].m_child0 + byte_t(str[i]);
-			assert(child < m_cache->total_states());
+			assert(child < cache->total_states());
 			if (terark_likely(da[child].m_parent == curr)) {
 				curr = child;
 				i++;
@@ -362,7 +377,9 @@ template<class NestTrie, class DawgType>
 void NestTrieDAWG<NestTrie, DawgType>::
 lower_bound(MatchContext& ctx, fstring word, size_t* index, size_t* dict_rank) const noexcept {
     assert(index || dict_rank);
-    m_trie->lower_bound(ctx, word, index, dict_rank, m_cache, getIsTerm());
+    NTD_CacheReadGuard guard;
+    auto cache = load_cache(guard);
+    m_trie->lower_bound(ctx, word, index, dict_rank, cache, getIsTerm());
 }
 
 template<class NestTrie, class DawgType>
@@ -594,7 +611,7 @@ NestTrieDAWG<NestTrie, DawgType>::finish_load_mmap(const DFA_MmapHeader* base) {
 template<class NestTrie, class DawgType>
 bool
 NestTrieDAWG<NestTrie, DawgType>::has_fsa_cache() const {
-	return NULL != m_cache;
+	return NULL != m_cache.load(std::memory_order_acquire);
 }
 
 template<class NestTrie, class DawgType>
@@ -604,24 +621,189 @@ build_fsa_cache(double cacheRatio, const char* walkMethod) {
 	if (cacheRatio > 1e-8) {
 		size_t cacheStates = size_t(m_trie->total_states() * cacheRatio);
 		if (cacheStates > 100) {
-			delete m_cache;
-			m_cache = NULL; // keep valid if new cache cons throws
-			m_cache = new NTD_CacheTrie(this, cacheStates, walkMethod);
+			auto cache = new NTD_CacheTrie(this, cacheStates, walkMethod);
+			retire_cache(m_cache.exchange(cache, std::memory_order_seq_cst));
 			return true;
 		}
 	}
 	return false;
 }
 
+template<class NestTrie, class DawgType>
+inline const NTD_CacheTrie*
+NestTrieDAWG<NestTrie, DawgType>::load_cache(NTD_CacheReadGuard& guard) const {
+	auto cache = m_cache.load(std::memory_order_seq_cst);
+	if (cache && terark_unlikely(NULL != as_atomic(m_sampler).load(std::memory_order_seq_cst))) {
+		guard.enter();
+		cache = m_cache.load(std::memory_order_seq_cst);
+	}
+	return cache;
+}
+
+// free old cache after readers which may hold it are finished
+template<class NestTrie, class DawgType>
+void
+NestTrieDAWG<NestTrie, DawgType>::retire_cache(NTD_CacheTrie* old) {
+	if (NULL == old)
+		return;
+	if (m_sampler && m_sampler->m_unguarded_cache == old)
+		return; // freed by dtor
+	NTD_CacheEpoch::synchronize();
+	delete old;
+}
+
 template<class NestTrie, class DawgType>
 void
 NestTrieDAWG<NestTrie, DawgType>::print_fsa_cache_stat(FILE* fp) const {
-	if (m_cache) {
-		m_cache->print_cache_stat(fp);
+	NTD_CacheReadGuard guard;
+	if (auto cache = load_cache(guard)) {
+		cache->print_cache_stat(fp);
 	}
 	else {
 		fprintf(fp, "No FSA_Cache\n");
 	}
+	if (m_sampler) {
+		m_sampler->print_stat(fp);
+	}
+}
+
+template<class NestTrie, class DawgType>
+bool
+NestTrieDAWG<NestTrie, DawgType>::
+start_fsa_cache_sampling(int sampleShift, double cacheRatio) {
+	if (m_sampler) {
+		m_sampler->m_mask = (uint32_t(1) << std::min(sampleShift, 31)) - 1;
+		m_sampler->m_cache_ratio = cacheRatio;
+		m_sampler->reset();
+		as_atomic(m_sampler->m_enabled).store(true, std::memory_order_relaxed);
+	}
+	else {
+		auto sampler = new NTD_CacheSampler(sampleShift, cacheRatio);
+		sampler->m_unguarded_cache = m_cache.load(std::memory_order_seq_cst);
+		as_atomic(m_sampler).store(sampler, std::memory_order_seq_cst);
+	}
+	return true;
+}
+
+template<class NestTrie, class DawgType>
+void
+NestTrieDAWG<NestTrie, DawgType>::stop_fsa_cache_sampling() {
+	// m_sampler is kept, it may be in use by searching threads
+	if (m_sampler) {
+		as_atomic(m_sampler->m_enabled).store(false, std::memory_order_relaxed);
+	}
+}
+
+template<class NestTrie, class DawgType>
+size_t
+NestTrieDAWG<NestTrie, DawgType>::
+fsa_cache_hit_depth_hist(valvec<size_t>* depthHist) const {
+	depthHist->erase_all();
+	if (NULL == m_sampler)
+		return 0;
+	valvec<std::pair<size_t, size_t> > hot;
+	size_t samples = 0;
+	depthHist->resize_no_init(NTD_CacheSampler::MaxDepth + 1);
+	m_sampler->collect(&hot, depthHist->data(), &samples);
+	return samples;
+}
+
+// record hit depth of DA cache and trie states on the path of str
+template<class NestTrie, class DawgType>
+void
+NestTrieDAWG<NestTrie, DawgType>::sample_index(fstring str) const {
+	NTD_CacheSampler* sampler = m_sampler;
+	if (!as_atomic(sampler->m_enabled).load(std::memory_order_relaxed))
+		return;
+	NTD_CacheSampler::Shard* sh = sampler->sample_shard();
+	if (NULL == sh)
+		return;
+	size_t depth = 0;
+	NTD_CacheReadGuard guard;
+	if (auto cache = load_cache(guard)) {
+		auto da = cache->get_double_array();
+		size_t curr = initial_state;
+		while (true) {
+			fstring zp = cache->get_zpath_data(curr, NULL);
+			if (zp.size()) {
+				if (depth + zp.size() > str.size() ||
+						memcmp(zp.p, str.p + depth, zp.size()) != 0)
+					break;
+				depth += zp.size();
+			}
+			if (str.size() == depth)
+				break;
+			size_t child = da[curr].m_child0 + byte_t(str[depth]);
+			if (da[child].m_parent != curr)
+				break;
+			curr = child;
+			depth++;
+		}
+	}
+	std::lock_guard<std::mutex> lock(sh->mtx);
+	sh->samples++;
+	sh->depth_hist[std::min(depth, NTD_CacheSampler::MaxDepth)]++;
+	MatchContext ctx;
+	size_t curr = initial_state;
+	size_t i = 0;
+	while (true) {
+		sh->counts[curr]++;
+		if (is_pzip(curr)) {
+			fstring zp = get_zpath_data(curr, &ctx);
+			if (i + zp.size() > str.size() ||
+					memcmp(zp.p, str.p + i, zp.size()) != 0)
+				break;
+			i += zp.size();
+		}
+		if (str.size() == i)
+			break;
+		curr = state_move(curr, byte_t(str[i++]));
+		if (nil_state == curr)
+			break;
+	}
+}
+
+// Ancestors of a state are counted at least as many times as the state, and
+// have smaller state id(LOUDS is BFS order), thus the top states ordered by
+// (count desc, state asc) are closed under parent, and so are states
+// [0, n), the union of them is a valid sub trie for the DA cache.
+template<class NestTrie, class DawgType>
+bool
+NestTrieDAWG<NestTrie, DawgType>::
+rebuild_fsa_cache_by_sample(const char* walkMethod) {
+	NTD_CacheSampler* sampler = m_sampler;
+	if (NULL == sampler)
+		return false;
+	std::lock_guard<std::mutex> lock(sampler->m_rebuild_mtx);
+	valvec<std::pair<size_t, size_t> > hot;
+	size_t hist[NTD_CacheSampler::MaxDepth + 1], samples;
+	sampler->collect(&hot, hist, &samples);
+	if (hot.empty())
+		return false;
+	NTD_CacheTrie* old = m_cache.load(std::memory_order_acquire);
+	size_t total = m_trie->total_states();
+	size_t budget = old ? old->v_gnode_states()
+						: size_t(total * sampler->m_cache_ratio);
+	budget = std::min(budget, total);
+	budget = std::min(budget, size_t(NTD_CacheState::max_state));
+	if (budget <= 100)
+		return false;
+	valvec<uint32_t> sel(budget, valvec_reserve());
+	for (size_t i = 0; i < hot.size() && sel.size() < budget; ++i)
+		sel.push_back(uint32_t(hot[i].second));
+	std::sort(sel.begin(), sel.end());
+	const size_t num_hot = sel.size();
+	for (size_t s = 0; sel.size() < budget; ++s) {
+		if (!std::binary_search(sel.begin(), sel.begin() + num_hot, uint32_t(s)))
+			sel.push_back(uint32_t(s));
+	}
+	std::sort(sel.begin(), sel.end());
+	TERARK_VERIFY_EQ(sel[0], initial_state);
+	auto cache = new NTD_CacheTrie(this,
+			SelectedStatesSubDFA<NestTrieDAWG>(this, sel), walkMethod);
+	retire_cache(m_cache.exchange(cache, std::memory_order_seq_cst));
+	sampler->reset();
+	return true;
 }
 
 template<class NestTrie, class DawgType>
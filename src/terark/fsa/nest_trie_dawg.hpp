@@ -2,6 +2,7 @@
 
 #include "nest_louds_trie.hpp"
 #include <terark/util/autofree.hpp>
+#include <atomic>
 
 namespace terark {
 
@@ -100,7 +101,8 @@ protected:
 	typedef NestTrieDAWG_IsTerm<NestTrie, NestTrie::is_link_rs_mixed::value> IsTermRep;
     typedef typename NestTrie::index_t index_t;
 	size_t m_zpNestLevel;
-	NTD_CacheTrie* m_cache;
+	std::atomic<NTD_CacheTrie*> m_cache; // replaced by rebuild, see NTD_CacheEpoch
+	NTD_CacheSampler* m_sampler; // for adaptive cache, normally NULL
 	using DawgType::n_words;
 	using IsTermRep::m_trie;
     using IsTermRep::getIsTerm;
@@ -110,6 +112,14 @@ protected:
 
     void build_term_bits(const valvec<size_t>& linkVec);
 
+    void sample_index(fstring) const;
+
+	// static cache lookups are not guarded, only in adaptive mode the cache
+	// is loaded under the epoch guard, a cache loaded without the guard was
+	// set before m_sampler, see NTD_CacheSampler::m_unguarded_cache
+	const NTD_CacheTrie* load_cache(NTD_CacheReadGuard& guard) const;
+	void retire_cache(NTD_CacheTrie* old);
+
 public:
     using IsTermRep::is_term;
 	using DawgType::null_word;
@@ -207,7 +217,7 @@ public:
 	using BaseDAWG::match_dawg_l;
 	size_t index(MatchContext&, fstring) const noexcept override final;
 	size_t index(fstring) const noexcept override final;
-	bool has_da_cache() const noexcept { return m_cache != nullptr; }
+	bool has_da_cache() const noexcept { return m_cache.load(std::memory_order_acquire) != nullptr; }
 	template<bool HasLink, bool TryDACache = true>
 	size_t index_impl(fstring) const noexcept terark_pure_func;
 	size_t index_impl_00(fstring) const noexcept terark_pure_func;
@@ -294,6 +304,12 @@ public:
 	bool has_fsa_cache() const override;
 	bool build_fsa_cache(double ratio, const char* WalkMethod) override;
 	void print_fsa_cache_stat(FILE*) const override;
+	bool start_fsa_cache_sampling(int sampleShift, double cacheRatio) override;
+	void stop_fsa_cache_sampling() override;
+	bool rebuild_fsa_cache_by_sample(const char* walkMethod) override;
+	/// depthHist[d] is number of sampled lookups matched d bytes in cache
+	/// @return number of samples since last rebuild
+	size_t fsa_cache_hit_depth_hist(valvec<size_t>* depthHist) const;
 
 	// extended
 	void debug_equal_check(const NestTrieDAWG& y) const { m_trie->debug_equal_check(*y.m_trie); }
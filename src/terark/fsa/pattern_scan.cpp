@@ -0,0 +1,683 @@
+/* vim: set tabstop=4 : */
+#include "pattern_scan.hpp"
+#include <terark/util/throw.hpp>
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <vector>
+
+namespace terark {
+
+namespace {
+
+typedef std::bitset<256> ByteSet;
+
+// AST of regex and glob
+struct PatNode {
+	enum Type { Set, Cat, Alt, Repeat, Empty } type;
+	ByteSet set;
+	std::vector<int> kids;
+	int min = 0, max = 0; // for Repeat, max = -1 means infinite
+	explicit PatNode(Type t) : type(t) {}
+};
+
+const int kMaxRepeat = 1000;
+const size_t kMaxNfaStates = 100000;
+const size_t kMaxDfaStates = 65536;
+
+class PatternParser {
+public:
+	std::vector<PatNode> nodes;
+	const char* beg;
+	const char* pos;
+	const char* end;
+
+	explicit PatternParser(fstring pat) {
+		beg = pos = pat.begin();
+		end = pat.end();
+	}
+	[[noreturn]] void error(const char* msg) const {
+		THROW_STD(invalid_argument, "%s at pos %zd of pattern: %.*s",
+				  msg, size_t(pos - beg), int(end - beg), beg);
+	}
+	int add(PatNode::Type t) {
+		nodes.emplace_back(t);
+		return int(nodes.size() - 1);
+	}
+	int add_set(const ByteSet& set) {
+		int n = add(PatNode::Set);
+		nodes[n].set = set;
+		return n;
+	}
+	int add_byte(byte_t c) {
+		ByteSet set;
+		set.set(c);
+		return add_set(set);
+	}
+	int add_any_bytes() { // .*
+		int any = add_set(ByteSet().set());
+		int n = add(PatNode::Repeat);
+		nodes[n].min = 0;
+		nodes[n].max = -1;
+		nodes[n].kids.push_back(any);
+		return n;
+	}
+	int add_kids(PatNode::Type t, const std::vector<int>& kids) {
+		if (kids.size() == 1)
+			return kids[0];
+		if (kids.empty())
+			return add(PatNode::Empty);
+		int n = add(t);
+		nodes[n].kids = kids;
+		return n;
+	}
+
+	static ByteSet class_set(char c) {
+		ByteSet set;
+		switch (c) {
+		case 'd': case 'D':
+			for (int i = '0'; i <= '9'; ++i) set.set(i);
+			break;
+		case 'w': case 'W':
+			for (int i = '0'; i <= '9'; ++i) set.set(i);
+			for (int i = 'a'; i <= 'z'; ++i) set.set(i);
+			for (int i = 'A'; i <= 'Z'; ++i) set.set(i);
+			set.set('_');
+			break;
+		case 's': case 'S':
+			for (char x : {' ', '\t', '\n', '\r', '\f', '\v'}) set.set(byte_t(x));
+			break;
+		}
+		if (isupper(byte_t(c)))
+			set.flip();
+		return set;
+	}
+	static int hex_val(char c) {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+	// after '\\', for regex escapes, set is filled if it is a class escape
+	byte_t parse_escape(ByteSet* set, bool regex) {
+		if (pos == end)
+			error("trailing backslash");
+		char c = *pos++;
+		if (!regex)
+			return byte_t(c);
+		switch (c) {
+		case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+			*set = class_set(c);
+			return 0;
+		case 'n': return '\n';
+		case 'r': return '\r';
+		case 't': return '\t';
+		case 'f': return '\f';
+		case 'v': return '\v';
+		case '0': return '\0';
+		case 'x': {
+			int h = pos + 2 <= end ? hex_val(pos[0]) : -1;
+			int l = pos + 2 <= end ? hex_val(pos[1]) : -1;
+			if (h < 0 || l < 0)
+				error("bad \\x escape");
+			pos += 2;
+			return byte_t(h * 16 + l);
+		}
+		default:
+			if (isalnum(byte_t(c)))
+				error("unknown escape");
+			return byte_t(c);
+		}
+	}
+	// after '[', negate chars are '^' for regex, '!' or '^' for glob
+	ByteSet parse_bracket(bool regex) {
+		ByteSet set;
+		bool neg = false;
+		if (pos < end && ('^' == *pos || (!regex && '!' == *pos)))
+			neg = true, pos++;
+		bool first = true;
+		while (true) {
+			if (pos == end)
+				error("missing ]");
+			if (']' == *pos && !first) {
+				pos++;
+				break;
+			}
+			first = false;
+			byte_t lo = byte_t(*pos++);
+			if ('\\' == lo) {
+				ByteSet cls;
+				lo = parse_escape(&cls, regex);
+				if (cls.any()) {
+					set |= cls;
+					continue;
+				}
+			}
+			byte_t hi = lo;
+			if (pos + 1 < end && '-' == pos[0] && ']' != pos[1]) {
+				pos++;
+				hi = byte_t(*pos++);
+				if ('\\' == hi) {
+					ByteSet cls;
+					hi = parse_escape(&cls, regex);
+					if (cls.any())
+						error("class escape as range end");
+				}
+				if (hi < lo)
+					error("bad range");
+			}
+			for (size_t c = lo; c <= hi; ++c)
+				set.set(c);
+		}
+		if (neg)
+			set.flip();
+		return set;
+	}
+
+	int parse_regex() {
+		int n = regex_alt();
+		if (pos != end)
+			error("unmatched )");
+		return n;
+	}
+	int regex_alt() {
+		std::vector<int> alts;
+		alts.push_back(regex_cat());
+		while (pos < end && '|' == *pos) {
+			pos++;
+			alts.push_back(regex_cat());
+		}
+		return add_kids(PatNode::Alt, alts);
+	}
+	int regex_cat() {
+		std::vector<int> seq;
+		while (pos < end && '|' != *pos && ')' != *pos) {
+			int n = regex_atom();
+			if (n >= 0)
+				seq.push_back(regex_quantifiers(n));
+		}
+		return add_kids(PatNode::Cat, seq);
+	}
+	int parse_int() {
+		if (pos == end || !isdigit(byte_t(*pos)))
+			error("expect number");
+		int x = 0;
+		while (pos < end && isdigit(byte_t(*pos))) {
+			x = x * 10 + (*pos++ - '0');
+			if (x > kMaxRepeat)
+				error("repeat count is too large");
+		}
+		return x;
+	}
+	int regex_quantifiers(int n) {
+		while (pos < end) {
+			int min, max;
+			switch (*pos) {
+			case '*': min = 0, max = -1; pos++; break;
+			case '+': min = 1, max = -1; pos++; break;
+			case '?': min = 0, max =  1; pos++; break;
+			case '{':
+				pos++;
+				min = max = parse_int();
+				if (pos < end && ',' == *pos) {
+					pos++;
+					max = pos < end && '}' == *pos ? -1 : parse_int();
+				}
+				if (pos == end || '}' != *pos)
+					error("missing }");
+				pos++;
+				if (max >= 0 && max < min)
+					error("bad repeat range");
+				break;
+			default:
+				return n;
+			}
+			int r = add(PatNode::Repeat);
+			nodes[r].min = min;
+			nodes[r].max = max;
+			nodes[r].kids.push_back(n);
+			n = r;
+		}
+		return n;
+	}
+	// @return -1 for ignored anchors
+	int regex_atom() {
+		char c = *pos++;
+		switch (c) {
+		case '(': {
+			if (pos + 1 < end && '?' == pos[0] && ':' == pos[1])
+				pos += 2;
+			int n = regex_alt();
+			if (pos == end || ')' != *pos)
+				error("missing )");
+			pos++;
+			return n;
+		}
+		case '[':
+			return add_set(parse_bracket(true));
+		case '.':
+			return add_set(ByteSet().set());
+		case '\\': {
+			ByteSet cls;
+			byte_t b = parse_escape(&cls, true);
+			return cls.any() ? add_set(cls) : add_byte(b);
+		}
+		case '^':
+			if (pos - 1 != beg)
+				error("^ is only allowed at beginning");
+			return -1;
+		case '$':
+			if (pos != end)
+				error("$ is only allowed at end");
+			return -1;
+		case '*': case '+': case '?': case '{':
+			pos--;
+			error("nothing to repeat");
+		default:
+			return add_byte(byte_t(c));
+		}
+	}
+
+	int parse_glob() {
+		int n = glob_seq(false);
+		if (pos != end)
+			error("unmatched }");
+		return n;
+	}
+	int glob_seq(bool in_brace) {
+		std::vector<int> seq;
+		while (pos < end) {
+			char c = *pos;
+			if (in_brace && (',' == c || '}' == c))
+				break;
+			pos++;
+			switch (c) {
+			case '*':
+				seq.push_back(add_any_bytes());
+				break;
+			case '?':
+				seq.push_back(add_set(ByteSet().set()));
+				break;
+			case '[':
+				seq.push_back(add_set(parse_bracket(false)));
+				break;
+			case '{': {
+				std::vector<int> alts;
+				alts.push_back(glob_seq(true));
+				while (pos < end && ',' == *pos) {
+					pos++;
+					alts.push_back(glob_seq(true));
+				}
+				if (pos == end)
+					error("missing }");
+				pos++;
+				seq.push_back(add_kids(PatNode::Alt, alts));
+				break;
+			}
+			case '\\': {
+				ByteSet unused;
+				seq.push_back(add_byte(parse_escape(&unused, false)));
+				break;
+			}
+			default:
+				seq.push_back(add_byte(byte_t(c)));
+				break;
+			}
+		}
+		return add_kids(PatNode::Cat, seq);
+	}
+};
+
+// Thompson NFA, each state has at most one byte set move
+class PatternNFA {
+public:
+	struct State {
+		int set = -1; // index of sets
+		int next = -1;
+		std::vector<int> eps;
+	};
+	std::vector<State> states;
+	std::vector<ByteSet> sets;
+	const std::vector<PatNode>& nodes;
+
+	explicit PatternNFA(const std::vector<PatNode>& n) : nodes(n) {}
+
+	int add() {
+		if (states.size() >= kMaxNfaStates)
+			THROW_STD(invalid_argument, "pattern is too complex");
+		states.emplace_back();
+		return int(states.size() - 1);
+	}
+	// @return (start, final)
+	std::pair<int,int> compile(int n) {
+		const PatNode& node = nodes[n];
+		switch (node.type) {
+		default:
+			TERARK_DIE("bad node type %d", node.type);
+		case PatNode::Empty: {
+			int s = add();
+			return {s, s};
+		}
+		case PatNode::Set: {
+			int s = add(), e = add();
+			states[s].set = int(sets.size());
+			states[s].next = e;
+			sets.push_back(node.set);
+			return {s, e};
+		}
+		case PatNode::Cat: {
+			auto f = compile(node.kids[0]);
+			for (size_t i = 1; i < node.kids.size(); ++i) {
+				auto g = compile(node.kids[i]);
+				states[f.second].eps.push_back(g.first);
+				f.second = g.second;
+			}
+			return f;
+		}
+		case PatNode::Alt: {
+			int s = add(), e = add();
+			for (int kid : node.kids) {
+				auto g = compile(kid);
+				states[s].eps.push_back(g.first);
+				states[g.second].eps.push_back(e);
+			}
+			return {s, e};
+		}
+		case PatNode::Repeat: {
+			int s = add(), e = s;
+			for (int i = 0; i < node.min; ++i) {
+				auto g = compile(node.kids[0]);
+				states[e].eps.push_back(g.first);
+				e = g.second;
+			}
+			if (node.max < 0) {
+				auto g = compile(node.kids[0]);
+				int f = add();
+				states[e].eps.push_back(g.first);
+				states[e].eps.push_back(f);
+				states[g.second].eps.push_back(g.first);
+				states[g.second].eps.push_back(f);
+				e = f;
+			}
+			else if (node.max > node.min) {
+				int f = add();
+				for (int i = node.min; i < node.max; ++i) {
+					auto g = compile(node.kids[0]);
+					states[e].eps.push_back(g.first);
+					states[e].eps.push_back(f);
+					e = g.second;
+				}
+				states[e].eps.push_back(f);
+				e = f;
+			}
+			return {s, e};
+		}
+		}
+	}
+	void closure(std::vector<int>* ss) const {
+		std::vector<byte_t> seen(states.size());
+		std::vector<int> stack(*ss);
+		ss->clear();
+		while (!stack.empty()) {
+			int s = stack.back(); stack.pop_back();
+			if (seen[s])
+				continue;
+			seen[s] = 1;
+			ss->push_back(s);
+			for (int t : states[s].eps)
+				if (!seen[t])
+					stack.push_back(t);
+		}
+		std::sort(ss->begin(), ss->end());
+	}
+};
+
+} // namespace
+
+PatternMatcher::PatternMatcher(fstring pattern, Syntax syntax) {
+	PatternParser parser(pattern);
+	int root = Glob == syntax ? parser.parse_glob() : parser.parse_regex();
+	PatternNFA nfa(parser.nodes);
+	auto frag = nfa.compile(root);
+
+	// subset construction
+	std::vector<std::vector<int> > dstates;
+	std::map<std::vector<int>, uint32_t> dmap;
+	valvec<uint32_t> trans; // without dead state
+	auto find_or_add = [&](std::vector<int>& ss) {
+		nfa.closure(&ss);
+		auto ib = dmap.emplace(ss, uint32_t(dstates.size()));
+		if (ib.second) {
+			if (dstates.size() >= kMaxDfaStates)
+				THROW_STD(invalid_argument, "pattern DFA is too large");
+			dstates.push_back(ss);
+		}
+		return ib.first->second;
+	};
+	std::vector<int> ss(1, frag.first);
+	find_or_add(ss);
+	std::vector<std::vector<int> > targets(256);
+	for (size_t ds = 0; ds < dstates.size(); ++ds) {
+		for (auto& t : targets)
+			t.clear();
+		for (int s : dstates[ds]) {
+			const auto& st = nfa.states[s];
+			if (st.set < 0)
+				continue;
+			const ByteSet& set = nfa.sets[st.set];
+			for (size_t c = 0; c < 256; ++c)
+				if (set.test(c))
+					targets[c].push_back(st.next);
+		}
+		trans.resize(256 * (ds + 1), UINT32_MAX);
+		for (size_t c = 0; c < 256; ++c) {
+			if (!targets[c].empty()) {
+				uint32_t t = find_or_add(targets[c]);
+				trans[256 * ds + c] = t;
+			}
+		}
+	}
+	const size_t n = dstates.size();
+
+	// live states: those can reach an accept state
+	valvec<byte_t> live(n, 0);
+	std::vector<std::vector<uint32_t> > rev(n);
+	std::vector<uint32_t> stack;
+	for (size_t s = 0; s < n; ++s) {
+		for (size_t c = 0; c < 256; ++c) {
+			uint32_t t = trans[256 * s + c];
+			if (UINT32_MAX != t)
+				rev[t].push_back(uint32_t(s));
+		}
+		if (std::binary_search(dstates[s].begin(), dstates[s].end(), frag.second))
+			live[s] = 1, stack.push_back(uint32_t(s));
+	}
+	while (!stack.empty()) {
+		uint32_t t = stack.back(); stack.pop_back();
+		for (uint32_t s : rev[t])
+			if (!live[s])
+				live[s] = 1, stack.push_back(s);
+	}
+	valvec<uint32_t> id(n, 0); // new id, 0 is dead
+	uint32_t num = 1;
+	for (size_t s = 0; s < n; ++s)
+		if (live[s])
+			id[s] = num++;
+	m_trans.resize(256 * size_t(num), 0);
+	m_accept.resize(num, 0);
+	m_num_live.resize(num, 0);
+	for (size_t s = 0; s < n; ++s) {
+		if (!live[s])
+			continue;
+		uint32_t ns = id[s];
+		for (size_t c = 0; c < 256; ++c) {
+			uint32_t t = trans[256 * s + c];
+			if (UINT32_MAX != t && live[t]) {
+				m_trans[256 * ns + c] = id[t];
+				m_num_live[ns]++;
+			}
+		}
+		m_accept[ns] = std::binary_search(dstates[s].begin(),
+							dstates[s].end(), frag.second);
+	}
+	m_few_beg.resize(num + 1);
+	for (size_t s = 0; s < num; ++s) {
+		m_few_beg[s] = uint32_t(m_few_bytes.size());
+		if (m_num_live[s] <= kFewBytes) {
+			for (size_t c = 0; c < 256; ++c)
+				if (m_trans[256 * s + c])
+					m_few_bytes.push_back(byte_t(c));
+		}
+	}
+	m_few_beg[num] = uint32_t(m_few_bytes.size());
+	m_start = id[0]; // dstates[0] is the start state
+	m_visited = 0;
+}
+
+PatternMatcher::~PatternMatcher() {}
+
+bool PatternMatcher::match(fstring str) const {
+	size_t ps = m_start;
+	for (size_t i = 0; ps && i < str.size(); ++i)
+		ps = m_trans[256 * ps + byte_t(str[i])];
+	return m_accept[ps] != 0;
+}
+
+// DFS over dfa in lockstep with pattern DFA. If there is a cursor, a path
+// is "tight" while it is a prefix of cursor, in which children less than
+// cursor are skipped and keys <= cursor are not reported.
+class PatternMatcher::Walker {
+public:
+	const PatternMatcher* pm;
+	const BaseDFA* dfa;
+	const OnMatch& on_match;
+	fstring cursor;
+	size_t  nil;
+	valvec<byte_t> key;
+	std::vector<valvec<CharTarget<size_t> > > moves; // per DFS level
+	MatchContext ctx;
+	size_t visited = 0;
+	size_t matched = 0;
+	bool   stop = false;
+
+	Walker(const PatternMatcher* pm1, const BaseDFA* dfa1, const OnMatch& fn)
+	  : on_match(fn) {
+		pm = pm1;
+		dfa = dfa1;
+		nil = dfa->v_nil_state();
+	}
+	// step pattern state by c at key.size(), update tight, 0 means skip
+	size_t step(size_t ps, byte_t c, bool* tight) const {
+		if (*tight) {
+			size_t d = key.size();
+			if (d < cursor.size()) {
+				if (c < byte_t(cursor[d]))
+					return 0;
+				*tight = c == byte_t(cursor[d]);
+			}
+			else
+				*tight = false; // key is longer than cursor
+		}
+		return pm->m_trans[256 * ps + c];
+	}
+	void visit(size_t s, size_t ps, bool tight, size_t level) {
+		const size_t d0 = key.size();
+		visited++;
+		if (dfa->v_is_pzip(s)) {
+			fstring zp = dfa->v_get_zpath_data(s, &ctx);
+			for (size_t j = 0; j < zp.size(); ++j) {
+				ps = step(ps, zp[j], &tight);
+				if (0 == ps) {
+					key.risk_set_size(d0);
+					return;
+				}
+				key.push_back(zp[j]);
+			}
+		}
+		const size_t d = key.size();
+		// if tight, key is a prefix of cursor, key <= cursor
+		if (pm->m_accept[ps] && !tight && dfa->v_is_term(s)) {
+			matched++;
+			if (!on_match(fstring(key.data(), d), s)) {
+				stop = true;
+				return;
+			}
+		}
+		auto child = [&](size_t t, byte_t c) {
+			bool child_tight = tight;
+			size_t cps = step(ps, c, &child_tight);
+			if (cps) {
+				key.push_back(c);
+				visit(t, cps, child_tight, level + 1);
+				key.risk_set_size(d);
+			}
+		};
+		const uint32_t* fb = pm->m_few_beg.data();
+		if (pm->m_num_live[ps] <= kFewBytes) {
+			for (size_t i = fb[ps]; i < fb[ps + 1] && !stop; ++i) {
+				byte_t c = pm->m_few_bytes[i];
+				size_t t = dfa->v_state_move(s, c);
+				if (nil != t)
+					child(t, c);
+			}
+		}
+		else {
+			if (moves.size() <= level)
+				moves.resize(level + 1);
+			auto& mv = moves[level];
+			mv.resize_no_init(dfa->get_sigma());
+			size_t n = dfa->get_all_move(s, mv.data());
+			for (size_t i = 0; i < n && !stop; ++i) {
+				CharTarget<size_t> ct = moves[level][i];
+				if (ct.ch < 256)
+					child(ct.target, byte_t(ct.ch));
+			}
+		}
+		key.risk_set_size(d0);
+	}
+};
+
+size_t PatternMatcher::do_scan(const BaseDFA* dfa, const fstring* cursor,
+							   const OnMatch& fn, size_t root) const {
+	Walker w(this, dfa, fn);
+	if (cursor)
+		w.cursor = *cursor;
+	if (m_start)
+		w.visit(root, m_start, NULL != cursor, 0);
+	m_visited = w.visited;
+	return w.matched;
+}
+
+size_t PatternMatcher::scan(const BaseDFA* dfa, const OnMatch& fn,
+							size_t root) const {
+	return do_scan(dfa, NULL, fn, root);
+}
+
+size_t PatternMatcher::scan_from(const BaseDFA* dfa, fstring cursor,
+								 const OnMatch& fn, size_t root) const {
+	return do_scan(dfa, &cursor, fn, root);
+}
+
+size_t PatternMatcher::scan_dawg(const BaseDFA* dfa,
+								 const OnMatchDAWG& fn) const {
+	const BaseDAWG* dawg = dfa->get_dawg();
+	if (NULL == dawg) {
+		THROW_STD(invalid_argument, "dfa is not a DAWG");
+	}
+	return do_scan(dfa, NULL, [&](fstring key, size_t s) {
+		return fn(key, dawg->v_state_to_word_id(s));
+	}, initial_state);
+}
+
+size_t PatternMatcher::scan_dawg_from(const BaseDFA* dfa, fstring cursor,
+									  const OnMatchDAWG& fn) const {
+	const BaseDAWG* dawg = dfa->get_dawg();
+	if (NULL == dawg) {
+		THROW_STD(invalid_argument, "dfa is not a DAWG");
+	}
+	return do_scan(dfa, &cursor, [&](fstring key, size_t s) {
+		return fn(key, dawg->v_state_to_word_id(s));
+	}, initial_state);
+}
+
+} // namespace terark
@@ -0,0 +1,76 @@
+/* vim: set tabstop=4 : */
+#pragma once
+#include "fsa.hpp"
+#include <string>
+
+namespace terark {
+
+/// Scan keys of a dfa(NestLoudsTrieDAWG, Patricia, DoubleArrayTrie...)
+/// matching a regex or glob pattern, without iterating all keys.
+///
+/// The pattern is compiled to a small byte DFA, states which can not reach
+/// an accept state are merged into the dead state 0. The dfa is walked
+/// depth first in lockstep with the pattern DFA, a subtree is skipped as
+/// soon as the pattern DFA goes dead, when the pattern state has only a
+/// few live bytes(such as a literal part), children are probed by
+/// v_state_move instead of enumerating all children.
+///
+/// A pattern always matches the whole key(as if it is ^pattern$).
+///
+/// Regex syntax: literal bytes, `.`(any byte), `[a-z]`, `[^...]`, `(...)`,
+/// `(?:...)`, `|`, `*`, `+`, `?`, `{n}`, `{n,}`, `{n,m}`, escapes `\d \D
+/// \w \W \s \S \n \r \t \xHH` and `\` + meta char, `^` at the beginning and
+/// `$` at the end are allowed and ignored.
+///
+/// Glob syntax: `*`(any bytes), `?`(any byte), `[a-z]`, `[!...]` or
+/// `[^...]`, `{foo,bar}` alternation, `\` escapes the next byte.
+///
+/// Syntax errors throw std::invalid_argument.
+class TERARK_DLL_EXPORT PatternMatcher {
+public:
+	enum Syntax { Regex, Glob };
+
+	/// return false to stop the scan
+	typedef function<bool(fstring key, size_t state)> OnMatch;
+	typedef function<bool(fstring key, size_t word_id)> OnMatchDAWG;
+
+	explicit PatternMatcher(fstring pattern, Syntax = Regex);
+	~PatternMatcher();
+
+	/// scan all matched keys in lexical order
+	/// @return number of reported keys
+	size_t scan(const BaseDFA*, const OnMatch&, size_t root = initial_state) const;
+
+	/// resume a scan: report matched keys greater than cursor, generally
+	/// cursor is the last key reported by the previous scan
+	size_t scan_from(const BaseDFA*, fstring cursor, const OnMatch&,
+					 size_t root = initial_state) const;
+
+	/// dfa must have get_dawg(), report word ids
+	size_t scan_dawg(const BaseDFA*, const OnMatchDAWG&) const;
+	size_t scan_dawg_from(const BaseDFA*, fstring cursor, const OnMatchDAWG&) const;
+
+	/// match a single string by the compiled pattern DFA
+	bool match(fstring) const;
+
+	size_t num_states() const { return m_accept.size(); }
+
+	/// number of visited dfa nodes of last scan, for diagnosis
+	size_t visited_nodes() const { return m_visited; }
+
+private:
+	class Walker; // defined in cpp
+	size_t do_scan(const BaseDFA*, const fstring* cursor,
+				   const OnMatch&, size_t root) const;
+
+	static const size_t kFewBytes = 8;
+	valvec<uint32_t> m_trans;  // num_states * 256, state 0 is dead
+	valvec<byte_t>   m_accept; // accept flag of states
+	valvec<uint16_t> m_num_live; // number of bytes not going to dead state
+	valvec<uint32_t> m_few_beg; // m_few_bytes[m_few_beg[s], m_few_beg[s+1])
+	valvec<byte_t>   m_few_bytes; // live bytes of states having few
+	uint32_t m_start;
+	mutable size_t m_visited;
+};
+
+} // namespace terark
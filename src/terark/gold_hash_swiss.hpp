@@ -0,0 +1,904 @@
+#pragma once
+
+#include "gold_hash_map.hpp"
+#include <terark/bitmanip.hpp>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && __GNUC_MINOR__ + 1000 * __GNUC__ > 7000
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wclass-memaccess" // which version support?
+  #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace terark {
+
+/// 16 control bytes of gold_swiss_tab, each control byte is:
+///   kEmpty   : slot is never used since last rehash, probing stops here
+///   kDeleted : tombstone, slot is free but probing must go on
+///   0 ~ 127  : slot is used, the byte is 7 bits "h2" of the mixed hash
+/// all bytes in a group are checked by one SSE2 compare + movemask
+struct SwissGroup16 {
+	enum : byte_t { kEmpty = 0x80, kDeleted = 0xFE };
+	enum : size_t { Width = 16 };
+
+#if defined(__SSE2__)
+	static uint32_t match(const byte_t* ctrl, byte_t h2) {
+		__m128i g = _mm_load_si128((const __m128i*)ctrl);
+		__m128i k = _mm_set1_epi8(char(h2));
+		return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(k, g)));
+	}
+	static uint32_t match_empty(const byte_t* ctrl) {
+		__m128i g = _mm_load_si128((const __m128i*)ctrl);
+		__m128i k = _mm_set1_epi8(char(kEmpty));
+		return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(k, g)));
+	}
+	/// kEmpty or kDeleted, both have the highest bit set
+	static uint32_t match_free(const byte_t* ctrl) {
+		__m128i g = _mm_load_si128((const __m128i*)ctrl);
+		return uint32_t(_mm_movemask_epi8(g));
+	}
+#else
+	static uint32_t match(const byte_t* ctrl, byte_t h2) {
+		uint32_t bits = 0;
+		for (size_t i = 0; i < Width; ++i)
+			bits |= uint32_t(ctrl[i] == h2) << i;
+		return bits;
+	}
+	static uint32_t match_empty(const byte_t* ctrl) {
+		return match(ctrl, kEmpty);
+	}
+	static uint32_t match_free(const byte_t* ctrl) {
+		uint32_t bits = 0;
+		for (size_t i = 0; i < Width; ++i)
+			bits |= uint32_t(ctrl[i] >> 7) << i;
+		return bits;
+	}
+#endif
+
+	/// the false start group of an empty table, all bytes are kEmpty
+	static const byte_t* empty_group() {
+		alignas(16) static const byte_t g[Width] = {
+			kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty,
+			kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty,
+		};
+		return g;
+	}
+};
+
+/// Open addressing variant of gold_hash_tab, with same template params
+/// and same index(i) based api.
+///
+/// Elem is still stored in NodeLayout in insertion order, so the index of
+/// an elem is stable, freelist works as in gold_hash_tab, and iterating
+/// is a sequential scan. link(i) of a valid elem is not a collision link
+/// but the position of elem i in the open addressing table, so erase_i
+/// need not to probe.
+///
+/// The table is an array of SwissGroup16 control bytes followed by an
+/// array of LinkTp which index into NodeLayout, both are flat arrays of
+/// plain integers, independent of memory address. A probe touches one
+/// control group, then just the candidates whose h2 are matched.
+///
+/// There is no mmap-able serialized form: DataIO saves just the elems, in
+/// the format of gold_hash_tab, and dio_load rebuilds the table by rehash,
+/// it is O(n) and can not be loaded zero copy.
+template< class Key
+		, class Elem = Key
+		, class HashEqual = hash_and_equal<Key, DEFAULT_HASH_FUNC<Key>, std::equal_to<Key> >
+		, class KeyExtractor = terark_identity<Elem>
+		, class NodeLayout = node_layout<Elem, unsigned/*LinkTp*/ >
+		, class HashTp = size_t
+		>
+class gold_swiss_tab : dummy_bucket<typename NodeLayout::link_t>, HashEqual, KeyExtractor
+{
+#define MyKeyExtractor static_cast<const KeyExtractor&>(*this)
+protected:
+	typedef typename NodeLayout::link_t LinkTp;
+	typedef typename NodeLayout::copy_strategy CopyStrategy;
+	typedef SwissGroup16 Group;
+
+	using dummy_bucket<LinkTp>::tail;
+	using dummy_bucket<LinkTp>::delmark;
+
+	struct IsNotFree {
+		bool operator()(LinkTp link_val) const { return delmark != link_val; }
+	};
+
+public:
+	enum { is_value_out = NodeLayout::is_value_out };
+	typedef typename ParamPassType<Key>::type         key_param_pass_t;
+
+	typedef typename NodeLayout::      iterator       fast_iterator;
+	typedef typename NodeLayout::const_iterator const_fast_iterator;
+
+	class iterator; friend class iterator;
+	class iterator {
+	public:
+		typedef Elem  value_type;
+		typedef gold_swiss_tab* OwnerPtr;
+	#define ClassIterator iterator
+	#include "gold_hash_map_iterator.hpp"
+	};
+	class const_iterator; friend class const_iterator;
+	class const_iterator {
+	public:
+		typedef const Elem  value_type;
+		const_iterator(const iterator& y)
+		  : owner(y.get_owner()), index(y.get_index()) {}
+		typedef const gold_swiss_tab* OwnerPtr;
+	#define ClassIterator const_iterator
+	#include "gold_hash_map_iterator.hpp"
+	};
+	      iterator get_iter(size_t idx)       { return       iterator(this, idx); }
+	const_iterator get_iter(size_t idx) const { return const_iterator(this, idx); }
+
+	typedef ptrdiff_t difference_type;
+	typedef size_t  size_type;
+	typedef Elem  value_type;
+	typedef Elem& reference;
+
+	typedef const Key key_type;
+	typedef LinkTp link_t;
+
+protected:
+	NodeLayout m_nl;
+	byte_t* m_ctrl;  // nSlot control bytes, followed by m_slot
+	LinkTp* m_slot;  // index to m_nl
+	size_t  nSlot;   // 0 or power of 2, and >= Group::Width
+	size_t  m_gmask; // group num - 1
+	LinkTp  nElem;
+	LinkTp  maxElem;
+	LinkTp  growth_left; // kEmpty slots which can be used before rehash
+	LinkTp  freelist_head;
+	LinkTp  freelist_size;
+	uint8_t load_factor;
+	bool    m_enable_freelist_reuse;
+
+	static size_t mix_hash(HashTp h) {
+		// std::hash of integers is identity, so mix it
+		uint64_t m = uint64_t(h) * 0x9E3779B97F4A7C15ull;
+		return size_t(m ^ (m >> 32));
+	}
+	static byte_t h2_of(size_t m) { return byte_t(m & 0x7F); }
+
+private:
+	void init() {
+		BOOST_STATIC_ASSERT(sizeof(LinkTp) <= sizeof(Elem));
+		new(&m_nl)NodeLayout();
+		m_ctrl = const_cast<byte_t*>(Group::empty_group()); // false start
+		m_slot = NULL;
+		nSlot = 0;
+		m_gmask = 0;
+		nElem = 0;
+		maxElem = 0;
+		growth_left = 0;
+		freelist_head = tail; // empty freelist
+		freelist_size = 0;
+		load_factor = uint8_t(256 * 7 / 8);
+		m_enable_freelist_reuse = true;
+	}
+
+	void free_table() {
+		if (nSlot)
+			::free(m_ctrl);
+	}
+
+	void alloc_table(size_t slots) {
+		TERARK_VERIFY_EQ(slots % Group::Width, 0);
+		TERARK_VERIFY_LT(slots, delmark);
+		size_t bytes = slots * (1 + sizeof(LinkTp));
+		byte_t* mem = (byte_t*)::aligned_alloc(Group::Width, bytes);
+		TERARK_VERIFY_F(nullptr != mem, "aligned_alloc(%zd) = NULL", bytes);
+		memset(mem, Group::kEmpty, slots);
+		m_ctrl = mem;
+		m_slot = (LinkTp*)(mem + slots);
+		nSlot = slots;
+		m_gmask = slots / Group::Width - 1;
+	}
+
+	/// find first free slot in probe sequence, just for insert
+	size_t find_free_pos(size_t m) const {
+		size_t g = (m >> 7) & m_gmask;
+		for (size_t step = 0; ; ) {
+			uint32_t bits = Group::match_free(m_ctrl + g * Group::Width);
+			if (bits)
+				return g * Group::Width + fast_ctz(bits);
+			g = (g + ++step) & m_gmask; // triangular, visit all groups
+		}
+	}
+
+	void set_pos(size_t pos, size_t m, size_t idx) {
+		TERARK_ASSERT_LT(pos, nSlot);
+		if (Group::kEmpty == m_ctrl[pos]) {
+			TERARK_ASSERT_GT(growth_left, 0);
+			growth_left--;
+		}
+		m_ctrl[pos] = h2_of(m);
+		m_slot[pos] = LinkTp(idx);
+		m_nl.link(idx) = LinkTp(pos);
+	}
+
+	void clear_pos(size_t pos) {
+		TERARK_ASSERT_LT(pos, nSlot);
+		TERARK_ASSERT_LT(m_ctrl[pos], 128);
+		const byte_t* group = m_ctrl + pos / Group::Width * Group::Width;
+		if (Group::match_empty(group)) {
+			// probing for any key which passed this group had stopped
+			// here, so this slot can be reverted to kEmpty
+			m_ctrl[pos] = Group::kEmpty;
+			growth_left++;
+		}
+		else {
+			m_ctrl[pos] = Group::kDeleted;
+		}
+	}
+
+	size_t slots_for(size_t cap) const {
+		size_t slots = cap * 256 / load_factor + 1;
+		slots = std::max<size_t>(slots, Group::Width);
+		return __hsm_align_pow2(slots);
+	}
+
+	void relink() {
+		if (0 == nSlot)
+			return;
+		memset(m_ctrl, Group::kEmpty, nSlot);
+		growth_left = LinkTp(nSlot * load_factor / 256);
+		NodeLayout nl = m_nl;
+		for (size_t j = 0, n = nElem; j < n; ++j) {
+			if (freelist_size && delmark == nl.link(j))
+				continue;
+			size_t m = mix_hash(hash_i(j));
+			set_pos(find_free_pos(m), m, j);
+		}
+	}
+
+	/// called when growth_left is 0
+	terark_no_inline void grow_for_insert() {
+		size_t live = nElem - freelist_size;
+		size_t maxload = nSlot * load_factor / 256;
+		if (nSlot && live < maxload / 2)
+			relink(); // too many tombstones, just purge them
+		else
+			rehash(std::max(2 * nSlot, slots_for(live + 1)));
+	}
+
+	void destroy() {
+		NodeLayout nl = m_nl;
+		if (!nl.is_null()) {
+			if (!boost::has_trivial_destructor<Elem>::value) {
+				if (freelist_is_empty()) {
+					for (size_t i = nElem; i > 0; --i)
+						nl.data(i-1).~Elem();
+				} else {
+					for (size_t i = nElem; i > 0; --i)
+						if (delmark != nl.link(i-1))
+							nl.data(i-1).~Elem();
+				}
+			}
+			m_nl.free();
+		}
+		free_table();
+	}
+
+public:
+	gold_swiss_tab() { init(); }
+	explicit gold_swiss_tab(HashEqual he
+						  , KeyExtractor keyExtr = KeyExtractor())
+	  : HashEqual(he), KeyExtractor(keyExtr) {
+		init();
+	}
+	explicit gold_swiss_tab(size_t cap
+						  , HashEqual he = HashEqual()
+						  , KeyExtractor keyExtr = KeyExtractor())
+	  : HashEqual(he), KeyExtractor(keyExtr) {
+		init();
+		reserve(cap);
+	}
+	gold_swiss_tab(std::initializer_list<Elem> list
+				 , HashEqual he = HashEqual()
+				 , KeyExtractor keyExtr = KeyExtractor())
+	  : HashEqual(he), KeyExtractor(keyExtr) {
+		init();
+		reserve(list.size());
+		for (auto& e : list)
+			this->insert_i(e);
+	}
+
+	/// ensured not calling HashEqual and KeyExtractor
+	gold_swiss_tab(const gold_swiss_tab& y)
+	  : HashEqual(y), KeyExtractor(y) {
+		init();
+		load_factor = y.load_factor;
+		m_enable_freelist_reuse = y.m_enable_freelist_reuse;
+		if (0 == y.nElem)
+			return;
+		m_nl.reserve(0, y.nElem);
+		if (!boost::has_trivial_copy<Elem>::value && y.freelist_size)
+			node_layout_copy_cons(m_nl, y.m_nl, y.nElem, IsNotFree());
+		else
+			node_layout_copy_cons(m_nl, y.m_nl, y.nElem);
+		nElem = maxElem = y.nElem;
+		freelist_head = y.freelist_head;
+		freelist_size = y.freelist_size;
+		if (y.nSlot) {
+			alloc_table(y.nSlot);
+			memcpy(m_ctrl, y.m_ctrl, nSlot * (1 + sizeof(LinkTp)));
+			growth_left = y.growth_left;
+		}
+	}
+	gold_swiss_tab& operator=(const gold_swiss_tab& y) {
+		if (this != &y) {
+			this->destroy();
+			new(this)gold_swiss_tab(y);
+		}
+		return *this;
+	}
+	gold_swiss_tab(gold_swiss_tab&& y) noexcept
+	  : HashEqual(std::move(y)), KeyExtractor(std::move(y)) {
+		m_nl    = y.m_nl;
+		m_ctrl  = y.m_ctrl;
+		m_slot  = y.m_slot;
+		nSlot   = y.nSlot;
+		m_gmask = y.m_gmask;
+		nElem   = y.nElem;
+		maxElem = y.maxElem;
+		growth_left   = y.growth_left;
+		freelist_head = y.freelist_head;
+		freelist_size = y.freelist_size;
+		load_factor   = y.load_factor;
+		m_enable_freelist_reuse = y.m_enable_freelist_reuse;
+		y.init(); // reset y as empty
+	}
+	gold_swiss_tab& operator=(gold_swiss_tab&& y) noexcept {
+		if (this != &y) {
+			this->~gold_swiss_tab();
+			new(this)gold_swiss_tab(std::move(y));
+		}
+		return *this;
+	}
+	~gold_swiss_tab() { destroy(); }
+
+	void swap(gold_swiss_tab& y) {
+		std::swap(m_nl   , y.m_nl);
+		std::swap(m_ctrl , y.m_ctrl);
+		std::swap(m_slot , y.m_slot);
+		std::swap(nSlot  , y.nSlot);
+		std::swap(m_gmask, y.m_gmask);
+		std::swap(nElem  , y.nElem);
+		std::swap(maxElem, y.maxElem);
+		std::swap(growth_left  , y.growth_left);
+		std::swap(freelist_head, y.freelist_head);
+		std::swap(freelist_size, y.freelist_size);
+		std::swap(load_factor  , y.load_factor);
+		std::swap(m_enable_freelist_reuse, y.m_enable_freelist_reuse);
+		std::swap(static_cast<HashEqual&>(*this), static_cast<HashEqual&>(y));
+		std::swap(static_cast<KeyExtractor&>(*this) , static_cast<KeyExtractor&>(y));
+	}
+
+	const HashEqual& getHashEqual() const { return *this; }
+	const KeyExtractor& getKeyExtractor() const { return *this; }
+
+	void clear() {
+		destroy();
+		init();
+	}
+
+	void shrink_to_fit() { if (nElem < maxElem) reserve_nodes(nElem); }
+
+	size_t rehash(size_t newSlotNum) {
+		newSlotNum = __hsm_align_pow2(std::max<size_t>(newSlotNum, Group::Width));
+		TERARK_VERIFY_GT(newSlotNum * load_factor / 256, nElem - freelist_size);
+		if (newSlotNum != nSlot) {
+			free_table();
+			alloc_table(newSlotNum);
+		}
+		relink();
+		return newSlotNum;
+	}
+
+	void reserve(size_t cap) {
+		reserve_nodes(cap);
+		if (slots_for(cap) > nSlot)
+			rehash(slots_for(cap));
+	}
+
+	void reserve_nodes(size_t cap) {
+		TERARK_VERIFY_GE(cap, nElem);
+		TERARK_VERIFY_LE(cap, delmark);
+		if (cap != (size_t)maxElem && cap != nElem) {
+			if (freelist_size)
+				m_nl.reserve(nElem, cap, IsNotFree());
+			else
+				m_nl.reserve(nElem, cap);
+			maxElem = LinkTp(cap);
+		}
+	}
+
+	/// max load factor is 0.875, larger value needs too long probing
+	void set_load_factor(double fact) {
+		if (fact > 0.875) {
+			throw std::logic_error("load factor must <= 0.875");
+		}
+		using namespace std;
+		load_factor = uint8_t(max(min(int(256 * fact), 224), 10));
+		if (nSlot)
+			rehash(max(nSlot, slots_for(size())));
+	}
+	double get_load_factor() const { return load_factor / 256.0; }
+
+	inline HashTp hash_i(size_t i) const {
+		TERARK_ASSERT_LT(i, nElem);
+		return HashTp(HashEqual::hash(MyKeyExtractor(m_nl.data(i))));
+	}
+	inline HashTp hash_v(const Elem& e) const {
+		return HashTp(HashEqual::hash(MyKeyExtractor(e)));
+	}
+	bool   empty() const { return nElem == freelist_size; }
+	size_t  size() const { return nElem -  freelist_size; }
+	size_t beg_i() const {
+		size_t i;
+		if (freelist_size == nElem)
+			i = nElem;
+		else if (freelist_size && delmark == m_nl.link(0))
+			i = next_i(0);
+		else
+			i = 0;
+		return i;
+	}
+	size_t  end_i() const { return nElem; }
+	size_t next_i(size_t idx) const {
+		size_t n = nElem;
+		TERARK_ASSERT_LT(idx, n);
+		do ++idx; while (idx < n && delmark == m_nl.link(idx));
+		return idx;
+	}
+	size_t prev_i(size_t idx) const {
+		TERARK_ASSERT_GT(idx, 0);
+		TERARK_ASSERT_LE(idx, nElem);
+		do --idx; while (idx > 0 && delmark == m_nl.link(idx));
+		return idx;
+	}
+	size_t max_size() const { return size_t(-1); }
+	size_t capacity() const { return maxElem; }
+	size_t delcnt() const { return freelist_size; }
+	size_t slot_num() const { return nSlot; }
+
+	      iterator  begin()       { return get_iter(beg_i()); }
+	const_iterator  begin() const { return get_iter(beg_i()); }
+	const_iterator cbegin() const { return get_iter(beg_i()); }
+
+	      iterator  end()       { return get_iter(nElem); }
+	const_iterator  end() const { return get_iter(nElem); }
+	const_iterator cend() const { return get_iter(nElem); }
+
+	      fast_iterator  fast_begin()       { return m_nl.begin(); }
+	const_fast_iterator  fast_begin() const { return m_nl.begin(); }
+	      fast_iterator  fast_end()       { return m_nl.begin() + nElem; }
+	const_fast_iterator  fast_end() const { return m_nl.begin() + nElem; }
+
+	template<class CompatibleObject>
+	std::pair<iterator, bool> insert(const CompatibleObject& obj) {
+		std::pair<size_t, bool> ib = insert_i(obj);
+		return std::pair<iterator, bool>(get_iter(ib.first), ib.second);
+	}
+	template<class... _Valty>
+	std::pair<iterator, bool> emplace(_Valty&&... _Val) {
+		std::pair<size_t, bool> ib =
+			insert_i(value_type(std::forward<_Valty>(_Val)...));
+		return std::pair<iterator, bool>(get_iter(ib.first), ib.second);
+	}
+
+	      iterator find(key_param_pass_t key)       { return get_iter(find_i(key)); }
+	const_iterator find(key_param_pass_t key) const { return get_iter(find_i(key)); }
+
+	// keep memory
+	void erase_all() {
+		if (nElem > freelist_size && !boost::has_trivial_destructor<Elem>::value) {
+			NodeLayout nl = m_nl;
+			for (size_t i = nElem; i > 0; --i)
+				if (delmark != nl.link(i-1))
+					nl.data(i-1).~Elem();
+		}
+		nElem = 0;
+		freelist_head = tail;
+		freelist_size = 0;
+		relink(); // reset all ctrl bytes as kEmpty
+	}
+
+	void erase(iterator iter) {
+		TERARK_ASSERT_EQ(iter.get_owner(), this);
+		erase_i(iter.get_index());
+	}
+
+	// freelist is always enabled!
+	// semantic of enable_freelist() is enabled and reuse!
+	void enable_freelist(bool e = true) { m_enable_freelist_reuse = e; }
+	void disable_freelist() { enable_freelist(false); }
+	bool is_freelist_enabled() const { return m_enable_freelist_reuse; }
+
+	// if return non-zero, all permanent id/index are invalidated
+	terark_no_inline
+	size_t revoke_deleted() {
+		if (0 == freelist_size)
+			return 0;
+		NodeLayout nl = m_nl;
+		size_t i = 0, n = nElem;
+		while (delmark != nl.link(i)) i++;
+		for (size_t j = i + 1; j < n; ++j)
+			if (delmark != nl.link(j))
+				CopyStrategy::move_cons(&nl.data(i), nl.data(j)), ++i;
+		nElem = LinkTp(i);
+		freelist_head = tail;
+		freelist_size = 0;
+		relink();
+		return n - i;
+	}
+	bool is_deleted(size_t idx) const {
+		TERARK_ASSERT_LT(idx, nElem);
+		return delmark == m_nl.link(idx);
+	}
+	bool freelist_is_empty() const { return 0 == freelist_size; }
+
+	template<class CompatibleObject>
+	std::pair<size_t, bool> insert_i(const CompatibleObject& obj) {
+		return lazy_insert_elem_i(MyKeyExtractor(obj), CopyConsFunc<CompatibleObject>(obj));
+	}
+	std::pair<size_t, bool> insert_i(const Elem& obj) {
+		return lazy_insert_elem_i(MyKeyExtractor(obj), CopyConsFunc<Elem>(obj));
+	}
+	template<class ConsElem>
+	std::pair<size_t, bool>
+	lazy_insert_elem_i(key_param_pass_t key, ConsElem cons_elem) {
+		const HashTp h = HashTp(HashEqual::hash(key));
+		return lazy_insert_elem_with_hash_i<ConsElem>(key, h, cons_elem);
+	}
+	template<class ConsElem>
+	std::pair<size_t, bool>
+	lazy_insert_elem_with_hash_i(key_param_pass_t key, HashTp h, ConsElem cons_elem) {
+		TERARK_ASSERT_EQ(HashEqual::hash(key), h);
+		const size_t m = mix_hash(h);
+		size_t found = probe(key, m);
+		if (found != nElem)
+			return std::make_pair(found, false);
+		if (terark_unlikely(0 == growth_left)) {
+			grow_for_insert();
+		}
+		size_t slot = risk_slot_alloc(); // here, no risk
+		cons_elem(&m_nl.data(slot)); // must success
+		set_pos(find_free_pos(m), m, slot);
+		return std::make_pair(slot, true);
+	}
+
+	///@{ low level operations
+	/// the caller should pay the risk for gain
+	///
+	LinkTp risk_slot_alloc() {
+		LinkTp slot;
+		if (0 == freelist_size) {
+			TERARK_ASSERT_EQ(freelist_head, tail);
+		  AllocNoReuse:
+			slot = nElem;
+			if (terark_unlikely(nElem == maxElem))
+				reserve_nodes(0 == nElem ? 1 : 2*nElem);
+			TERARK_ASSERT_LT(nElem, maxElem);
+			nElem++;
+		} else if (!m_enable_freelist_reuse) {
+			goto AllocNoReuse;
+		} else {
+			TERARK_ASSERT_LT(freelist_head, nElem);
+			TERARK_ASSERT_EQ(m_nl.link(freelist_head), delmark);
+			slot = freelist_head;
+			freelist_size--;
+			freelist_head = reinterpret_cast<LinkTp&>(m_nl.data(slot));
+		}
+		m_nl.link(slot) = tail; // for debug check&verify
+		return slot;
+	}
+	//@}
+
+	size_t find_i(key_param_pass_t key) const {
+		const HashTp h = HashTp(HashEqual::hash(key));
+		return find_with_hash_i(key, h);
+	}
+	size_t find_with_hash_i(key_param_pass_t key, HashTp h) const {
+		TERARK_ASSERT_EQ(HashEqual::hash(key), h);
+		return probe(key, mix_hash(h));
+	}
+	template<class CompatibleKey>
+	size_t find_i(const CompatibleKey& key) const {
+		const HashTp h = HashTp(HashEqual::hash(key));
+		return find_with_hash_i(key, h);
+	}
+	template<class CompatibleKey>
+	size_t find_with_hash_i(const CompatibleKey& key, HashTp h) const {
+		TERARK_ASSERT_EQ(HashEqual::hash(key), h);
+		return probe(key, mix_hash(h));
+	}
+
+	// return erased element count
+	size_t erase(key_param_pass_t key) {
+		size_t idx = find_i(key);
+		if (idx == nElem)
+			return 0;
+		erase_i(idx);
+		return 1;
+	}
+
+	// erase and get the erasing element by get_val
+	template<class GetValue>
+	size_t erase(key_param_pass_t key, GetValue get_val) {
+		size_t idx = find_i(key);
+		if (idx == nElem)
+			return 0;
+		get_val(std::move(m_nl.data(idx)));
+		erase_i(idx);
+		return 1;
+	}
+
+	size_t count(key_param_pass_t key) const {
+		return find_i(key) == nElem ? 0 : 1;
+	}
+	bool exists(key_param_pass_t key) const {
+		return find_i(key) != nElem;
+	}
+	bool contains(key_param_pass_t key) const { // synonym of exists
+		return find_i(key) != nElem;
+	}
+
+private:
+	template<class CompatibleKey>
+	size_t probe(const CompatibleKey& key, size_t m) const {
+		const byte_t h2 = h2_of(m);
+		size_t g = (m >> 7) & m_gmask;
+		for (size_t step = 0; ; ) {
+			const byte_t* ctrl = m_ctrl + g * Group::Width;
+			for (uint32_t bits = Group::match(ctrl, h2); bits; bits &= bits - 1) {
+				size_t p = m_slot[g * Group::Width + fast_ctz(bits)];
+				TERARK_ASSERT_LT(p, nElem);
+				if (HashEqual::equal(key, MyKeyExtractor(m_nl.data(p))))
+					TOPLING_ASSUME_RETURN(p, < nElem);
+			}
+			if (terark_likely(Group::match_empty(ctrl)))
+				return nElem; // not found
+			g = (g + ++step) & m_gmask;
+		}
+	}
+
+	// use erased elem as free list link
+	HSM_FORCE_INLINE void fast_slot_free(size_t slot) {
+		m_nl.link(slot) = delmark;
+		m_nl.data(slot).~Elem();
+		reinterpret_cast<LinkTp&>(m_nl.data(slot)) = freelist_head;
+		freelist_size++;
+		freelist_head = LinkTp(slot);
+	}
+
+public:
+	void erase_i(const size_t idx) {
+		TERARK_ASSERT_GE(nElem, 1);
+		TERARK_ASSERT_LT(idx, nElem);
+		TERARK_ASSERT_NE(delmark, m_nl.link(idx));
+		TERARK_ASSERT_EQ(m_slot[m_nl.link(idx)], idx);
+		clear_pos(m_nl.link(idx));
+		fast_slot_free(idx);
+	}
+
+	const Key& key(size_t idx) const {
+		TERARK_ASSERT_LT(idx, nElem);
+		TERARK_ASSERT_NE(delmark, m_nl.link(idx));
+		return MyKeyExtractor(m_nl.data(idx));
+	}
+	const Elem& elem_at(size_t idx) const {
+		TERARK_ASSERT_LT(idx, nElem);
+		TERARK_ASSERT_NE(delmark, m_nl.link(idx));
+		return m_nl.data(idx);
+	}
+	Elem& elem_at(size_t idx) {
+		TERARK_ASSERT_LT(idx, nElem);
+		TERARK_ASSERT_NE(delmark, m_nl.link(idx));
+		return m_nl.data(idx);
+	}
+
+	template<class OP>
+	void for_each(OP op) {
+		NodeLayout nl = m_nl;
+		for (size_t i = 0, n = nElem; i != n; ++i)
+			if (0 == freelist_size || delmark != nl.link(i))
+				op(nl.data(i));
+	}
+	template<class OP>
+	void for_each(OP op) const {
+		const NodeLayout nl = m_nl;
+		for (size_t i = 0, n = nElem; i != n; ++i)
+			if (0 == freelist_size || delmark != nl.link(i))
+				op(nl.data(i));
+	}
+
+	/// histogram of probed group num of all elems, for tuning hash func
+	template<class IntVec>
+	void probe_histogram(IntVec& hist) const {
+		for (size_t i = beg_i(); i < nElem; i = next_i(i)) {
+			size_t m = mix_hash(hash_i(i));
+			size_t g = (m >> 7) & m_gmask, g_end = m_nl.link(i) / Group::Width;
+			size_t len = 1;
+			for (size_t step = 0; g != g_end; ++len)
+				g = (g + ++step) & m_gmask;
+			if (hist.size() <= len)
+				hist.resize(len+1);
+			hist[len]++;
+		}
+	}
+
+protected:
+	// format is compatible with gold_hash_tab, the table is not saved,
+	// it is rebuilt by rehash on load
+	template<class DataIO> void dio_load(DataIO& dio) {
+		typename DataIO::my_var_uint64_t Size;
+		dio >> Size;
+		this->clear();
+		this->reserve_nodes(Size.t);
+		for (size_t i = 0, n = Size.t; i < n; ++i) {
+			Elem& e = m_nl.data(i); // uninitialized
+			new(&e)Elem(); // default cons
+			dio >> e;
+			m_nl.link(i) = tail;
+			this->nElem = LinkTp(i + 1); // for exception safe
+		}
+		this->rehash(slots_for(Size.t));
+	}
+	template<class DataIO> void dio_save(DataIO& dio) const {
+		dio << typename DataIO::my_var_uint64_t(this->size());
+		for (size_t i = 0, n = this->end_i(); i < n; ++i)
+			if (0 == freelist_size || !this->is_deleted(i))
+				dio << m_nl.data(i);
+	}
+
+	template<class DataIO>
+	friend void DataIO_loadObject(DataIO& dio, gold_swiss_tab& x) {
+		x.dio_load(dio);
+	}
+	template<class DataIO>
+	friend void DataIO_saveObject(DataIO& dio, const gold_swiss_tab& x) {
+		x.dio_save(dio);
+	}
+#undef MyKeyExtractor
+};
+
+template< class Key
+		, class Value
+		, class HashFunc = DEFAULT_HASH_FUNC<Key>
+		, class KeyEqual = std::equal_to<Key>
+		, class NodeLayout = node_layout<std::pair<Key, Value>, unsigned>
+		, class HashTp = size_t
+		>
+class gold_swiss_map : public
+	gold_swiss_tab<Key, std::pair<Key, Value>
+		, hash_and_equal<Key, HashFunc, KeyEqual>, terark_get_first<Key>
+		, NodeLayout
+		, HashTp
+		>
+{
+	typedef
+	gold_swiss_tab<Key, std::pair<Key, Value>
+		, hash_and_equal<Key, HashFunc, KeyEqual>, terark_get_first<Key>
+		, NodeLayout
+		, HashTp
+		>
+	super;
+public:
+	typedef typename super::key_param_pass_t key_param_pass_t;
+	typedef Value mapped_type;
+	using super::super;
+	using super::insert_i;
+	std::pair<size_t, bool>
+	insert_i(key_param_pass_t key, const Value& val) {
+		return this->insert_i(std::make_pair(key, val));
+	}
+	std::pair<size_t, bool>
+	insert_i(key_param_pass_t key) {
+		return this->lazy_insert_i(key, &default_cons<Value>);
+	}
+	template<class ConsValue>
+	std::pair<size_t, bool>
+	lazy_insert_i(key_param_pass_t key, const ConsValue& cons) {
+		return this->lazy_insert_elem_i(key, [&](std::pair<Key, Value>* kv_mem) {
+			new(&kv_mem->first) Key(key);
+			cons(&kv_mem->second); // if cons fail, key will be leaked
+		});
+	}
+	template<class ConsValue>
+	std::pair<size_t, bool>
+	lazy_insert_with_hash_i(key_param_pass_t key, HashTp h,
+							const ConsValue& cons) {
+		return this->lazy_insert_elem_with_hash_i(key, h,
+		[&](std::pair<Key, Value>* kv_mem) {
+			new(&kv_mem->first) Key(key);
+			cons(&kv_mem->second); // if cons fail, key will be leaked
+		});
+	}
+
+	Value& operator[](key_param_pass_t key) {
+		std::pair<size_t, bool> ib = this->insert_i(key);
+		return this->m_nl.data(ib.first).second;
+	}
+	Value& at(key_param_pass_t key) {
+		size_t idx = this->find_i(key);
+		if (this->end_i() != idx)
+			return this->m_nl.data(idx).second;
+		else
+			throw std::out_of_range(BOOST_CURRENT_FUNCTION);
+	}
+	const Value& at(key_param_pass_t key) const {
+		size_t idx = this->find_i(key);
+		if (this->end_i() != idx)
+			return this->m_nl.data(idx).second;
+		else
+			throw std::out_of_range(BOOST_CURRENT_FUNCTION);
+	}
+	Value& val(size_t idx) {
+		TERARK_ASSERT_LT(idx, this->nElem);
+		TERARK_ASSERT_NE(this->delmark, this->m_nl.link(idx));
+		return this->m_nl.data(idx).second;
+	}
+	const Value& val(size_t idx) const {
+		TERARK_ASSERT_LT(idx, this->nElem);
+		TERARK_ASSERT_NE(this->delmark, this->m_nl.link(idx));
+		return this->m_nl.data(idx).second;
+	}
+
+	using super::erase;
+	size_t erase(key_param_pass_t key, Value* erased) {
+		return super::erase(key, [erased](std::pair<Key, Value>&& kv) {
+			*erased = std::move(kv.second);
+		});
+	}
+
+// DataIO support
+	template<class DataIO>
+	friend void DataIO_loadObject(DataIO& dio, gold_swiss_map& x) {
+		x.dio_load(dio);
+	}
+	template<class DataIO>
+	friend void DataIO_saveObject(DataIO& dio, const gold_swiss_map& x) {
+		x.dio_save(dio);
+	}
+};
+
+template< class Key
+		, class HashFunc = DEFAULT_HASH_FUNC<Key>
+		, class KeyEqual = std::equal_to<Key>
+		, class NodeLayout = node_layout<Key, unsigned>
+		, class HashTp = size_t
+		>
+class gold_swiss_set : public
+	gold_swiss_tab<Key, Key
+		, hash_and_equal<Key, HashFunc, KeyEqual>, terark_identity<Key>
+		, NodeLayout, HashTp
+		>
+{
+	using super = gold_swiss_tab<Key, Key
+		, hash_and_equal<Key, HashFunc, KeyEqual>, terark_identity<Key>
+		, NodeLayout, HashTp
+		>;
+public:
+	using super::super;
+// DataIO support
+	template<class DataIO>
+	friend void DataIO_loadObject(DataIO& dio, gold_swiss_set& x) {
+		x.dio_load(dio);
+	}
+	template<class DataIO>
+	friend void DataIO_saveObject(DataIO& dio, const gold_swiss_set& x) {
+		x.dio_save(dio);
+	}
+};
+
+} // namespace terark
+
+#if defined(__GNUC__) && __GNUC_MINOR__ + 1000 * __GNUC__ > 7000
+  #pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,604 @@
+/* vim: set tabstop=4 : */
+#include "AsyncFileStream.hpp"
+
+#if !defined(_MSC_VER)
+
+#include <terark/num_to_str.hpp>
+#include <terark/util/throw.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// same as fiber_aio.cpp
+#if defined(__linux__)
+  #include <linux/version.h>
+  #if defined(TOPLING_IO_WITH_URING)
+    #if TOPLING_IO_WITH_URING // mandatory io uring
+      #include <liburing.h>
+      #define TOPLING_IO_HAS_URING
+    #endif
+  #elif LINUX_VERSION_CODE >= KERNEL_VERSION(5,1,0)
+    #include <liburing.h>
+    #define TOPLING_IO_HAS_URING
+  #endif
+#endif
+
+#if !defined(O_DIRECT)
+  #define O_DIRECT 0
+#endif
+
+namespace terark {
+
+static bool g_useUring = getEnvBool("AsyncFileStream_useUring", true);
+
+// complete a request synchronously from done bytes, a read does just one
+// pread, a short read is completed by AsyncFileStreamBase::wait() up to
+// the file size, it is never retried at EOF where the offset would be
+// unaligned for O_DIRECT
+static intptr_t AsyncFileSyncIO(int fd, AsyncFileSlot* s, size_t done) {
+	while (done < s->len) {
+		ssize_t n;
+		if (s->is_write)
+			n = ::pwrite(fd, s->buf + done, s->len - done, s->offset + done);
+		else
+			n = ::pread(fd, s->buf + done, s->len - done, s->offset + done);
+		if (n < 0) {
+			if (EINTR == errno)
+				continue;
+			return -errno;
+		}
+		if (0 == n) {
+			if (s->is_write)
+				return -EIO;
+			break; // EOF
+		}
+		done += n;
+		if (!s->is_write)
+			break;
+	}
+	return intptr_t(done);
+}
+
+class AsyncFileEngine {
+public:
+	virtual ~AsyncFileEngine() {}
+	virtual bool is_uring() const = 0;
+	virtual void submit(int fd, AsyncFileSlot*) = 0;
+	// wait until slot->done, returns true if it really blocked
+	virtual bool wait(AsyncFileSlot*) = 0;
+};
+
+// fallback when io uring is not available: one io thread per stream, it
+// is enough for write behind and read ahead of one sequential stream
+class AsyncFileThreadEngine : public AsyncFileEngine {
+	std::mutex m_mtx;
+	std::condition_variable m_req_cond;
+	std::condition_variable m_done_cond;
+	std::deque<std::pair<int, AsyncFileSlot*> > m_queue;
+	bool m_stop = false;
+	std::thread m_thr;
+	void run() {
+		std::unique_lock<std::mutex> lock(m_mtx);
+		for (;;) {
+			while (m_queue.empty() && !m_stop)
+				m_req_cond.wait(lock);
+			if (m_queue.empty())
+				break;
+			auto req = m_queue.front();
+			m_queue.pop_front();
+			lock.unlock();
+			intptr_t result = AsyncFileSyncIO(req.first, req.second, 0);
+			lock.lock();
+			req.second->result = result;
+			req.second->done = true;
+			m_done_cond.notify_all();
+		}
+	}
+public:
+	AsyncFileThreadEngine() {
+		m_thr = std::thread(&AsyncFileThreadEngine::run, this);
+	}
+	~AsyncFileThreadEngine() override {
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_stop = true;
+		}
+		m_req_cond.notify_one();
+		m_thr.join();
+	}
+	bool is_uring() const override { return false; }
+	void submit(int fd, AsyncFileSlot* s) override {
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_queue.emplace_back(fd, s);
+		}
+		m_req_cond.notify_one();
+	}
+	bool wait(AsyncFileSlot* s) override {
+		std::unique_lock<std::mutex> lock(m_mtx);
+		bool blocked = !s->done;
+		while (!s->done)
+			m_done_cond.wait(lock);
+		return blocked;
+	}
+};
+
+#if defined(TOPLING_IO_HAS_URING)
+class AsyncFileUringEngine : public AsyncFileEngine {
+	io_uring m_ring;
+public:
+	int init(unsigned queue_depth) {
+		return io_uring_queue_init(queue_depth, &m_ring, 0);
+	}
+	~AsyncFileUringEngine() override {
+		io_uring_queue_exit(&m_ring);
+	}
+	bool is_uring() const override { return true; }
+	void submit(int fd, AsyncFileSlot* s) override {
+		// queue depth >= numBufs >= requests in flight
+		io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+		TERARK_VERIFY(nullptr != sqe);
+		int cmd = s->is_write ? IORING_OP_WRITE : IORING_OP_READ;
+		io_uring_prep_rw(cmd, sqe, fd, s->buf, unsigned(s->len), s->offset);
+		io_uring_sqe_set_data(sqe, s);
+		int ret = io_uring_submit(&m_ring);
+		if (ret < 0) {
+			errno = -ret;
+			TERARK_THROW(IOException, "io_uring_submit(fd=%d, len=%zd, offset=%lld)",
+						 fd, s->len, s->offset);
+		}
+	}
+	bool wait(AsyncFileSlot* s) override {
+		bool blocked = !s->done;
+		while (!s->done) {
+			io_uring_cqe* cqe = nullptr;
+			int ret = io_uring_wait_cqe(&m_ring, &cqe);
+			if (ret < 0) {
+				if (-EINTR == ret)
+					continue;
+				errno = -ret;
+				TERARK_THROW(IOException, "io_uring_wait_cqe");
+			}
+			auto done = (AsyncFileSlot*)io_uring_cqe_get_data(cqe);
+			done->result = cqe->res;
+			done->done = true;
+			io_uring_cqe_seen(&m_ring, cqe);
+		}
+		return blocked;
+	}
+};
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+AsyncFileStreamBase::AsyncFileStreamBase(size_t bufSize, int numBufs) {
+	m_fd = -1;
+	m_own_fd = false;
+	m_direct = false;
+	m_align = 4096;
+	m_buf_size = align_up(std::max<size_t>(bufSize, m_align), m_align);
+	// m_align is reset to 1 by init_fd if not O_DIRECT
+	m_cur = 0;
+	m_fsize = 0;
+	m_engine = nullptr;
+	m_submit_cnt = 0;
+	m_wait_cnt = 0;
+	m_slots.resize(std::max(numBufs, 2));
+	for (auto& s : m_slots) {
+		memset(&s, 0, sizeof(s));
+		void* mem = nullptr;
+		int err = posix_memalign(&mem, 4096, m_buf_size);
+		TERARK_VERIFY_F(0 == err, "posix_memalign(4096, %zd) = %s",
+						m_buf_size, strerror(err));
+		s.buf = (byte_t*)mem;
+	}
+}
+
+AsyncFileStreamBase::~AsyncFileStreamBase() {
+	if (m_fd >= 0 && m_own_fd) {
+		::close(m_fd); // derived constructor throws after init_fd
+	}
+	delete m_engine;
+	for (auto& s : m_slots) {
+		free(s.buf);
+	}
+}
+
+void AsyncFileStreamBase::init_fd(fstring fpath, int flags, bool direct) {
+	flags |= O_CLOEXEC;
+	if (direct && O_DIRECT) {
+		m_fd = ::open(fpath.c_str(), flags | O_DIRECT, 0644);
+		if (m_fd >= 0)
+			m_direct = true;
+		else if (EINVAL != errno)
+			throw OpenFileException(fpath.c_str(), strerror(errno));
+		// EINVAL: fs does not support O_DIRECT, fallback to buffered io
+	}
+	if (m_fd < 0) {
+		m_fd = ::open(fpath.c_str(), flags, 0644);
+		if (m_fd < 0)
+			throw OpenFileException(fpath.c_str(), strerror(errno));
+	}
+	m_own_fd = true;
+	if (!m_direct)
+		m_align = 1; // buffers are still 4K aligned
+	init_engine();
+}
+
+void AsyncFileStreamBase::init_fd(int fd) {
+	TERARK_VERIFY_GE(fd, 0);
+	m_fd = fd;
+	m_own_fd = false;
+	int flags = fcntl(fd, F_GETFL);
+	m_direct = O_DIRECT && flags >= 0 && (flags & O_DIRECT);
+	if (!m_direct)
+		m_align = 1;
+	init_engine();
+}
+
+void AsyncFileStreamBase::init_engine() {
+#if defined(TOPLING_IO_HAS_URING)
+	if (g_useUring) {
+		auto uring = new AsyncFileUringEngine();
+		int ret = uring->init((unsigned)m_slots.size());
+		if (0 == ret) {
+			m_engine = uring;
+			return;
+		}
+		// old kernel or io uring is disabled by seccomp
+		fprintf(stderr,
+			"WARN: AsyncFileStream: io_uring_queue_init(%zd) = %s, fallback to io thread\n",
+			m_slots.size(), strerror(-ret));
+		delete uring;
+	}
+#endif
+	m_engine = new AsyncFileThreadEngine();
+}
+
+bool AsyncFileStreamBase::isUring() const noexcept {
+	return m_engine && m_engine->is_uring();
+}
+
+void AsyncFileStreamBase::submit(AsyncFileSlot& s) {
+	assert(!s.busy);
+	s.result = 0;
+	s.done = false;
+	s.busy = true;
+	m_engine->submit(m_fd, &s);
+	m_submit_cnt++;
+}
+
+void AsyncFileStreamBase::wait(AsyncFileSlot& s) {
+	if (!s.busy)
+		return;
+	if (m_engine->wait(&s))
+		m_wait_cnt++;
+	s.busy = false;
+	if (s.is_write && s.result >= 0 && size_t(s.result) < s.len) {
+		// short write, can happen on io uring
+		s.result = AsyncFileSyncIO(m_fd, &s, size_t(s.result));
+	}
+	// short read before EOF, can happen on io uring or by signals
+	while (!s.is_write && s.result > 0 && size_t(s.result) < s.len &&
+			s.offset + s.result < m_fsize) {
+		intptr_t done = s.result;
+		s.result = AsyncFileSyncIO(m_fd, &s, size_t(done));
+		if (s.result == done)
+			break; // file is truncated, checked by reader
+	}
+	if (s.result < 0) {
+		errno = int(-s.result);
+		TERARK_THROW(IOException, "%s(fd=%d, len=%zd, offset=%lld)",
+					 s.is_write ? "pwrite" : "pread", m_fd, s.len, s.offset);
+	}
+}
+
+void AsyncFileStreamBase::wait_all() {
+	// wait all before throwing, buffers must not be in flight on destroy
+	const char* err = nullptr;
+	std::string msg;
+	for (auto& s : m_slots) {
+		try {
+			wait(s);
+		}
+		catch (const IOException& ex) {
+			if (!err)
+				msg = ex.what(), err = msg.c_str();
+		}
+	}
+	if (err) {
+		throw IOException(err);
+	}
+}
+
+void AsyncFileStreamBase::close_fd() {
+	if (m_fd >= 0) {
+		int fd = m_fd;
+		m_fd = -1;
+		if (m_own_fd && ::close(fd) < 0) {
+			TERARK_THROW(IOException, "close(fd=%d)", fd);
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+AsyncFileOutputStream::AsyncFileOutputStream(fstring fpath, size_t bufSize,
+											 int numBufs, bool direct)
+  : AsyncFileStreamBase(bufSize, numBufs) {
+	init_fd(fpath, O_WRONLY|O_CREAT|O_TRUNC, direct);
+	m_pos = m_base = 0;
+	m_len = m_flushed = 0;
+	m_oldsize = 0;
+}
+
+AsyncFileOutputStream::AsyncFileOutputStream(int fd, llong startPos,
+											 size_t bufSize, int numBufs)
+  : AsyncFileStreamBase(bufSize, numBufs) {
+	init_fd(fd);
+	struct stat st;
+	if (::fstat(fd, &st) < 0) {
+		TERARK_THROW(IOException, "fstat(fd=%d)", fd);
+	}
+	m_oldsize = st.st_size;
+	m_pos = startPos;
+	m_base = align_down(startPos, m_align);
+	m_len = size_t(startPos - m_base);
+	if (m_len) {
+		// O_DIRECT and startPos is not aligned, load head of the block
+		AsyncFileSlot& s = m_slots[0];
+		s.len = m_align;
+		s.offset = m_base;
+		s.is_write = false;
+		intptr_t n = AsyncFileSyncIO(m_fd, &s, 0);
+		if (n < intptr_t(m_len)) {
+			TERARK_THROW(IOException, "pread(fd=%d, len=%zd, offset=%lld) = %zd",
+						 m_fd, m_align, m_base, n);
+		}
+	}
+	m_flushed = m_len;
+}
+
+AsyncFileOutputStream::~AsyncFileOutputStream() {
+	if (m_fd >= 0) {
+		try {
+			close();
+		}
+		catch (const std::exception& ex) {
+			fprintf(stderr, "ERROR: %s: %s\n", BOOST_CURRENT_FUNCTION, ex.what());
+		}
+	}
+}
+
+void AsyncFileOutputStream::submit_cur() {
+	AsyncFileSlot& s = m_slots[m_cur];
+	size_t len = m_len;
+	size_t keep = len % m_align; // tail which is not aligned
+	s.len = align_up(len, m_align);
+	s.offset = m_base;
+	s.is_write = true;
+	if (keep && llong(m_base + len) < m_oldsize) {
+		// O_DIRECT overwrites existing data, padding must keep the data
+		AsyncFileSlot tail = s;
+		tail.buf = s.buf + (len - keep);
+		tail.len = m_align;
+		tail.offset = m_base + (len - keep);
+		tail.is_write = false;
+		byte_t head[4096]; // keep < m_align == 4096
+		memcpy(head, tail.buf, keep);
+		intptr_t n = AsyncFileSyncIO(m_fd, &tail, 0);
+		if (n < 0) {
+			errno = int(-n);
+			TERARK_THROW(IOException, "pread(fd=%d, len=%zd, offset=%lld)",
+						 m_fd, m_align, tail.offset);
+		}
+		memset(tail.buf + n, 0, m_align - n);
+		memcpy(tail.buf, head, keep);
+	}
+	else {
+		memset(s.buf + len, 0, s.len - len); // padding for O_DIRECT
+	}
+	submit(s);
+	m_cur = (m_cur + 1) % m_slots.size();
+	AsyncFileSlot& next = m_slots[m_cur];
+	wait(next);
+	m_base += len - keep;
+	m_len = m_flushed = keep;
+	if (keep) {
+		// the tail is rewritten by next slot, called by flush/close which
+		// wait all before next submit, so the two writes are not reordered
+		memcpy(next.buf, s.buf + (len - keep), keep);
+	}
+}
+
+size_t AsyncFileOutputStream::write(const void* vbuf, size_t len) {
+	TERARK_ASSERT_GE(m_fd, 0);
+	auto buf = (const byte_t*)vbuf;
+	size_t remain = len;
+	while (remain) {
+		AsyncFileSlot& s = m_slots[m_cur];
+		size_t n = std::min(remain, m_buf_size - m_len);
+		memcpy(s.buf + m_len, buf, n);
+		m_len += n;
+		buf += n;
+		remain -= n;
+		if (m_buf_size == m_len)
+			submit_cur();
+	}
+	m_pos += len;
+	return len;
+}
+
+void AsyncFileOutputStream::flush() {
+	TERARK_ASSERT_GE(m_fd, 0);
+	if (m_len > m_flushed) {
+		submit_cur();
+	}
+	wait_all();
+}
+
+void AsyncFileOutputStream::close() {
+	TERARK_VERIFY_GE(m_fd, 0);
+	try {
+		flush();
+	}
+	catch (...) {
+		close_fd();
+		throw;
+	}
+	llong fsize = std::max(m_pos, m_oldsize);
+	if (m_direct && fsize % m_align) {
+		// remove padding of last block
+		struct stat st;
+		if (::fstat(m_fd, &st) == 0 && st.st_size > fsize &&
+				st.st_size <= align_up(fsize, m_align)) {
+			if (::ftruncate(m_fd, fsize) < 0) {
+				int fd = m_fd;
+				close_fd();
+				TERARK_THROW(IOException, "ftruncate(fd=%d, size=%lld)", fd, fsize);
+			}
+		}
+	}
+	close_fd();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+AsyncFileInputStream::AsyncFileInputStream(fstring fpath, size_t bufSize,
+										   int numBufs, bool direct)
+  : AsyncFileStreamBase(bufSize, numBufs) {
+	init_fd(fpath, O_RDONLY, direct);
+	m_pos = 0;
+	init();
+}
+
+AsyncFileInputStream::AsyncFileInputStream(int fd, llong startPos,
+										   size_t bufSize, int numBufs)
+  : AsyncFileStreamBase(bufSize, numBufs) {
+	init_fd(fd);
+	m_pos = startPos;
+	init();
+}
+
+void AsyncFileInputStream::init() {
+	struct stat st;
+	if (::fstat(m_fd, &st) < 0) {
+		int fd = m_fd;
+		close_fd();
+		TERARK_THROW(IOException, "fstat(fd=%d)", fd);
+	}
+	m_fsize = st.st_size;
+	m_eof = m_pos >= m_fsize;
+	m_next = m_direct ? align_down(m_pos, m_align) : m_pos;
+	m_skip = size_t(m_pos - m_next); // head of first block
+	m_rpos = m_rlen = 0;
+	m_cur = m_slots.size() - 1; // next_buf() starts from slot 0
+	for (auto& s : m_slots) {
+		if (m_next >= m_fsize)
+			break;
+		submit_next(s);
+	}
+}
+
+AsyncFileInputStream::~AsyncFileInputStream() {
+	if (m_fd >= 0) {
+		try {
+			close();
+		}
+		catch (const std::exception& ex) {
+			fprintf(stderr, "ERROR: %s: %s\n", BOOST_CURRENT_FUNCTION, ex.what());
+		}
+	}
+}
+
+void AsyncFileInputStream::submit_next(AsyncFileSlot& s) {
+	s.len = m_buf_size;
+	s.offset = m_next;
+	s.is_write = false;
+	submit(s);
+	m_next += m_buf_size;
+}
+
+bool AsyncFileInputStream::next_buf() {
+	if (m_rlen) {
+		// current buffer is consumed, reuse it for read ahead
+		if (m_next < m_fsize)
+			submit_next(m_slots[m_cur]);
+		m_rpos = m_rlen = 0;
+	}
+	if (m_eof)
+		return false;
+	m_cur = (m_cur + 1) % m_slots.size();
+	AsyncFileSlot& s = m_slots[m_cur];
+	if (!s.busy) {
+		m_eof = true;
+		return false;
+	}
+	wait(s);
+	if (size_t(s.result) < s.len && s.offset + s.result < m_fsize) {
+		TERARK_THROW(IOException,
+			"pread(fd=%d, len=%zd, offset=%lld) = %zd, file is truncated, fsize was %lld",
+			m_fd, s.len, s.offset, size_t(s.result), m_fsize);
+	}
+	size_t skip = m_skip;
+	m_skip = 0;
+	if (size_t(s.result) <= skip) {
+		m_eof = true;
+		return false;
+	}
+	m_rpos = skip;
+	m_rlen = size_t(s.result);
+	return true;
+}
+
+size_t AsyncFileInputStream::read(void* vbuf, size_t len) {
+	TERARK_ASSERT_GE(m_fd, 0);
+	auto buf = (byte_t*)vbuf;
+	size_t got = 0;
+	while (got < len) {
+		if (m_rpos == m_rlen && !next_buf()) {
+			break;
+		}
+		AsyncFileSlot& s = m_slots[m_cur];
+		size_t n = std::min(len - got, m_rlen - m_rpos);
+		memcpy(buf + got, s.buf + m_rpos, n);
+		m_rpos += n;
+		got += n;
+	}
+	m_pos += got;
+	if (len && 0 == got)
+		m_eof = true;
+	return got;
+}
+
+void AsyncFileInputStream::ensureRead(void* buf, size_t len) {
+	size_t n = read(buf, len);
+	if (n != len) {
+		throw EndOfFileException(ExceptionFormatString(
+			"AsyncFileInputStream::ensureRead(len=%zd) = %zd, pos=%lld, fsize=%lld",
+			len, n, m_pos, m_fsize));
+	}
+}
+
+void AsyncFileInputStream::close() {
+	TERARK_VERIFY_GE(m_fd, 0);
+	try {
+		wait_all();
+	}
+	catch (...) {
+		close_fd();
+		throw;
+	}
+	close_fd();
+}
+
+} // namespace terark
+
+#endif // _MSC_VER
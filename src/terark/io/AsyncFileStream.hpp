@@ -0,0 +1,139 @@
+/* vim: set tabstop=4 : */
+#pragma once
+
+#include <terark/stdtypes.hpp>
+#include <terark/util/refcount.hpp>
+#include <terark/fstring.hpp>
+#include <terark/valvec.hpp>
+#include "IOException.hpp"
+#include "IStream.hpp"
+
+namespace terark {
+
+class AsyncFileEngine; // io uring or an io thread, defined in cpp
+struct AsyncFileSlot {
+	byte_t* buf;
+	size_t  len;     // request len, multiple of align if O_DIRECT
+	llong   offset;  // file offset
+	intptr_t result; // bytes read/written or -errno
+	bool    is_write;
+	bool    busy;    // submitted and not waited
+	volatile bool done;
+};
+
+/// Common part of AsyncFileOutputStream and AsyncFileInputStream:
+/// a ring of numBufs buffers of bufSize, each buffer is an io request,
+/// at most numBufs requests are in flight.
+///
+/// io requests are submitted by io uring if it is compiled in and the
+/// kernel supports it, else by a dedicated io thread per stream.
+/// env AsyncFileStream_useUring=0 forces the io thread.
+///
+/// If direct is true, file is opened with O_DIRECT, the buffers and
+/// requests are aligned to 4K, if O_DIRECT is not supported by the file
+/// system, it silently falls back to buffered io, check isDirect().
+class TERARK_DLL_EXPORT AsyncFileStreamBase : public RefCounter {
+	DECLARE_NONE_COPYABLE_CLASS(AsyncFileStreamBase)
+protected:
+	int    m_fd;
+	bool   m_own_fd;
+	bool   m_direct;
+	size_t m_buf_size;
+	size_t m_align;
+	size_t m_cur; // index of current slot
+	llong  m_fsize; // reads are completed up to it, 0 for output
+	valvec<AsyncFileSlot> m_slots;
+	AsyncFileEngine* m_engine;
+	size_t m_submit_cnt;
+	size_t m_wait_cnt; // number of waits which really blocked
+
+	AsyncFileStreamBase(size_t bufSize, int numBufs);
+	~AsyncFileStreamBase() override;
+	void init_fd(fstring fpath, int flags, bool direct);
+	void init_fd(int fd);
+	void init_engine();
+	void submit(AsyncFileSlot&);
+	void wait(AsyncFileSlot&);
+	void wait_all();
+	void close_fd();
+
+public:
+	bool isOpen() const noexcept { return m_fd >= 0; }
+	int  fd() const noexcept { return m_fd; }
+	bool isDirect() const noexcept { return m_direct; }
+	bool isUring() const noexcept;
+	size_t bufSize() const noexcept { return m_buf_size; }
+	size_t numBufs() const noexcept { return m_slots.size(); }
+	size_t submitCnt() const noexcept { return m_submit_cnt; }
+	size_t waitCnt() const noexcept { return m_wait_cnt; }
+};
+
+/// Write behind output stream, write() copies data into current buffer,
+/// a full buffer is submitted and write() goes on with next buffer, it
+/// blocks only when all buffers are in flight.
+///
+/// flush() submits the partial buffer and waits all requests, data is in
+/// page cache(or on device if O_DIRECT) after flush(), no fsync.
+/// close() is called by destructor, it throws on io error, so call close()
+/// explicitly if errors are needed to be handled.
+class TERARK_DLL_EXPORT AsyncFileOutputStream
+	: public AsyncFileStreamBase, public IOutputStream
+{
+	llong  m_pos; // logical file size
+	size_t m_len; // data len in current buffer
+	size_t m_flushed; // m_len when current buffer was written by flush
+	llong  m_base; // file offset of current buffer
+	llong  m_oldsize; // file size on attach, 0 for fpath ctor(O_TRUNC)
+	void submit_cur();
+public:
+	explicit
+	AsyncFileOutputStream(fstring fpath, size_t bufSize = 1<<20,
+						  int numBufs = 4, bool direct = false);
+	/// fd is not owned, file offset of fd is not used nor changed,
+	/// writing starts at startPos by pwrite, direct is implied by fd flags
+	explicit
+	AsyncFileOutputStream(int fd, llong startPos = 0,
+						  size_t bufSize = 1<<20, int numBufs = 4);
+	~AsyncFileOutputStream() override;
+
+	size_t write(const void* buf, size_t len) override;
+	void ensureWrite(const void* buf, size_t len) { write(buf, len); }
+	void flush() override;
+	void close();
+	llong tell() const noexcept { return m_pos; }
+};
+
+/// Read ahead input stream for sequential read, numBufs requests are kept
+/// in flight ahead of the reader, read() blocks only when the buffer to be
+/// consumed is not completed yet.
+class TERARK_DLL_EXPORT AsyncFileInputStream
+	: public AsyncFileStreamBase, public IInputStream
+{
+	llong  m_pos;   // logical read pos
+	llong  m_next;  // file offset of next request to submit
+	size_t m_rpos;  // read pos in current buffer
+	size_t m_rlen;  // data len in current buffer
+	size_t m_skip;  // unaligned startPos with O_DIRECT
+	bool   m_eof;
+	void init();
+	void submit_next(AsyncFileSlot&);
+	bool next_buf();
+public:
+	explicit
+	AsyncFileInputStream(fstring fpath, size_t bufSize = 1<<20,
+						 int numBufs = 4, bool direct = false);
+	/// fd is not owned, reading starts at startPos by pread
+	explicit
+	AsyncFileInputStream(int fd, llong startPos = 0,
+						 size_t bufSize = 1<<20, int numBufs = 4);
+	~AsyncFileInputStream() override;
+
+	size_t read(void* buf, size_t len) override;
+	void ensureRead(void* buf, size_t len);
+	bool eof() const override { return m_eof; }
+	void close();
+	llong tell() const noexcept { return m_pos; }
+	llong fsize() const noexcept { return m_fsize; }
+};
+
+} // namespace terark
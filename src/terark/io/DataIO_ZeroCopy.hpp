@@ -0,0 +1,230 @@
+/* vim: set tabstop=4 : */
+#pragma once
+
+#include <terark/valvec.hpp>
+#include <terark/pass_by_value.hpp>
+#include <terark/util/function.hpp> // for MemType
+#include <terark/util/mmap.hpp>
+#include <terark/util/fstrvec.hpp>
+#include <terark/util/sortable_strvec.hpp>
+#include "DataIO.hpp"
+#include "MemStream.hpp"
+#include <type_traits>
+
+namespace terark {
+
+/// Opt in zero copy load for large arrays of trivially copyable T.
+///
+/// Layout: var_size_t(n), byte(pad), pad zero bytes, n*sizeof(T) bytes,
+/// the payload is aligned to `align` relative to the stream start, which is
+/// also aligned in memory when the stream is a page aligned mapping.
+///
+/// If the input stream is a memory stream(MemIO and derived, which have
+/// zc_borrow), and the payload is aligned in memory, the loaded valvec just
+/// points into the memory, *memType is set to MemType::User, it must be
+/// destroyed by valvec::risk_destroy(MemType::User) before the memory is
+/// released, and it is read only if the memory is read only, else data is
+/// copied and *memType is set to MemType::Malloc.
+namespace zero_copy_detail {
+	template<class Stream>
+	auto borrow(Stream* s, size_t len, int) -> decltype(s->zc_borrow(len)) {
+		return s->zc_borrow(len);
+	}
+	template<class Stream>
+	const void* borrow(Stream*, size_t, long) { return NULL; }
+
+	template<class DataIO>
+	const void* borrow(DataIO& dio, size_t len) {
+		return borrow(dio.getStream(), len, 0);
+	}
+} // namespace zero_copy_detail
+
+template<class DataIO, class T>
+void zero_copy_load(DataIO& dio, valvec<T>& vec, MemType* memType) {
+	BOOST_STATIC_ASSERT(std::is_trivially_copyable<T>::value);
+	var_size_t n;
+	byte_t pad;
+	dio >> n;
+	dio >> pad;
+	if (terark_unlikely(n.t > (size_t(-1) - 256) / sizeof(T))) // corrupted
+		THROW_STD(length_error, "n = %zd is too large", size_t(n.t));
+	size_t bytes = sizeof(T) * n.t;
+	vec.clear(); // must be owned by vec
+	*memType = MemType::Malloc;
+	if (const byte_t* mem = (const byte_t*)
+			zero_copy_detail::borrow(dio, pad + bytes)) {
+		mem += pad;
+		if (size_t(mem) % alignof(T) == 0) {
+			vec.risk_set_data((T*)mem, n.t);
+			*memType = MemType::User;
+		} else {
+			vec.resize_no_init(n.t);
+			memcpy(vec.data(), mem, bytes);
+		}
+	}
+	else {
+		byte_t zeros[256];
+		dio.ensureRead(zeros, pad);
+		vec.resize_no_init(n.t);
+		dio.ensureRead(vec.data(), bytes);
+	}
+}
+
+template<class DataIO, class T>
+void zero_copy_save(DataIO& dio, const valvec<T>& vec, size_t align = 16) {
+	BOOST_STATIC_ASSERT(std::is_trivially_copyable<T>::value);
+	assert(align >= 1 && align <= 256);
+	assert((align & (align - 1)) == 0);
+	dio << var_size_t(vec.size());
+	align = std::max(align, alignof(T));
+	size_t pos = size_t(dio.tell()) + 1; // after pad byte
+	size_t pad = (align - pos % align) % align;
+	const byte_t zeros[256] = {0};
+	dio << byte_t(pad);
+	dio.ensureWrite(zeros, pad);
+	dio.ensureWrite(vec.data(), sizeof(T) * vec.size());
+}
+
+/// copy a zero copy loaded vec to owned memory
+template<class T>
+void zero_copy_make_owned(valvec<T>& vec, MemType* memType) {
+	if (MemType::Malloc != *memType) {
+		const T* p = vec.data();
+		size_t n = vec.size();
+		vec.risk_release_ownership();
+		vec.assign(p, n);
+		*memType = MemType::Malloc;
+	}
+}
+
+/// SortableStrVec: m_strpool references the memory, with m_strpool_mem_type,
+/// m_index is copied because it is changed in place by sort and friends
+template<class DataIO>
+void zero_copy_load(DataIO& dio, SortableStrVec& x) {
+	x.clear();
+	zero_copy_load(dio, x.m_strpool, &x.m_strpool_mem_type);
+	MemType indexMemType;
+	zero_copy_load(dio, x.m_index, &indexMemType);
+	zero_copy_make_owned(x.m_index, &indexMemType);
+	x.sync_real_str_size();
+}
+template<class DataIO>
+void zero_copy_save(DataIO& dio, const SortableStrVec& x) {
+	zero_copy_save(dio, x.m_strpool);
+	zero_copy_save(dio, x.m_index);
+}
+
+/// FixedLenStrVec: m_strpool references the memory, with m_strpool_mem_type
+template<class DataIO>
+void zero_copy_load(DataIO& dio, FixedLenStrVec& x) {
+	var_size_t fixlen, size;
+	dio >> fixlen >> size;
+	x.clear();
+	zero_copy_load(dio, x.m_strpool, &x.m_strpool_mem_type);
+	TERARK_VERIFY_EQ(fixlen.t * size.t, x.m_strpool.size());
+	x.m_fixlen = uint32_t(fixlen.t);
+	x.m_size = size.t;
+	x.optimize_func();
+}
+template<class DataIO>
+void zero_copy_save(DataIO& dio, const FixedLenStrVec& x) {
+	dio << var_size_t(x.m_fixlen) << var_size_t(x.m_size);
+	zero_copy_save(dio, x.m_strpool);
+}
+
+/// basic_fstrvec has no mem type, both strpool and offsets reference the
+/// memory if *memType is MemType::User, they must be destroyed by
+/// risk_destroy(*memType) before the memory is released
+template<class DataIO, class Char, class Offset, class OffsetOp>
+void zero_copy_load(DataIO& dio, basic_fstrvec<Char, Offset, OffsetOp>& x,
+					MemType* memType) {
+	MemType poolMemType, offsetsMemType;
+	zero_copy_load(dio, x.strpool, &poolMemType);
+	zero_copy_load(dio, x.offsets, &offsetsMemType);
+	if (poolMemType != offsetsMemType) {
+		zero_copy_make_owned(x.strpool, &poolMemType);
+		zero_copy_make_owned(x.offsets, &offsetsMemType);
+	}
+	*memType = poolMemType;
+}
+template<class DataIO, class Char, class Offset, class OffsetOp>
+void zero_copy_save(DataIO& dio, const basic_fstrvec<Char, Offset, OffsetOp>& x) {
+	zero_copy_save(dio, x.strpool);
+	zero_copy_save(dio, x.offsets);
+}
+
+template<class Obj>
+class DataIO_zero_copy_ref {
+	Obj& m_obj;
+public:
+	explicit DataIO_zero_copy_ref(Obj& obj) : m_obj(obj) {}
+	template<class DataIO>
+	friend void DataIO_loadObject(DataIO& dio, DataIO_zero_copy_ref x) {
+		zero_copy_load(dio, x.m_obj);
+	}
+	template<class DataIO>
+	friend void DataIO_saveObject(DataIO& dio, DataIO_zero_copy_ref x) {
+		zero_copy_save(dio, x.m_obj);
+	}
+};
+
+template<class Obj>
+class DataIO_zero_copy_mt_ref {
+	Obj&     m_obj;
+	MemType* m_memType;
+public:
+	DataIO_zero_copy_mt_ref(Obj& obj, MemType* mt) : m_obj(obj), m_memType(mt) {}
+	template<class DataIO>
+	friend void DataIO_loadObject(DataIO& dio, DataIO_zero_copy_mt_ref x) {
+		zero_copy_load(dio, x.m_obj, x.m_memType);
+	}
+};
+
+//! for load: `dio >> as_zero_copy(vec, &memType)`
+template<class T>
+inline pass_by_value<DataIO_zero_copy_mt_ref<valvec<T> > >
+as_zero_copy(valvec<T>& vec, MemType* memType) {
+	return DataIO_zero_copy_mt_ref<valvec<T> >(vec, memType);
+}
+template<class Char, class Offset, class OffsetOp>
+inline pass_by_value<DataIO_zero_copy_mt_ref<basic_fstrvec<Char, Offset, OffsetOp> > >
+as_zero_copy(basic_fstrvec<Char, Offset, OffsetOp>& x, MemType* memType) {
+	return DataIO_zero_copy_mt_ref<basic_fstrvec<Char, Offset, OffsetOp> >(x, memType);
+}
+
+//! for load: `dio >> as_zero_copy(strvec)`, for save: `dio << as_zero_copy(strvec)`
+inline pass_by_value<DataIO_zero_copy_ref<SortableStrVec> >
+as_zero_copy(SortableStrVec& x) {
+	return DataIO_zero_copy_ref<SortableStrVec>(x);
+}
+inline pass_by_value<DataIO_zero_copy_ref<FixedLenStrVec> >
+as_zero_copy(FixedLenStrVec& x) {
+	return DataIO_zero_copy_ref<FixedLenStrVec>(x);
+}
+
+//! for save: `dio << as_zero_copy(vec)`, output stream must have tell()
+template<class Obj>
+inline DataIO_zero_copy_ref<const Obj>
+as_zero_copy(const Obj& x) {
+	return DataIO_zero_copy_ref<const Obj>(x);
+}
+
+/// DataInput on a whole file mapping, containers loaded by as_zero_copy
+/// reference the mapping, so it must outlive them, or the mapping can be
+/// moved to a long lived owner by mmap().swap(...)
+class MmapDataInput : public NativeDataInput<MemIO> {
+	MmapWholeFile m_mmap;
+public:
+	explicit MmapDataInput(const char* fname, bool populate = false)
+		: m_mmap(fname, false, populate) {
+		this->set(m_mmap.base, m_mmap.size);
+	}
+	template<class String>
+	explicit MmapDataInput(const String& fname, bool populate = false)
+		: MmapDataInput(fname.c_str(), populate) {}
+
+	MmapWholeFile& mmap() { return m_mmap; }
+	size_t tell() const { return this->current() - (const byte_t*)m_mmap.base; }
+};
+
+} // namespace terark
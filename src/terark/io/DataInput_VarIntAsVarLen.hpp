@@ -76,6 +76,65 @@ public:
 	   	x.t = this->getStream()->read_var_uint32();
 	   	return *this;
    	}
+
+// bulk var int arrays, valvec/std::vector of var_*int* are loaded by them
+	void load_var_array(var_uint32_t* a, size_t n)
+	{
+		BOOST_STATIC_ASSERT(sizeof(var_uint32_t) == sizeof(uint32_t));
+		this->getStream()->read_var_uint32_bulk(reinterpret_cast<uint32_t*>(a), n);
+	}
+	void load_var_array(var_int32_t* a, size_t n)
+	{
+		BOOST_STATIC_ASSERT(sizeof(var_int32_t) == sizeof(uint32_t));
+		uint32_t* u = reinterpret_cast<uint32_t*>(a);
+		this->getStream()->read_var_uint32_bulk(u, n);
+		for (size_t i = 0; i < n; ++i)
+			a[i].t = var_int32_u2s(u[i]);
+	}
+#if !defined(BOOST_NO_INT64_T)
+	void load_var_array(var_uint64_t* a, size_t n)
+	{
+		BOOST_STATIC_ASSERT(sizeof(var_uint64_t) == sizeof(uint64_t));
+		this->getStream()->read_var_uint64_bulk(reinterpret_cast<uint64_t*>(a), n);
+	}
+	void load_var_array(var_int64_t* a, size_t n)
+	{
+		BOOST_STATIC_ASSERT(sizeof(var_int64_t) == sizeof(uint64_t));
+		uint64_t* u = reinterpret_cast<uint64_t*>(a);
+		this->getStream()->read_var_uint64_bulk(u, n);
+		for (size_t i = 0; i < n; ++i)
+			a[i].t = var_int64_u2s(u[i]);
+	}
+#endif
+
+#define DATA_IO_GEN_VAR_INT_VEC_INPUT(VarInt) \
+	MyType& operator>>(valvec<VarInt>& x) { \
+		return load_var_vector(x); \
+	} \
+	template<class Alloc> \
+	MyType& operator>>(std::vector<VarInt, Alloc>& x) { \
+		return load_var_vector(x); \
+	}
+	DATA_IO_GEN_VAR_INT_VEC_INPUT(var_uint32_t)
+	DATA_IO_GEN_VAR_INT_VEC_INPUT(var_int32_t)
+#if !defined(BOOST_NO_INT64_T)
+	DATA_IO_GEN_VAR_INT_VEC_INPUT(var_uint64_t)
+	DATA_IO_GEN_VAR_INT_VEC_INPUT(var_int64_t)
+#endif
+#undef DATA_IO_GEN_VAR_INT_VEC_INPUT
+
+protected:
+	template<class Vector>
+	MyType& load_var_vector(Vector& x)
+	{
+		var_size_t n;
+		*this >> n;
+		FastResizeVector(*this, x, n.t);
+		if (terark_likely(n.t))
+			load_var_array(&*x.begin(), n.t);
+		return *this;
+	}
+public:
 #endif // TERARK_DATA_IO_SLOW_VAR_INT
 
 //-------------------------------------------------------------
@@ -66,6 +66,69 @@ public:
 		this->getStream()->write_var_uint32(x.t);
 		return *this;
 	}
+
+// bulk var int arrays, valvec/std::vector of var_*int* are saved by them
+	void save_var_array(const var_uint32_t* a, size_t n)
+	{
+		BOOST_STATIC_ASSERT(sizeof(var_uint32_t) == sizeof(uint32_t));
+		this->getStream()->write_var_uint32_bulk(reinterpret_cast<const uint32_t*>(a), n);
+	}
+	void save_var_array(const var_int32_t* a, size_t n)
+	{
+		uint32_t u[256];
+		for (size_t i = 0; i < n; ) {
+			size_t k = std::min<size_t>(n - i, 256);
+			for (size_t j = 0; j < k; ++j)
+				u[j] = var_int32_s2u(a[i + j].t);
+			this->getStream()->write_var_uint32_bulk(u, k);
+			i += k;
+		}
+	}
+#if !defined(BOOST_NO_INT64_T)
+	void save_var_array(const var_uint64_t* a, size_t n)
+	{
+		BOOST_STATIC_ASSERT(sizeof(var_uint64_t) == sizeof(uint64_t));
+		this->getStream()->write_var_uint64_bulk(reinterpret_cast<const uint64_t*>(a), n);
+	}
+	void save_var_array(const var_int64_t* a, size_t n)
+	{
+		uint64_t u[256];
+		for (size_t i = 0; i < n; ) {
+			size_t k = std::min<size_t>(n - i, 256);
+			for (size_t j = 0; j < k; ++j)
+				u[j] = var_int64_s2u(a[i + j].t);
+			this->getStream()->write_var_uint64_bulk(u, k);
+			i += k;
+		}
+	}
+#endif
+
+#define DATA_IO_GEN_VAR_INT_VEC_OUTPUT(VarInt) \
+	MyType& operator<<(const valvec<VarInt>& x) { \
+		return save_var_vector(x); \
+	} \
+	template<class Alloc> \
+	MyType& operator<<(const std::vector<VarInt, Alloc>& x) { \
+		return save_var_vector(x); \
+	}
+	DATA_IO_GEN_VAR_INT_VEC_OUTPUT(var_uint32_t)
+	DATA_IO_GEN_VAR_INT_VEC_OUTPUT(var_int32_t)
+#if !defined(BOOST_NO_INT64_T)
+	DATA_IO_GEN_VAR_INT_VEC_OUTPUT(var_uint64_t)
+	DATA_IO_GEN_VAR_INT_VEC_OUTPUT(var_int64_t)
+#endif
+#undef DATA_IO_GEN_VAR_INT_VEC_OUTPUT
+
+protected:
+	template<class Vector>
+	MyType& save_var_vector(const Vector& x)
+	{
+		*this << var_size_t(x.size());
+		if (terark_likely(!x.empty()))
+			save_var_array(&*x.begin(), x.size());
+		return *this;
+	}
+public:
 #endif // TERARK_DATA_IO_SLOW_VAR_INT
 
 //--------------------------------------------------------
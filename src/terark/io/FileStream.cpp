@@ -398,6 +398,18 @@ int64_t FileStream::read_var_int61()
 	return var_int61_u2s(read_var_uint61());
 }
 
+void FileStream::read_var_uint32_bulk(uint32_t* a, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		a[i] = read_var_uint32();
+}
+
+void FileStream::read_var_uint64_bulk(uint64_t* a, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		a[i] = read_var_uint64();
+}
+
 void FileStream::read_string(std::string& str)
 {
 	size_t len = read_var_uint32();
@@ -506,6 +518,18 @@ void FileStream::write_var_int61(int64_t x)
 }
 
 
+void FileStream::write_var_uint32_bulk(const uint32_t* a, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		write_var_uint32(a[i]);
+}
+
+void FileStream::write_var_uint64_bulk(const uint64_t* a, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		write_var_uint64(a[i]);
+}
+
 void FileStream::write_string(const std::string& str)
 {
 	write_var_uint32(str.size());
@@ -211,6 +211,17 @@ public:
 	}
 	ptrdiff_t buf_remain_bytes() const { return m_end - m_pos; }
 
+	/// for zero copy load: return current pos and skip length bytes,
+	/// the memory is owned by the caller of set()
+	const void* zc_borrow(size_t length) {
+		// length is read from stream, m_pos + length may overflow
+		if (terark_unlikely(length > size_t(m_end - m_pos)))
+			throw_EndOfFile(BOOST_CURRENT_FUNCTION, length);
+		byte* old = m_pos;
+		m_pos += length;
+		return old;
+	}
+
 	template<class InputStream>
 	void from_input(InputStream& input, size_t length){
 		if (terark_unlikely(m_pos + length > m_end))
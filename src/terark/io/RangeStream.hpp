@@ -60,6 +60,8 @@ namespace terark {
 		int32_t read_var_int30() { return var_int30_u2s(read_var_uint30()); }
 		int64_t read_var_int64() { return var_int64_u2s(read_var_uint64()); }
 		int64_t read_var_int61() { return var_int61_u2s(read_var_uint61()); }
+		void read_var_uint32_bulk(uint32_t* a, size_t n) { for (size_t i = 0; i < n; ++i) a[i] = read_var_uint32(); }
+		void read_var_uint64_bulk(uint64_t* a, size_t n) { for (size_t i = 0; i < n; ++i) a[i] = read_var_uint64(); }
 
 		void read_string(std::string& s) {
 			size_t len = TERARK_IF_WORD_BITS_64(read_var_uint64, read_var_uint32)();
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <terark/io/var_int.hpp>
+#include <algorithm>
 //#include <terark/io/DataIO.hpp>
 
 namespace terark {
@@ -33,6 +34,21 @@ public:
 	FirstIntType value() const { return m_cur; }
 	operator FirstIntType() const { return m_cur; }
 
+	//! decode n values, same as n times of `input >> decode_diff`, but
+	//! the diffs are loaded by bulk var int decoding
+	template<class Input>
+	void load_array(Input& input, FirstIntType* out, size_t n)
+	{
+		var_uint64_t diff[256];
+		for (size_t i = 0; i < n; ) {
+			size_t k = std::min<size_t>(n - i, 256);
+			input.load_var_array(diff, k);
+			for (size_t j = 0; j < k; ++j)
+				out[i + j] = m_cur += diff[j].t;
+			i += k;
+		}
+	}
+
 	template<class Input>
 	friend void DataIO_loadObject(Input& in, DecodeIntDiff<FirstIntType, DiffIntType>& x)
 	{
@@ -88,6 +104,21 @@ public:
 		m_cur = next;
 		return var_uint32_t(diff);
 	}
+
+	//! encode n values, same as n times of `output << encode_diff(a[i])`,
+	//! but the diffs are saved by bulk var int encoding
+	template<class Output>
+	void save_array(Output& output, const FirstIntType* a, size_t n)
+	{
+		var_uint32_t diff[256];
+		for (size_t i = 0; i < n; ) {
+			size_t k = std::min<size_t>(n - i, 256);
+			for (size_t j = 0; j < k; ++j)
+				diff[j] = (*this)(a[i + j]);
+			output.save_var_array(diff, k);
+			i += k;
+		}
+	}
 };
 
 } // namespace terark
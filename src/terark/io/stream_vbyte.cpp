@@ -0,0 +1,108 @@
+/* vim: set tabstop=4 : */
+#include "stream_vbyte.hpp"
+#include <terark/util/throw.hpp>
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSSE3__)
+# include <immintrin.h>
+#endif
+
+namespace terark {
+
+namespace {
+
+struct StreamVByteTable {
+	alignas(16) byte_t shuf[256][16]; // control byte to pshufb mask
+	byte_t len[256]; // data length of 4 values
+	StreamVByteTable() {
+		for (unsigned c = 0; c < 256; ++c) {
+			unsigned pos = 0;
+			for (unsigned i = 0; i < 4; ++i) {
+				unsigned code = (c >> (2*i)) & 3;
+				for (unsigned k = 0; k < 4; ++k)
+					shuf[c][4*i + k] = k <= code ? byte_t(pos + k) : 0x80;
+				pos += code + 1;
+			}
+			len[c] = byte_t(pos);
+		}
+	}
+	static const StreamVByteTable& get() {
+		static const StreamVByteTable tab;
+		return tab;
+	}
+};
+
+inline unsigned svb_code(uint32_t x) {
+	return x < (1u << 8) ? 0 : x < (1u << 16) ? 1 : x < (1u << 24) ? 2 : 3;
+}
+
+inline uint32_t svb_load(const byte_t* p, unsigned code) {
+	uint32_t x = 0;
+	for (unsigned k = 0; k <= code; ++k)
+		x |= uint32_t(p[k]) << (8*k);
+	return x;
+}
+
+} // namespace
+
+size_t svb_encode_uint32(const uint32_t* in, size_t n, byte_t* out) {
+	byte_t* control = out;
+	byte_t* data = out + svb_control_size(n);
+	for (size_t i = 0; i < n; i += 4) {
+		size_t m = std::min<size_t>(n - i, 4);
+		unsigned c = 0;
+		for (size_t j = 0; j < m; ++j) {
+			uint32_t x = in[i + j];
+			unsigned code = svb_code(x);
+			c |= code << (2*j);
+			for (unsigned k = 0; k <= code; ++k)
+				*data++ = byte_t(x >> (8*k));
+		}
+		*control++ = byte_t(c);
+	}
+	return data - out;
+}
+
+size_t svb_data_size(const byte_t* control, size_t n) {
+	const StreamVByteTable& tab = StreamVByteTable::get();
+	size_t full = n / 4, sum = 0;
+	for (size_t g = 0; g < full; ++g)
+		sum += tab.len[control[g]];
+	for (size_t j = 0; j < n % 4; ++j)
+		sum += ((control[full] >> (2*j)) & 3) + 1;
+	return sum;
+}
+
+size_t svb_decode_uint32(const byte_t* in, size_t inlen, uint32_t* out, size_t n) {
+	size_t csize = svb_control_size(n);
+	if (inlen < csize)
+		THROW_STD(length_error, "inlen = %zd < control size = %zd", inlen, csize);
+	size_t dsize = svb_data_size(in, n);
+	if (inlen < csize + dsize)
+		THROW_STD(length_error, "inlen = %zd < encoded size = %zd", inlen, csize + dsize);
+	const byte_t* control = in;
+	const byte_t* data = in + csize;
+	const byte_t* end = data + dsize;
+	size_t full = n / 4, g = 0;
+#if defined(__SSSE3__)
+	const StreamVByteTable& tab = StreamVByteTable::get();
+	for (; g < full && end - data >= 16; ++g) {
+		byte_t c = control[g];
+		__m128i v = _mm_loadu_si128((const __m128i*)data);
+		__m128i s = _mm_load_si128((const __m128i*)tab.shuf[c]);
+		_mm_storeu_si128((__m128i*)(out + 4*g), _mm_shuffle_epi8(v, s));
+		data += tab.len[c];
+	}
+#endif
+	for (size_t i = 4*g; i < n; ++i) {
+		unsigned code = (control[i / 4] >> (2*(i % 4))) & 3;
+		out[i] = svb_load(data, code);
+		data += code + 1;
+	}
+	assert(data == end);
+	return end - in;
+}
+
+} // namespace terark
@@ -0,0 +1,78 @@
+/* vim: set tabstop=4 : */
+#pragma once
+
+#include <terark/stdtypes.hpp>
+#include <terark/valvec.hpp>
+#include <terark/pass_by_value.hpp>
+#include "var_int.hpp"
+
+namespace terark {
+
+/// Stream VByte: values are grouped by 4, each group has a control byte with
+/// 2 bits length code(len-1) per value, all control bytes are stored before
+/// data bytes, thus data length is known before decoding and a group of 4
+/// values is decoded by one pshufb(SSSE3) without any data dependent branch.
+///
+/// This is a new layout, not compatible with var_uint32(LEB128), it is used
+/// for large uint32 arrays where decoding speed matters.
+inline size_t svb_control_size(size_t n) { return (n + 3) / 4; }
+inline size_t svb_max_encoded_size(size_t n) { return (n + 3) / 4 + 4 * n; }
+
+/// out must have room for svb_max_encoded_size(n), return encoded size
+TERARK_DLL_EXPORT size_t svb_encode_uint32(const uint32_t* in, size_t n, byte_t* out);
+
+/// data length of n values described by control bytes
+TERARK_DLL_EXPORT size_t svb_data_size(const byte_t* control, size_t n);
+
+/// decode n values from [in, in+inlen), return consumed bytes,
+/// throw std::length_error if inlen is less than the encoded size
+TERARK_DLL_EXPORT size_t svb_decode_uint32(const byte_t* in, size_t inlen, uint32_t* out, size_t n);
+
+/// DataIO adaptor for valvec<uint32_t> in Stream VByte layout:
+/// var_size_t(n), control bytes, data bytes
+template<class Vec>
+class as_stream_vbyte_ref {
+	Vec& vec;
+public:
+	explicit as_stream_vbyte_ref(Vec& v) : vec(v) {}
+
+	template<class Input>
+	friend void DataIO_loadObject(Input& in, as_stream_vbyte_ref x) {
+		var_size_t n;
+		in >> n;
+		x.vec.resize_no_init(n.t);
+		if (0 == n.t)
+			return;
+		size_t csize = svb_control_size(n.t);
+		valvec<byte_t> buf(csize, valvec_no_init());
+		in.ensureRead(buf.data(), csize);
+		size_t dsize = svb_data_size(buf.data(), n.t);
+		buf.resize_no_init(csize + dsize);
+		in.ensureRead(buf.data() + csize, dsize);
+		svb_decode_uint32(buf.data(), buf.size(), x.vec.data(), n.t);
+	}
+	template<class Output>
+	friend void DataIO_saveObject(Output& out, as_stream_vbyte_ref x) {
+		size_t n = x.vec.size();
+		out << var_size_t(n);
+		if (0 == n)
+			return;
+		valvec<byte_t> buf(svb_max_encoded_size(n), valvec_no_init());
+		size_t len = svb_encode_uint32(x.vec.data(), n, buf.data());
+		out.ensureWrite(buf.data(), len);
+	}
+};
+
+//! for load: `input >> as_stream_vbyte(vec)`
+inline pass_by_value<as_stream_vbyte_ref<valvec<uint32_t> > >
+as_stream_vbyte(valvec<uint32_t>& vec) {
+	return as_stream_vbyte_ref<valvec<uint32_t> >(vec);
+}
+
+//! for save: `output << as_stream_vbyte(vec)`
+inline as_stream_vbyte_ref<const valvec<uint32_t> >
+as_stream_vbyte(const valvec<uint32_t>& vec) {
+	return as_stream_vbyte_ref<const valvec<uint32_t> >(vec);
+}
+
+} // namespace terark
@@ -1,8 +1,13 @@
 /* vim: set tabstop=4 : */
 #include "var_int.hpp"
 #include <assert.h>
+#include <string.h>
 #include <stdexcept>
 
+#if defined(__SSSE3__)
+# include <immintrin.h>
+#endif
+
 #if defined(_MSC_VER)
 # include <intrin.h>
 #pragma intrinsic(_BitScanReverse)
@@ -92,6 +97,188 @@ unsigned char* save_var_uint61(unsigned char* buf, uint64_t x) { return gg_save_
 unsigned char* save_var_int30(unsigned char* buf, int32_t x) { return save_var_uint30(buf, var_int30_s2u(x)); }
 unsigned char* save_var_int61(unsigned char* buf, int64_t x) { return save_var_uint61(buf, var_int61_s2u(x)); }
 
+//##########################################################################################
+// bulk var_uint32/var_uint64
+
+namespace {
+
+// find the end of the var_uint starting at p,
+// return NULL if it is not complete in [p, end)
+inline const unsigned char*
+find_var_uint_end(const unsigned char* p, const unsigned char* end) {
+	for (; p < end; ++p) {
+		if (!(*p & 0x80))
+			return p + 1;
+	}
+	return NULL;
+}
+
+template<class T_uint>
+inline size_t
+decode_var_uint_tail(const unsigned char* p, const unsigned char* end,
+					 T_uint* out, size_t n, const unsigned char** endp) {
+	const ptrdiff_t maxlen = sizeof(T_uint) == 4 ? 5 : 10;
+	size_t i = 0;
+	for (; i < n; ++i) {
+		if (end - p < maxlen && !find_var_uint_end(p, end))
+			break;
+		out[i] = gg_load_var_uint<T_uint>(p, &p, BOOST_CURRENT_FUNCTION);
+	}
+	*endp = p;
+	return i;
+}
+
+#if defined(BOOST_ENDIAN_LITTLE_BYTE)
+inline uint64_t unaligned_load_u64(const unsigned char* p) {
+	uint64_t w;
+	memcpy(&w, p, 8);
+	return w;
+}
+#endif
+
+#if defined(__SSSE3__)
+// masked VByte: bit i of mask is continuation bit of byte i, for each
+// 12 bit mask, shuf places upto 4 complete values with at most 4 bytes
+// each into 4 uint32 lanes, the lanes are then packed 7 bits per byte
+struct MaskedVByteTable {
+	alignas(16) unsigned char shuf[4096][16];
+	unsigned char count[4096];    // number of decoded values
+	unsigned char consumed[4096]; // number of consumed bytes
+	MaskedVByteTable() {
+		for (unsigned mask = 0; mask < 4096; ++mask) {
+			memset(shuf[mask], 0x80, 16); // pshufb zeros the byte
+			unsigned pos = 0, cnt = 0;
+			while (cnt < 4) {
+				unsigned j = pos;
+				while (j < 12 && (mask >> j & 1))
+					j++;
+				if (j >= 12 || j - pos >= 4)
+					break;
+				for (unsigned k = pos; k <= j; ++k)
+					shuf[mask][cnt*4 + k - pos] = (unsigned char)k;
+				cnt++;
+				pos = j + 1;
+			}
+			count[mask] = (unsigned char)cnt;
+			consumed[mask] = (unsigned char)pos;
+		}
+	}
+	static const MaskedVByteTable& get() {
+		static const MaskedVByteTable tab;
+		return tab;
+	}
+};
+#endif
+
+} // namespace
+
+size_t decode_var_uint32_bulk(const unsigned char* buf, const unsigned char* end,
+							  uint32_t* out, size_t n, const unsigned char** endp)
+{
+	const unsigned char* p = buf;
+	size_t i = 0;
+#if defined(__SSSE3__)
+	const MaskedVByteTable& tab = MaskedVByteTable::get();
+	const __m128i m7f   = _mm_set1_epi32(0x0000007F);
+	const __m128i m7f00 = _mm_set1_epi32(0x00007F00);
+	const __m128i m7f16 = _mm_set1_epi32(0x007F0000);
+	const __m128i m7f24 = _mm_set1_epi32(0x7F000000);
+	const __m128i zero  = _mm_setzero_si128();
+	while (end - p >= 16 && n - i >= 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		unsigned mask = (unsigned)_mm_movemask_epi8(v);
+		if (0 == mask && n - i >= 16) { // 16 single byte values
+			__m128i lo = _mm_unpacklo_epi8(v, zero);
+			__m128i hi = _mm_unpackhi_epi8(v, zero);
+			_mm_storeu_si128((__m128i*)(out + i +  0), _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)(out + i +  4), _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)(out + i +  8), _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128((__m128i*)(out + i + 12), _mm_unpackhi_epi16(hi, zero));
+			p += 16;
+			i += 16;
+			continue;
+		}
+		mask &= 0xFFF;
+		if (terark_unlikely(0 == tab.count[mask])) { // 5 bytes value
+			out[i++] = gg_load_var_uint<uint32_t>(p, &p, BOOST_CURRENT_FUNCTION);
+			continue;
+		}
+		__m128i s = _mm_shuffle_epi8(v, _mm_load_si128((const __m128i*)tab.shuf[mask]));
+		__m128i r = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(s, m7f),
+						 _mm_srli_epi32(_mm_and_si128(s, m7f00), 1)),
+			_mm_or_si128(_mm_srli_epi32(_mm_and_si128(s, m7f16), 2),
+						 _mm_srli_epi32(_mm_and_si128(s, m7f24), 3)));
+		_mm_storeu_si128((__m128i*)(out + i), r); // n - i >= 4
+		i += tab.count[mask];
+		p += tab.consumed[mask];
+	}
+#elif defined(BOOST_ENDIAN_LITTLE_BYTE)
+	while (end - p >= 8 && n - i >= 8) {
+		uint64_t w = unaligned_load_u64(p);
+		if (0 == (w & 0x8080808080808080ULL)) { // 8 single byte values
+			for (size_t j = 0; j < 8; ++j)
+				out[i + j] = uint32_t(w >> 8*j) & 0xFF;
+			p += 8;
+			i += 8;
+		}
+		else {
+			out[i++] = gg_load_var_uint<uint32_t>(p, &p, BOOST_CURRENT_FUNCTION);
+		}
+	}
+#endif
+	return i + decode_var_uint_tail(p, end, out + i, n - i, endp);
+}
+
+size_t decode_var_uint64_bulk(const unsigned char* buf, const unsigned char* end,
+							  uint64_t* out, size_t n, const unsigned char** endp)
+{
+	const unsigned char* p = buf;
+	size_t i = 0;
+#if defined(BOOST_ENDIAN_LITTLE_BYTE)
+	while (end - p >= 10 && n - i >= 8) {
+		uint64_t w = unaligned_load_u64(p);
+		if (0 == (w & 0x8080808080808080ULL)) { // 8 single byte values
+			for (size_t j = 0; j < 8; ++j)
+				out[i + j] = (w >> 8*j) & 0xFF;
+			p += 8;
+			i += 8;
+		}
+		else {
+			// decode values until the next 8 bytes window
+			const unsigned char* stop = p + 8;
+			do out[i++] = gg_load_var_uint<uint64_t>(p, &p, BOOST_CURRENT_FUNCTION);
+			while (p < stop && i < n && end - p >= 10);
+		}
+	}
+#endif
+	return i + decode_var_uint_tail(p, end, out + i, n - i, endp);
+}
+
+unsigned char* encode_var_uint32_bulk(unsigned char* buf, const uint32_t* in, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		uint32_t x = in[i];
+		if (x < 128)
+			*buf++ = (unsigned char)x;
+		else
+			buf = gg_save_var_uint<uint32_t>(buf, x);
+	}
+	return buf;
+}
+
+unsigned char* encode_var_uint64_bulk(unsigned char* buf, const uint64_t* in, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t x = in[i];
+		if (x < 128)
+			*buf++ = (unsigned char)x;
+		else
+			buf = gg_save_var_uint<uint64_t>(buf, x);
+	}
+	return buf;
+}
+
 //##########################################################################################
 
 /**
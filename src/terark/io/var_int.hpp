@@ -212,6 +212,20 @@ TERARK_DLL_EXPORT unsigned char* save_var_int30(unsigned char* buf, int32_t x);
 TERARK_DLL_EXPORT unsigned char* save_var_int64(unsigned char* buf, int64_t x);
 TERARK_DLL_EXPORT unsigned char* save_var_int61(unsigned char* buf, int64_t x);
 
+////////////////////////////////////////////////////////////////////////////////////////
+/// bulk load of var_uint32/var_uint64 in the same layout as load_var_uint*,
+/// decode at most n values in [buf, end), stop before the first incomplete
+/// value, return number of decoded values and set *endp to the end of last
+/// decoded value. With SSSE3, var_uint32 is decoded by masked VByte: 12 bytes
+/// are classified by their continuation bits, and upto 4 values are decoded
+/// by one pshufb through a precomputed shuffle table.
+TERARK_DLL_EXPORT size_t decode_var_uint32_bulk(const unsigned char* buf, const unsigned char* end, uint32_t* out, size_t n, const unsigned char** endp);
+TERARK_DLL_EXPORT size_t decode_var_uint64_bulk(const unsigned char* buf, const unsigned char* end, uint64_t* out, size_t n, const unsigned char** endp);
+
+/// bulk save, buf must have room for n*5 or n*10 bytes, return end of output
+TERARK_DLL_EXPORT unsigned char* encode_var_uint32_bulk(unsigned char* buf, const uint32_t* in, size_t n);
+TERARK_DLL_EXPORT unsigned char* encode_var_uint64_bulk(unsigned char* buf, const uint64_t* in, size_t n);
+
 ////////////////////////////////////////////////////////////////////////////////////////
 TERARK_DLL_EXPORT uint32_t reverse_get_var_uint32(const unsigned char* buf, unsigned char const ** cur);
 TERARK_DLL_EXPORT int32_t reverse_get_var_int32(const unsigned char* buf, unsigned char const ** cur);
@@ -89,6 +89,38 @@ int64_t STREAM_READER::read_var_int61()
 	return var_int61_u2s(read_var_uint61());
 }
 
+// decode as many values as possible in buffer, then read the value which
+// crosses buffer boundary by read_var_uint*, which refills the buffer
+void STREAM_READER::read_var_uint32_bulk(uint32_t* a, size_t n)
+{
+	while (n) {
+		const unsigned char* endp = NULL;
+		size_t k = decode_var_uint32_bulk(m_pos, m_pos + this->buf_remain_bytes(), a, n, &endp);
+		m_pos = (unsigned char*)endp;
+		a += k;
+		n -= k;
+		if (n) {
+			*a++ = read_var_uint32();
+			n--;
+		}
+	}
+}
+
+void STREAM_READER::read_var_uint64_bulk(uint64_t* a, size_t n)
+{
+	while (n) {
+		const unsigned char* endp = NULL;
+		size_t k = decode_var_uint64_bulk(m_pos, m_pos + this->buf_remain_bytes(), a, n, &endp);
+		m_pos = (unsigned char*)endp;
+		a += k;
+		n -= k;
+		if (n) {
+			*a++ = read_var_uint64();
+			n--;
+		}
+	}
+}
+
 void STREAM_READER::read_string(std::string& str)
 {
 	size_t len = read_var_uint32();
@@ -190,6 +222,38 @@ void STREAM_WRITER::write_var_int61(int64_t x)
 }
 
 
+void STREAM_WRITER::write_var_uint32_bulk(const uint32_t* a, size_t n)
+{
+	while (n) {
+		size_t k = std::min(n, size_t(this->buf_remain_bytes()) / 5);
+		if (k) {
+			m_pos = encode_var_uint32_bulk(m_pos, a, k);
+			a += k;
+			n -= k;
+		}
+		else {
+			write_var_uint32(*a++);
+			n--;
+		}
+	}
+}
+
+void STREAM_WRITER::write_var_uint64_bulk(const uint64_t* a, size_t n)
+{
+	while (n) {
+		size_t k = std::min(n, size_t(this->buf_remain_bytes()) / 10);
+		if (k) {
+			m_pos = encode_var_uint64_bulk(m_pos, a, k);
+			a += k;
+			n -= k;
+		}
+		else {
+			write_var_uint64(*a++);
+			n--;
+		}
+	}
+}
+
 void STREAM_WRITER::write_string(const std::string& str)
 {
 	write_var_uint32(str.size());
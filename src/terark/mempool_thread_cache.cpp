@@ -3,6 +3,8 @@
 // #pragma GCC optimize("no-omit-frame-pointer")
 #include "mempool_thread_cache.hpp"
 #include <terark/util/atomic.hpp>
+#include <terark/bitmanip.hpp>
+#include <terark/fstring.hpp>
 #include <stdexcept>
 #include <boost/integer/static_log2.hpp>
 #include <boost/mpl/if.hpp>
@@ -15,6 +17,11 @@
 #else
 #include <sys/mman.h>
 #endif
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <terark/util/fast_getcpu.hpp>
+#endif
 #include <terark/util/hugepage.hpp>
 #include <terark/util/profiling.hpp> // for qtime
 
@@ -54,6 +61,13 @@ TCMemPoolOneThreadMF()TCMemPoolOneThread(ThreadCacheMemPool<AlignSize>* mp) {
     for(auto& next : huge_list.next) next = list_tail;
     m_hot_pos = 0;
     m_hot_end = 0;
+    m_remote_out = 0;
+    m_remote_in = 0;
+    m_depot_put = 0;
+    m_depot_get = 0;
+    m_is_idle = false;
+    m_remote.head = list_tail;
+    m_remote.len = 0;
 }
 TCMemPoolOneThreadMF()~TCMemPoolOneThread() {
 }
@@ -80,6 +94,21 @@ TCMemPoolOneThreadMF(size_t)random_level() {
     }
 #endif
 
+// freelist links are in poisoned memory
+template<class Link>
+static inline Link mptc_get_link(const byte_t* base, size_t pos) {
+    ASAN_UNPOISON_MEMORY_REGION(base + pos, sizeof(Link));
+    Link link = *(const Link*)(base + pos);
+    ASAN_POISON_MEMORY_REGION(base + pos, sizeof(Link));
+    return link;
+}
+template<class Link>
+static inline void mptc_set_link(byte_t* base, size_t pos, Link link) {
+    ASAN_UNPOISON_MEMORY_REGION(base + pos, sizeof(Link));
+    *(Link*)(base + pos) = link;
+    ASAN_POISON_MEMORY_REGION(base + pos, sizeof(Link));
+}
+
 TCMemPoolOneThreadMF(void)reduce_frag_size(size_t request) {
     fragment_size -= request;
     m_frag_inc -= request;
@@ -90,6 +119,43 @@ TCMemPoolOneThreadMF(void)reduce_frag_size(size_t request) {
     }
 }
 
+TCMemPoolOneThreadMF(void)remote_free(byte_t* base, size_t pos, size_t len) {
+    assert(pos % AlignSize == 0);
+    assert(len % AlignSize == 0);
+    assert(len >= sizeof(remote_link_t));
+    auto node = (remote_link_t*)(base + pos);
+    mptc1t_debug_fill_free(base, pos + sizeof(remote_link_t), len - sizeof(remote_link_t));
+    ASAN_POISON_MEMORY_REGION(node + 1, len - sizeof(remote_link_t));
+    node->len = link_size_t(len / AlignSize);
+    // add len before push, so m_remote.len never underflow in drain
+    as_atomic(m_remote.len).fetch_add(len, std::memory_order_relaxed);
+    auto& head = as_atomic(m_remote.head);
+    link_size_t old_head = head.load(std::memory_order_relaxed);
+    do {
+        node->next = old_head;
+    } while (!head.compare_exchange_weak(old_head, link_size_t(pos / AlignSize),
+                std::memory_order_release, std::memory_order_relaxed));
+}
+
+// the whole list is taken by one exchange, so there is no ABA problem
+TCMemPoolOneThreadMF(size_t)drain_remote_free(byte_t* base) {
+    size_t next = as_atomic(m_remote.head).
+        exchange(link_size_t(list_tail), std::memory_order_acquire);
+    size_t sum = 0;
+    while (list_tail != next) {
+        size_t pos = next * AlignSize;
+        auto node = (remote_link_t*)(base + pos);
+        size_t len = size_t(node->len) * AlignSize;
+        next = node->next;
+        ASAN_UNPOISON_MEMORY_REGION(base + pos, len);
+        sfree(base, pos, len);
+        sum += len;
+    }
+    as_atomic(m_remote.len).fetch_sub(sum, std::memory_order_relaxed);
+    m_remote_in += sum;
+    return sum;
+}
+
 TCMemPoolOneThreadMF(terark_no_inline size_t)
 alloc(byte_t* base, size_t request) {
     assert(request % AlignSize == 0);
@@ -98,6 +164,9 @@ alloc(byte_t* base, size_t request) {
         if (loop_cnt > 200) { \
             fprintf(stderr, "%s:%d: loop_cnt = %zd\n", __FILE__, __LINE__, loop_cnt); \
         }} while (0)
+    if (terark_unlikely(remote_pending_len() >= remote_drain_batch)) {
+        drain_remote_free(base);
+    }
     if (terark_likely(request <= m_freelist_head.size() * AlignSize)) {
         size_t idx = request / AlignSize - 1;
         auto& list = m_freelist_head[idx];
@@ -390,6 +459,10 @@ TCMemPoolOneThreadMF(void)sfree(byte_t* base, size_t pos, size_t len) {
         as_atomic(m_mempool->fragment_size).
             fetch_add(size_t(m_frag_inc), std::memory_order_relaxed);
         m_frag_inc = 0;
+        // fragments of this thread are growing, share surplus to others
+        if (m_mempool->m_fastbin_rebalance) {
+            m_mempool->fastbin_rebalance(this, m_mempool->m_fastbin_keep_cnt);
+        }
     }
 }
 
@@ -431,20 +504,33 @@ TCMemPoolOneThreadMF(void)init_for_reuse() {}
 
 ThreadCacheMemPoolMF(void)clean_for_reuse(TCMemPoolOneThread<AlignSize>* t) {
     t->clean_for_reuse();
+    as_atomic(t->m_is_idle).store(true, std::memory_order_relaxed);
+    // blocks pushed after this drain will be drained by init_for_reuse
+    t->drain_remote_free(mem::p);
+    if (m_fastbin_rebalance) {
+        fastbin_rebalance(t, 0); // the thread is exiting, share all fastbin
+    }
     as_atomic(fragment_size).fetch_add(t->m_frag_inc, std::memory_order_relaxed);
     t->m_frag_inc = 0;
 }
 
 ThreadCacheMemPoolMF(void)init_for_reuse(TCMemPoolOneThread<AlignSize>* t) const {
+    as_atomic(t->m_is_idle).store(false, std::memory_order_relaxed);
+    t->drain_remote_free(mem::p);
     t->init_for_reuse();
 }
 
 ThreadCacheMemPoolMF()ThreadCacheMemPool(size_t fastbin_max_size) {
+    static bool g_remote_free = getEnvBool("ThreadCacheMemPool_remoteFree", false);
+    static bool g_fastbin_rebalance = getEnvBool("ThreadCacheMemPool_fastbinRebalance", false);
+    m_remote_free = g_remote_free;
+    m_fastbin_rebalance = g_fastbin_rebalance;
     assert(fastbin_max_size >= AlignSize);
     assert(fastbin_max_size >= sizeof(typename TCMemPoolOneThread<AlignSize>::huge_link_t));
     fragment_size = 0;
     m_fastbin_max_size = pow2_align_up(fastbin_max_size, AlignSize);
     m_new_tc = &default_new_tc;
+    m_depot.resize(m_fastbin_max_size / AlignSize);
 }
 
 ThreadCacheMemPoolMF()~ThreadCacheMemPool() {
@@ -462,7 +548,7 @@ ThreadCacheMemPoolMF(void)sync_frag_size() {
 // thread accessing this mempool's meta data.
 // after this function call, this->fragment_size includs hot area free size
 ThreadCacheMemPoolMF(void)sync_frag_size_full() {
-    this->fragment_size = 0;
+    this->fragment_size = as_atomic(m_depot_len).load(std::memory_order_relaxed);
     this->for_each_tls([this](TCMemPoolOneThread<AlignSize>* tc) {
         size_t hot_len = tc->m_hot_end - tc->m_hot_pos;
         this->fragment_size += tc->fragment_size + hot_len;
@@ -473,8 +559,14 @@ ThreadCacheMemPoolMF(void)sync_frag_size_full() {
 // the frag_size including hot area of each thread cache and
 // fragments in freelists
 ThreadCacheMemPoolMF(size_t)slow_get_free_size() const {
-    size_t sz = 0;
-    this->for_each_tls([&sz](TCMemPoolOneThread<AlignSize>* tc) {
+    return slow_get_free_size(nullptr);
+}
+
+ThreadCacheMemPoolMF(size_t)slow_get_free_size(valvec<size_t>* each) const {
+    size_t sz = as_atomic(m_depot_len).load(std::memory_order_relaxed);
+    if (each)
+        each->erase_all();
+    this->for_each_tls([&sz,each](TCMemPoolOneThread<AlignSize>* tc) {
         size_t hot_end, hot_pos;
         do {
             hot_end = tc->m_hot_end;
@@ -482,8 +574,11 @@ ThreadCacheMemPoolMF(size_t)slow_get_free_size() const {
             // other threads may updating hot_pos and hot_end which
             // cause race condition and make hot_pos > hot_end
         } while (terark_unlikely(hot_pos > hot_end));
-        sz += hot_end - hot_pos;
-        sz += tc->fragment_size;
+        size_t tc_sz = hot_end - hot_pos + tc->fragment_size
+                     + tc->remote_pending_len();
+        if (each)
+            each->push_back(tc_sz);
+        sz += tc_sz;
     });
     return sz;
 }
@@ -513,6 +608,19 @@ ThreadCacheMemPoolMF(void)get_fastbin(valvec<size_t>* fast) const {
     });
 }
 
+ThreadCacheMemPoolMF(void)get_fastbin(valvec<valvec<size_t> >* fast) const {
+    fast->erase_all();
+    this->for_each_tls([fast](TCMemPoolOneThread<AlignSize>* tc) {
+        auto _p = tc->m_freelist_head.data();
+        auto _n = tc->m_freelist_head.size();
+        valvec<size_t>& one = fast->emplace_back();
+        one.resize_no_init(_n);
+        for (size_t i = 0; i < _n; ++i) {
+            one[i] = _p[i].cnt;
+        }
+    });
+}
+
 ThreadCacheMemPoolMF(void)print_stat(FILE* fp) const {
     size_t ti = 0, computed_frag_size = 0, computed_hot_size = 0;
     fprintf(fp, "threads=%zd, frag=%zd\n", this->m_tls_vec.size(), fragment_size);
@@ -537,8 +645,22 @@ ThreadCacheMemPoolMF(void)print_stat(FILE* fp) const {
         computed_frag_size += tc->huge_size_sum;
         computed_hot_size += hotlen;
         fprintf(fp, "len = %zd\n", len);
+        fprintf(fp, "    remote{out=%zd,in=%zd,pending=%zd}, depot{put=%zd,get=%zd}\n",
+            tc->m_remote_out, tc->m_remote_in, tc->remote_pending_len(),
+            tc->m_depot_put, tc->m_depot_get);
         ti++;
     });
+    fprintf(fp, "depot_len = %zd\n", get_depot_len());
+    if (m_numa_local) {
+        fprintf(fp, "numa: bind_fail = %zd, node_len: ", m_numa_bind_fail_cnt);
+        valvec<size_t> node_len;
+        get_numa_stat(&node_len);
+        for (size_t i = 0; i < node_len.size(); ++i) {
+            if (node_len[i])
+                fprintf(fp, "(%zd, %zd), ", i, node_len[i]);
+        }
+        fprintf(fp, "\n");
+    }
     fprintf(fp, "computed_frag_size = %zd, computed_hot_size = %zd, plus the two = %zd\n",
                     computed_frag_size, computed_hot_size, computed_frag_size + computed_hot_size);
 }
@@ -575,6 +697,108 @@ ThreadCacheMemPoolMF(terark_no_inline void)reserve(size_t cap) {
     mem::n = oldsize;
     ASAN_POISON_MEMORY_REGION(mem::p + oldsize, mem::c - oldsize);
     MSAN_POISON_MEMORY_REGION(mem::p + oldsize, mem::c - oldsize);
+    if (m_remote_free && 0 == oldsize) {
+        init_chunk_owner();
+    }
+}
+
+ThreadCacheMemPoolMF(void)init_chunk_owner() {
+    m_chunk_shift = fast_ctz64(m_chunk_size);
+    m_chunk_base_idx = size_t(mem::p) >> m_chunk_shift;
+    size_t last_idx = size_t(mem::p + mem::c - 1) >> m_chunk_shift;
+    m_chunk_owner.resize_fill(last_idx - m_chunk_base_idx + 1, nullptr);
+}
+
+ThreadCacheMemPoolMF(void)
+set_chunk_owner(size_t pos, size_t len, TCMemPoolOneThread<AlignSize>* tc) {
+    if (m_chunk_owner.empty() || 0 == len)
+        return;
+    size_t beg = (size_t(mem::p + pos) >> m_chunk_shift) - m_chunk_base_idx;
+    size_t end = (size_t(mem::p + pos + len - 1) >> m_chunk_shift) - m_chunk_base_idx;
+    // mem::p may be changed by reserve(), the owner is just a hint for
+    // routing freed blocks, thus out of range chunks are just ignored
+    end = std::min(end, m_chunk_owner.size() - 1);
+    for (size_t i = beg; i <= end; i++) {
+        as_atomic(m_chunk_owner[i]).store(tc, std::memory_order_relaxed);
+    }
+}
+
+// move fastbin blocks exceeding keep_cnt of each size class to m_depot,
+// called by the owner thread of tc
+ThreadCacheMemPoolMF(terark_no_inline void)
+fastbin_rebalance(TCMemPoolOneThread<AlignSize>* tc, size_t keep_cnt) {
+    using link_size_t = typename TCMemPoolOneThread<AlignSize>::link_size_t;
+    byte_t* base = mem::p;
+    auto lists = tc->m_freelist_head.data();
+    size_t num = tc->m_freelist_head.size();
+    size_t sum = 0;
+    for (size_t idx = 0; idx < num; ++idx) {
+        auto& list = lists[idx];
+        if (list.cnt <= keep_cnt)
+            continue;
+        size_t cnt = list.cnt - keep_cnt;
+        size_t head = list.head;
+        size_t tail = head;
+        for (size_t i = 1; i < cnt; ++i) {
+            tail = mptc_get_link<link_size_t>(base, tail * AlignSize);
+        }
+        list.head = mptc_get_link<link_size_t>(base, tail * AlignSize);
+        list.cnt  = link_size_t(keep_cnt);
+        auto& depot = m_depot[idx];
+        m_depot_mtx.lock();
+        mptc_set_link<link_size_t>(base, tail * AlignSize, depot.head);
+        as_atomic(depot.head).store(link_size_t(head), std::memory_order_relaxed);
+        as_atomic(depot.cnt).store(link_size_t(depot.cnt + cnt), std::memory_order_relaxed);
+        m_depot_mtx.unlock();
+        sum += cnt * (idx + 1) * AlignSize;
+    }
+    if (sum) {
+        // m_mempool->fragment_size is not changed
+        tc->fragment_size -= sum;
+        tc->m_depot_put += sum;
+        as_atomic(m_depot_len).fetch_add(sum, std::memory_order_relaxed);
+    }
+}
+
+// move a batch of blocks from m_depot to tc's freelist
+ThreadCacheMemPoolMF(terark_no_inline bool)
+depot_take(TCMemPoolOneThread<AlignSize>* tc, size_t request) {
+    using link_size_t = typename TCMemPoolOneThread<AlignSize>::link_size_t;
+    const size_t list_tail = TCMemPoolOneThread<AlignSize>::list_tail;
+    size_t idx = request / AlignSize - 1;
+    if (idx >= m_depot.size())
+        return false;
+    auto& depot = m_depot[idx];
+    if (0 == as_atomic(depot.cnt).load(std::memory_order_relaxed))
+        return false;
+    byte_t* base = mem::p;
+    size_t batch = std::max<size_t>(m_fastbin_keep_cnt / 2, 1);
+    m_depot_mtx.lock();
+    size_t head = depot.head;
+    if (list_tail == head) {
+        m_depot_mtx.unlock();
+        return false;
+    }
+    size_t tail = head, cnt = 1;
+    for (; cnt < batch; ++cnt) {
+        size_t next = mptc_get_link<link_size_t>(base, tail * AlignSize);
+        if (list_tail == next)
+            break;
+        tail = next;
+    }
+    as_atomic(depot.head).store(mptc_get_link<link_size_t>(base, tail * AlignSize),
+                                std::memory_order_relaxed);
+    as_atomic(depot.cnt).store(link_size_t(depot.cnt - cnt), std::memory_order_relaxed);
+    m_depot_mtx.unlock();
+    auto& list = tc->m_freelist_head[idx];
+    mptc_set_link<link_size_t>(base, tail * AlignSize, list.head);
+    list.head = link_size_t(head);
+    list.cnt += link_size_t(cnt);
+    size_t sum = cnt * request;
+    tc->fragment_size += sum;
+    tc->m_depot_get += sum;
+    as_atomic(m_depot_len).fetch_sub(sum, std::memory_order_relaxed);
+    return true;
 }
 
 ThreadCacheMemPoolMF(void)shrink_to_fit() {}
@@ -604,6 +828,10 @@ chunk_alloc(TCMemPoolOneThread<AlignSize>* tc, size_t request) {
         assert(oldn + chunk_len <= cap);
     } while (!cas_weak(mem::n, oldn, oldn + chunk_len));
 
+    if (m_numa_local) {
+        numa_bind(oldn, chunk_len); // must before POPULATE_WRITE
+    }
+
   #if defined(_MSC_VER)
     // Windows requires explicit commit virtual memory
     size_t beg = pow2_align_down(size_t(base + oldn), 4096);
@@ -657,10 +885,48 @@ chunk_alloc(TCMemPoolOneThread<AlignSize>* tc, size_t request) {
     }
   #endif
 
+    set_chunk_owner(oldn, chunk_len, tc);
     tc->set_hot_area(base, oldn, chunk_len);
     return true;
 }
 
+ThreadCacheMemPoolMF(void)numa_bind(size_t pos, size_t len) {
+  #if defined(__linux__)
+    size_t node = fast_getnode();
+    if (terark_unlikely(node >= MaxNumaNodes)) {
+        as_atomic(m_numa_bind_fail_cnt).fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // align up beg: the page may be shared with previous chunk
+    size_t beg = pow2_align_up(size_t(mem::p + pos), 4096);
+    size_t end = pow2_align_up(size_t(mem::p + pos + len), 4096);
+    if (beg >= end) {
+        return;
+    }
+    const int MPOL_PREFERRED = 1; // do not depend on libnuma's numaif.h
+    unsigned long nodemask = 1UL << node;
+    // kernel decreases maxnode by 1, so pass bits + 1
+    if (syscall(SYS_mbind, beg, end - beg, MPOL_PREFERRED, &nodemask,
+                sizeof(nodemask) * 8 + 1, 0) != 0) {
+        as_atomic(m_numa_bind_fail_cnt).fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    as_atomic(m_numa_len[node]).fetch_add(len, std::memory_order_relaxed);
+  #endif
+}
+
+ThreadCacheMemPoolMF(void)get_numa_stat(valvec<size_t>* node_len) const {
+    node_len->resize_no_init(MaxNumaNodes);
+    size_t num = 0;
+    for (size_t i = 0; i < MaxNumaNodes; ++i) {
+        size_t len = as_atomic(m_numa_len[i]).load(std::memory_order_relaxed);
+        (*node_len)[i] = len;
+        if (len)
+            num = i + 1;
+    }
+    node_len->risk_set_size(num);
+}
+
 ThreadCacheMemPoolMF(TCMemPoolOneThread<AlignSize>*)
 default_new_tc(ThreadCacheMemPool* mp) {
     return new TCMemPoolOneThread<AlignSize>(mp);
@@ -709,6 +975,14 @@ alloc3(size_t oldpos, size_t oldlen, size_t newlen,
 
 ThreadCacheMemPoolMF(size_t)
 alloc_slow_path(size_t request, TCMemPoolOneThread<AlignSize>* tc) {
+    // reuse freed memory before allocating new chunk
+    if (tc->remote_pending_len() && tc->drain_remote_free(mem::p)) {
+        size_t res = tc->alloc(mem::p, request);
+        if (size_t(-1) != res)
+            return res;
+    }
+    if (depot_take(tc, request))
+        return tc->alloc(mem::p, request);
     if (chunk_alloc(tc, request))
         return tc->alloc(mem::p, request);
     else
@@ -741,7 +1015,11 @@ ThreadCacheMemPoolMF(void)tc_populate(size_t sz) {
         assert(oldn + chunk_len <= cap);
     } while (!cas_weak(mem::n, oldn, oldn + chunk_len));
 
+    if (m_numa_local) {
+        numa_bind(oldn, chunk_len);
+    }
     auto tc = this->get_tls();
+    set_chunk_owner(oldn, chunk_len, tc);
     tc->set_hot_area(base, oldn, chunk_len);
     //tc->populate_hot_area(base, m_chunk_size);
     tc->populate_hot_area(base, 4*1024);
@@ -4,6 +4,7 @@
 #include <terark/thread/instance_tls_owner.hpp>
 #include <boost/integer/static_log2.hpp>
 #include <boost/mpl/if.hpp>
+#include <mutex>
 
 namespace terark {
 
@@ -30,6 +31,20 @@ public:
         link_size_t head;
         link_size_t cnt;
     };
+    /// header of a block in remote free queue, so remote free requires
+    /// block len >= sizeof(remote_link_t), smaller blocks are freed locally
+    struct remote_link_t {
+        link_size_t next;
+        link_size_t len; // in unit of AlignSize
+    };
+    /// pushed by other threads, popped(drained) only by the owner thread,
+    /// occupies a whole cache line to avoid false sharing with hot fields
+    struct alignas(64) remote_queue_t {
+        link_size_t head;
+        size_t      len; // pending bytes, increased before push
+        char        padding[64 - sizeof(size_t) - sizeof(size_t)];
+    };
+    static const size_t remote_drain_batch = 64 * 1024;
     size_t         fragment_size;
     intptr_t       m_frag_inc;
     valvec32<head_t> m_freelist_head;
@@ -50,6 +65,12 @@ public:
     size_t  huge_node_cnt;
     TCMemPoolOneThread* m_next_free;
     ThreadCacheMemPool<AlignSize>* m_mempool;
+    size_t  m_remote_out; // bytes pushed to other threads' remote queue
+    size_t  m_remote_in;  // bytes drained from this->m_remote
+    size_t  m_depot_put;  // bytes donated to mempool fastbin depot
+    size_t  m_depot_get;  // bytes taken from mempool fastbin depot
+    bool    m_is_idle;    // owner thread has exited, wait for reuse
+    remote_queue_t m_remote;
     size_t random_level();
 
     void reduce_frag_size(size_t request);
@@ -57,6 +78,16 @@ public:
     size_t alloc3(byte_t* base, size_t oldpos, size_t oldlen, size_t newlen);
 
     void sfree(byte_t* base, size_t pos, size_t len);
+
+    // called by non-owner threads, push the block to m_remote
+    void remote_free(byte_t* base, size_t pos, size_t len);
+
+    // called by owner thread, move all blocks in m_remote to local freelist
+    size_t drain_remote_free(byte_t* base);
+
+    size_t remote_pending_len() const {
+        return as_atomic(m_remote.len).load(std::memory_order_relaxed);
+    }
     void set_hot_area(byte_t* base, size_t pos, size_t len);
     void populate_hot_area(byte_t* base, size_t pageSize);
 
@@ -108,6 +139,24 @@ protected:
 
     size_t alloc_slow_path(size_t request, TCMemPoolOneThread<AlignSize>*);
 
+    // chunk owner map: a freed block is routed to the thread cache which
+    // allocated its chunk, thus fragments go back to where they came from
+    valvec<TCMemPoolOneThread<AlignSize>*> m_chunk_owner;
+    size_t m_chunk_shift = 0;
+    size_t m_chunk_base_idx = 0;
+    void init_chunk_owner();
+    void set_chunk_owner(size_t pos, size_t len, TCMemPoolOneThread<AlignSize>*);
+
+    // fastbin depot: surplus fastbin blocks donated by thread caches
+    valvec<typename TCMemPoolOneThread<AlignSize>::head_t> m_depot;
+    size_t     m_depot_len = 0; // bytes in m_depot
+    std::mutex m_depot_mtx;
+    bool depot_take(TCMemPoolOneThread<AlignSize>*, size_t request);
+
+    enum { MaxNumaNodes = 64 };
+    size_t m_numa_len[MaxNumaNodes] = {}; // chunk bytes bound to each node
+    void numa_bind(size_t pos, size_t len);
+
     TCMemPoolOneThread<AlignSize>* create_tls_obj() const; // for compile
 
 public:
@@ -128,12 +177,39 @@ public:
     std::function<TCMemPoolOneThread<AlignSize>*(ThreadCacheMemPool*)> m_new_tc;
 
     bool m_vm_explicit_commit = false;
+
+    /// route blocks freed by non-owner thread to owner's remote queue,
+    /// must be set before reserve(). Opt-in: default is false, which keeps
+    /// the old behavior, env ThreadCacheMemPool_remoteFree=1 changes default
+    bool m_remote_free;
+
+    /// move fastbin blocks more than m_fastbin_keep_cnt in a size class of
+    /// a thread cache to a shared depot, which is used by other threads
+    /// before allocating new chunks. Opt-in: default is false, env
+    /// ThreadCacheMemPool_fastbinRebalance=1 changes default
+    bool m_fastbin_rebalance;
+    size_t m_fastbin_keep_cnt = 256;
+
+    void fastbin_rebalance(TCMemPoolOneThread<AlignSize>* tc, size_t keep_cnt);
+
+    /// bind each new chunk to the numa node which the allocating thread is
+    /// running on, chunks are not touched before binding, so pages will be
+    /// faulted in on that node
+    bool m_numa_local = false;
+    size_t m_numa_bind_fail_cnt = 0;
+
+    /// (*node_len)[i] is the chunk bytes bound to numa node i
+    void get_numa_stat(valvec<size_t>* node_len) const;
     size_t m_vm_commit_fail_cnt = 0;
     size_t m_vm_commit_fail_len = 0;
 
     void set_chunk_size(size_t sz) {
         TERARK_VERIFY_F((sz & (sz-1)) == 0, "%zd(%#zX)", sz, sz);
         m_chunk_size = sz;
+        if (!m_chunk_owner.empty()) {
+            TERARK_VERIFY_EQ(mem::n, 0);
+            init_chunk_owner();
+        }
     }
     size_t get_chunk_size() const { return m_chunk_size; }
 
@@ -157,8 +233,18 @@ public:
     size_t slow_get_free_size() const;
     size_t get_cur_tls_free_size() const;
 
+    // per thread cache stat, (*each)[i] is the free size of i-th thread cache,
+    // return value is same as slow_get_free_size()
+    size_t slow_get_free_size(valvec<size_t>* each) const;
+
     void destroy_and_clean();
     void get_fastbin(valvec<size_t>* fast) const;
+
+    // per thread cache stat, (*fast)[i] is fastbin of i-th thread cache
+    void get_fastbin(valvec<valvec<size_t> >* fast) const;
+    size_t get_depot_len() const {
+        return as_atomic(m_depot_len).load(std::memory_order_relaxed);
+    }
     void print_stat(FILE* fp) const;
 
     size_t get_huge_stat(size_t* huge_memsize) const;
@@ -226,9 +312,27 @@ public:
         }
         len = pow2_align_up(len, AlignSize);
         assert(pos + len <= mem::n);
+        if (m_remote_free) {
+            auto owner = chunk_owner(pos);
+            if (terark_unlikely(owner != tc && nullptr != owner &&
+                    len >= sizeof(typename TCMemPoolOneThread<AlignSize>::remote_link_t) &&
+                    !as_atomic(owner->m_is_idle).load(std::memory_order_relaxed))) {
+                owner->remote_free(mem::p, pos, len);
+                tc->m_remote_out += len;
+                return;
+            }
+        }
         tc->sfree(mem::p, pos, len);
     }
 
+    TCMemPoolOneThread<AlignSize>* chunk_owner(size_t pos) const {
+        size_t ci = (size_t(mem::p + pos) >> m_chunk_shift) - m_chunk_base_idx;
+        if (ci < m_chunk_owner.size())
+            return as_atomic(m_chunk_owner[ci]).load(std::memory_order_relaxed);
+        else
+            return nullptr;
+    }
+
     void tc_populate(size_t sz);
 };
 
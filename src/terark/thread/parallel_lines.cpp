@@ -0,0 +1,99 @@
+/* vim: set tabstop=4 : */
+#include "parallel_lines.hpp"
+#include <terark/util/throw.hpp>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+namespace terark {
+
+LineBlockTask::~LineBlockTask() {}
+
+LineBlockReader::LineBlockReader(FILE* fp, size_t block_size)
+  : PipelineStage(-1) // generate plserial
+{
+	TERARK_VERIFY(NULL != fp);
+	TERARK_VERIFY_GT(block_size, 0);
+	m_fp = fp;
+	m_block_size = block_size;
+	m_lineno = 0;
+	m_bytes = 0;
+	m_step_name = "LineBlockReader";
+}
+
+LineBlockReader::~LineBlockReader() {}
+
+void LineBlockReader::process(int /*threadno*/, PipelineQueueItem* item) {
+	LineBlockTask* t = new LineBlockTask();
+	t->data.swap(m_carry);
+	t->data.reserve(t->data.size() + m_block_size);
+	for (;;) {
+		size_t oldsize = t->data.size();
+		t->data.resize_no_init(oldsize + m_block_size);
+		size_t n = fread(t->data.data() + oldsize, 1, m_block_size, m_fp);
+		t->data.risk_set_size(oldsize + n);
+		m_bytes += n;
+		if (n < m_block_size) {
+			if (ferror(m_fp)) {
+				int err = errno;
+				delete t;
+				m_owner->stop();
+				THROW_STD(runtime_error, "fread(block_size = %zd) = %s",
+						  m_block_size, strerror(err));
+			}
+			// EOF, emit all remaining data, the last line may have no '\n'
+			m_owner->stop();
+			if (t->data.empty()) {
+				delete t;
+				return;
+			}
+			break;
+		}
+		const byte_t* beg = t->data.data();
+		const byte_t* eol = (const byte_t*)memrchr(beg + oldsize, '\n', n);
+		if (eol) {
+			size_t cut = eol + 1 - beg;
+			m_carry.assign(beg + cut, t->data.size() - cut);
+			t->data.risk_set_size(cut);
+			break;
+		}
+		// a very long line, grow the block
+	}
+	t->lineno = m_lineno + 1;
+	t->num_lines = std::count(t->data.begin(), t->data.end(), '\n');
+	if ('\n' != t->data.back())
+		t->num_lines++; // last line without '\n'
+	m_lineno += t->num_lines;
+	item->task = t;
+}
+
+size_t parallel_ingest_lines(FILE* fp, const ParallelLinesOptions& opt,
+				const function<void(int threadno, LineBlockTask*)>& parse,
+				const function<void(LineBlockTask*)>& output)
+{
+	TERARK_VERIFY_GT(opt.threads, 0);
+	PipelineProcessor pipeline;
+	PipelineStageErrors errors(&pipeline);
+	LineBlockReader* reader = new LineBlockReader(fp, opt.block_size);
+	pipeline.setLogLevel(0);
+	pipeline.setQueueSize(opt.queue_size ? opt.queue_size : opt.threads * 2);
+	pipeline
+	  | reader
+	  | new FunPipelineStage(opt.threads,
+		[&](PipelineStage*, int tno, PipelineQueueItem* item) {
+			errors.run([&]{ parse(tno, static_cast<LineBlockTask*>(item->task)); });
+		}, "parse")
+	  | new FunPipelineStage(opt.keep_order ? 0 : 1,
+		[&](PipelineStage*, int, PipelineQueueItem* item) {
+			errors.run([&]{ output(static_cast<LineBlockTask*>(item->task)); });
+		}, "output");
+	pipeline.start();
+	pipeline.wait();
+	errors.rethrow_first();
+	const std::string& err = reader->err(0);
+	if (!err.empty())
+		THROW_STD(runtime_error, "%s", err.c_str());
+	return reader->lines();
+}
+
+} // namespace terark
@@ -0,0 +1,85 @@
+/* vim: set tabstop=4 : */
+#pragma once
+
+#include "pipeline.hpp"
+#include <terark/valvec.hpp>
+#include <terark/util/function.hpp>
+#include <stdio.h>
+
+namespace terark {
+
+/// A block of complete lines, produced by LineBlockReader.
+/// The last line of input may have no '\n'.
+class TERARK_DLL_EXPORT LineBlockTask : public PipelineTask {
+public:
+	valvec<byte_t> data; ///< complete lines
+	valvec<byte_t> out;  ///< output of parse stage, for output stage
+	valvec<byte_t> out2; ///< optional second output, such as values
+	size_t lineno;       ///< line number(1 based) of the first line
+	size_t num_lines;    ///< number of lines in data
+
+	LineBlockTask() : lineno(0), num_lines(0) {}
+	~LineBlockTask() override;
+
+	/// fn(lineno, beg, end), all trailing '\r' and '\n' are excluded, just
+	/// as LineBuf::chomp, *end is writable('\n' or '\r' or the byte past
+	/// data.end()) thus fn can set *end = '\0' to get a C string
+	template<class Fn>
+	void for_each_line(Fn fn) {
+		data.reserve(data.size() + 1);
+		char* beg = (char*)data.begin();
+		char* end = (char*)data.end();
+		size_t ln = lineno;
+		while (beg < end) {
+			char* eol = (char*)memchr(beg, '\n', end - beg);
+			char* next = eol ? eol + 1 : end;
+			if (!eol)
+				eol = end;
+			while (eol > beg && '\r' == eol[-1])
+				eol--;
+			fn(ln++, beg, eol);
+			beg = next;
+		}
+	}
+};
+
+/// First stage(generator) of a pipeline, read input by large blocks and cut
+/// each block at the last '\n', the tail is carried to the next block, a line
+/// longer than block_size makes the block grow until '\n' or EOF.
+///
+/// Input may be any FILE*, such as stdin, pipe, ProcPipeStream, it needs not
+/// to be a regular file as MmapWholeFile::parallel_for_lines does.
+class TERARK_DLL_EXPORT LineBlockReader : public PipelineStage {
+	FILE*  m_fp;
+	size_t m_block_size;
+	size_t m_lineno;
+	size_t m_bytes;
+	valvec<byte_t> m_carry;
+protected:
+	void process(int threadno, PipelineQueueItem* item) override;
+public:
+	explicit LineBlockReader(FILE* fp, size_t block_size = 4 << 20);
+	~LineBlockReader() override;
+	size_t lines() const { return m_lineno; }
+	size_t bytes() const { return m_bytes; }
+};
+
+struct ParallelLinesOptions {
+	size_t block_size = 4 << 20;
+	int    threads    = 4; ///< parse threads
+	int    queue_size = 0; ///< 0 means threads * 2
+	bool   keep_order = true; ///< output blocks in input order
+};
+
+/// Read lines from fp by LineBlockReader, call parse(threadno, task) in
+/// parallel, then call output(task) serially, in input order if keep_order.
+/// parse is generally writing task->out, output writes task->out to a sink.
+/// The first exception thrown by parse or output stops the pipeline and is
+/// re-thrown after the pipeline is drained.
+/// @return number of lines
+TERARK_DLL_EXPORT
+size_t parallel_ingest_lines(FILE* fp, const ParallelLinesOptions&,
+				const function<void(int threadno, LineBlockTask*)>& parse,
+				const function<void(LineBlockTask*)>& output);
+
+} // namespace terark
@@ -11,6 +11,7 @@
 #endif
 
 #include "pipeline.hpp"
+#include "work_stealing_executor.hpp"
 #include <terark/circular_queue.hpp>
 #include <terark/num_to_str.hpp>
 //#include <terark/util/compare.hpp>
@@ -18,9 +19,24 @@
 //#include <deque>
 //#include <boost/circular_buffer.hpp>
 #include <terark/util/atomic.hpp>
+#include <terark/util/auto_grow_circular_queue.hpp>
 #include <terark/util/concurrent_queue.hpp>
+#include <terark/util/mpmc_ring_queue.hpp>
 #include <stdio.h>
+#include <errno.h>
+#include <string.h>
 #include <iostream>
+#include <chrono>
+#include <climits>
+
+#if defined(__linux__)
+	#include "futex.hpp"
+#endif
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__x86_64) || defined(__amd64__) || defined(__amd64)
+	#include <immintrin.h>
+#else
+	#define _mm_pause()
+#endif
 
 #if !defined(TOPLING_PIPELINE_WITH_FIBER)
 #if defined(_MSC_VER)
@@ -84,6 +100,20 @@ public:
     virtual bool empty() = 0;
     virtual size_t size() = 0;
     virtual size_t peekSize() const = 0;
+
+    // batched push/pop, overridden by LockFreeQueue
+    virtual void push_back_n(const PipelineQueueItem* x, size_t n, FiberYield* fy) {
+        for (size_t i = 0; i < n; ++i)
+            push_back(x[i], fy);
+    }
+    // @returns number of popped items, 0 indicate timeout
+    virtual size_t pop_front_n(PipelineQueueItem* x, size_t n, int timeout, FiberYield* fy) {
+        return n && pop_front(x[0], timeout, fy) ? 1 : 0;
+    }
+    virtual void get_stat(QueueStat* st) const {
+        memset(st, 0, sizeof(*st));
+        st->size = peekSize();
+    }
 };
 
 class BlockQueue : public PipelineStage::queue_t {
@@ -106,6 +136,202 @@ public:
     size_t peekSize() const final { return q.peekSize(); }
 };
 
+// lock-free ring queue, a waiter spins a while, then parks on futex.
+// push side and pop side each have a futex word and a waiter count, the
+// notifier only increments the futex word and makes the syscall when there
+// are waiters, so the uncontended path has no syscall and no lock.
+class LockFreeQueue : public PipelineStage::queue_t {
+    typedef std::chrono::steady_clock Clock;
+    enum { MaxSpinLoops = 256 };
+    util::mpmc_ring_queue<PipelineQueueItem> q;
+    alignas(64) uint32_t m_pop_futex;    // notified by push
+    uint32_t m_pop_waiters;
+    alignas(64) uint32_t m_push_futex;   // notified by pop
+    uint32_t m_push_waiters;
+    alignas(64) size_t m_push_wait_cnt;
+    size_t m_pop_wait_cnt;
+    size_t m_push_wait_us;
+    size_t m_pop_wait_us;
+    size_t m_park_cnt;
+    bool   m_fiber_yield; // EUType::mixed, yield to other fibers when spin
+
+    static void notify(uint32_t& fut, uint32_t& waiters, size_t num) {
+        // pair with fetch_add(waiters) in wait_slow: either the waiter sees
+        // the item, or we see the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (as_atomic(waiters).load(std::memory_order_relaxed)) {
+            as_atomic(fut).fetch_add(1, std::memory_order_seq_cst);
+        #if defined(__linux__)
+            futex(&fut, FUTEX_WAKE_PRIVATE, uint32_t(std::min<size_t>(num, INT_MAX)));
+        #endif
+        }
+    }
+    void park(uint32_t& fut, uint32_t seq, Clock::duration dur) {
+        as_atomic(m_park_cnt).fetch_add(1, std::memory_order_relaxed);
+    #if defined(__linux__)
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(dur).count();
+        timespec ts;
+        ts.tv_sec = time_t(ns / 1000000000);
+        ts.tv_nsec = long(ns % 1000000000);
+        if (futex(&fut, FUTEX_WAIT_PRIVATE, seq, &ts) < 0) {
+            int err = errno;
+            if (!(EINTR == err || EAGAIN == err || ETIMEDOUT == err))
+                TERARK_DIE("futex(WAIT) = %d: %s", err, strerror(err));
+        }
+    #else
+        TERARK_UNUSED_VAR(seq);
+        TERARK_UNUSED_VAR(dur);
+        std::this_thread::yield();
+    #endif
+    }
+    template<class TryOp>
+    bool wait_slow(TryOp try_op, uint32_t& fut, uint32_t& waiters,
+                   size_t& wait_cnt, size_t& wait_us, int timeout, FiberYield* fy) {
+        auto t0 = Clock::now();
+        bool ok = false;
+        // spin is useless on single cpu, the peer can not run while we spin
+        static const int spin_loops =
+            std::thread::hardware_concurrency() > 1 ? MaxSpinLoops : 0;
+        for (int i = 0; i < spin_loops; ++i) {
+        #if TOPLING_PIPELINE_WITH_FIBER
+            if (m_fiber_yield)
+                fy->yield();
+            else
+        #endif
+                _mm_pause();
+            if (try_op()) {
+                ok = true;
+                goto Done;
+            }
+        }
+        {
+            auto deadline = t0 + std::chrono::milliseconds(timeout);
+            for (;;) {
+                as_atomic(waiters).fetch_add(1, std::memory_order_seq_cst);
+                uint32_t seq = as_atomic(fut).load(std::memory_order_seq_cst);
+                if (try_op()) {
+                    as_atomic(waiters).fetch_sub(1, std::memory_order_relaxed);
+                    ok = true;
+                    break;
+                }
+                auto now = Clock::now();
+                if (now >= deadline) {
+                    as_atomic(waiters).fetch_sub(1, std::memory_order_relaxed);
+                    break;
+                }
+                park(fut, seq, deadline - now);
+                as_atomic(waiters).fetch_sub(1, std::memory_order_relaxed);
+                if (try_op()) {
+                    ok = true;
+                    break;
+                }
+            }
+        }
+      Done:
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+        as_atomic(wait_cnt).fetch_add(1, std::memory_order_relaxed);
+        as_atomic(wait_us).fetch_add(size_t(us), std::memory_order_relaxed);
+        return ok;
+    }
+public:
+    LockFreeQueue(size_t size, bool fiber_yield) : q(size) {
+        m_pop_futex = m_pop_waiters = 0;
+        m_push_futex = m_push_waiters = 0;
+        m_push_wait_cnt = m_pop_wait_cnt = 0;
+        m_push_wait_us = m_pop_wait_us = 0;
+        m_park_cnt = 0;
+        m_fiber_yield = fiber_yield;
+    }
+    void push_back(const PipelineQueueItem& x, FiberYield* fy) final {
+        push_back_n(&x, 1, fy);
+    }
+    bool push_back(const PipelineQueueItem& x, int timeout, FiberYield* fy) final {
+        if (!q.try_push(x)) {
+            auto try_op = [&]() { return q.try_push(x); };
+            if (!wait_slow(try_op, m_push_futex, m_push_waiters,
+                           m_push_wait_cnt, m_push_wait_us, timeout, fy))
+                return false;
+        }
+        notify(m_pop_futex, m_pop_waiters, 1);
+        return true;
+    }
+    void push_back_n(const PipelineQueueItem* x, size_t n, FiberYield* fy) final {
+        size_t pushed = q.try_push_n(x, n);
+        if (pushed)
+            notify(m_pop_futex, m_pop_waiters, pushed);
+        while (pushed < n) {
+            size_t k = 0;
+            auto try_op = [&]() { return (k = q.try_push_n(x + pushed, n - pushed)) != 0; };
+            if (wait_slow(try_op, m_push_futex, m_push_waiters,
+                          m_push_wait_cnt, m_push_wait_us, 1000, fy)) {
+                notify(m_pop_futex, m_pop_waiters, k);
+                pushed += k;
+            }
+        }
+    }
+    bool pop_front(PipelineQueueItem& x, int timeout, FiberYield* fy) final {
+        return pop_front_n(&x, 1, timeout, fy) == 1;
+    }
+    size_t pop_front_n(PipelineQueueItem* x, size_t n, int timeout, FiberYield* fy) final {
+        size_t k = q.try_pop_n(x, n);
+        if (0 == k) {
+            auto try_op = [&]() { return (k = q.try_pop_n(x, n)) != 0; };
+            if (!wait_slow(try_op, m_pop_futex, m_pop_waiters,
+                           m_pop_wait_cnt, m_pop_wait_us, timeout, fy))
+                return 0;
+        }
+        notify(m_push_futex, m_push_waiters, k);
+        return k;
+    }
+    bool empty() final { return q.peekEmpty(); }
+    size_t size() final { return q.peekSize(); }
+    size_t peekSize() const final { return q.peekSize(); }
+    void get_stat(PipelineStage::QueueStat* st) const final {
+        st->size = q.peekSize();
+        st->capacity = q.capacity();
+        st->push_wait_cnt = as_atomic(m_push_wait_cnt).load(std::memory_order_relaxed);
+        st->pop_wait_cnt  = as_atomic(m_pop_wait_cnt ).load(std::memory_order_relaxed);
+        st->push_wait_us  = as_atomic(m_push_wait_us ).load(std::memory_order_relaxed);
+        st->pop_wait_us   = as_atomic(m_pop_wait_us  ).load(std::memory_order_relaxed);
+        st->park_cnt      = as_atomic(m_park_cnt     ).load(std::memory_order_relaxed);
+    }
+};
+
+// queue between stages in executor mode, it must not block the pusher which
+// is an executor worker, the amount of items is bounded by m_exec_inflight
+class UnboundedQueue : public PipelineStage::queue_t {
+    std::mutex m_mtx;
+    AutoGrowCircularQueue<PipelineQueueItem> q;
+    size_t m_size; // for racy peekSize
+public:
+    UnboundedQueue() : q(256) { m_size = 0; }
+	void push_back(const PipelineQueueItem& x, FiberYield*) final {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        q.push_back(x);
+        as_atomic(m_size).store(q.size(), std::memory_order_relaxed);
+	}
+    bool push_back(const PipelineQueueItem& x, int, FiberYield* fy) final {
+        push_back(x, fy);
+        return true;
+    }
+    bool pop_front(PipelineQueueItem& x, int timeout, FiberYield* fy) final {
+        return pop_front_n(&x, 1, timeout, fy) == 1;
+    }
+    // never wait, timeout is ignored
+    size_t pop_front_n(PipelineQueueItem* x, size_t n, int, FiberYield*) final {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        n = std::min(n, q.size());
+        q.pop_n(x, n);
+        as_atomic(m_size).store(q.size(), std::memory_order_relaxed);
+        return n;
+    }
+    bool empty() final { return peekSize() == 0; }
+    size_t size() final { return peekSize(); }
+    size_t peekSize() const final {
+        return as_atomic(m_size).load(std::memory_order_relaxed);
+    }
+};
+
 #if TOPLING_PIPELINE_WITH_FIBER
 class FiberQueue : public PipelineStage::queue_t {
     circular_queue<PipelineQueueItem> q;
@@ -176,18 +402,31 @@ public:
 
 static
 PipelineStage::queue_t*
-NewQueue(PipelineProcessor::EUType euType, size_t size) {
+NewQueue(PipelineProcessor::EUType euType, PipelineStage::QueueType qt, size_t size) {
+	const bool lock_free = PipelineStage::QueueType::lock_free == qt;
 	switch (euType) {
 	default: abort();
 	case PipelineProcessor::EUType::fiber : return new FiberQueue(size);
-	case PipelineProcessor::EUType::thread: return new BlockQueue(size);
-	case PipelineProcessor::EUType::mixed : return new MixedQueue(size);
+	case PipelineProcessor::EUType::thread:
+		if (lock_free)
+			return new LockFreeQueue(size, false);
+		else
+			return new BlockQueue(size);
+	case PipelineProcessor::EUType::mixed :
+		if (lock_free)
+			return new LockFreeQueue(size, true);
+		else
+			return new MixedQueue(size);
 	}
 }
 #else
 static
-PipelineStage::queue_t* NewQueue(PipelineProcessor::EUType, size_t size) {
-	return new BlockQueue(size);
+PipelineStage::queue_t*
+NewQueue(PipelineProcessor::EUType, PipelineStage::QueueType qt, size_t size) {
+	if (PipelineStage::QueueType::lock_free == qt)
+		return new LockFreeQueue(size, false);
+	else
+		return new BlockQueue(size);
 }
 #endif
 
@@ -299,6 +538,7 @@ PipelineStage::PipelineStage(int thread_count, int fibers_per_thread)
 	m_threads.resize(thread_count);
 	m_fibers_per_thread = std::max(fibers_per_thread, 1);
 	m_running_exec_units = 0;
+	m_queue_type = QueueType::lock_free;
 }
 
 PipelineStage::~PipelineStage()
@@ -306,7 +546,8 @@ PipelineStage::~PipelineStage()
 	delete m_out_queue;
 	for (size_t threadno = 0; threadno != m_threads.size(); ++threadno)
 	{
-		assert(!m_threads[threadno].m_thread->joinable());
+		// m_thread is NULL in executor mode
+		assert(!m_threads[threadno].m_thread || !m_threads[threadno].m_thread->joinable());
 	}
 }
 
@@ -323,10 +564,17 @@ size_t PipelineStage::getOutputQueueSize() const {
 void PipelineStage::createOutputQueue(size_t size) {
 	if (size > 0) {
 		assert(NULL == this->m_out_queue);
-		this->m_out_queue = NewQueue(m_owner->m_EUType, size);
+		this->m_out_queue = NewQueue(m_owner->m_EUType, m_queue_type, size);
 	}
 }
 
+PipelineStage::QueueStat PipelineStage::getOutputQueueStat() const {
+	assert(this->m_out_queue);
+	QueueStat st;
+	this->m_out_queue->get_stat(&st);
+	return st;
+}
+
 const std::string& PipelineStage::err(int threadno) const
 {
 	return m_threads[threadno].m_err_text;
@@ -368,12 +616,16 @@ void PipelineStage::wait()
 void PipelineStage::start(int queue_size)
 {
 	assert(NULL != m_owner);
+	if (m_owner->m_executor) {
+		exec_start();
+		return;
+	}
 	const auto euType = m_owner->m_EUType;
 	const bool fiberMode = euType == PipelineProcessor::EUType::fiber;
 
 	if (this != m_owner->m_head->m_prev) { // is not last step
 		if (NULL == m_out_queue)
-			m_out_queue = NewQueue(euType, queue_size);
+			m_out_queue = NewQueue(euType, m_queue_type, queue_size);
 	}
 	if (m_step_name.empty()) {
 		m_step_name.reserve(15);
@@ -383,7 +635,15 @@ void PipelineStage::start(int queue_size)
 	if (m_threads.size() == 0) {
 		throw std::runtime_error("thread count = 0");
 	}
-	m_running_exec_units = 0;
+	// count exec units as running before they are spawned, else if the
+	// generator stops before threads of this stage are scheduled, next stage
+	// finds this stage not running and its queue empty, then exits early
+	int exec_units = int(m_threads.size());
+#if TOPLING_PIPELINE_WITH_FIBER
+	if (euType == PipelineProcessor::EUType::mixed)
+		exec_units *= m_fibers_per_thread;
+#endif
+	m_running_exec_units = exec_units;
 
 	for (int threadno = 0; threadno != (int)m_threads.size(); ++threadno)
 	{
@@ -492,7 +752,7 @@ void PipelineStage::run_wrapper(int threadno)
   #endif
   }
 #endif
-	as_atomic(m_running_exec_units)++;
+	// m_running_exec_units was increased by start()
 	m_threads[threadno].m_live_fibers++;
 	bool setup_successed = false;
 	try {
@@ -746,16 +1006,22 @@ void PipelineStage::run_serial_step_fast(int threadno)
 	const ptrdiff_t nlen = TERARK_IF_DEBUG(4, 64); // should power of 2
 	ptrdiff_t head = 0;
 	valvec<PipelineQueueItem> cache(nlen), overflow;
+	// this is the single consumer, pop in batch to reduce queue overhead
+	PipelineQueueItem batch[16];
+	size_t batch_head = 0, batch_tail = 0;
 	m_plserial = 1; // this is expected_serial
-	while (isPrevRunning()) {
-		PipelineQueueItem item;
-		if (!m_prev->m_out_queue->pop_front(item, m_owner->m_queue_timeout, fy))
-        {
-		    if (m_owner->m_logLevel >= 3) {
-		        fprintf(stderr, "Pipeline: serial_step_fast(%s): tno=%d, prev.live_exec = %d, wait pop timeout, retry ...\n", m_step_name.c_str(), threadno, m_prev->m_running_exec_units);
-		    }
-			continue;
+	while (batch_head < batch_tail || isPrevRunning()) {
+		if (batch_head == batch_tail) {
+			batch_head = 0;
+			batch_tail = m_prev->m_out_queue->pop_front_n(batch, 16, m_owner->m_queue_timeout, fy);
+			if (0 == batch_tail) {
+			    if (m_owner->m_logLevel >= 3) {
+			        fprintf(stderr, "Pipeline: serial_step_fast(%s): tno=%d, prev.live_exec = %d, wait pop timeout, retry ...\n", m_step_name.c_str(), threadno, m_prev->m_running_exec_units);
+			    }
+				continue;
+			}
 		}
+		PipelineQueueItem item = batch[batch_head++];
 		CHECK_SERIAL()
 		ptrdiff_t diff = item.plserial - m_plserial; // diff is in [0, nlen)
 		//  not all equivalent to cycle queue, so it is not 'diff < nlen-1'
@@ -824,6 +1090,123 @@ void PipelineStage::run_serial_step_fast(int threadno)
 	}
 }
 
+//////////////////////////////////////////////////////////////////////////
+// executor mode: no dedicated exec units, pushing an item to the input
+// queue of a stage schedules a runner of the stage into the executor.
+
+void PipelineStage::exec_start()
+{
+	if (this != m_owner->m_head->m_prev) { // is not last step
+		if (NULL == m_out_queue)
+			m_out_queue = new UnboundedQueue();
+	}
+	if (m_step_name.empty()) {
+		char buf[32];
+		m_step_name.assign(buf, snprintf(buf, sizeof(buf), "stage-%d", step_ordinal()));
+	}
+	if (ple_keep == m_pl_enum)
+		m_plserial = 1; // this is expected_serial
+	m_exec_free_tno.erase_all();
+	for (int threadno = int(m_threads.size()); threadno-- > 0; ) {
+		m_exec_free_tno.push_back(threadno);
+		setup(threadno);
+	}
+}
+
+// called after pushing to input queue, and by a runner after it returned
+// its threadno: if pusher found no free threadno, the runner found the item
+void PipelineStage::exec_schedule()
+{
+	int threadno;
+	{
+		PipelineLockGuard lock(m_exec_mtx);
+		if (m_exec_free_tno.empty())
+			return;
+		threadno = m_exec_free_tno.pop_val();
+	}
+	as_atomic(m_running_exec_units)++;
+	m_owner->m_executor->submit(&PipelineStage::exec_runner, this, threadno);
+}
+
+void PipelineStage::exec_runner(void* stage, size_t threadno, size_t)
+{
+	static_cast<PipelineStage*>(stage)->exec_run(int(threadno));
+}
+
+void PipelineStage::exec_run(int threadno)
+{
+	queue_t* inq = m_prev->m_out_queue;
+	PipelineQueueItem batch[16];
+	size_t done = 0;
+	// limit items per run, let other stages and pipelines to get workers
+	while (done < 256) {
+		size_t n = inq->pop_front_n(batch, 16, 0, NULL);
+		if (0 == n)
+			break;
+		for (size_t i = 0; i < n; ++i)
+			exec_item(threadno, batch[i]);
+		done += n;
+	}
+	{
+		PipelineLockGuard lock(m_exec_mtx);
+		m_exec_free_tno.push_back(threadno);
+	}
+	if (!inq->empty())
+		exec_schedule();
+	// must be the last access to this stage, PipelineProcessor::exec_wait
+	// checks it for all runners are finished
+	as_atomic(m_running_exec_units)--;
+}
+
+void PipelineStage::exec_item(int threadno, PipelineQueueItem& item)
+{
+	PipelineProcessor* owner = m_owner;
+	auto do_item = [&](PipelineQueueItem& x) {
+		if (x.task) {
+			try {
+				process(threadno, &x);
+			}
+			catch (const std::exception& exp) {
+				onException(threadno, exp);
+				owner->stop();
+				if (x.task) {
+					owner->destroyTask(x.task);
+					x.task = NULL;
+				}
+			}
+		}
+		if (this == owner->m_head->m_prev) { // is last step
+			if (x.task)
+				owner->destroyTask(x.task);
+			owner->exec_done();
+		}
+		else if (x.task || owner->m_keepSerial) {
+			m_out_queue->push_back(x, NULL);
+			m_next->exec_schedule();
+		}
+		else {
+			owner->exec_done();
+		}
+	};
+	if (ple_keep == m_pl_enum) {
+		// at most 1 runner, m_exec_reorder & m_plserial are not shared
+		CHECK_SERIAL()
+		m_exec_reorder.push_back(item);
+		push_heap(m_exec_reorder.begin(), m_exec_reorder.end(), plserial_greater());
+		while (!m_exec_reorder.empty() && m_exec_reorder[0].plserial == m_plserial) {
+			pop_heap(m_exec_reorder.begin(), m_exec_reorder.end(), plserial_greater());
+			PipelineQueueItem x = m_exec_reorder.pop_val();
+			do_item(x);
+			++m_plserial;
+		}
+	}
+	else {
+		if (ple_generate == m_pl_enum)
+			item.plserial = ++m_plserial; // at most 1 runner
+		do_item(item);
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 FunPipelineStage::FunPipelineStage(int thread_count,
@@ -891,6 +1274,9 @@ PipelineProcessor::PipelineProcessor()
 	m_run = false;
 	m_logLevel = 1;
 	m_EUType = EUType::thread;
+	m_executor = NULL;
+	m_exec_inflight = 0;
+	m_exec_waiters = 0;
 }
 
 PipelineProcessor::~PipelineProcessor()
@@ -938,7 +1324,15 @@ std::string PipelineProcessor::queueInfo()
 	const PipelineStage* p = m_head->m_next;
 	oss << "QueueSize: ";
 	while (p != m_head->m_prev) {
-		oss << "(" << p->m_step_name << "=" << p->m_out_queue->peekSize() << "), ";
+		PipelineStage::QueueStat st;
+		p->m_out_queue->get_stat(&st);
+		oss << "(" << p->m_step_name << "=" << st.size;
+		if (st.capacity) { // has wait counters
+			oss << ", push_wait=" << st.push_wait_cnt << ":" << st.push_wait_us/1000 << "ms"
+				<< ", pop_wait=" << st.pop_wait_cnt << ":" << st.pop_wait_us/1000 << "ms"
+				<< ", park=" << st.park_cnt;
+		}
+		oss << "), ";
 		p = p->m_next;
 	}
 	oss.resize(oss.size()-2);
@@ -984,6 +1378,12 @@ void PipelineProcessor::start()
 		}
 	}
 // End check for double start
+	// executor mode only supports compile(): input feed is from external
+	TERARK_RT_assert(!m_executor || m_head->m_out_queue, std::invalid_argument);
+	if (m_executor && EUType::thread != m_EUType && m_logLevel >= 1) {
+		fprintf(stderr, "WARN: Pipeline: EUType %s is ignored in executor mode\n",
+				euTypeName());
+	}
 
 	m_run = true;
 
@@ -1040,13 +1440,20 @@ void PipelineProcessor::compile(int input_feed_queue_size)
 		}
 	}
 // End check for double start
-	m_head->m_out_queue = NewQueue(m_EUType, input_feed_queue_size);
+	if (m_executor)
+		m_head->m_out_queue = new UnboundedQueue();
+	else
+		m_head->m_out_queue = NewQueue(m_EUType, m_head->m_queue_type, input_feed_queue_size);
 	start();
 }
 
 void PipelineProcessor::enqueue(PipelineTask* task)
 {
-    if (EUType::fiber == m_EUType) {
+    if (m_executor) {
+    	PipelineLockGuard lock(m_mutexForInqueue);
+        exec_enqueue(&task, 1);
+    }
+    else if (EUType::fiber == m_EUType) {
         enqueue_impl(task);
     }
     else {
@@ -1071,7 +1478,11 @@ void PipelineProcessor::enqueue_impl(PipelineTask* task) {
 }
 
 void PipelineProcessor::enqueue(PipelineTask** tasks, size_t num) {
-    if (EUType::fiber == m_EUType) {
+    if (m_executor) {
+        PipelineLockGuard lock(m_mutexForInqueue);
+        exec_enqueue(tasks, num);
+    }
+    else if (EUType::fiber == m_EUType) {
         enqueue_impl(tasks, num);
     }
     else {
@@ -1094,8 +1505,13 @@ void PipelineProcessor::enqueue_impl(PipelineTask** tasks, size_t num) {
         }
     }
     else {
-        for (size_t i = 0; i < num; ++i) {
-            queue->push_back(PipelineQueueItem(++plserial, tasks[i]), &fy);
+        PipelineQueueItem items[64];
+        for (size_t i = 0; i < num; ) {
+            size_t n = std::min(num - i, size_t(64));
+            for (size_t j = 0; j < n; ++j)
+                items[j] = PipelineQueueItem(++plserial, tasks[i + j]);
+            queue->push_back_n(items, n, &fy);
+            i += n;
         }
     }
 	m_head->m_plserial = plserial;
@@ -1106,10 +1522,90 @@ void PipelineProcessor::wait()
 	if (NULL != m_head->m_out_queue) {
 		assert(!this->m_run); // user must call stop() before wait
 	}
+	if (m_executor) {
+		exec_wait();
+		return;
+	}
 	for (PipelineStage* s = m_head->m_next; s != m_head; s = s->m_next)
 		s->wait();
 }
 
+static void exec_futex_wait(uint32_t* addr, uint32_t val) {
+#if defined(__linux__)
+	timespec ts = {0, 1000000}; // 1ms, limit the damage of a missed wake
+	futex(addr, FUTEX_WAIT_PRIVATE, val, &ts);
+#else
+	TERARK_UNUSED_VAR(addr);
+	TERARK_UNUSED_VAR(val);
+	std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+}
+
+// back pressure: limit the number of tasks in the pipeline, inter stage
+// queues of executor mode are unbounded because executor workers must not
+// block on pushing
+void PipelineProcessor::exec_enqueue(PipelineTask** tasks, size_t num) {
+	const uint32_t limit = uint32_t(std::max(m_queue_size, 1) * total_steps());
+	uintptr_t plserial = m_head->m_plserial;
+	for (size_t i = 0; i < num; ++i) {
+		for (;;) {
+			uint32_t inflight = as_atomic(m_exec_inflight).load(std::memory_order_seq_cst);
+			if (inflight < limit)
+				break;
+			// a worker enqueue: run other tasks instead of blocking
+			if (m_executor->current_worker() >= 0 && m_executor->help_one())
+				continue;
+			as_atomic(m_exec_waiters).fetch_add(1, std::memory_order_seq_cst);
+			if (as_atomic(m_exec_inflight).load(std::memory_order_seq_cst) == inflight)
+				exec_futex_wait(&m_exec_inflight, inflight);
+			as_atomic(m_exec_waiters).fetch_sub(1, std::memory_order_relaxed);
+		}
+		as_atomic(m_exec_inflight).fetch_add(1, std::memory_order_relaxed);
+		m_head->m_out_queue->push_back(PipelineQueueItem(++plserial, tasks[i]), NULL);
+		m_head->m_next->exec_schedule();
+	}
+	m_head->m_plserial = plserial;
+}
+
+void PipelineProcessor::exec_done() {
+	as_atomic(m_exec_inflight).fetch_sub(1, std::memory_order_seq_cst);
+	if (as_atomic(m_exec_waiters).load(std::memory_order_seq_cst)) {
+	#if defined(__linux__)
+		futex(&m_exec_inflight, FUTEX_WAKE_PRIVATE, INT_MAX);
+	#endif
+	}
+}
+
+void PipelineProcessor::exec_wait() {
+	auto is_busy = [this]() {
+		if (as_atomic(m_exec_inflight).load(std::memory_order_seq_cst))
+			return true;
+		for (PipelineStage* s = m_head->m_next; s != m_head; s = s->m_next) {
+			if (as_atomic(s->m_running_exec_units).load(std::memory_order_seq_cst))
+				return true;
+		}
+		return false;
+	};
+	while (is_busy()) {
+		if (m_executor->current_worker() >= 0 && m_executor->help_one())
+			continue;
+		uint32_t inflight = as_atomic(m_exec_inflight).load(std::memory_order_seq_cst);
+		if (inflight) {
+			as_atomic(m_exec_waiters).fetch_add(1, std::memory_order_seq_cst);
+			if (as_atomic(m_exec_inflight).load(std::memory_order_seq_cst) == inflight)
+				exec_futex_wait(&m_exec_inflight, inflight);
+			as_atomic(m_exec_waiters).fetch_sub(1, std::memory_order_relaxed);
+		}
+		else {
+			std::this_thread::yield(); // runners are returning threadno
+		}
+	}
+	for (PipelineStage* s = m_head->m_next; s != m_head; s = s->m_next) {
+		for (int threadno = 0; threadno < (int)s->m_threads.size(); ++threadno)
+			s->clean(threadno);
+	}
+}
+
 void PipelineProcessor::add_step(PipelineStage* step)
 {
 	step->m_owner = this;
@@ -1165,5 +1661,19 @@ size_t PipelineProcessor::getInputQueueSize(size_t step_no) const {
 	return step->m_out_queue->size();
 }
 
+void PipelineStageErrors::on_error() {
+	// the first one sets m_failed and keeps the exception, m_first is read
+	// by rethrow_first after all stage threads are done
+	if (!m_failed.exchange(true))
+		m_first = std::current_exception();
+	if (m_stop_on_error)
+		m_stop_on_error->stop();
+}
+
+void PipelineStageErrors::rethrow_first() const {
+	if (m_first)
+		std::rethrow_exception(m_first);
+}
+
 } // namespace terark
 
@@ -8,6 +8,8 @@
 #endif
 
 #include <stddef.h>
+#include <atomic>
+#include <exception>
 #include <string>
 #include <type_traits>
 #include <terark/config.hpp>
@@ -62,6 +64,7 @@ public:
 };
 
 class TERARK_DLL_EXPORT PipelineProcessor;
+class TERARK_DLL_EXPORT WorkStealingExecutor;
 
 class TERARK_DLL_EXPORT PipelineStage : boost::noncopyable
 {
@@ -71,6 +74,20 @@ public:
 	class queue_t;
 	class ExecUnit; // ExecUnit is thread or fiber
 
+	enum class QueueType : unsigned char {
+		lock_free, ///< lock-free ring buffer, spin then park on futex
+		mutex,     ///< concurrent_queue, mutex + condition_variable
+	};
+	struct QueueStat {
+		size_t size;          ///< current depth, approximate
+		size_t capacity;
+		size_t push_wait_cnt; ///< number of push which found queue full
+		size_t pop_wait_cnt;  ///< number of pop  which found queue empty
+		size_t push_wait_us;  ///< total time of push waiting for a slot
+		size_t pop_wait_us;   ///< total time of pop  waiting for an item
+		size_t park_cnt;      ///< number of waits which are parked in kernel
+	};
+
 protected:
 	queue_t* m_out_queue;
 
@@ -93,6 +110,20 @@ protected:
 	uintptr_t m_plserial;
 	int m_fibers_per_thread;
 	volatile int m_running_exec_units;
+	QueueType m_queue_type; // type of m_out_queue
+
+	// executor mode, see PipelineProcessor::setExecutor()
+	// at most m_threads.size() runners of this stage are in the executor,
+	// a runner takes a free threadno, drains the input queue, then returns
+	// the threadno, so threadno is still unique among concurrent process()
+	mutex m_exec_mtx; // protects m_exec_free_tno
+	valvec<int> m_exec_free_tno;
+	valvec<PipelineQueueItem> m_exec_reorder; // min heap for ple_keep
+	static void exec_runner(void* stage, size_t threadno, size_t);
+	void exec_schedule();
+	void exec_run(int threadno);
+	void exec_item(int threadno, PipelineQueueItem& item);
+	void exec_start();
 
 	void run_wrapper(int threadno);
 
@@ -138,6 +169,12 @@ public:
 	size_t getInputQueueSize()  const;
 	size_t getOutputQueueSize() const;
 	void createOutputQueue(size_t size);
+
+	/// type of output queue, must be set before pipeline start/compile,
+	/// it is ignored for EUType::fiber, which always uses FiberQueue
+	void setQueueType(QueueType qt) { m_queue_type = qt; }
+	QueueType getQueueType() const { return m_queue_type; }
+	QueueStat getOutputQueueStat() const;
 };
 
 class TERARK_DLL_EXPORT FunPipelineStage : public PipelineStage
@@ -179,6 +216,9 @@ private:
 	bool m_keepSerial;
 	signed char m_logLevel;
 	EUType m_EUType;
+	WorkStealingExecutor* m_executor;
+	uint32_t m_exec_inflight; // enqueued but not finished tasks
+	uint32_t m_exec_waiters;
 
 protected:
 	static void defaultDestroyTask(PipelineTask* task);
@@ -190,6 +230,10 @@ protected:
 	void enqueue_impl(PipelineTask* task);
 	void enqueue_impl(PipelineTask** tasks, size_t num);
 
+	void exec_enqueue(PipelineTask** tasks, size_t num);
+	void exec_done();
+	void exec_wait();
+
 public:
 	static int sysCpuCount();
 
@@ -207,6 +251,14 @@ public:
 
 	const char* euTypeName() const;
 
+	/// run stages as tasks of a shared executor instead of dedicated
+	/// threads/fibers, EUType is ignored in executor mode.
+	/// must be called before compile(), self-driven pipeline(start() with a
+	/// generator stage) is not supported in executor mode.
+	/// thread_count of a stage is the max concurrent runners of the stage.
+	void setExecutor(WorkStealingExecutor* exe) { m_executor = exe; }
+	WorkStealingExecutor* getExecutor() const { return m_executor; }
+
 	void setQueueSize(int queue_size) { m_queue_size = queue_size; }
 	int  getQueueSize() const { return m_queue_size; }
 	void setQueueTimeout(int queue_timeout) { m_queue_timeout = queue_timeout; }
@@ -215,6 +267,11 @@ public:
 	void setMutex(mutex* pmutex);
 	mutex* getMutex() { return m_mutex; }
 
+	/// type of input feed queue of compile()'d pipeline
+	void setInputQueueType(PipelineStage::QueueType qt) { m_head->m_queue_type = qt; }
+
+	/// depth of each queue, and wait counters for lock-free queues:
+	/// push/pop wait count, push/pop wait time and park count
 	std::string queueInfo();
 
 	int step_ordinal(const PipelineStage* step) const;
@@ -250,6 +307,36 @@ public:
 	size_t getInputQueueSize(size_t step_no) const;
 };
 
+/// Exceptions must not escape from stages: a lost task makes an ordered
+/// (keep order) stage wait for it forever. Stages run their work by run(fn),
+/// the first exception is kept, later tasks are skipped, and it is re-thrown
+/// by rethrow_first() after the pipeline is drained.
+class TERARK_DLL_EXPORT PipelineStageErrors : boost::noncopyable {
+	std::atomic<bool>  m_failed;
+	std::exception_ptr m_first;
+	PipelineProcessor* m_stop_on_error; // may be NULL
+public:
+	/// @param stop_on_error the pipeline is stopped on the first exception,
+	///        it is needed when a generator stage feeds the pipeline
+	explicit PipelineStageErrors(PipelineProcessor* stop_on_error = NULL)
+	  : m_failed(false), m_stop_on_error(stop_on_error) {}
+
+	template<class Fn>
+	void run(Fn&& fn) {
+		if (failed())
+			return;
+		try { fn(); }
+		catch (...) { on_error(); }
+	}
+	/// keep current exception if it is the first, must be called in catch
+	void on_error();
+	/// skip later tasks without an error, such as on discarding tasks
+	void set_failed() { m_failed.store(true, std::memory_order_relaxed); }
+	bool failed() const { return m_failed.load(std::memory_order_relaxed); }
+	/// must be called after PipelineProcessor::wait
+	void rethrow_first() const;
+};
+
 #define PPL_STAGE(pObject, Class, MemFun, thread_count, ...) \
 	new terark::FunPipelineStage(thread_count\
 		, terark::bind(&Class::MemFun, pObject, _1, _2, _3,##__VA_ARGS__) \
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+
+namespace terark {
+
+/// A client of smooth weighted round robin(same as nginx upstream): in any
+/// window of picks, each client is picked in proportion to its weight, and
+/// picks of different clients are interleaved instead of bursting.
+///
+/// A client whose inflight reaches its budget is skipped until done().
+/// Not thread safe, callers should hold their own lock.
+struct WeightedRoundRobinClient {
+    int    weight = 1;
+    int    curWeight = 0;
+    int    budget = 0;      ///< max inflight, 0 means no limit
+    size_t inflight = 0;    ///< picked but not done
+    size_t maxInflight = 0; ///< high watermark of inflight
+
+    bool can_pick() const { return budget <= 0 || inflight < size_t(budget); }
+    void done() { assert(inflight > 0); inflight--; }
+};
+
+/// @param get(*iter) returns WeightedRoundRobinClient* of the element, or
+///        nullptr if the element has nothing to be picked
+/// @returns iterator of picked element, whose inflight is increased, or
+///          end if no element can be picked
+template<class Iter, class GetClient>
+Iter weighted_round_robin_pick(Iter beg, Iter end, GetClient get) {
+    Iter best = end;
+    WeightedRoundRobinClient* bestc = nullptr;
+    int total = 0;
+    for (Iter iter = beg; iter != end; ++iter) {
+        WeightedRoundRobinClient* c = get(*iter);
+        if (!c || !c->can_pick())
+            continue;
+        c->curWeight += c->weight;
+        total += c->weight;
+        if (!bestc || c->curWeight > bestc->curWeight) {
+            best = iter;
+            bestc = c;
+        }
+    }
+    if (bestc) {
+        bestc->curWeight -= total;
+        bestc->inflight++;
+        if (bestc->maxInflight < bestc->inflight)
+            bestc->maxInflight = bestc->inflight;
+    }
+    return best;
+}
+
+} // namespace terark
@@ -0,0 +1,344 @@
+/* vim: set tabstop=4 : */
+#include "work_stealing_executor.hpp"
+#include <terark/fstring.hpp>
+#include <terark/util/atomic.hpp>
+#include <exception>
+#include <new>
+#include <stdlib.h>
+
+namespace terark {
+
+struct WorkStealingTls {
+	const WorkStealingExecutor* exe;
+	int idx;
+};
+static thread_local WorkStealingTls g_ws_tls = {NULL, -1};
+
+// tasks are read by thieves concurrently with the owner writing a reused
+// cell, a torn read is discarded by the failed CAS of top, so the fields
+// are relaxed atomics to be free of data race
+struct WorkStealingExecutor::TaskDeque::Array {
+	struct Cell {
+		std::atomic<void (*)(void*, size_t, size_t)> func;
+		std::atomic<void*>  arg1;
+		std::atomic<size_t> arg2;
+		std::atomic<size_t> arg3;
+	};
+	size_t mask;
+	Cell cells[1]; // actual size is mask + 1
+
+	static Array* create(size_t cap) {
+		assert((cap & (cap - 1)) == 0);
+		size_t bytes = sizeof(Array) + sizeof(Cell) * (cap - 1);
+		auto a = (Array*)malloc(bytes);
+		TERARK_VERIFY(NULL != a);
+		a->mask = cap - 1;
+		for (size_t i = 0; i < cap; ++i)
+			new(&a->cells[i]) Cell();
+		return a;
+	}
+	void put(intptr_t i, const task_t& t) {
+		Cell& c = cells[i & mask];
+		c.func.store(t.func, std::memory_order_relaxed);
+		c.arg1.store(t.arg1, std::memory_order_relaxed);
+		c.arg2.store(t.arg2, std::memory_order_relaxed);
+		c.arg3.store(t.arg3, std::memory_order_relaxed);
+	}
+	void get(intptr_t i, task_t* t) const {
+		const Cell& c = cells[i & mask];
+		t->func = c.func.load(std::memory_order_relaxed);
+		t->arg1 = c.arg1.load(std::memory_order_relaxed);
+		t->arg2 = c.arg2.load(std::memory_order_relaxed);
+		t->arg3 = c.arg3.load(std::memory_order_relaxed);
+	}
+};
+
+WorkStealingExecutor::TaskDeque::TaskDeque()
+  : m_top(0), m_bottom(0), m_array(Array::create(256)) {
+}
+
+WorkStealingExecutor::TaskDeque::~TaskDeque() {
+	free(m_array.load(std::memory_order_relaxed));
+	for (Array* a : m_retired)
+		free(a);
+}
+
+WorkStealingExecutor::TaskDeque::Array*
+WorkStealingExecutor::TaskDeque::grow(Array* a, intptr_t t, intptr_t b) {
+	Array* g = Array::create(2 * (a->mask + 1));
+	task_t task;
+	for (intptr_t i = t; i < b; ++i) {
+		a->get(i, &task);
+		g->put(i, task);
+	}
+	m_retired.push_back(a);
+	m_array.store(g, std::memory_order_release);
+	return g;
+}
+
+void WorkStealingExecutor::TaskDeque::push(const task_t& task) {
+	intptr_t b = m_bottom.load(std::memory_order_relaxed);
+	intptr_t t = m_top.load(std::memory_order_acquire);
+	Array* a = m_array.load(std::memory_order_relaxed);
+	if (b - t > intptr_t(a->mask))
+		a = grow(a, t, b);
+	a->put(b, task);
+	// release store instead of release fence + relaxed store, the same on
+	// x86, and visible to tsan which does not model fences
+	m_bottom.store(b + 1, std::memory_order_release);
+}
+
+bool WorkStealingExecutor::TaskDeque::pop(task_t* task) {
+	intptr_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+	Array* a = m_array.load(std::memory_order_relaxed);
+	m_bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	intptr_t t = m_top.load(std::memory_order_relaxed);
+	if (t > b) { // empty
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+		return false;
+	}
+	a->get(b, task);
+	if (t == b) { // last one, race with thieves
+		bool won = m_top.compare_exchange_strong(t, t + 1,
+			std::memory_order_seq_cst, std::memory_order_relaxed);
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+		return won;
+	}
+	return true;
+}
+
+bool WorkStealingExecutor::TaskDeque::steal(task_t* task) {
+	for (;;) {
+		intptr_t t = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		intptr_t b = m_bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return false;
+		Array* a = m_array.load(std::memory_order_acquire);
+		a->get(t, task);
+		if (m_top.compare_exchange_strong(t, t + 1,
+				std::memory_order_seq_cst, std::memory_order_relaxed))
+			return true;
+		// lost the race to owner or another thief, retry
+	}
+}
+
+bool WorkStealingExecutor::TaskDeque::empty() const {
+	intptr_t t = m_top.load(std::memory_order_relaxed);
+	intptr_t b = m_bottom.load(std::memory_order_relaxed);
+	return t >= b;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+WorkStealingExecutor::WorkStealingExecutor(int num_workers) {
+	if (num_workers <= 0)
+		num_workers = std::max(int(std::thread::hardware_concurrency()), 1);
+	m_inject_num = 0;
+	m_pending = 0;
+	m_idle = 0;
+	m_stop = false;
+	m_workers.resize(num_workers);
+	for (int i = 0; i < num_workers; ++i) {
+		m_workers[i] = new Worker;
+		m_workers[i]->exec_cnt = 0;
+		m_workers[i]->steal_cnt = 0;
+	}
+	// start threads after all Worker are created, because worker steals
+	for (int i = 0; i < num_workers; ++i) {
+		m_workers[i]->thr = std::thread(&WorkStealingExecutor::worker_proc, this, i);
+	}
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+	{
+		std::lock_guard<std::mutex> lock(m_idle_mtx);
+		m_stop = true;
+	}
+	m_idle_cond.notify_all();
+	for (Worker* w : m_workers) {
+		w->thr.join();
+	}
+	assert(m_inject.empty());
+	for (Worker* w : m_workers) {
+		assert(w->tasks.empty());
+		delete w;
+	}
+}
+
+WorkStealingExecutor& WorkStealingExecutor::global() {
+	static WorkStealingExecutor exe(
+		(int)getEnvLong("WorkStealingExecutor_threads", 0));
+	return exe;
+}
+
+void WorkStealingExecutor::submit(const task_t& task) {
+	// pair with worker_proc: worker increments m_idle then checks m_pending,
+	// we increment m_pending then check m_idle, at least one sees the other.
+	// m_pending is incremented before push, so it never underflows
+	as_atomic(m_pending).fetch_add(1, std::memory_order_seq_cst);
+	if (this == g_ws_tls.exe) {
+		m_workers[g_ws_tls.idx]->tasks.push(task);
+	}
+	else {
+		std::lock_guard<std::mutex> lock(m_inject_mtx);
+		m_inject.push_back(task);
+		as_atomic(m_inject_num).store(m_inject.size(), std::memory_order_relaxed);
+	}
+	if (as_atomic(m_idle).load(std::memory_order_seq_cst)) {
+		std::lock_guard<std::mutex> lock(m_idle_mtx);
+		m_idle_cond.notify_one();
+	}
+}
+
+bool WorkStealingExecutor::pop_local(size_t idx, task_t* task) {
+	if (!m_workers[idx]->tasks.pop(task))
+		return false;
+	as_atomic(m_pending).fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+// idx is the calling worker, or m_workers.size() for a non-worker
+bool WorkStealingExecutor::steal(size_t idx, task_t* task) {
+	const size_t n = m_workers.size();
+	for (size_t i = 1; i <= n + 1; ++i) {
+		size_t victim = (idx + i) % (n + 1);
+		if (victim == idx && idx < n)
+			continue; // own deque is popped by pop_local
+		if (victim == n) {
+			if (0 == as_atomic(m_inject_num).load(std::memory_order_relaxed))
+				continue; // just a hint, avoid locking empty queue
+			std::lock_guard<std::mutex> lock(m_inject_mtx);
+			if (m_inject.empty())
+				continue;
+			*task = m_inject.front();
+			m_inject.pop_front();
+			as_atomic(m_inject_num).store(m_inject.size(), std::memory_order_relaxed);
+		}
+		else if (!m_workers[victim]->tasks.steal(task)) {
+			continue;
+		}
+		as_atomic(m_pending).fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+namespace {
+struct ParallelForState {
+	void (*func)(void*, size_t);
+	void*  arg;
+	size_t remain;
+	std::exception_ptr ex;
+	std::mutex mtx;
+	std::condition_variable cond;
+};
+} // namespace
+
+static void ParallelForTask(void* vs, size_t i, size_t) {
+	auto s = (ParallelForState*)vs;
+	std::exception_ptr ex;
+	try { s->func(s->arg, i); }
+	catch (...) { ex = std::current_exception(); }
+	// s may be destroyed as soon as remain is 0, so notify under the lock
+	std::lock_guard<std::mutex> lock(s->mtx);
+	if (ex && !s->ex)
+		s->ex = ex;
+	if (0 == --s->remain)
+		s->cond.notify_all();
+}
+
+void WorkStealingExecutor::parallel_for(size_t num,
+					void (*func)(void* arg, size_t i), void* arg) {
+	if (0 == num)
+		return;
+	ParallelForState s;
+	s.func = func;
+	s.arg = arg;
+	s.remain = num;
+	for (size_t i = 1; i < num; ++i)
+		submit(&ParallelForTask, &s, i);
+	ParallelForTask(&s, 0, 0);
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(s.mtx);
+			if (0 == s.remain)
+				break;
+		}
+		if (help_one())
+			continue;
+		std::unique_lock<std::mutex> lock(s.mtx);
+		while (s.remain)
+			s.cond.wait(lock);
+		break;
+	}
+	if (s.ex)
+		std::rethrow_exception(s.ex);
+}
+
+bool WorkStealingExecutor::help_one() {
+	task_t task;
+	if (this == g_ws_tls.exe) {
+		size_t idx = g_ws_tls.idx;
+		if (!pop_local(idx, &task) && !steal(idx, &task))
+			return false;
+	}
+	else if (!steal(m_workers.size(), &task)) {
+		return false;
+	}
+	task.func(task.arg1, task.arg2, task.arg3);
+	return true;
+}
+
+int WorkStealingExecutor::current_worker() const {
+	return this == g_ws_tls.exe ? g_ws_tls.idx : -1;
+}
+
+void WorkStealingExecutor::worker_proc(size_t idx) {
+	g_ws_tls.exe = this;
+	g_ws_tls.idx = int(idx);
+	Worker* self = m_workers[idx];
+	for (;;) {
+		task_t task;
+		if (pop_local(idx, &task)) {
+			task.func(task.arg1, task.arg2, task.arg3);
+			as_atomic(self->exec_cnt).fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+		if (steal(idx, &task)) {
+			task.func(task.arg1, task.arg2, task.arg3);
+			as_atomic(self->exec_cnt).fetch_add(1, std::memory_order_relaxed);
+			as_atomic(self->steal_cnt).fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(m_idle_mtx);
+		as_atomic(m_idle).fetch_add(1, std::memory_order_seq_cst);
+		while (!m_stop && 0 == as_atomic(m_pending).load(std::memory_order_seq_cst)) {
+			m_idle_cond.wait(lock);
+		}
+		as_atomic(m_idle).fetch_sub(1, std::memory_order_relaxed);
+		if (m_stop && 0 == as_atomic(m_pending).load(std::memory_order_relaxed))
+			break;
+	}
+	g_ws_tls.exe = NULL;
+	g_ws_tls.idx = -1;
+}
+
+size_t WorkStealingExecutor::pending_cnt() const {
+	return as_atomic(m_pending).load(std::memory_order_relaxed);
+}
+size_t WorkStealingExecutor::exec_cnt() const {
+	size_t sum = 0;
+	for (const Worker* w : m_workers)
+		sum += as_atomic(w->exec_cnt).load(std::memory_order_relaxed);
+	return sum;
+}
+size_t WorkStealingExecutor::steal_cnt() const {
+	size_t sum = 0;
+	for (const Worker* w : m_workers)
+		sum += as_atomic(w->steal_cnt).load(std::memory_order_relaxed);
+	return sum;
+}
+
+} // namespace terark
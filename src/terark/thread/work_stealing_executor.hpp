@@ -0,0 +1,114 @@
+/* vim: set tabstop=4 : */
+#pragma once
+
+#include <terark/config.hpp>
+#include <terark/valvec.hpp>
+#include <boost/noncopyable.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace terark {
+
+/// Shared work stealing executor, all pipelines/builders in a process can
+/// submit to one executor(global()), so the number of running threads is
+/// bounded by the worker count, no matter how many pipelines are running.
+///
+///   - each worker has a lock free Chase-Lev deque, only the worker pushes
+///     and pops its back(LIFO, cache hot), other workers steal its front
+///     (FIFO, older tasks) by CAS
+///   - submit from a worker goes to its own deque, submit from non-worker
+///     goes to a mutex protected inject queue, which is also stolen from
+///   - an idle worker parks on a condition_variable, submit wakes one only
+///     when there are idle workers
+///
+/// Tasks should not block on each other, a task waiting for others should
+/// call help_one() to run pending tasks instead of sleeping.
+class TERARK_DLL_EXPORT WorkStealingExecutor : boost::noncopyable {
+public:
+	/// same as FiberPool::task_t, no memory alloc for task
+	struct task_t {
+		void (*func)(void* arg1, size_t arg2, size_t arg3);
+		void*  arg1;
+		size_t arg2;
+		size_t arg3;
+	};
+	explicit WorkStealingExecutor(int num_workers = 0); // 0: cpu count
+	~WorkStealingExecutor();
+
+	/// process wide executor, worker count is env WorkStealingExecutor_threads
+	/// or cpu count by default
+	static WorkStealingExecutor& global();
+
+	void submit(const task_t& task);
+	void submit(void (*func)(void*, size_t, size_t), void* arg1,
+				size_t arg2 = 0, size_t arg3 = 0) {
+		submit(task_t{func, arg1, arg2, arg3});
+	}
+
+	/// run fn(i) for i in [0, num) as tasks and wait all of them, fn(0) is
+	/// run by the calling thread, which helps pending tasks while waiting.
+	/// the first exception thrown by fn is rethrown after all are done
+	template<class Fn>
+	void parallel_for(size_t num, Fn&& fn) {
+		typedef typename std::remove_reference<Fn>::type FnType;
+		parallel_for(num, [](void* f, size_t i) { (*(FnType*)f)(i); }, (void*)&fn);
+	}
+	void parallel_for(size_t num, void (*func)(void* arg, size_t i), void* arg);
+
+	/// run one pending task in the calling thread
+	/// @returns false if there is no pending task
+	bool help_one();
+
+	/// index of calling worker thread in this executor, -1 if it is not
+	int current_worker() const;
+
+	int num_workers() const { return int(m_workers.size()); }
+	size_t pending_cnt() const;
+	size_t exec_cnt() const;
+	size_t steal_cnt() const;
+
+protected:
+	/// Chase-Lev deque(Le et al, PPoPP 2013), push/pop by owner, steal by
+	/// others, a grown-out array is kept until destruct because a thief may
+	/// still read it
+	class TaskDeque : boost::noncopyable {
+		struct Array;
+		std::atomic<intptr_t> m_top;
+		std::atomic<intptr_t> m_bottom;
+		std::atomic<Array*>   m_array;
+		valvec<Array*>        m_retired; // only accessed by owner
+		Array* grow(Array*, intptr_t top, intptr_t bottom);
+	public:
+		TaskDeque();
+		~TaskDeque();
+		void push(const task_t&);
+		bool pop(task_t*);
+		bool steal(task_t*);
+		bool empty() const;
+	};
+	struct alignas(64) Worker {
+		TaskDeque tasks;
+		std::thread thr;
+		size_t exec_cnt;
+		size_t steal_cnt;
+	};
+	bool pop_local(size_t idx, task_t* task);
+	bool steal(size_t idx, task_t* task);
+	void worker_proc(size_t idx);
+
+	valvec<Worker*> m_workers;
+	std::mutex m_inject_mtx;
+	std::deque<task_t> m_inject; // submitted by non-worker threads
+	size_t m_inject_num; // m_inject.size(), for lock free peek
+	size_t m_pending;    // tasks in all deques
+	size_t m_idle;       // parked workers
+	bool   m_stop;
+	std::mutex m_idle_mtx;
+	std::condition_variable m_idle_cond;
+};
+
+} // namespace terark
@@ -0,0 +1,224 @@
+/* vim: set tabstop=4 : */
+#include "ext_sort.hpp"
+#include "tmpfile.hpp"
+#include <terark/io/AsyncFileStream.hpp>
+#include <terark/io/DataIO.hpp>
+#include <terark/io/StreamBuffer.hpp>
+#include <terark/set_op.hpp>
+#include <terark/util/throw.hpp>
+#include <terark/util/str_radix_sort.hpp>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace terark {
+
+namespace {
+
+// guard value at the end of each way of LoserTree
+const char g_max_key_buf[1] = {0};
+const fstring g_max_key(g_max_key_buf, ptrdiff_t(0));
+
+struct ExtSortLess {
+	bool operator()(const fstring& x, const fstring& y) const {
+		if (terark_unlikely(y.p == g_max_key.p))
+			return x.p != g_max_key.p;
+		if (terark_unlikely(x.p == g_max_key.p))
+			return false;
+		return x < y;
+	}
+};
+
+} // namespace
+
+class ExternalStrSorter::Run {
+public:
+	TempFileDeleteOnClose file;
+	size_t num = 0;
+	// for read
+	boost::intrusive_ptr<AsyncFileInputStream> stream;
+	NativeDataInput<InputBuffer> reader;
+	valvec<byte_t> rec;
+	size_t remain = 0;
+	bool   at_end = true;
+
+	void write(fstring str) {
+		file.writer << var_size_t(str.size());
+		file.writer.ensureWrite(str.data(), str.size());
+		num++;
+	}
+	void start_read(const Options& opt) {
+		file.complete_write();
+		stream = new AsyncFileInputStream(fileno(file.fp.fp()), 0,
+										  opt.read_buf_size, opt.read_bufs);
+		reader.attach(stream.get());
+		remain = num;
+		next();
+	}
+	void next() {
+		if (0 == remain) {
+			at_end = true;
+			return;
+		}
+		var_size_t len;
+		reader >> len;
+		rec.resize_no_init(len.t);
+		reader.ensureRead(rec.data(), len.t);
+		remain--;
+		at_end = false;
+	}
+	fstring cur() const { return at_end ? g_max_key : fstring(rec); }
+	void finish_read() {
+		reader.attach(NULL);
+		stream.reset();
+		file.close();
+	}
+};
+
+namespace {
+struct RunWayIter {
+	typedef std::input_iterator_tag iterator_category;
+	typedef fstring   value_type;
+	typedef ptrdiff_t difference_type;
+	typedef const fstring* pointer;
+	typedef const fstring& reference;
+	ExternalStrSorter::Run* run;
+	fstring operator*() const { return run->cur(); }
+	RunWayIter& operator++() { run->next(); return *this; }
+};
+
+template<class WayIter>
+void loser_tree_merge(std::vector<WayIter>& ways,
+					  const function<void(fstring)>& fn) {
+	if (ways.empty())
+		return;
+	// same strings are output by way order, but runs are sorted by the
+	// unstable parallel_radix_sort, thus the whole sort is not stable
+	multi_way::LoserTree<WayIter, fstring, true, ExtSortLess> lt(g_max_key);
+	lt.m_ways.swap(ways);
+	lt.start();
+	while (!lt.empty()) {
+		fn(lt.current_value());
+		lt.increment();
+	}
+}
+} // namespace
+
+ExternalStrSorter::ExternalStrSorter(const Options& opt) : m_opt(opt) {
+	TERARK_VERIFY_GT(opt.threads, 0);
+	TERARK_VERIFY_GE(opt.max_ways, 2);
+	m_size = 0;
+}
+
+ExternalStrSorter::~ExternalStrSorter() {}
+
+size_t ExternalStrSorter::num_runs() const { return m_runs.size(); }
+
+void ExternalStrSorter::push_back(fstring str) {
+	m_buf.push_back(str);
+	m_size++;
+	if (m_buf.mem_size() >= m_opt.mem_limit)
+		spill();
+}
+
+void ExternalStrSorter::append(const SortableStrVec& strVec) {
+	for (size_t i = 0; i < strVec.size(); ++i)
+		push_back(strVec[i]);
+}
+
+void ExternalStrSorter::append(const FixedLenStrVec& strVec) {
+	for (size_t i = 0; i < strVec.size(); ++i)
+		push_back(strVec[i]);
+}
+
+// threads partition m_buf.m_index by radix into disjoint buckets and sort
+// the buckets, so the whole index is sorted in place, no merge is needed
+void ExternalStrSorter::sort_buf() {
+	typedef SortableStrVec::SEntry SEntry;
+	const byte_t* pool = m_buf.m_strpool.data();
+	auto get = [pool](const SEntry& x) {
+		return fstring(pool + x.offset, x.length);
+	};
+	SEntry* index = m_buf.m_index.data();
+	size_t n = m_buf.size();
+	// not stable, but same strings are not distinguishable in output
+	parallel_radix_sort(index, n, get, m_opt.threads);
+}
+
+void ExternalStrSorter::write_buf(const function<void(fstring)>& fn) {
+	const byte_t* pool = m_buf.m_strpool.data();
+	for (const auto& x : m_buf.m_index)
+		fn(fstring(pool + x.offset, x.length));
+}
+
+std::unique_ptr<ExternalStrSorter::Run> ExternalStrSorter::new_run() {
+	std::unique_ptr<Run> run(new Run());
+	run->file.path = m_opt.tmp_dir + "/ExternalStrSorter-XXXXXX";
+	run->file.open_temp();
+	return run;
+}
+
+void ExternalStrSorter::spill() {
+	if (m_buf.size() == 0)
+		return;
+	sort_buf();
+	std::unique_ptr<Run> run = new_run();
+	Run* r = run.get();
+	write_buf([r](fstring str) { r->write(str); });
+	r->file.writer.flush_buffer();
+	m_runs.push_back(std::move(run));
+	m_buf.clear();
+}
+
+void ExternalStrSorter::merge_runs(size_t beg, size_t end,
+								   const function<void(fstring)>& fn) {
+	std::vector<RunWayIter> ways;
+	for (size_t i = beg; i < end; ++i) {
+		m_runs[i]->start_read(m_opt);
+		ways.push_back(RunWayIter{m_runs[i].get()});
+	}
+	loser_tree_merge(ways, fn);
+	for (size_t i = beg; i < end; ++i)
+		m_runs[i]->finish_read();
+}
+
+void ExternalStrSorter::merge(const function<void(fstring)>& fn) {
+	if (m_runs.empty()) {
+		if (m_buf.size()) {
+			sort_buf();
+			write_buf(fn);
+		}
+	}
+	else {
+		spill();
+		// multi pass: merge each group of max_ways runs into a new run
+		const size_t max_ways = m_opt.max_ways;
+		while (m_runs.size() > max_ways) {
+			std::vector<std::unique_ptr<Run> > merged;
+			for (size_t beg = 0; beg < m_runs.size(); beg += max_ways) {
+				size_t end = std::min(beg + max_ways, m_runs.size());
+				if (end - beg == 1) {
+					merged.push_back(std::move(m_runs[beg]));
+					continue;
+				}
+				std::unique_ptr<Run> run = new_run();
+				Run* r = run.get();
+				merge_runs(beg, end, [r](fstring str) { r->write(str); });
+				r->file.writer.flush_buffer();
+				merged.push_back(std::move(run));
+			}
+			m_runs.swap(merged);
+		}
+		merge_runs(0, m_runs.size(), fn);
+	}
+	m_buf.clear();
+	m_runs.clear();
+	m_size = 0;
+}
+
+void ExternalStrSorter::merge(SortableStrVec* out) {
+	out->reserve(out->size() + m_size, out->str_size() + m_buf.str_size());
+	merge([out](fstring str) { out->push_back(str); });
+}
+
+} // namespace terark
@@ -0,0 +1,71 @@
+/* vim: set tabstop=4 : */
+#pragma once
+
+#include <terark/fstring.hpp>
+#include <terark/valvec.hpp>
+#include <terark/util/function.hpp>
+#include <terark/util/sortable_strvec.hpp>
+#include <boost/noncopyable.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace terark {
+
+/// External memory sort for string sets larger than RAM.
+///
+/// push_back() appends to an in memory SortableStrVec, when it reaches
+/// mem_limit, it is sorted in place by parallel_radix_sort with `threads`
+/// threads(top levels are partitioned into disjoint buckets, which are sorted
+/// by the threads), and written in order as a sorted run to a temp file in
+/// tmp_dir. The radix sort needs about 48 bytes per string besides mem_limit.
+///
+/// merge() merges all runs by LoserTree, each run is read by an
+/// AsyncFileInputStream, which keeps read_bufs reads in flight, if there are
+/// more than max_ways runs, groups of max_ways runs are merged to new runs
+/// first. If nothing was spilled, merge() is done in memory.
+///
+/// The sort is not stable, it is for strings only, same strings are not
+/// distinguishable in the output.
+class TERARK_DLL_EXPORT ExternalStrSorter : boost::noncopyable {
+public:
+	struct Options {
+		size_t mem_limit = size_t(1) << 30; ///< in memory buffer, bytes
+		int    threads   = 4;
+		int    max_ways  = 128; ///< max runs merged in one pass
+		size_t read_buf_size = 256 << 10; ///< per run
+		int    read_bufs = 4; ///< per run
+		std::string tmp_dir = "/tmp";
+	};
+	explicit ExternalStrSorter(const Options&);
+	~ExternalStrSorter();
+
+	void push_back(fstring str);
+	void append(const SortableStrVec&);
+	void append(const FixedLenStrVec&);
+
+	size_t size() const { return m_size; }
+	size_t num_runs() const; ///< number of spilled runs
+
+	/// fn is called for each string in sorted order, the fstring is valid
+	/// only during the call, the sorter is empty after merge
+	void merge(const function<void(fstring)>& fn);
+
+	/// output must fit in memory
+	void merge(SortableStrVec* out);
+
+	class Run; // defined in cpp
+private:
+	void spill();
+	void sort_buf();
+	void write_buf(const function<void(fstring)>& fn);
+	void merge_runs(size_t beg, size_t end, const function<void(fstring)>& fn);
+	std::unique_ptr<Run> new_run();
+
+	Options m_opt;
+	SortableStrVec m_buf;
+	std::vector<std::unique_ptr<Run> > m_runs;
+	size_t m_size;
+};
+
+} // namespace terark
@@ -0,0 +1,136 @@
+/* vim: set tabstop=4 : */
+#pragma once
+
+#include <terark/stdtypes.hpp>
+#include <atomic>
+#include <type_traits>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace terark { namespace util {
+
+/// Bounded lock-free multi producer multi consumer ring queue.
+///
+/// Each cell has a sequence number(D.Vyukov's bounded MPMC queue):
+///   - cell[pos & mask].seq == pos      : cell is free for producer of pos
+///   - cell[pos & mask].seq == pos + 1  : cell is filled for consumer of pos
+/// A producer claims positions by CAS on m_tail, a consumer by CAS on m_head,
+/// the cell is published by a release store of its seq.
+///
+/// Batched push/pop claim up to n consecutive positions by one CAS: the
+/// cells are first checked in order to be ready, then the range is claimed,
+/// a ready cell can only be changed by the thread which claimed it, so the
+/// check is still valid after a successful CAS.
+///
+/// This class never blocks, wait/park policy is up to the caller.
+/// capacity is rounded up to power of 2.
+template<class T>
+class mpmc_ring_queue {
+	static_assert(std::is_trivially_copyable<T>::value,
+				  "T must be trivially copyable");
+	struct Cell {
+		std::atomic<size_t> seq;
+		T data;
+	};
+	Cell*  m_cells;
+	size_t m_mask;
+	alignas(64) std::atomic<size_t> m_tail; // next pos to push
+	alignas(64) std::atomic<size_t> m_head; // next pos to pop
+	char   m_padding[64 - sizeof(size_t)];
+
+	mpmc_ring_queue(const mpmc_ring_queue&) = delete;
+	mpmc_ring_queue& operator=(const mpmc_ring_queue&) = delete;
+
+public:
+	explicit mpmc_ring_queue(size_t cap) {
+		size_t n = 2;
+		while (n < cap)
+			n *= 2;
+		m_cells = (Cell*)malloc(sizeof(Cell) * n);
+		TERARK_VERIFY_F(nullptr != m_cells, "malloc(%zd) = NULL", sizeof(Cell) * n);
+		for (size_t i = 0; i < n; ++i)
+			new(&m_cells[i].seq) std::atomic<size_t>(i);
+		m_mask = n - 1;
+		m_tail.store(0, std::memory_order_relaxed);
+		m_head.store(0, std::memory_order_relaxed);
+	}
+	~mpmc_ring_queue() { free(m_cells); }
+
+	size_t capacity() const { return m_mask + 1; }
+
+	/// approximate when there are concurrent push/pop
+	size_t peekSize() const {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		return tail > head ? tail - head : 0;
+	}
+	bool peekEmpty() const { return 0 == peekSize(); }
+	bool peekFull() const { return peekSize() > m_mask; }
+
+	bool try_push(const T& x) { return try_push_n(&x, 1) == 1; }
+	bool try_pop(T* x) { return try_pop_n(x, 1) == 1; }
+
+	/// @returns number of pushed elements, which is the prefix of src
+	size_t try_push_n(const T* src, size_t n) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		for (;;) {
+			size_t k = 0;
+			while (k < n && ready_for_push(tail + k))
+				k++;
+			if (0 == k) {
+				size_t tail2 = m_tail.load(std::memory_order_relaxed);
+				if (tail2 == tail)
+					return 0; // full
+				tail = tail2;
+				continue;
+			}
+			if (m_tail.compare_exchange_weak(tail, tail + k,
+											 std::memory_order_relaxed)) {
+				for (size_t i = 0; i < k; ++i) {
+					Cell& c = m_cells[(tail + i) & m_mask];
+					c.data = src[i];
+					c.seq.store(tail + i + 1, std::memory_order_release);
+				}
+				return k;
+			}
+		}
+	}
+
+	/// @returns number of popped elements, filled into dst[0, ret)
+	size_t try_pop_n(T* dst, size_t n) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		for (;;) {
+			size_t k = 0;
+			while (k < n && ready_for_pop(head + k))
+				k++;
+			if (0 == k) {
+				size_t head2 = m_head.load(std::memory_order_relaxed);
+				if (head2 == head)
+					return 0; // empty
+				head = head2;
+				continue;
+			}
+			if (m_head.compare_exchange_weak(head, head + k,
+											 std::memory_order_relaxed)) {
+				for (size_t i = 0; i < k; ++i) {
+					Cell& c = m_cells[(head + i) & m_mask];
+					dst[i] = c.data;
+					c.seq.store(head + i + m_mask + 1, std::memory_order_release);
+				}
+				return k;
+			}
+		}
+	}
+
+private:
+	bool ready_for_push(size_t pos) const {
+		const Cell& c = m_cells[pos & m_mask];
+		return c.seq.load(std::memory_order_acquire) == pos;
+	}
+	bool ready_for_pop(size_t pos) const {
+		const Cell& c = m_cells[pos & m_mask];
+		return c.seq.load(std::memory_order_acquire) == pos + 1;
+	}
+};
+
+}} // namespace terark::util
@@ -3,6 +3,8 @@
 #include <terark/gold_hash_map.hpp>
 #include <terark/io/DataIO_Basic.hpp>
 #include <terark/util/small_memcpy.hpp>
+#include <terark/util/str_radix_sort.hpp>
+#include <terark/thread/work_stealing_executor.hpp>
 
 #define parallel_sort terark_parallel_sort
 
@@ -147,6 +149,13 @@ void SortableStrVec::sort() {
 	}
 }
 
+void SortableStrVec::sort_parallel(size_t threads) {
+	const byte* pool = m_strpool.data();
+	parallel_radix_sort(m_index.data(), m_index.size(),
+		[pool](const SEntry& x) { return fstring(pool + x.offset, x.length); },
+		threads);
+}
+
 void SortableStrVec::clear() {
 	m_strpool.risk_destroy(m_strpool_mem_type);
 	m_index.clear();
@@ -885,6 +894,16 @@ void SortThinStrVec::sort(size_t valuelen) {
 	}
 }
 
+void SortThinStrVec::sort_parallel(size_t threads, size_t valuelen) {
+	const byte* pool = m_strpool.data();
+	parallel_radix_sort(m_index.data(), m_index.size(),
+		[pool,valuelen](const SEntry& x) {
+			TERARK_ASSERT_GE(x.length, valuelen);
+			return fstring(pool + x.offset, x.length - valuelen);
+		},
+		threads);
+}
+
 void SortThinStrVec::clear() {
 	m_strpool.risk_destroy(m_strpool_mem_type);
 	m_index.clear();
@@ -1293,6 +1312,120 @@ inline static bool SortAsUint(void* base, size_t num, size_t valuelen) {
 	return false;
 }
 
+void FixedLenStrVec::sort_parallel(size_t threads, size_t valuelen) {
+	assert(m_fixlen * m_size == m_strpool.size());
+	TERARK_VERIFY_GT(m_fixlen, valuelen);
+	const size_t fixlen = m_fixlen;
+	const size_t keylen = fixlen - valuelen;
+	if (keylen <= 8 && m_size >= 64*1024) {
+		// few passes, the temp copy is no more than the parallel path
+		sort_raw_lsd(m_strpool.data(), m_size, fixlen, valuelen, threads);
+		return;
+	}
+	if (keylen <= 8 || threads <= 1 || m_size <= 1) {
+		sort_raw(m_strpool.data(), m_size, fixlen, valuelen);
+		return;
+	}
+	// sort record index, then permute records
+	const byte_t* pool = m_strpool.data();
+	valvec<size_t> index(m_size, valvec_no_init());
+	for (size_t i = 0; i < m_size; ++i)
+		index[i] = i;
+	parallel_radix_sort(index.data(), m_size,
+		[pool,fixlen,keylen](size_t i) { return fstring(pool + fixlen*i, keylen); },
+		threads);
+	valvec<byte_t> sorted(m_strpool.size(), valvec_no_init());
+	for (size_t i = 0; i < m_size; ++i)
+		memcpy(sorted.data() + fixlen*i, pool + fixlen*index[i], fixlen);
+	m_strpool.risk_destroy(m_strpool_mem_type);
+	m_strpool.swap(sorted);
+	m_strpool_mem_type = MemType::Malloc;
+}
+
+template<size_t FixLen>
+static void LSD_scatter(const byte_t* src, byte_t* dst, size_t num,
+						size_t fixlen, size_t k, size_t* pos) {
+	const size_t len = FixLen ? FixLen : fixlen;
+	for (size_t i = 0; i < num; ++i) {
+		const byte_t* rec = src + len * i;
+		memcpy(dst + len * pos[rec[k]]++, rec, len);
+	}
+}
+
+void FixedLenStrVec::sort_raw_lsd(void* base, size_t num, size_t fixlen,
+								  size_t valuelen, size_t threads) {
+	TERARK_VERIFY_GT(fixlen, valuelen);
+	const size_t keylen = fixlen - valuelen;
+	if (num <= 1)
+		return;
+	// records are split into blocks, each block counts and scatters its own
+	// records, blocks keep their order in each bucket, thus it is stable
+	const size_t blocks = std::max<size_t>(1, std::min(threads, num / 16384));
+	auto run = [blocks](const std::function<void(size_t)>& fn) {
+		if (blocks > 1)
+			WorkStealingExecutor::global().parallel_for(blocks, fn);
+		else
+			fn(0);
+	};
+	auto block_beg = [num,blocks](size_t b) { return num * b / blocks; };
+	// histograms of all key bytes in one pass, per block
+	valvec<size_t> cnt(256 * keylen * blocks, 0);
+	byte_t* src = (byte_t*)base;
+	run([&](size_t b) {
+		size_t* c = &cnt[256 * keylen * b];
+		for (size_t i = block_beg(b), e = block_beg(b+1); i < e; ++i) {
+			const byte_t* rec = src + fixlen * i;
+			for (size_t k = 0; k < keylen; ++k)
+				c[256 * k + rec[k]]++;
+		}
+	});
+	valvec<size_t> total(cnt.data(), 256 * keylen);
+	for (size_t b = 1; b < blocks; ++b)
+		for (size_t j = 0; j < 256 * keylen; ++j)
+			total[j] += cnt[256 * keylen * b + j];
+	valvec<size_t> pos(256 * blocks, valvec_no_init());
+	valvec<byte_t> tmp(num * fixlen, valvec_no_init());
+	byte_t* dst = tmp.data();
+	bool moved = false;
+	for (size_t k = keylen; k-- > 0; ) {
+		const size_t* c = &total[256 * k];
+		if (*std::max_element(c, c + 256) == num)
+			continue; // all same byte, skip the pass
+		if (moved && blocks > 1) {
+			// records were moved by previous pass, recount byte k
+			run([&](size_t b) {
+				size_t* bc = &cnt[256 * keylen * b + 256 * k];
+				std::fill_n(bc, 256, 0);
+				for (size_t i = block_beg(b), e = block_beg(b+1); i < e; ++i)
+					bc[src[fixlen * i + k]]++;
+			});
+		}
+		size_t sum = 0;
+		for (size_t d = 0; d < 256; ++d) {
+			for (size_t b = 0; b < blocks; ++b) {
+				pos[256 * b + d] = sum; // start pos of block b in bucket d
+				sum += cnt[256 * keylen * b + 256 * k + d];
+			}
+		}
+		run([&](size_t b) {
+			const byte_t* bsrc = src + fixlen * block_beg(b);
+			size_t bnum = block_beg(b+1) - block_beg(b);
+			size_t* bpos = &pos[256 * b];
+			switch (fixlen) {
+			case  4: LSD_scatter< 4>(bsrc, dst, bnum, fixlen, k, bpos); break;
+			case  8: LSD_scatter< 8>(bsrc, dst, bnum, fixlen, k, bpos); break;
+			case 12: LSD_scatter<12>(bsrc, dst, bnum, fixlen, k, bpos); break;
+			case 16: LSD_scatter<16>(bsrc, dst, bnum, fixlen, k, bpos); break;
+			default: LSD_scatter< 0>(bsrc, dst, bnum, fixlen, k, bpos); break;
+			}
+		});
+		std::swap(src, dst);
+		moved = true;
+	}
+	if (src != base)
+		memcpy(base, src, num * fixlen);
+}
+
 void FixedLenStrVec::sort_raw(void* base, size_t num, size_t fixlen) {
 	return sort_raw(base, num, fixlen, 0);
 }
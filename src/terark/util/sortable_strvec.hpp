@@ -80,6 +80,7 @@ public:
 	void back_grow_no_init(size_t nGrow);
 	void reverse_keys();
 	void sort();
+	void sort_parallel(size_t threads); ///< parallel MSD radix sort
 	void sort_by_offset();
 	void sort_by_seq_id();
 	void clear();
@@ -260,6 +261,7 @@ public:
 	void reverse_keys();
 	void sort();
 	void sort(size_t valuelen); ///< except suffix valuelen
+	void sort_parallel(size_t threads, size_t valuelen = 0);
 	void sort_by_offset();
 	void clear();
 	void build_subkeys();
@@ -434,8 +436,16 @@ public:
     void reverse_order();
     void sort();
     void sort(size_t valuelen); ///< m_fixlen = keylen + valuelen
+    void sort_parallel(size_t threads, size_t valuelen = 0);
     static void sort_raw(void* base, size_t num, size_t fixlen);
     static void sort_raw(void* base, size_t num, size_t fixlen, size_t valuelen);
+    /// LSD radix sort, stable, for short keys, it needs a temp copy of
+    /// num * fixlen bytes, sort_raw is in place and never calls it,
+    /// sort_parallel calls it when keylen <= 8 and num is large.
+    /// Each pass is split into up to `threads` blocks which run on
+    /// WorkStealingExecutor::global()
+    static void sort_raw_lsd(void* base, size_t num, size_t fixlen,
+                             size_t valuelen, size_t threads = 1);
     void clear();
     void optimize_func(); // optimize (lower|upper)_bound_fixed
     size_t lower_bound_by_offset(size_t offset) const;
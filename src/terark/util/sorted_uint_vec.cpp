@@ -10,6 +10,10 @@
 #include <terark/util/function.hpp>
 #include <boost/intrusive_ptr.hpp>
 
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
 namespace terark {
 
 static inline size_t safe_bsr_u64(uint64_t val) {
@@ -415,6 +419,76 @@ std::array<size_t, 2> SortedUintVec::get2(size_t idx) const {
     return aVal;
 }
 
+#if defined(__AVX2__)
+// Unpack kernels of get_block for the cases all units are small: units are
+// decoded by a byte, the prefix sums of the units in a byte are taken from
+// a table and widened to 64 bit lanes, then added to the running value.
+struct SortedUintVec_PrefixTables {
+    uint64_t bits1[256]; // byte j is sum of 1 bit units [0, j) of the byte
+    uint32_t bits2[256]; // byte j is sum of 2 bit units [0, j) of the byte
+    SortedUintVec_PrefixTables() {
+        for (size_t b = 0; b < 256; ++b) {
+            uint64_t x1 = 0, sum1 = 0;
+            for (size_t j = 0; j < 8; ++j) {
+                x1 |= sum1 << 8*j;
+                sum1 += (b >> j) & 1;
+            }
+            uint32_t x2 = 0, sum2 = 0;
+            for (size_t j = 0; j < 4; ++j) {
+                x2 |= sum2 << 8*j;
+                sum2 += (b >> 2*j) & 3;
+            }
+            bits1[b] = x1;
+            bits2[b] = x2;
+        }
+    }
+};
+static const SortedUintVec_PrefixTables g_suv_prefix;
+
+static inline
+void get_block_fixed_avx2(size_t val, size_t loWater, size_t blockUnits, size_t* aVals) {
+    __m256i step = _mm256_set1_epi64x(4 * loWater);
+    __m256i v = _mm256_add_epi64(_mm256_set1_epi64x(val),
+                    _mm256_set_epi64x(3*loWater, 2*loWater, loWater, 0));
+    for (size_t i = 0; i < blockUnits; i += 4) {
+        _mm256_storeu_si256((__m256i*)(aVals + i), v);
+        v = _mm256_add_epi64(v, step);
+    }
+}
+
+static inline
+void get_block_bits1_avx2(const byte_t* pData, size_t val, size_t loWater,
+                          size_t blockUnits, size_t* aVals) {
+    const __m256i lanes = _mm256_set_epi64x(3*loWater, 2*loWater, loWater, 0);
+    const __m256i step4 = _mm256_set1_epi64x(4 * loWater);
+    for (size_t i = 0; i < blockUnits / 8; ++i) {
+        byte_t b = pData[i];
+        __m128i t = _mm_cvtsi64_si128(g_suv_prefix.bits1[b]);
+        __m256i v = _mm256_add_epi64(_mm256_set1_epi64x(val), lanes);
+        __m256i lo = _mm256_cvtepu8_epi64(t);
+        __m256i hi = _mm256_cvtepu8_epi64(_mm_srli_si128(t, 4));
+        _mm256_storeu_si256((__m256i*)(aVals + 8*i + 0), _mm256_add_epi64(v, lo));
+        _mm256_storeu_si256((__m256i*)(aVals + 8*i + 4),
+                            _mm256_add_epi64(_mm256_add_epi64(v, step4), hi));
+        val += 8 * loWater + fast_popcount32(b);
+    }
+}
+
+static inline
+void get_block_bits2_avx2(const byte_t* pData, size_t val, size_t loWater,
+                          size_t blockUnits, size_t* aVals) {
+    const __m256i lanes = _mm256_set_epi64x(3*loWater, 2*loWater, loWater, 0);
+    for (size_t i = 0; i < blockUnits / 4; ++i) {
+        byte_t b = pData[i];
+        __m128i t = _mm_cvtsi32_si128(int(g_suv_prefix.bits2[b]));
+        __m256i v = _mm256_add_epi64(_mm256_set1_epi64x(val), lanes);
+        _mm256_storeu_si256((__m256i*)(aVals + 4*i),
+                            _mm256_add_epi64(v, _mm256_cvtepu8_epi64(t)));
+        val += 4 * loWater + (b & 3) + (b >> 2 & 3) + (b >> 4 & 3) + (b >> 6);
+    }
+}
+#endif
+
 /// aVal capacity must be at least blockUnits(64 or 128)
 void SortedUintVec::get_block(size_t blockIdx, size_t* aVals) const {
     assert(blockIdx << m_log2_blockUnits < m_size + (size_t(1) << m_log2_blockUnits) - 1);
@@ -442,11 +516,15 @@ void SortedUintVec::get_block(size_t blockIdx, size_t* aVals) const {
         assert(offset0 + 2 <= offset1);
         size_t headerLen;
         size_t loWater = GetLoWater_x(header, &headerLen);
+    #if defined(__AVX2__)
+        get_block_fixed_avx2(sample0, loWater, blockUnits, aVals);
+    #else
         size_t val = sample0;
         for (size_t i = 0; i < blockUnits; ++i) {
             aVals[i] = val;
             val += loWater;
         }
+    #endif
         break; }
     case 1:
 #define Width 1
@@ -483,6 +561,9 @@ void SortedUintVec::get_block(size_t blockIdx, size_t* aVals) const {
         size_t headerLen;
         size_t const loWater = GetLoWater_x(header, &headerLen);
         size_t const* pData = (const size_t*)(uintptr_t(header) + headerLen);
+    #if defined(__AVX2__)
+        get_block_bits1_avx2((const byte_t*)pData, sample0, loWater, blockUnits, aVals);
+    #else
         size_t val = sample0;
         for(size_t i = 0; i < blockUnits / TERARK_WORD_BITS; ++i) {
             auto   w = unaligned_load<size_t>(&pData[i]);
@@ -492,6 +573,7 @@ void SortedUintVec::get_block(size_t blockIdx, size_t* aVals) const {
                 w >>= 1;
             }
         }
+    #endif
         break; }
     case 12:
 #define Width 12
@@ -537,6 +619,9 @@ void SortedUintVec::get_block(size_t blockIdx, size_t* aVals) const {
             }
             break; // break the case
         }
+    #if defined(__AVX2__)
+        get_block_bits2_avx2(pData, sample0, loWater, blockUnits, aVals);
+    #else
         size_t val = sample0;
         for(size_t i = 0; i < blockUnits / (TERARK_WORD_BITS/2); ++i) {
             auto   w = unaligned_load<size_t>(pData, i);
@@ -546,6 +631,7 @@ void SortedUintVec::get_block(size_t blockIdx, size_t* aVals) const {
                 w >>= 2;
             }
         }
+    #endif
         break; }
     } // switch
 }
@@ -558,6 +644,33 @@ size_t SortedUintVec::get(size_t idx) const {
 	return aVal[0];
 }
 
+void SortedUintVec::get_range(size_t lo, size_t hi, size_t* out) const {
+	assert(lo <= hi);
+	assert(hi <= m_size);
+	assert(m_is_sorted_uint_vec);
+	if (lo == hi)
+		return;
+	size_t log2_bu = m_log2_blockUnits;
+	size_t blockUnits = size_t(1) << log2_bu;
+	size_t mask = blockUnits - 1;
+	size_t blk = lo >> log2_bu;
+	size_t tmp[128];
+	assert(blockUnits <= 128);
+	if (lo & mask) { // head of a partial block
+		get_block(blk, tmp);
+		size_t n = std::min(hi - lo, blockUnits - (lo & mask));
+		std::copy_n(tmp + (lo & mask), n, out);
+		out += n; lo += n; blk++;
+	}
+	for (; lo + blockUnits <= hi; lo += blockUnits, out += blockUnits, blk++) {
+		get_block(blk, out); // full blocks are decoded in place
+	}
+	if (lo < hi) { // tail of a partial block
+		get_block(blk, tmp);
+		std::copy_n(tmp, hi - lo, out);
+	}
+}
+
 SortedUintVec::SortedUintVec() {
 	m_index = NULL;
 	m_log2_blockUnits = 0;
@@ -81,6 +81,8 @@ public:
 	}
 	std::array<size_t, 2> get2(size_t idx) const;
 	void get_block(size_t blockIdx, size_t* aVal) const;
+	/// decode [lo, hi) to out, block by block, much faster than get(i) loop
+	void get_range(size_t lo, size_t hi, size_t* out) const;
 
     const void* get_index_base() const { return m_index; }
     size_t get_index_width() const { return m_offsetWidth + m_sampleWidth; }
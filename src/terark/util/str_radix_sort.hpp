@@ -0,0 +1,272 @@
+/* vim: set tabstop=4 : */
+#pragma once
+
+#include <terark/fstring.hpp>
+#include <terark/valvec.hpp>
+#include <terark/io/byte_swap.hpp>
+#include <terark/thread/work_stealing_executor.hpp>
+#include <boost/predef/other/endian.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace terark {
+
+/// Parallel MSD radix sort of string index entries, used by sort_parallel
+/// of SortableStrVec, SortThinStrVec and FixedLenStrVec.
+///
+/// Each entry is sorted together with a cached 8 byte key prefix(big endian
+/// uint64 of the bytes at current depth, zero padded), so most comparisons
+/// and radix digits do not touch the string pool. Buckets are split by MSD
+/// radix on the bytes of the cached prefix, small buckets are sorted by
+/// multikey quicksort whose "character" is the 8 byte prefix, when a prefix
+/// is exhausted, it is reloaded at depth + 8.
+///
+/// Top levels are partitioned by `threads` tasks, then buckets are sorted
+/// by the tasks, tasks run on WorkStealingExecutor::global(), sort is not
+/// stable.
+namespace str_radix_sort_detail {
+
+template<class Entry>
+struct Item {
+	uint64_t pfx; // 8 bytes at depth, big endian, zero padded
+	Entry    ent;
+};
+
+inline uint64_t load_pfx(const byte_t* s, size_t len, size_t depth) {
+	uint64_t x = 0;
+	if (len >= depth + 8) {
+		memcpy(&x, s + depth, 8);
+	} else if (len > depth) {
+		memcpy(&x, s + depth, len - depth);
+	}
+#if BOOST_ENDIAN_LITTLE_BYTE
+	x = byte_swap(x);
+#endif
+	return x;
+}
+
+template<class Entry, class GetStr>
+class Sorter {
+public:
+	typedef Item<Entry> item_t;
+	static const size_t kInsertSort = 16;
+	static const size_t kRadixMin   = 1024; // smaller buckets use mkqs
+	static const size_t kParallelMin = 64 * 1024;
+
+	GetStr m_get;
+	item_t* m_tmp;
+
+	Sorter(GetStr get, item_t* tmp) : m_get(get), m_tmp(tmp) {}
+
+	// length of remaining string at depth, capped by 9(means more than 8)
+	size_t clen(const item_t& x, size_t depth) const {
+		size_t len = m_get(x.ent).size();
+		return len <= depth ? 0 : std::min<size_t>(len - depth, 9);
+	}
+	void reload(item_t* a, size_t n, size_t depth) const {
+		for (size_t i = 0; i < n; ++i) {
+			fstring s = m_get(a[i].ent);
+			a[i].pfx = load_pfx(s.udata(), s.size(), depth);
+		}
+	}
+	// full compare, pfx of both are loaded at depth
+	bool less(const item_t& x, const item_t& y, size_t depth) const {
+		if (x.pfx != y.pfx)
+			return x.pfx < y.pfx;
+		fstring sx = m_get(x.ent), sy = m_get(y.ent);
+		depth = std::min(depth + 8, std::min(sx.size(), sy.size()));
+		return fstring(sx.p + depth, sx.end()) < fstring(sy.p + depth, sy.end());
+	}
+	void insert_sort(item_t* a, size_t n, size_t depth) const {
+		for (size_t i = 1; i < n; ++i) {
+			item_t x = a[i];
+			size_t j = i;
+			for (; j > 0 && less(x, a[j-1], depth); --j)
+				a[j] = a[j-1];
+			a[j] = x;
+		}
+	}
+
+	// multikey quicksort, the key at depth is (pfx, clen)
+	void mkqs(item_t* a, size_t n, size_t depth) const {
+		while (n > kInsertSort) {
+			const item_t& m1 = a[0], &m2 = a[n/2], &m3 = a[n-1];
+			auto key = [&](const item_t& x) {
+				return std::make_pair(x.pfx, clen(x, depth));
+			};
+			auto k1 = key(m1), k2 = key(m2), k3 = key(m3);
+			auto pivot = std::max(std::min(k1, k2), std::min(std::max(k1, k2), k3));
+			// Dijkstra 3-way partition: [0,lt) < pivot, [lt,gt) == pivot
+			size_t lt = 0, i = 0, gt = n;
+			while (i < gt) {
+				auto k = key(a[i]);
+				if (k < pivot)
+					std::swap(a[lt++], a[i++]);
+				else if (pivot < k)
+					std::swap(a[i], a[--gt]);
+				else
+					i++;
+			}
+			mkqs(a, lt, depth);
+			mkqs(a + gt, n - gt, depth);
+			if (pivot.second <= 8)
+				return; // equal strings
+			a += lt;
+			n = gt - lt;
+			depth += 8;
+			reload(a, n, depth);
+		}
+		insert_sort(a, n, depth);
+	}
+
+	// digit of byte b in prefix, 0 for strings ended before byte b
+	static size_t digit(uint64_t pfx, size_t cl, size_t b) {
+		return cl <= b ? 0 : 1 + size_t((pfx >> (56 - 8*b)) & 255);
+	}
+
+	void sort_bucket(item_t* a, size_t n, size_t depth, size_t b) {
+		if (0 == n)
+			return;
+		if (8 == b) { // prefix exhausted, strings of clen <= 8 are equal
+			size_t k = 0;
+			for (size_t i = 0; i < n; ++i)
+				if (clen(a[i], depth) <= 8)
+					std::swap(a[k++], a[i]);
+			a += k, n -= k;
+			depth += 8, b = 0;
+			reload(a, n, depth);
+		}
+		radix(a, n, depth, b);
+	}
+
+	// MSD radix on byte b of pfx, prefix of all items are same before b
+	void radix(item_t* a, size_t n, size_t depth, size_t b) {
+		if (n < kRadixMin) {
+			mkqs(a, n, depth);
+			return;
+		}
+		size_t cnt[258] = {0};
+		for (size_t i = 0; i < n; ++i)
+			cnt[1 + digit(a[i].pfx, clen(a[i], depth), b)]++;
+		for (size_t d = 1; d < 258; ++d)
+			cnt[d] += cnt[d-1];
+		size_t maxcnt = 0;
+		for (size_t d = 0; d < 257; ++d)
+			maxcnt = std::max(maxcnt, cnt[d+1] - cnt[d]);
+		if (maxcnt < n) { // else all items are in one bucket
+			item_t* tmp = m_tmp + (a - m_base);
+			size_t pos[257];
+			std::copy(cnt, cnt + 257, pos);
+			for (size_t i = 0; i < n; ++i)
+				tmp[pos[digit(a[i].pfx, clen(a[i], depth), b)]++] = a[i];
+			std::copy(tmp, tmp + n, a);
+		}
+		mkqs(a, cnt[1], depth); // strings ended before b, ordered by clen
+		for (size_t d = 1; d < 257; ++d)
+			sort_bucket(a + cnt[d], cnt[d+1] - cnt[d], depth, b + 1);
+	}
+
+	item_t* m_base = NULL;
+};
+
+template<class Entry, class GetStr>
+void parallel_sort_items(Item<Entry>* a, Item<Entry>* tmp, size_t n,
+						 GetStr get, size_t threads, size_t b) {
+	typedef Sorter<Entry, GetStr> sorter_t;
+	if (threads <= 1 || n < sorter_t::kParallelMin || b >= 8) {
+		sorter_t s(get, tmp);
+		s.m_base = a;
+		s.sort_bucket(a, n, 0, b);
+		return;
+	}
+	auto run = [threads](const std::function<void(size_t)>& fn) {
+		WorkStealingExecutor::global().parallel_for(threads, fn);
+	};
+	// parallel partition by byte b
+	std::vector<std::array<size_t, 258> > cnt(threads);
+	run([&](size_t t) {
+		sorter_t s(get, tmp);
+		auto& c = cnt[t];
+		c.fill(0);
+		size_t beg = n * t / threads, end = n * (t+1) / threads;
+		for (size_t i = beg; i < end; ++i)
+			c[1 + s.digit(a[i].pfx, s.clen(a[i], 0), b)]++;
+	});
+	size_t bucket[258], sum = 0;
+	bucket[0] = 0;
+	for (size_t d = 1; d < 258; ++d) {
+		for (size_t t = 0; t < threads; ++t) {
+			size_t c = cnt[t][d];
+			cnt[t][d] = sum; // start pos of thread t in bucket d-1
+			sum += c;
+		}
+		bucket[d] = sum;
+	}
+	run([&](size_t t) {
+		sorter_t s(get, tmp);
+		size_t pos[257];
+		for (size_t d = 0; d < 257; ++d)
+			pos[d] = cnt[t][d+1];
+		size_t beg = n * t / threads, end = n * (t+1) / threads;
+		for (size_t i = beg; i < end; ++i)
+			tmp[pos[s.digit(a[i].pfx, s.clen(a[i], 0), b)]++] = a[i];
+	});
+	run([&](size_t t) {
+		size_t beg = n * t / threads, end = n * (t+1) / threads;
+		std::copy(tmp + beg, tmp + end, a + beg);
+	});
+	// a large bucket is partitioned by all threads at next byte,
+	// others are sorted by threads, largest first for load balance
+	std::vector<std::pair<size_t, size_t> > order; // (size, digit)
+	for (size_t d = 1; d < 257; ++d) {
+		size_t m = bucket[d+1] - bucket[d];
+		if (m > n / threads)
+			parallel_sort_items(a + bucket[d], tmp + bucket[d], m, get, threads, b + 1);
+		else if (m)
+			order.emplace_back(m, d);
+	}
+	if (bucket[1])
+		order.emplace_back(bucket[1], 0);
+	std::sort(order.begin(), order.end(), std::greater<std::pair<size_t,size_t> >());
+	std::atomic<size_t> next(0);
+	run([&](size_t) {
+		sorter_t s(get, tmp);
+		s.m_base = a;
+		for (size_t k; (k = next++) < order.size(); ) {
+			size_t d = order[k].second;
+			Item<Entry>* p = a + bucket[d];
+			size_t m = bucket[d+1] - bucket[d];
+			if (0 == d)
+				s.mkqs(p, m, 0);
+			else
+				s.sort_bucket(p, m, 0, b + 1);
+		}
+	});
+}
+
+} // namespace str_radix_sort_detail
+
+/// GetStr: fstring get(const Entry&), the string of an entry(may exclude
+/// a value suffix), it must be cheap and thread safe
+template<class Entry, class GetStr>
+void parallel_radix_sort(Entry* base, size_t n, GetStr get, size_t threads) {
+	using namespace str_radix_sort_detail;
+	if (n <= 1)
+		return;
+	threads = std::max<size_t>(threads, 1);
+	valvec<Item<Entry> > items(n, valvec_no_init());
+	valvec<Item<Entry> > tmp(n, valvec_no_init());
+	for (size_t i = 0; i < n; ++i) {
+		fstring s = get(base[i]);
+		items[i].pfx = load_pfx(s.udata(), s.size(), 0);
+		items[i].ent = base[i];
+	}
+	parallel_sort_items(items.data(), tmp.data(), n, get, threads, 0);
+	for (size_t i = 0; i < n; ++i)
+		base[i] = items[i].ent;
+}
+
+} // namespace terark
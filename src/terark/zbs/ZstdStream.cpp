@@ -1,7 +1,14 @@
 #include "ZstdStream.hpp"
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string.h>
+#include <terark/valvec.hpp>
+#include <terark/thread/work_stealing_executor.hpp>
+#include <terark/util/atomic.hpp>
 #include <zstd/zstd.h>
+#include <zstd/common/zstd_errors.h>
 
 namespace terark {
 
@@ -32,6 +39,43 @@ namespace terark {
         CHECK(!ZSTD_isError(err), "%s", ZSTD_getErrorName(err)); \
     } while (0)
 
+// zstd seekable format, see zstd/contrib/seekable_format
+static const uint32_t kZstdSkippableMagic = 0x184D2A50; // low 4 bits are any
+static const uint32_t kZstdSeekTableMagic = 0x184D2A5E;
+static const uint32_t kZstdSeekableMagic  = 0x8F92EAB1;
+static const size_t   kZstdFrameHeaderMax = 18; // ZSTD_FRAMEHEADERSIZE_MAX
+
+// a frame compressed/decompressed by a task on WorkStealingExecutor
+struct ZstdFrameJob {
+    valvec<byte_t> src;
+    valvec<byte_t> dst;
+    size_t err = 0;
+    bool   done = false; // set under mtx of the stream
+};
+
+// zstd contexts are expensive, each executor worker reuses its own
+struct ZstdTlsContext {
+    ZSTD_CCtx* cctx = nullptr;
+    ZSTD_DCtx* dctx = nullptr;
+    ~ZstdTlsContext() {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+};
+static thread_local ZstdTlsContext g_zstd_tls;
+
+// wait job done, run other tasks instead of sleeping if possible
+static void ZstdWaitJob(ZstdFrameJob* job, std::mutex& mtx,
+                        std::condition_variable& cond) {
+    auto& exe = WorkStealingExecutor::global();
+    while (!as_atomic(job->done).load(std::memory_order_acquire)) {
+        if (exe.help_one())
+            continue;
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!job->done)
+            cond.wait(lock);
+    }
+}
 
 class ZstdInputStream::Impl {
 public:
@@ -43,12 +87,32 @@ public:
     void* buffOut;
     size_t buffOutSize;
     ZSTD_outBuffer output;
+
+    // for parallel decompression
+    int workers = 0;
+    int maxWindowLog = 0;
+    size_t maxFrameSize = size_t(16) << 20;
+    bool serial = true; // also true after a frame without content size
+    bool inputEof = false;
+    valvec<byte_t> pending; // compressed data which is not dispatched
+    size_t pendingPos = 0;
+    std::deque<ZstdFrameJob*> jobs; // in stream order
+    size_t outPos = 0; // read pos in jobs.front()->dst
+    std::mutex mtx;
+    std::condition_variable cond;
+
+    size_t serialRead(void* buf, size_t size);
+    size_t parallelRead(void* buf, size_t size);
+    bool readMore();
+    bool nextFrame();
+    void waitAll();
+    static void decompressTask(void* impl, size_t job, size_t);
 };
 
 ZstdInputStream::ZstdInputStream(IInputStream* istream)
     : m_impl(new ZstdInputStream::Impl)
 {
-    assert(m_impl->istream != nullptr);
+    assert(istream != nullptr);
     m_impl->istream = istream;
     m_impl->dctx = ZSTD_createDCtx();
     CHECK(m_impl->dctx != NULL, "ZSTD_createDCtx() failed!");
@@ -63,45 +127,83 @@ ZstdInputStream::ZstdInputStream(IInputStream* istream)
 
 ZstdInputStream::~ZstdInputStream()
 {
+    m_impl->waitAll();
     ZSTD_freeDCtx(m_impl->dctx);
     free(m_impl->buffIn);
     free(m_impl->buffOut);
     delete m_impl;
 }
 
+void ZstdInputStream::setWorkers(int n)
+{
+    m_impl->workers = n;
+    m_impl->serial = n <= 0;
+}
+
+void ZstdInputStream::setMaxFrameSize(size_t size)
+{
+    m_impl->maxFrameSize = size;
+}
+
+void ZstdInputStream::setMaxWindowLog(int log)
+{
+    m_impl->maxWindowLog = log;
+    CHECK_ZSTD(ZSTD_DCtx_setParameter(m_impl->dctx, ZSTD_d_windowLogMax, log));
+}
+
 void ZstdInputStream::resetIstream(IInputStream* istream)
 {
     // only allow to reset the m_impl->istream when the previous m_impl->istream has been decompressed
     assert(eof() && istream != nullptr);
+    m_impl->waitAll();
     m_impl->istream = istream;
     ZSTD_DCtx_reset(m_impl->dctx, ZSTD_reset_session_and_parameters);
+    if (m_impl->maxWindowLog)
+        ZSTD_DCtx_setParameter(m_impl->dctx, ZSTD_d_windowLogMax, m_impl->maxWindowLog);
     m_impl->input = { m_impl->buffIn, m_impl->buffInSize, m_impl->buffInSize };
+    m_impl->serial = m_impl->workers <= 0;
+    m_impl->inputEof = false;
+    m_impl->pending.clear();
+    m_impl->pendingPos = 0;
 }
 
 size_t ZstdInputStream::read(void* buf, size_t size) throw()
 {
-    size_t const toRead = m_impl->buffInSize;
+    if (m_impl->serial && m_impl->jobs.empty())
+        return m_impl->serialRead(buf, size);
+    else
+        return m_impl->parallelRead(buf, size);
+}
+
+size_t ZstdInputStream::Impl::serialRead(void* buf, size_t size)
+{
+    size_t const toRead = buffInSize;
     size_t read;
     size_t lastRet = 0;
     int isEmpty = 1;
     size_t usable_out_size = size;
 
     while (usable_out_size > 0) {
-        if (m_impl->input.pos < m_impl->input.size) {
+        if (input.pos < input.size) {
+            isEmpty = 0;
+        } else if (pendingPos < pending.size()) {
+            // left by parallel mode
+            input = { pending.data() + pendingPos, pending.size() - pendingPos, 0 };
+            pendingPos = pending.size();
             isEmpty = 0;
-        } else if ((read = m_impl->istream->read(m_impl->buffIn, toRead))) {
-            m_impl->input = { m_impl->buffIn, read, 0 };
+        } else if ((read = istream->read(buffIn, toRead))) {
+            input = { buffIn, read, 0 };
             isEmpty = 0;
         } else {
             break;
         }
 
-        while (usable_out_size > 0 && m_impl->input.pos < m_impl->input.size) {
-            m_impl->output = { m_impl->buffOut, std::min(usable_out_size, m_impl->buffOutSize), 0 };
-            size_t const ret = ZSTD_decompressStream(m_impl->dctx, &m_impl->output, &m_impl->input);
+        while (usable_out_size > 0 && input.pos < input.size) {
+            output = { buffOut, std::min(usable_out_size, buffOutSize), 0 };
+            size_t const ret = ZSTD_decompressStream(dctx, &output, &input);
             CHECK_ZSTD(ret);
-            memcpy((char*)buf + size - usable_out_size, m_impl->buffOut, m_impl->output.pos);
-            usable_out_size -= m_impl->output.pos;
+            memcpy((char*)buf + size - usable_out_size, buffOut, output.pos);
+            usable_out_size -= output.pos;
             lastRet = ret;
         }
     }
@@ -117,9 +219,141 @@ size_t ZstdInputStream::read(void* buf, size_t size) throw()
     return size - usable_out_size;
 }
 
+size_t ZstdInputStream::Impl::parallelRead(void* vbuf, size_t size)
+{
+    auto buf = (byte_t*)vbuf;
+    size_t got = 0;
+    while (got < size) {
+        if (jobs.empty()) {
+            while (jobs.size() < size_t(workers) * 2 && nextFrame()) {}
+            if (jobs.empty()) {
+                if (serial) // met a frame without content size
+                    got += serialRead(buf + got, size - got);
+                break;
+            }
+        }
+        ZstdFrameJob* job = jobs.front();
+        ZstdWaitJob(job, mtx, cond);
+        CHECK(!ZSTD_isError(job->err), "%s", ZSTD_getErrorName(job->err));
+        size_t n = std::min(size - got, job->dst.size() - outPos);
+        memcpy(buf + got, job->dst.data() + outPos, n);
+        outPos += n;
+        got += n;
+        if (job->dst.size() == outPos) {
+            jobs.pop_front();
+            delete job;
+            outPos = 0;
+            // read ahead: keep workers*2 frames in flight
+            while (jobs.size() < size_t(workers) * 2 && nextFrame()) {}
+        }
+    }
+    return got;
+}
+
+bool ZstdInputStream::Impl::readMore()
+{
+    if (inputEof)
+        return false;
+    if (pendingPos) {
+        pending.erase_i(0, pendingPos);
+        pendingPos = 0;
+    }
+    size_t oldsize = pending.size();
+    size_t toRead = std::max(buffInSize, oldsize);
+    pending.resize_no_init(oldsize + toRead);
+    size_t n = istream->read(pending.data() + oldsize, toRead);
+    pending.risk_set_size(oldsize + n);
+    if (0 == n)
+        inputEof = true;
+    return n > 0;
+}
+
+// dispatch next frame to executor, skippable frames(seek table) are skipped
+// returns false on EOF or a frame which is not suitable for parallel decode,
+// thus the rest is decoded by ZSTD_decompressStream, without buffering whole
+// frames: a frame without content size or larger than maxFrameSize
+bool ZstdInputStream::Impl::nextFrame()
+{
+    for (;;) {
+        const byte_t* p = pending.data() + pendingPos;
+        size_t avail = pending.size() - pendingPos;
+        if (avail < kZstdFrameHeaderMax && readMore())
+            continue;
+        if (0 == avail)
+            return false;
+        if (avail >= 4 && (unaligned_load<uint32_t>(p) & 0xFFFFFFF0) == kZstdSkippableMagic) {
+            if (avail >= 8) {
+                size_t fsize = 8 + size_t(unaligned_load<uint32_t>(p + 4));
+                if (avail >= fsize) {
+                    pendingPos += fsize;
+                    continue;
+                }
+            }
+            CHECK(readMore(), "truncated skippable frame");
+            continue;
+        }
+        auto contentSize = ZSTD_getFrameContentSize(p, avail);
+        CHECK(ZSTD_CONTENTSIZE_ERROR != contentSize, "bad zstd frame header");
+        if (ZSTD_CONTENTSIZE_UNKNOWN == contentSize || contentSize > maxFrameSize) {
+            serial = true;
+            return false;
+        }
+        size_t frameSize = ZSTD_findFrameCompressedSize(p, avail);
+        if (ZSTD_isError(frameSize)) {
+            // a valid frame is never larger than compress bound, on
+            // corrupted data let ZSTD_decompressStream report the error
+            if (avail > ZSTD_compressBound(size_t(contentSize)) + kZstdFrameHeaderMax + 4) {
+                serial = true;
+                return false;
+            }
+            CHECK(readMore(), "truncated zstd frame: %s", ZSTD_getErrorName(frameSize));
+            continue;
+        }
+        auto job = new ZstdFrameJob;
+        job->src.assign(p, frameSize);
+        job->dst.resize_no_init(size_t(contentSize));
+        pendingPos += frameSize;
+        jobs.push_back(job);
+        WorkStealingExecutor::global().submit(&decompressTask, this, size_t(job));
+        return true;
+    }
+}
+
+void ZstdInputStream::Impl::decompressTask(void* vimpl, size_t vjob, size_t)
+{
+    auto impl = (Impl*)vimpl;
+    auto job = (ZstdFrameJob*)vjob;
+    auto& dctx = g_zstd_tls.dctx;
+    if (!dctx) {
+        dctx = ZSTD_createDCtx();
+        CHECK(dctx != NULL, "ZSTD_createDCtx() failed!");
+    }
+    size_t ret = ZSTD_decompressDCtx(dctx, job->dst.data(), job->dst.size(),
+                                     job->src.data(), job->src.size());
+    if (!ZSTD_isError(ret) && ret != job->dst.size())
+        ret = size_t(-ZSTD_error_corruption_detected);
+    job->err = ZSTD_isError(ret) ? ret : 0;
+    job->src.clear();
+    std::lock_guard<std::mutex> lock(impl->mtx);
+    as_atomic(job->done).store(true, std::memory_order_release);
+    impl->cond.notify_all();
+}
+
+void ZstdInputStream::Impl::waitAll()
+{
+    for (ZstdFrameJob* job : jobs) {
+        ZstdWaitJob(job, mtx, cond);
+        delete job;
+    }
+    jobs.clear();
+    outPos = 0;
+}
+
 bool ZstdInputStream::eof() const
 {
-    return m_impl->istream->eof() && m_impl->input.pos >= m_impl->input.size;
+    auto impl = m_impl;
+    return impl->istream->eof() && impl->input.pos >= impl->input.size
+        && impl->pendingPos >= impl->pending.size() && impl->jobs.empty();
 }
 
 ///////////////////////////////////////////////////////
@@ -132,8 +366,48 @@ public:
     void* buffOut;
     size_t buffOutSize;
     ZSTD_outBuffer output;
+
+    int workers = 0;
+    int longWindow = 0;
+    size_t frameSize = 0;
+    bool paramsApplied = false;
+
+    // for frameSize != 0
+    valvec<byte_t> curSrc;
+    std::deque<ZstdFrameJob*> jobs; // in stream order
+    valvec<std::pair<uint32_t, uint32_t> > seekTable; // {zip, raw} sizes
+    std::mutex mtx;
+    std::condition_variable cond;
+
+    void setParams(ZSTD_CCtx*, bool useWorkers) const;
+    void submitFrame();
+    void writeFrontFrame();
+    void writeSeekTable();
+    static void compressTask(void* impl, size_t job, size_t);
 };
 
+void ZstdOutputStream::Impl::setParams(ZSTD_CCtx* zc, bool useWorkers) const
+{
+    CHECK_ZSTD(ZSTD_CCtx_setParameter(zc, ZSTD_c_compressionLevel, int(cLevel)));
+    if (longWindow) {
+        CHECK_ZSTD(ZSTD_CCtx_setParameter(zc, ZSTD_c_enableLongDistanceMatching, 1));
+        CHECK_ZSTD(ZSTD_CCtx_setParameter(zc, ZSTD_c_windowLog, longWindow));
+    }
+    if (useWorkers && workers > 0) {
+        size_t err = ZSTD_CCtx_setParameter(zc, ZSTD_c_nbWorkers, workers);
+        if (ZSTD_isError(err)) {
+            static bool warned = false;
+            if (!warned) {
+                warned = true;
+                fprintf(stderr,
+                    "WARN: ZstdOutputStream: ZSTD_c_nbWorkers = %s, zstd is "
+                    "not compiled with ZSTD_MULTITHREAD, use single thread\n",
+                    ZSTD_getErrorName(err));
+            }
+        }
+    }
+}
+
 ZstdOutputStream::ZstdOutputStream(IOutputStream* ostream)
     : m_impl(new ZstdOutputStream::Impl)
 {
@@ -162,6 +436,23 @@ void ZstdOutputStream::setCLevel(size_t l) {
     m_impl->cLevel = l;
 };
 
+void ZstdOutputStream::setWorkers(int n) {
+    assert(!m_impl->paramsApplied);
+    m_impl->workers = n;
+}
+
+void ZstdOutputStream::setLongWindow(int log) {
+    assert(!m_impl->paramsApplied);
+    m_impl->longWindow = log;
+}
+
+void ZstdOutputStream::setFrameSize(size_t frameSize) {
+    assert(!m_impl->paramsApplied);
+    // sizes in seek table are uint32
+    CHECK(frameSize < (size_t(1) << 31), "frameSize = %zd is too large", frameSize);
+    m_impl->frameSize = frameSize;
+}
+
 void ZstdOutputStream::resetOstream(IOutputStream* ostream)
 {
     // only allow to reset the ostream when the previous ostream has been closed
@@ -173,37 +464,156 @@ void ZstdOutputStream::resetOstream(IOutputStream* ostream)
 size_t ZstdOutputStream::write(const void* buf, size_t size) throw()
 {
     assert(m_impl->ostream != nullptr);
+    if (m_impl->frameSize) {
+        auto impl = m_impl;
+        auto src = (const byte_t*)buf;
+        size_t remain = size;
+        impl->paramsApplied = true;
+        while (remain) {
+            if (impl->curSrc.capacity() < impl->frameSize)
+                impl->curSrc.reserve(impl->frameSize);
+            size_t n = std::min(remain, impl->frameSize - impl->curSrc.size());
+            impl->curSrc.append(src, n);
+            src += n;
+            remain -= n;
+            if (impl->curSrc.size() == impl->frameSize)
+                impl->submitFrame();
+        }
+        return size;
+    }
     ZSTD_inBuffer input = { buf, size, 0 };
     size_t remaining;
 
-    CHECK_ZSTD(ZSTD_CCtx_setParameter(m_impl->cctx, ZSTD_c_compressionLevel, m_impl->cLevel));
+    if (!m_impl->paramsApplied) {
+        m_impl->setParams(m_impl->cctx, true);
+        m_impl->paramsApplied = true;
+    }
 
+    // with ZSTD_c_nbWorkers, remaining may keep non-zero until jobs are
+    // done, so it is not used as the loop condition
     do {
         m_impl->output = { m_impl->buffOut, m_impl->buffOutSize, 0 };
         remaining = ZSTD_compressStream2(m_impl->cctx, &m_impl->output, &input, ZSTD_e_continue);
         CHECK_ZSTD(remaining);
         m_impl->ostream->write(m_impl->buffOut, m_impl->output.pos);
-    } while (remaining != 0);
+    } while (input.pos < input.size);
     CHECK(input.pos == input.size,
         "Impossible: zstd only returns 0 when the input is completely consumed!");
     return input.pos;
 }
 
+void ZstdOutputStream::Impl::submitFrame()
+{
+    if (curSrc.empty())
+        return;
+    auto job = new ZstdFrameJob;
+    job->src.swap(curSrc);
+    if (workers <= 0) {
+        jobs.push_back(job);
+        compressTask(this, size_t(job), 0);
+        writeFrontFrame();
+        return;
+    }
+    // at most workers frames are in flight
+    while (jobs.size() >= size_t(workers))
+        writeFrontFrame();
+    jobs.push_back(job);
+    WorkStealingExecutor::global().submit(&compressTask, this, size_t(job));
+    while (!jobs.empty() && as_atomic(jobs.front()->done).load(std::memory_order_acquire))
+        writeFrontFrame();
+}
+
+void ZstdOutputStream::Impl::compressTask(void* vimpl, size_t vjob, size_t)
+{
+    auto impl = (Impl*)vimpl;
+    auto job = (ZstdFrameJob*)vjob;
+    auto& zc = g_zstd_tls.cctx;
+    if (!zc) {
+        zc = ZSTD_createCCtx();
+        CHECK(zc != NULL, "ZSTD_createCCtx() failed!");
+    }
+    ZSTD_CCtx_reset(zc, ZSTD_reset_session_and_parameters);
+    impl->setParams(zc, false);
+    job->dst.resize_no_init(ZSTD_compressBound(job->src.size()));
+    size_t ret = ZSTD_compress2(zc, job->dst.data(), job->dst.size(),
+                                job->src.data(), job->src.size());
+    if (ZSTD_isError(ret)) {
+        job->err = ret;
+    } else {
+        job->dst.risk_set_size(ret);
+        job->dst.shrink_to_fit();
+    }
+    std::lock_guard<std::mutex> lock(impl->mtx);
+    as_atomic(job->done).store(true, std::memory_order_release);
+    impl->cond.notify_all();
+}
+
+void ZstdOutputStream::Impl::writeFrontFrame()
+{
+    ZstdFrameJob* job = jobs.front();
+    ZstdWaitJob(job, mtx, cond);
+    jobs.pop_front();
+    CHECK(!ZSTD_isError(job->err), "%s", ZSTD_getErrorName(job->err));
+    ostream->write(job->dst.data(), job->dst.size());
+    seekTable.emplace_back(uint32_t(job->dst.size()), uint32_t(job->src.size()));
+    delete job;
+}
+
+void ZstdOutputStream::Impl::writeSeekTable()
+{
+    size_t num = seekTable.size();
+    valvec<byte_t> buf(8 + num * 8 + 9);
+    byte_t* p = buf.data();
+    unaligned_save<uint32_t>(p + 0, kZstdSeekTableMagic);
+    unaligned_save<uint32_t>(p + 4, uint32_t(num * 8 + 9));
+    p += 8;
+    for (auto& e : seekTable) {
+        unaligned_save<uint32_t>(p + 0, e.first);
+        unaligned_save<uint32_t>(p + 4, e.second);
+        p += 8;
+    }
+    unaligned_save<uint32_t>(p, uint32_t(num));
+    p[4] = 0; // Seek_Table_Descriptor: no checksum
+    unaligned_save<uint32_t>(p + 5, kZstdSeekableMagic);
+    ostream->write(buf.data(), buf.size());
+    seekTable.erase_all();
+}
+
 void ZstdOutputStream::flush()
 {
     assert(m_impl->ostream != nullptr);
-    m_impl->output = { m_impl->buffOut, m_impl->buffOutSize, 0 };
-    ZSTD_flushStream(m_impl->cctx, &m_impl->output);
-    m_impl->ostream->write(m_impl->buffOut, m_impl->output.pos);
+    if (m_impl->frameSize) {
+        m_impl->submitFrame();
+        while (!m_impl->jobs.empty())
+            m_impl->writeFrontFrame();
+        return;
+    }
+    size_t remaining;
+    do {
+        m_impl->output = { m_impl->buffOut, m_impl->buffOutSize, 0 };
+        remaining = ZSTD_flushStream(m_impl->cctx, &m_impl->output);
+        CHECK_ZSTD(remaining);
+        m_impl->ostream->write(m_impl->buffOut, m_impl->output.pos);
+    } while (remaining != 0);
 }
 
 void ZstdOutputStream::close()
 {
     assert(m_impl->ostream != nullptr);
-    m_impl->output = { m_impl->buffOut, m_impl->buffOutSize, 0 };
-    ZSTD_endStream(m_impl->cctx, &m_impl->output);
-    m_impl->ostream->write(m_impl->buffOut, m_impl->output.pos);
+    if (m_impl->frameSize) {
+        flush();
+        m_impl->writeSeekTable();
+    } else {
+        size_t remaining;
+        do {
+            m_impl->output = { m_impl->buffOut, m_impl->buffOutSize, 0 };
+            remaining = ZSTD_endStream(m_impl->cctx, &m_impl->output);
+            CHECK_ZSTD(remaining);
+            m_impl->ostream->write(m_impl->buffOut, m_impl->output.pos);
+        } while (remaining != 0);
+    }
     m_impl->ostream = nullptr;
+    m_impl->paramsApplied = false;
 }
 
 } // namespace terark
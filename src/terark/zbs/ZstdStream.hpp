@@ -14,6 +14,22 @@ public:
     explicit ZstdInputStream(IInputStream*);
     ~ZstdInputStream();
 
+    /// decompress up to n frames in parallel on WorkStealingExecutor::global()
+    /// and read ahead compressed data of these frames, 0 is serial.
+    /// it is for multi frame input such as which written by
+    /// ZstdOutputStream::setFrameSize, only frames with content size in
+    /// header and not larger than setMaxFrameSize are decompressed in
+    /// parallel, once other frame is met, the rest is decompressed serially
+    /// by streaming, so memory is bounded by about 2 * n * maxFrameSize.
+    void setWorkers(int n);
+
+    /// max content size of a frame to be decompressed in parallel,
+    /// default is 16M
+    void setMaxFrameSize(size_t size);
+
+    /// required for streams written with setLongWindow(log) if log > 27
+    void setMaxWindowLog(int log);
+
     void resetIstream(IInputStream*);
     size_t read(void* buf, size_t size) throw();
     bool eof() const;
@@ -31,6 +47,23 @@ public:
     ~ZstdOutputStream();
 
     void setCLevel(size_t l);
+
+    /// compress with n worker threads, 0 is on the caller's thread.
+    /// if frameSize is 0, it is zstd's ZSTD_c_nbWorkers, else frames are
+    /// compressed in parallel on WorkStealingExecutor::global()
+    void setWorkers(int n);
+
+    /// enable long distance matching with window size of (1 << log),
+    /// 0 to disable, log > 27 requires ZstdInputStream::setMaxWindowLog
+    void setLongWindow(int log);
+
+    /// split output into independent frames of frameSize input bytes, each
+    /// frame has content size in its header, and a seek table is appended
+    /// on close, in zstd seekable format(contrib/seekable_format), so the
+    /// output can be randomly accessed and decompressed in parallel.
+    /// 0(default) is one streaming frame. must be called before write.
+    void setFrameSize(size_t frameSize);
+
     void resetOstream(IOutputStream*);
     size_t write(const void* buf, size_t size) throw();
     void flush();
@@ -53,6 +53,21 @@ RegisterBlobStore::RegisterFactory::RegisterFactory
   }
 }
 
+static hash_strmap<AbstractBlobStore::Builder::Factory>& g_getBuilderFactroyMap() {
+  static hash_strmap<AbstractBlobStore::Builder::Factory> map;
+  return map;
+}
+AbstractBlobStore::Builder::RegisterFactory::RegisterFactory
+(std::initializer_list<fstring> names, Factory factory)
+{
+  auto& map = g_getBuilderFactroyMap();
+  fstring clazz = *names.begin();
+  for (fstring name : names) {
+    auto ib = map.insert_i(name, factory);
+    TERARK_VERIFY_S(ib.second, "dup builder name %s for class: %s, envs:\n%s",
+                    name, clazz, GetAllEnv());
+  }
+}
 
 AbstractBlobStore::Dictionary::Dictionary() {
     xxhash = XXHash64(g_dicthash_seed)("");
@@ -77,7 +92,12 @@ AbstractBlobStore::Builder::~Builder() {}
 AbstractBlobStore::Builder*
 AbstractBlobStore::Builder::
 createBuilder(fstring clazz, fstring outputFileName, fstring moreConfig) {
-    return nullptr;
+    auto& map = g_getBuilderFactroyMap();
+    auto find = map.find(clazz);
+    if (map.end() == find) {
+        return nullptr;
+    }
+    return find->second(outputFileName, moreConfig);
 }
 AbstractBlobStore::Builder*
 AbstractBlobStore::Builder::getPreBuilder() const {
@@ -11,6 +11,10 @@ class TERARK_DLL_EXPORT AbstractBlobStore : public BlobStore {
 public:
     struct TERARK_DLL_EXPORT Builder : public CacheAlignedNewDelete {
         static Builder* createBuilder(fstring clazz, fstring outputFileName, fstring moreConfig);
+        typedef Builder* (*Factory)(fstring fpath, fstring moreConfig);
+        struct TERARK_DLL_EXPORT RegisterFactory { // for createBuilder
+            RegisterFactory(std::initializer_list<fstring> names, Factory);
+        };
         virtual ~Builder();
         virtual Builder* getPreBuilder() const;
         virtual void addRecord(fstring rec) = 0;
@@ -55,4 +59,11 @@ TERARK_DLL_EXPORT
 AbstractBlobStore*
 NestLoudsTrieBlobStore_build(fstring clazz, int nestLevel, SortableStrVec&);
 
+#define REGISTER_BlobStoreBuilder(Clazz, ...) \
+	static AbstractBlobStore::Builder::RegisterFactory \
+    s_regBuilder##Clazz({#Clazz, ## __VA_ARGS__}, \
+		[](fstring fpath, fstring moreConfig) -> AbstractBlobStore::Builder* { \
+			return new Clazz::MyBuilder(fpath, moreConfig); \
+		})
+
 } // namespace terark
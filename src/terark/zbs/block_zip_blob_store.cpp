@@ -0,0 +1,648 @@
+#include "block_zip_blob_store.hpp"
+#include "blob_store_file_header.hpp"
+#include "zip_reorder_map.hpp"
+#include <terark/io/DataOutput.hpp>
+#include <terark/io/FileStream.hpp>
+#include <terark/io/StreamBuffer.hpp>
+#include <terark/thread/fiber_aio.hpp>
+#include <terark/util/checksum_exception.hpp>
+#include <terark/util/mmap.hpp>
+#include <terark/zbs/xxhash_helper.hpp>
+#include <zstd/zstd.h>
+#include <zstd/dictBuilder/zdict.h>
+#include <atomic>
+
+namespace terark {
+
+REGISTER_BlobStore(BlockZipBlobStore);
+REGISTER_BlobStoreBuilder(BlockZipBlobStore);
+
+static const uint64_t g_bzbs_seed = 0x534270695a6b6c42ull; // echo BlkZipBS | od -t x8
+
+static std::atomic<uint64_t> g_bzbs_instance_id(0);
+
+// | FileHeader | dict | zdata | recOffsets | blockRecs | blockOffsets | Footer |
+// each section is aligned to 64
+struct BlockZipBlobStore::FileHeader : public FileHeaderBase {
+    uint64_t  sections[5]; // size of each section
+    uint16_t  blockRecords;
+    uint08_t  checksumLevel;
+    int08_t   compressLevel;
+    uint32_t  blockBytes;
+
+    FileHeader() {
+        BOOST_STATIC_ASSERT(sizeof(FileHeader) == 128);
+        memset(this, 0, sizeof(*this));
+        magic_len = MagicStrLen;
+        strcpy(magic, MagicString);
+        strcpy(className, "BlockZipBlobStore");
+    }
+    size_t section_pos(size_t i) const {
+        size_t pos = sizeof(FileHeader);
+        for (size_t j = 0; j < i; ++j)
+            pos = align_up(pos + sections[j], 64);
+        return pos;
+    }
+};
+
+struct BlockZipBlobStore::DecodedBlock {
+    uint64_t storeId = 0; // 0 is an empty slot
+    size_t   blockId = size_t(-1);
+    size_t   firstRec = 0;
+    size_t   endRec = 0;
+    size_t   rawBase = 0; // unzipped offset of firstRec
+    size_t   lastUse = 0;
+    valvec<byte_t> data;
+};
+
+// a few slots, for a thread reads multiple stores interleaved
+struct BlockZipBlobStore::ThreadCache {
+    static const size_t kSlots = 4;
+    DecodedBlock slots[kSlots];
+    size_t tick = 0;
+    ZSTD_DCtx* dctx = nullptr;
+    ~ThreadCache() {
+        ZSTD_freeDCtx(dctx);
+    }
+    const DecodedBlock* find_block(uint64_t storeId, size_t blockId) {
+        for (auto& db : slots) {
+            if (db.storeId == storeId && db.blockId == blockId) {
+                db.lastUse = ++tick;
+                return &db;
+            }
+        }
+        return nullptr;
+    }
+    const DecodedBlock* find_rec(uint64_t storeId, size_t recID) {
+        for (auto& db : slots) {
+            if (db.storeId == storeId && db.firstRec <= recID && recID < db.endRec) {
+                db.lastUse = ++tick;
+                return &db;
+            }
+        }
+        return nullptr;
+    }
+    DecodedBlock& victim() {
+        DecodedBlock* lru = &slots[0];
+        for (auto& db : slots) {
+            if (db.lastUse < lru->lastUse)
+                lru = &db;
+        }
+        lru->storeId = 0;
+        lru->lastUse = ++tick;
+        return *lru;
+    }
+};
+
+BlockZipBlobStore::ThreadCache& BlockZipBlobStore::tls_cache() {
+    static thread_local ThreadCache tc;
+    return tc;
+}
+
+BlockZipBlobStore::Options BlockZipBlobStore::Options::parse(fstring conf) {
+    Options opt;
+    valvec<fstring> kvs;
+    conf.split(';', &kvs);
+    for (fstring kv : kvs) {
+        if (kv.empty())
+            continue;
+        const char* eq = kv.strchr('=');
+        if (!eq) {
+            THROW_STD(invalid_argument, "missing '=' in: %.*s", kv.ilen(), kv.data());
+        }
+        std::string key(kv.data(), eq), val(eq + 1, kv.end());
+        char* end = NULL;
+        long num = strtol(val.c_str(), &end, 10);
+        switch (*end) {
+        case 'K': case 'k': num <<= 10; break;
+        case 'M': case 'm': num <<= 20; break;
+        }
+        if (end == val.c_str()) {
+            THROW_STD(invalid_argument, "bad value of %s: %s", key.c_str(), val.c_str());
+        }
+        if ("block_records" == key)
+            opt.block_records = int(num);
+        else if ("block_bytes" == key)
+            opt.block_bytes = int(num);
+        else if ("compress_level" == key)
+            opt.compress_level = int(num);
+        else if ("dict_size" == key)
+            opt.dict_size = int(num);
+        else if ("dict_sample_bytes" == key)
+            opt.dict_sample_bytes = int(num);
+        else if ("block_units" == key)
+            opt.block_units = int(num);
+        else if ("checksum_level" == key)
+            opt.checksum_level = int(num);
+        else
+            THROW_STD(invalid_argument, "unknown option: %s", key.c_str());
+    }
+    return opt;
+}
+
+void BlockZipBlobStore::set_meta_mem(const fstring mems[3]) {
+    SortedUintVec* vecs[3] = {&m_recOffsets, &m_blockRecs, &m_blockOffsets};
+    for (size_t i = 0; i < 3; ++i) {
+        vecs[i]->risk_release_ownership();
+        vecs[i]->risk_set_data(mems[i].data(), mems[i].size());
+    }
+    TERARK_VERIFY_EQ(m_recOffsets.size(), m_numRecords + 1);
+    TERARK_VERIFY_EQ(m_blockRecs.size(), m_blockOffsets.size());
+    TERARK_VERIFY_EQ(m_blockOffsets[num_blocks()], m_zdata.size());
+    m_instanceId = ++g_bzbs_instance_id; // invalidate cached blocks
+}
+
+void BlockZipBlobStore::init_from_memory(fstring dataMem, Dictionary/*dict*/) {
+    auto mmapBase = (const FileHeader*)dataMem.p;
+    m_mmapBase = mmapBase;
+    m_numRecords = mmapBase->records;
+    m_unzipSize = mmapBase->unzipSize;
+    m_checksumLevel = mmapBase->checksumLevel;
+    m_checksumType = mmapBase->checksumType;
+    if (m_checksumLevel == 3 && isChecksumVerifyEnabled()) {
+        XXHash64 hash(g_bzbs_seed);
+        hash.update(mmapBase, mmapBase->fileSize - sizeof(BlobStoreFileFooter));
+        const uint64_t hashVal = hash.digest();
+        auto& footer = ((const BlobStoreFileFooter*)((const byte_t*)(mmapBase) + mmapBase->fileSize))[-1];
+        if (hashVal != footer.fileXXHash) {
+            std::string msg = "BlockZipBlobStore::load_mmap(\"" + get_fpath() + "\")";
+            throw BadChecksumException(msg, footer.fileXXHash, hashVal);
+        }
+    }
+    TERARK_VERIFY_LE(mmapBase->section_pos(5),
+                     mmapBase->fileSize - sizeof(BlobStoreFileFooter));
+    fstring mems[5];
+    for (size_t i = 0; i < 5; ++i) {
+        mems[i] = fstring(dataMem.data() + mmapBase->section_pos(i),
+                          mmapBase->sections[i]);
+    }
+    m_dict = mems[0];
+    m_zdata = mems[1];
+    set_meta_mem(mems + 2);
+    if (m_dict.size()) {
+        m_ddict = ZSTD_createDDict(m_dict.data(), m_dict.size());
+        TERARK_VERIFY_F(NULL != m_ddict, "ZSTD_createDDict(dict size = %zd)", m_dict.size());
+    }
+}
+
+void BlockZipBlobStore::get_meta_blocks(valvec<Block>* blocks) const {
+    blocks->erase_all();
+    blocks->push_back({"recOffsets", {m_recOffsets.data(), (ptrdiff_t)m_recOffsets.mem_size()}});
+    blocks->push_back({"blockRecs", {m_blockRecs.data(), (ptrdiff_t)m_blockRecs.mem_size()}});
+    blocks->push_back({"blockOffsets", {m_blockOffsets.data(), (ptrdiff_t)m_blockOffsets.mem_size()}});
+}
+
+void BlockZipBlobStore::get_data_blocks(valvec<Block>* blocks) const {
+    blocks->erase_all();
+    blocks->push_back({"dict", m_dict});
+    blocks->push_back({"data", m_zdata});
+}
+
+void BlockZipBlobStore::detach_meta_blocks(const valvec<Block>& blocks) {
+    assert(!m_isDetachMeta);
+    TERARK_VERIFY_EQ(blocks.size(), 3);
+    fstring mems[3] = {blocks[0].data, blocks[1].data, blocks[2].data};
+    set_meta_mem(mems);
+    m_isDetachMeta = true;
+}
+
+// write all sections and footer, header.sections are set by mems
+void BlockZipBlobStore::write_sections(FileHeader& header, const fstring mems[5],
+                                       OutputBuffer& buffer) {
+    for (size_t i = 0; i < 5; ++i) {
+        header.sections[i] = mems[i].size();
+    }
+    header.fileSize = header.section_pos(5) + sizeof(BlobStoreFileFooter);
+    XXHash64 xxhash64(g_bzbs_seed);
+    xxhash64.update(&header, sizeof header);
+    buffer.ensureWrite(&header, sizeof header);
+    for (size_t i = 0; i < 5; ++i) {
+        xxhash64.update(mems[i].data(), mems[i].size());
+        buffer.ensureWrite(mems[i].data(), mems[i].size());
+        PadzeroForAlign<64>(buffer, xxhash64, mems[i].size());
+    }
+    BlobStoreFileFooter footer;
+    footer.fileXXHash = xxhash64.digest();
+    buffer.ensureWrite(&footer, sizeof footer);
+}
+
+void BlockZipBlobStore::save_mmap(function<void(const void*, size_t)> write) const {
+    FunctionAdaptBuffer adaptBuffer(write);
+    OutputBuffer buffer(&adaptBuffer);
+    FileHeader header = *(const FileHeader*)m_mmapBase;
+    fstring mems[5] = {
+        m_dict, m_zdata,
+        fstring(m_recOffsets.data(), m_recOffsets.mem_size()),
+        fstring(m_blockRecs.data(), m_blockRecs.mem_size()),
+        fstring(m_blockOffsets.data(), m_blockOffsets.mem_size()),
+    };
+    write_sections(header, mems, buffer);
+}
+
+BlockZipBlobStore::BlockZipBlobStore() {
+    m_instanceId = 0;
+    m_ddict = NULL;
+    m_checksumLevel = 2;
+    m_checksumType = 0;
+    m_get_record_append = BlobStoreStaticCastPMF(get_record_append_func_t,
+                    &BlockZipBlobStore::get_record_append_imp<false>);
+    m_get_record_append_fiber_vm_prefetch =
+                    BlobStoreStaticCastPMF(get_record_append_func_t,
+                    &BlockZipBlobStore::get_record_append_imp<true>);
+    m_fspread_record_append = BlobStoreStaticCastPMF(fspread_record_append_func_t,
+                    &BlockZipBlobStore::fspread_record_append_imp);
+    m_get_record_append_CacheOffsets =
+                    BlobStoreStaticCastPMF(get_record_append_CacheOffsets_func_t,
+                    &BlockZipBlobStore::get_record_append_CacheOffsets_imp);
+    m_get_zipped_size = BlobStoreStaticCastPMF(get_zipped_size_func_t,
+                    &BlockZipBlobStore::get_zipped_size_imp);
+}
+
+BlockZipBlobStore::~BlockZipBlobStore() {
+    ZSTD_freeDDict(m_ddict);
+    // offsets are always on m_mmapBase, user mem or detached meta blocks
+    m_recOffsets.risk_release_ownership();
+    m_blockRecs.risk_release_ownership();
+    m_blockOffsets.risk_release_ownership();
+    if (m_isUserMem) {
+        if (m_isMmapData) {
+            mmap_close((void*)m_mmapBase, m_mmapBase->fileSize);
+        }
+        m_mmapBase = nullptr;
+        m_isMmapData = false;
+        m_isUserMem = false;
+    }
+}
+
+BlockZipBlobStore::Options BlockZipBlobStore::get_options() const {
+    auto header = (const FileHeader*)m_mmapBase;
+    Options opt;
+    opt.block_records = header->blockRecords;
+    opt.block_bytes = header->blockBytes;
+    opt.compress_level = header->compressLevel;
+    opt.dict_size = int(m_dict.size());
+    opt.block_units = int(m_recOffsets.block_units());
+    opt.checksum_level = header->checksumLevel;
+    opt.dict = m_dict;
+    return opt;
+}
+
+size_t BlockZipBlobStore::mem_size() const {
+    return sizeof(FileHeader) + m_dict.size() + m_zdata.size() +
+           m_recOffsets.mem_size() + m_blockRecs.mem_size() +
+           m_blockOffsets.mem_size();
+}
+
+inline size_t BlockZipBlobStore::block_of(size_t recID) const {
+    return m_blockRecs.upper_bound(0, m_blockRecs.size(), recID) - 1;
+}
+
+const BlockZipBlobStore::DecodedBlock&
+BlockZipBlobStore::decompress_block(ThreadCache& tc, size_t blockId,
+                                    const byte_t* zptr, size_t zlen)
+const {
+    auto recs = m_blockRecs.get2(blockId);
+    size_t rawBase = m_recOffsets.get(recs[0]);
+    size_t rawLen = m_recOffsets.get(recs[1]) - rawBase;
+    if (!tc.dctx) {
+        tc.dctx = ZSTD_createDCtx();
+        TERARK_VERIFY(NULL != tc.dctx);
+    }
+    DecodedBlock& db = tc.victim(); // storeId is 0 until decompressed
+    db.data.resize_no_init(rawLen);
+    size_t len = m_ddict
+        ? ZSTD_decompress_usingDDict(tc.dctx, db.data.data(), rawLen, zptr, zlen, m_ddict)
+        : ZSTD_decompressDCtx(tc.dctx, db.data.data(), rawLen, zptr, zlen);
+    if (ZSTD_isError(len)) {
+        THROW_STD(logic_error, "%s: blockId = %zd, zlen = %zd, err = %s",
+                  get_fpath().c_str(), blockId, zlen, ZSTD_getErrorName(len));
+    }
+    if (len != rawLen) {
+        THROW_STD(logic_error, "%s: blockId = %zd, unzip len = %zd, expected %zd",
+                  get_fpath().c_str(), blockId, len, rawLen);
+    }
+    db.blockId = blockId;
+    db.firstRec = recs[0];
+    db.endRec = recs[1];
+    db.rawBase = rawBase;
+    db.storeId = m_instanceId;
+    return db;
+}
+
+template<bool FiberVmPrefetch>
+inline const BlockZipBlobStore::DecodedBlock&
+BlockZipBlobStore::load_block(ThreadCache& tc, size_t blockId) const {
+    auto zBegEnd = m_blockOffsets.get2(blockId);
+    auto zptr = (const byte_t*)m_zdata.data() + zBegEnd[0];
+    size_t zlen = zBegEnd[1] - zBegEnd[0];
+    if (FiberVmPrefetch)
+        fiber_aio_vm_prefetch(zptr, zlen); // may yield, tc is not touched yet
+    return decompress_block(tc, blockId, zptr, zlen);
+}
+
+template<bool FiberVmPrefetch>
+void
+BlockZipBlobStore::get_record_append_imp(size_t recID, valvec<byte_t>* recData)
+const {
+    TERARK_ASSERT_LT(recID, m_numRecords);
+    ThreadCache& tc = tls_cache();
+    const DecodedBlock* db = tc.find_rec(m_instanceId, recID);
+    if (terark_unlikely(!db)) {
+        db = &load_block<FiberVmPrefetch>(tc, block_of(recID));
+    }
+    auto BegEnd = m_recOffsets.get2(recID);
+    recData->append(db->data.data() + (BegEnd[0] - db->rawBase), BegEnd[1] - BegEnd[0]);
+}
+
+// co->offsets[0,1] are record id range of co->blockId, offsets[2..] are the
+// record offsets of the block, if the block has at most kCoMaxRecs records
+static const size_t kCoMaxRecs = 126;
+
+void
+BlockZipBlobStore::get_record_append_CacheOffsets_imp(size_t recID, CacheOffsets* co)
+const {
+    TERARK_ASSERT_LT(recID, m_numRecords);
+    if (terark_unlikely(size_t(-1) == co->blockId ||
+            recID < co->offsets[0] || recID >= co->offsets[1])) {
+        size_t blockId = block_of(recID);
+        auto recs = m_blockRecs.get2(blockId);
+        co->offsets[0] = recs[0];
+        co->offsets[1] = recs[1];
+        if (recs[1] - recs[0] <= kCoMaxRecs)
+            m_recOffsets.get_range(recs[0], recs[1] + 1, co->offsets + 2);
+        co->blockId = blockId;
+    }
+    size_t firstRec = co->offsets[0];
+    size_t BegEnd[2];
+    if (co->offsets[1] - firstRec <= kCoMaxRecs) {
+        BegEnd[0] = co->offsets[2 + recID - firstRec];
+        BegEnd[1] = co->offsets[3 + recID - firstRec];
+    }
+    else {
+        m_recOffsets.get2(recID, BegEnd);
+    }
+    ThreadCache& tc = tls_cache();
+    const DecodedBlock* db = tc.find_block(m_instanceId, co->blockId);
+    if (terark_unlikely(!db)) {
+        db = &load_block<false>(tc, co->blockId);
+    }
+    co->recData.append(db->data.data() + (BegEnd[0] - db->rawBase), BegEnd[1] - BegEnd[0]);
+}
+
+void
+BlockZipBlobStore::fspread_record_append_imp(pread_func_t fspread, void* lambda,
+                                             size_t baseOffset, size_t recID,
+                                             valvec<byte_t>* recData,
+                                             valvec<byte_t>* rdbuf)
+const {
+    TERARK_ASSERT_LT(recID, m_numRecords);
+    ThreadCache& tc = tls_cache();
+    const DecodedBlock* db = tc.find_rec(m_instanceId, recID);
+    if (terark_unlikely(!db)) {
+        size_t blockId = block_of(recID);
+        auto zBegEnd = m_blockOffsets.get2(blockId);
+        size_t zlen = zBegEnd[1] - zBegEnd[0];
+        size_t offset = ((const FileHeader*)m_mmapBase)->section_pos(1) + zBegEnd[0];
+        auto zptr = fspread(lambda, baseOffset + offset, zlen, rdbuf);
+        db = &decompress_block(tc, blockId, zptr, zlen);
+    }
+    auto BegEnd = m_recOffsets.get2(recID);
+    recData->append(db->data.data() + (BegEnd[0] - db->rawBase), BegEnd[1] - BegEnd[0]);
+}
+
+// share of the record in its block
+size_t
+BlockZipBlobStore::get_zipped_size_imp(size_t recID, CacheOffsets*) const {
+    TERARK_ASSERT_LT(recID, m_numRecords);
+    size_t blockId = block_of(recID);
+    auto recs = m_blockRecs.get2(blockId);
+    auto zBegEnd = m_blockOffsets.get2(blockId);
+    auto BegEnd = m_recOffsets.get2(recID);
+    size_t rawLen = m_recOffsets.get(recs[1]) - m_recOffsets.get(recs[0]);
+    if (0 == rawLen)
+        return 0;
+    return size_t(double(zBegEnd[1] - zBegEnd[0]) * (BegEnd[1] - BegEnd[0]) / rawLen);
+}
+
+// rebuild with the same options and dict
+void BlockZipBlobStore::reorder_zip_data(ZReorderMap& newToOld,
+        function<void(const void* data, size_t size)> writeAppend,
+        fstring tmpFile)
+const {
+    TERARK_VERIFY_EQ(newToOld.size(), m_numRecords);
+    {
+        MyBuilder builder(tmpFile, get_options());
+        valvec<byte_t> rec;
+        for (newToOld.rewind(); !newToOld.eof(); ++newToOld) {
+            get_record(*newToOld, &rec);
+            builder.addRecord(rec);
+        }
+        builder.finish();
+    }
+    {
+        MmapWholeFile mmap(tmpFile);
+        writeAppend(mmap.base, mmap.size);
+    }
+    ::remove(tmpFile.c_str());
+}
+
+///////////////////////////////////////////////////////////////////////////
+class BlockZipBlobStore::MyBuilder::Impl : boost::noncopyable {
+    Options m_opt;
+    std::string m_fpath;
+    valvec<byte_t> m_dict;
+    FileStream m_file;
+    NativeDataOutput<OutputBuffer> m_writer;
+    ZSTD_CCtx*  m_cctx;
+    ZSTD_CDict* m_cdict;
+    std::unique_ptr<SortedUintVec::Builder> m_recOffsets;
+    std::unique_ptr<SortedUintVec::Builder> m_blockRecs;
+    std::unique_ptr<SortedUintVec::Builder> m_blockOffsets;
+    valvec<byte_t> m_block;
+    valvec<byte_t> m_zbuf;
+    size_t m_blockRecNum;
+    // leading records are buffered as dict samples until dict is trained
+    bool m_training;
+    size_t m_sampleBytes;
+    valvec<byte_t> m_samples;
+    valvec<size_t> m_sampleLens;
+    size_t m_numRecords;
+    uint64_t m_unzipSize;
+    uint64_t m_zdataSize;
+
+    void start_data() {
+        m_writer.ensureWrite(m_dict.data(), m_dict.size());
+        PadzeroForAlign<64>(m_writer, m_dict.size());
+        m_cctx = ZSTD_createCCtx();
+        TERARK_VERIFY(NULL != m_cctx);
+        ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_compressionLevel, m_opt.compress_level);
+        ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_checksumFlag, m_opt.checksum_level >= 2);
+        ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_dictIDFlag, 0);
+        if (m_dict.size()) {
+            m_cdict = ZSTD_createCDict(m_dict.data(), m_dict.size(), m_opt.compress_level);
+            TERARK_VERIFY(NULL != m_cdict);
+            ZSTD_CCtx_refCDict(m_cctx, m_cdict);
+        }
+    }
+    void train_dict() {
+        m_training = false;
+        m_dict.resize_no_init(m_opt.dict_size);
+        size_t len = ZDICT_trainFromBuffer(m_dict.data(), m_dict.size(),
+                                           m_samples.data(), m_sampleLens.data(),
+                                           unsigned(m_sampleLens.size()));
+        if (ZDICT_isError(len)) {
+            len = 0; // too few samples, dict is useless
+        }
+        m_dict.risk_set_size(len);
+        start_data();
+        const byte_t* pos = m_samples.data();
+        for (size_t recLen : m_sampleLens) {
+            add_to_block(fstring(pos, recLen));
+            pos += recLen;
+        }
+        m_samples.clear();
+        m_sampleLens.clear();
+    }
+    void add_to_block(fstring rec) {
+        m_recOffsets->push_back(m_unzipSize);
+        m_block.append(rec.data(), rec.size());
+        m_unzipSize += rec.size();
+        m_numRecords++;
+        if (++m_blockRecNum >= size_t(m_opt.block_records) ||
+                m_block.size() >= size_t(m_opt.block_bytes)) {
+            flush_block();
+        }
+    }
+    void flush_block() {
+        m_zbuf.resize_no_init(ZSTD_compressBound(m_block.size()));
+        size_t zlen = ZSTD_compress2(m_cctx, m_zbuf.data(), m_zbuf.size(),
+                                     m_block.data(), m_block.size());
+        if (ZSTD_isError(zlen)) {
+            THROW_STD(runtime_error, "%s: ZSTD_compress2 = %s",
+                      m_fpath.c_str(), ZSTD_getErrorName(zlen));
+        }
+        m_writer.ensureWrite(m_zbuf.data(), zlen);
+        m_zdataSize += zlen;
+        m_blockRecs->push_back(m_numRecords);
+        m_blockOffsets->push_back(m_zdataSize);
+        m_block.erase_all();
+        m_blockRecNum = 0;
+    }
+    void write_meta(SortedUintVec::Builder* builder, uint64_t* size) {
+        SortedUintVec vec;
+        builder->finish(&vec);
+        *size = vec.mem_size();
+        m_writer.ensureWrite(vec.data(), vec.mem_size());
+        PadzeroForAlign<64>(m_writer, vec.mem_size());
+    }
+
+public:
+    Impl(fstring fpath, const Options& opt)
+        : m_opt(opt)
+        , m_fpath(fpath.begin(), fpath.end())
+        , m_file(fpath, "wb")
+        , m_writer(&m_file)
+        , m_cctx(NULL)
+        , m_cdict(NULL)
+        , m_blockRecNum(0)
+        , m_training(false)
+        , m_sampleBytes(0)
+        , m_numRecords(0)
+        , m_unzipSize(0)
+        , m_zdataSize(0) {
+        TERARK_VERIFY_F(opt.block_records >= 1 && opt.block_records <= UINT16_MAX,
+                        "block_records = %d", opt.block_records);
+        TERARK_VERIFY_F(opt.block_bytes >= 1, "block_bytes = %d", opt.block_bytes);
+        TERARK_VERIFY_F(opt.block_units == 64 || opt.block_units == 128,
+                        "block_units = %d", opt.block_units);
+        m_file.disbuf();
+        m_recOffsets.reset(SortedUintVec::createBuilder(true, opt.block_units));
+        m_blockRecs.reset(SortedUintVec::createBuilder(true, opt.block_units));
+        m_blockOffsets.reset(SortedUintVec::createBuilder(true, opt.block_units));
+        m_blockRecs->push_back(0);
+        m_blockOffsets->push_back(0);
+        FileHeader header; // placeholder
+        m_writer.ensureWrite(&header, sizeof header);
+        if (opt.dict.size()) {
+            m_dict.assign(opt.dict.udata(), opt.dict.size());
+            start_data();
+        }
+        else if (opt.dict_size > 0) {
+            m_training = true;
+            m_sampleBytes = opt.dict_sample_bytes > 0 ? opt.dict_sample_bytes
+                                                      : 100 * size_t(opt.dict_size);
+        }
+        else {
+            start_data();
+        }
+    }
+    ~Impl() {
+        ZSTD_freeCCtx(m_cctx);
+        ZSTD_freeCDict(m_cdict);
+    }
+    void add_record(fstring rec) {
+        if (m_training) {
+            m_samples.append(rec.data(), rec.size());
+            m_sampleLens.push_back(rec.size());
+            if (m_samples.size() >= m_sampleBytes)
+                train_dict();
+            return;
+        }
+        add_to_block(rec);
+    }
+    void finish() {
+        if (m_training)
+            train_dict();
+        if (m_blockRecNum)
+            flush_block();
+        m_recOffsets->push_back(m_unzipSize);
+        PadzeroForAlign<64>(m_writer, m_zdataSize);
+        FileHeader header;
+        header.sections[0] = m_dict.size();
+        header.sections[1] = m_zdataSize;
+        write_meta(m_recOffsets.get(), &header.sections[2]);
+        write_meta(m_blockRecs.get(), &header.sections[3]);
+        write_meta(m_blockOffsets.get(), &header.sections[4]);
+        BlobStoreFileFooter footer;
+        m_writer.ensureWrite(&footer, sizeof footer);
+        m_writer.flush_buffer();
+        m_file.close();
+
+        size_t file_size = header.section_pos(5) + sizeof(BlobStoreFileFooter);
+        header.fileSize = file_size;
+        header.unzipSize = m_unzipSize;
+        header.records = m_numRecords;
+        header.blockRecords = uint16_t(m_opt.block_records);
+        header.blockBytes = uint32_t(m_opt.block_bytes);
+        header.checksumLevel = uint08_t(m_opt.checksum_level);
+        header.compressLevel = int08_t(m_opt.compress_level);
+        MmapWholeFile mmap(m_fpath, true);
+        TERARK_VERIFY_EQ(mmap.size, file_size);
+        memcpy(mmap.base, &header, sizeof header);
+
+        XXHash64 xxhash64(g_bzbs_seed);
+        xxhash64.update(mmap.base, file_size - sizeof(BlobStoreFileFooter));
+        footer.fileXXHash = xxhash64.digest();
+        ((BlobStoreFileFooter*)((byte_t*)mmap.base + file_size))[-1] = footer;
+    }
+};
+
+BlockZipBlobStore::MyBuilder::MyBuilder(fstring fpath, Options options) {
+    impl = new Impl(fpath, options);
+}
+BlockZipBlobStore::MyBuilder::MyBuilder(fstring fpath, fstring moreConfig) {
+    impl = new Impl(fpath, Options::parse(moreConfig));
+}
+BlockZipBlobStore::MyBuilder::~MyBuilder() {
+    delete impl;
+}
+void BlockZipBlobStore::MyBuilder::addRecord(fstring rec) {
+    assert(NULL != impl);
+    impl->add_record(rec);
+}
+void BlockZipBlobStore::MyBuilder::finish() {
+    assert(NULL != impl);
+    impl->finish();
+}
+
+} // namespace terark
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "abstract_blob_store.hpp"
+#include <terark/util/sorted_uint_vec.hpp>
+
+struct ZSTD_DDict_s;
+
+namespace terark {
+
+/// Records are packed to blocks of at most block_records records or about
+/// block_bytes bytes, each block is a zstd frame, optionally compressed with
+/// a dictionary trained from the leading records of the file.
+///
+/// Building is a single pass with a fast zstd level, for short lived files
+/// such as L0 flush files, where build speed matters more than ratio.
+///
+/// Decoded blocks are cached per reader thread, thus sequential reads, in
+/// particular by CacheOffsets, decompress each block only once.
+class TERARK_DLL_EXPORT BlockZipBlobStore : public AbstractBlobStore {
+public:
+    struct TERARK_DLL_EXPORT Options {
+      Options() : block_records(64), block_bytes(16*1024), compress_level(1)
+                , dict_size(0), dict_sample_bytes(0), block_units(64)
+                , checksum_level(2) {}
+      int block_records;     // max records of a block
+      int block_bytes;       // a block is sealed when it reaches this size
+      int compress_level;    // zstd level
+      int dict_size;         // 0 means no dict
+      int dict_sample_bytes; // 0 means 100 * dict_size
+      int block_units;       // of SortedUintVec
+      int checksum_level;    // 2: zstd frame checksum, 3: also whole file
+      fstring dict;          // use this dict instead of training
+
+      /// "key=value;key=value", keys are names of the fields above
+      static Options parse(fstring conf);
+    };
+
+private:
+    struct FileHeader; friend struct FileHeader;
+    uint64_t       m_instanceId; // key of per thread block cache
+    fstring        m_dict;
+    fstring        m_zdata;
+    SortedUintVec  m_recOffsets;   // unzipped offset of records, size = n+1
+    SortedUintVec  m_blockRecs;    // first record id of blocks, size = blocks+1
+    SortedUintVec  m_blockOffsets; // offset of blocks in m_zdata, size = blocks+1
+    ZSTD_DDict_s*  m_ddict;
+
+    struct DecodedBlock;
+    struct ThreadCache;
+    static ThreadCache& tls_cache();
+    size_t block_of(size_t recID) const;
+    template<bool FiberVmPrefetch>
+    const DecodedBlock& load_block(ThreadCache&, size_t blockId) const;
+    const DecodedBlock& decompress_block(ThreadCache&, size_t blockId,
+                                         const byte_t* zptr, size_t zlen) const;
+
+    template<bool FiberVmPrefetch>
+    void get_record_append_imp(size_t recID, valvec<byte_t>* recData) const;
+    void get_record_append_CacheOffsets_imp(size_t recID, CacheOffsets*) const;
+    void fspread_record_append_imp(pread_func_t fspread, void* lambda,
+                                   size_t baseOffset, size_t recID,
+                                   valvec<byte_t>* recData,
+                                   valvec<byte_t>* rdbuf) const;
+    size_t get_zipped_size_imp(size_t recID, CacheOffsets*) const;
+    void set_meta_mem(const fstring mems[3]);
+    static void write_sections(FileHeader&, const fstring mems[5], OutputBuffer&);
+
+public:
+    void init_from_memory(fstring dataMem, Dictionary dict) override;
+    void get_meta_blocks(valvec<Block>* blocks) const override;
+    void get_data_blocks(valvec<Block>* blocks) const override;
+    void detach_meta_blocks(const valvec<Block>& blocks) override;
+    void save_mmap(function<void(const void*, size_t)> write) const override;
+    using AbstractBlobStore::save_mmap;
+
+    BlockZipBlobStore();
+    ~BlockZipBlobStore();
+
+    size_t num_blocks() const { return m_blockRecs.size() - 1; }
+    Options get_options() const;
+
+    size_t mem_size() const override;
+    void reorder_zip_data(ZReorderMap& newToOld,
+        function<void(const void* data, size_t size)> writeAppend,
+        fstring tmpFile) const override;
+
+    struct TERARK_DLL_EXPORT MyBuilder : public AbstractBlobStore::Builder {
+        class TERARK_DLL_EXPORT Impl; Impl* impl;
+    public:
+        MyBuilder(fstring fpath, Options options = Options());
+        MyBuilder(fstring fpath, fstring moreConfig); // Options::parse
+        virtual ~MyBuilder();
+        void addRecord(fstring rec) override;
+        void finish() override;
+    };
+};
+
+} // namespace terark
@@ -0,0 +1,682 @@
+#include "column_blob_store.hpp"
+#include "blob_store_file_header.hpp"
+#include "dict_zip_blob_store.hpp"
+#include "entropy_zip_blob_store.hpp"
+#include "zip_offset_blob_store.hpp"
+#include "zip_reorder_map.hpp"
+#include <terark/entropy/huffman_encoding.hpp>
+#include <terark/io/DataOutput.hpp>
+#include <terark/io/FileMemStream.hpp>
+#include <terark/io/FileStream.hpp>
+#include <terark/io/StreamBuffer.hpp>
+#include <terark/io/var_int_inline.hpp>
+#include <terark/thread/fiber_aio.hpp>
+#include <terark/util/checksum_exception.hpp>
+#include <terark/util/mmap.hpp>
+#include <terark/zbs/xxhash_helper.hpp>
+
+namespace terark {
+
+REGISTER_BlobStore(ColumnBlobStore);
+
+static const uint64_t g_cbs_seed = 0x53426e6d756c6f43ull; // echo ColumnBS | od -t x8
+
+// | FileHeader | ColumnMeta[columns] | col 0 | ... | col n-1 | Footer |
+// each column is aligned to 64
+struct ColumnBlobStore::FileHeader : public FileHeaderBase {
+    uint32_t  columns;
+    uint08_t  checksumLevel;
+    uint08_t  padding21[3];
+    uint64_t  padding22[5];
+
+    FileHeader() {
+        BOOST_STATIC_ASSERT(sizeof(FileHeader) == 128);
+        memset(this, 0, sizeof(*this));
+        magic_len = MagicStrLen;
+        strcpy(magic, MagicString);
+        strcpy(className, "ColumnBlobStore");
+    }
+};
+
+ColumnBlobStore::ColumnData::ColumnData() {
+    memset(&meta, 0, sizeof meta);
+}
+ColumnBlobStore::ColumnData::~ColumnData() {
+    uints.risk_release_ownership();
+    sorted.risk_release_ownership();
+}
+
+size_t ColumnBlobStore::columns_begin(size_t columns) {
+    BOOST_STATIC_ASSERT(sizeof(ColumnMeta) == 32);
+    return align_up(sizeof(FileHeader) + sizeof(ColumnMeta) * columns, 64);
+}
+
+ColumnBlobStore::Schema& ColumnBlobStore::Schema::add_uint(size_t width) {
+    TERARK_VERIFY_F(width >= 1 && width <= 8, "width = %zd", width);
+    columns.push_back({kUint, kZipOffset, uint08_t(width)});
+    return *this;
+}
+ColumnBlobStore::Schema& ColumnBlobStore::Schema::add_sorted_uint(size_t width) {
+    TERARK_VERIFY_F(width >= 1 && width <= 8, "width = %zd", width);
+    columns.push_back({kSortedUint, kZipOffset, uint08_t(width)});
+    return *this;
+}
+ColumnBlobStore::Schema& ColumnBlobStore::Schema::add_bytes(BytesCodec codec) {
+    columns.push_back({kBytes, codec, 0});
+    return *this;
+}
+
+void ColumnBlobStore::set_column_mem(ColumnData& col, fstring mem) {
+    col.mem = mem;
+    if (0 == m_numRecords) {
+        return;
+    }
+    switch (col.meta.type) {
+    default:
+        THROW_STD(invalid_argument, "bad column type = %d", col.meta.type);
+    case kUint:
+        col.uints.risk_release_ownership();
+        col.uints.risk_set_data((byte_t*)mem.data(), m_numRecords, col.meta.uintbits);
+        TERARK_VERIFY_EQ(col.uints.mem_size(), mem.size());
+        break;
+    case kSortedUint:
+        col.sorted.risk_release_ownership();
+        col.sorted.risk_set_data(mem.data(), mem.size());
+        TERARK_VERIFY_EQ(col.sorted.size(), m_numRecords);
+        break;
+    case kBytes:
+        col.store.reset(AbstractBlobStore::load_from_user_memory(mem, Dictionary()));
+        TERARK_VERIFY_EQ(col.store->num_records(), m_numRecords);
+        break;
+    }
+}
+
+void ColumnBlobStore::init_from_memory(fstring dataMem, Dictionary/*dict*/) {
+    auto mmapBase = (const FileHeader*)dataMem.p;
+    m_mmapBase = mmapBase;
+    m_numRecords = mmapBase->records;
+    m_unzipSize = mmapBase->unzipSize;
+    m_checksumLevel = mmapBase->checksumLevel;
+    m_checksumType = mmapBase->checksumType;
+    if (m_checksumLevel == 3 && isChecksumVerifyEnabled()) {
+        XXHash64 hash(g_cbs_seed);
+        hash.update(mmapBase, mmapBase->fileSize - sizeof(BlobStoreFileFooter));
+        const uint64_t hashVal = hash.digest();
+        auto& footer = ((const BlobStoreFileFooter*)((const byte_t*)(mmapBase) + mmapBase->fileSize))[-1];
+        if (hashVal != footer.fileXXHash) {
+            std::string msg = "ColumnBlobStore::load_mmap(\"" + get_fpath() + "\")";
+            throw BadChecksumException(msg, footer.fileXXHash, hashVal);
+        }
+    }
+    size_t columns = mmapBase->columns;
+    size_t dataEnd = mmapBase->fileSize - sizeof(BlobStoreFileFooter);
+    TERARK_VERIFY_LE(columns_begin(columns), dataEnd);
+    auto metas = (const ColumnMeta*)(mmapBase + 1);
+    m_columns.resize(columns);
+    for (size_t i = 0; i < columns; ++i) {
+        ColumnData& col = m_columns[i];
+        col.meta = metas[i];
+        TERARK_VERIFY_LE(col.meta.offset + col.meta.size, dataEnd);
+        set_column_mem(col, fstring(dataMem.data() + col.meta.offset, col.meta.size));
+    }
+}
+
+// uint columns are meta, kBytes columns are data
+void ColumnBlobStore::get_meta_blocks(valvec<Block>* blocks) const {
+    blocks->erase_all();
+    for (auto& col : m_columns) {
+        if (kBytes != col.meta.type)
+            blocks->push_back({"column", col.mem});
+    }
+}
+
+void ColumnBlobStore::get_data_blocks(valvec<Block>* blocks) const {
+    blocks->erase_all();
+    for (auto& col : m_columns) {
+        if (kBytes == col.meta.type)
+            blocks->push_back({"column", col.mem});
+    }
+}
+
+void ColumnBlobStore::detach_meta_blocks(const valvec<Block>& blocks) {
+    assert(!m_isDetachMeta);
+    size_t k = 0;
+    for (auto& col : m_columns) {
+        if (kBytes != col.meta.type) {
+            TERARK_VERIFY_LT(k, blocks.size());
+            auto mem = blocks[k++].data;
+            TERARK_VERIFY_EQ(mem.size(), col.mem.size());
+            set_column_mem(col, mem);
+        }
+    }
+    TERARK_VERIFY_EQ(k, blocks.size());
+    m_isDetachMeta = true;
+}
+
+// write header, column metas, column data and footer, metas[i].offset and
+// metas[i].size are set by mems[i]
+void ColumnBlobStore::write_columns(FileHeader& header,
+                                    valvec<ColumnMeta>& metas,
+                                    const fstring* mems, OutputBuffer& buffer) {
+    size_t columns = metas.size();
+    size_t offset = columns_begin(columns);
+    for (size_t i = 0; i < columns; ++i) {
+        metas[i].offset = offset;
+        metas[i].size = mems[i].size();
+        offset = align_up(offset + mems[i].size(), 64);
+    }
+    header.fileSize = offset + sizeof(BlobStoreFileFooter);
+    header.columns = uint32_t(columns);
+
+    XXHash64 xxhash64(g_cbs_seed);
+    xxhash64.update(&header, sizeof header);
+    buffer.ensureWrite(&header, sizeof header);
+    xxhash64.update(metas.data(), metas.used_mem_size());
+    buffer.ensureWrite(metas.data(), metas.used_mem_size());
+    PadzeroForAlign<64>(buffer, xxhash64, sizeof header + metas.used_mem_size());
+    for (size_t i = 0; i < columns; ++i) {
+        xxhash64.update(mems[i].data(), mems[i].size());
+        buffer.ensureWrite(mems[i].data(), mems[i].size());
+        PadzeroForAlign<64>(buffer, xxhash64, mems[i].size());
+    }
+    BlobStoreFileFooter footer;
+    footer.fileXXHash = xxhash64.digest();
+    buffer.ensureWrite(&footer, sizeof footer);
+}
+
+void ColumnBlobStore::save_mmap(function<void(const void*, size_t)> write) const {
+    FunctionAdaptBuffer adaptBuffer(write);
+    OutputBuffer buffer(&adaptBuffer);
+    FileHeader header = *(const FileHeader*)m_mmapBase;
+    valvec<ColumnMeta> metas(m_columns.size(), valvec_reserve());
+    valvec<fstring> mems(m_columns.size(), valvec_reserve());
+    for (auto& col : m_columns) {
+        metas.push_back(col.meta);
+        mems.push_back(col.mem);
+    }
+    write_columns(header, metas, mems.data(), buffer);
+}
+
+ColumnBlobStore::ColumnBlobStore() {
+    m_checksumLevel = 3;
+    m_checksumType = 0;
+    m_get_record_append = BlobStoreStaticCastPMF(get_record_append_func_t,
+                    &ColumnBlobStore::get_record_append_imp<false>);
+    m_get_record_append_fiber_vm_prefetch =
+                    BlobStoreStaticCastPMF(get_record_append_func_t,
+                    &ColumnBlobStore::get_record_append_imp<true>);
+    m_fspread_record_append = BlobStoreStaticCastPMF(fspread_record_append_func_t,
+                    &ColumnBlobStore::fspread_record_append_imp);
+    // binary compatible:
+    m_get_record_append_CacheOffsets =
+        reinterpret_cast<get_record_append_CacheOffsets_func_t>(
+        m_get_record_append);
+}
+
+ColumnBlobStore::~ColumnBlobStore() {
+    m_columns.clear(); // nested stores are on m_mmapBase
+    if (m_isUserMem) {
+        if (m_isMmapData) {
+            mmap_close((void*)m_mmapBase, m_mmapBase->fileSize);
+        }
+        m_mmapBase = nullptr;
+        m_isMmapData = false;
+        m_isUserMem = false;
+    }
+}
+
+ColumnBlobStore::Column ColumnBlobStore::column(size_t col) const {
+    TERARK_VERIFY_LT(col, m_columns.size());
+    const ColumnMeta& meta = m_columns[col].meta;
+    return {ColumnType(meta.type), BytesCodec(meta.codec), meta.width};
+}
+
+size_t ColumnBlobStore::mem_size() const {
+    size_t size = columns_begin(m_columns.size());
+    for (auto& col : m_columns)
+        size += col.mem.size();
+    return size;
+}
+
+// zero copy stores set recData to their memory, it can not be appended
+template<bool FiberVmPrefetch>
+static inline void
+NestedRecordAppend(const BlobStore* store, size_t recID, valvec<byte_t>* recData) {
+    if (store->support_zero_copy()) {
+        valvec<byte_t> ref;
+        store->get_record_append(recID, &ref);
+        if (FiberVmPrefetch)
+            fiber_aio_vm_prefetch(ref.data(), ref.size());
+        recData->append(ref.data(), ref.size());
+        ref.risk_release_ownership();
+    }
+    else if (FiberVmPrefetch)
+        store->get_record_append_fiber_vm_prefetch(recID, recData);
+    else
+        store->get_record_append(recID, recData);
+}
+
+inline
+void ColumnBlobStore::get_field_append_imp(const ColumnData& col, size_t recID,
+                                           valvec<byte_t>* field)
+const {
+    uint64_t val;
+    switch (col.meta.type) {
+    default:
+        TERARK_DIE("bad column type = %d", col.meta.type);
+    case kUint:
+        val = col.meta.minVal + col.uints.get(recID);
+        break;
+    case kSortedUint:
+        val = col.sorted.get(recID);
+        break;
+    case kBytes:
+        NestedRecordAppend<false>(col.store.get(), recID, field);
+        return;
+    }
+    field->append((const byte_t*)&val, col.meta.width); // little endian
+}
+
+template<bool FiberVmPrefetch>
+void
+ColumnBlobStore::get_record_append_imp(size_t recID, valvec<byte_t>* recData)
+const {
+    TERARK_ASSERT_LT(recID, m_numRecords);
+    for (auto& col : m_columns) {
+        if (FiberVmPrefetch && kBytes == col.meta.type)
+            NestedRecordAppend<true>(col.store.get(), recID, recData);
+        else
+            get_field_append_imp(col, recID, recData);
+    }
+}
+
+void
+ColumnBlobStore::fspread_record_append_imp(pread_func_t fspread, void* lambda,
+                                           size_t baseOffset, size_t recID,
+                                           valvec<byte_t>* recData,
+                                           valvec<byte_t>* rdbuf)
+const {
+    TERARK_ASSERT_LT(recID, m_numRecords);
+    for (auto& col : m_columns) {
+        if (kBytes == col.meta.type)
+            col.store->fspread_record_append(fspread, lambda,
+                baseOffset + col.meta.offset, recID, recData, rdbuf);
+        else
+            get_field_append_imp(col, recID, recData);
+    }
+}
+
+void ColumnBlobStore::get_field_append(size_t recID, size_t col,
+                                       valvec<byte_t>* field)
+const {
+    TERARK_VERIFY_LT(recID, m_numRecords);
+    TERARK_VERIFY_LT(col, m_columns.size());
+    get_field_append_imp(m_columns[col], recID, field);
+}
+
+uint64_t ColumnBlobStore::get_uint(size_t recID, size_t col) const {
+    TERARK_VERIFY_LT(recID, m_numRecords);
+    TERARK_VERIFY_LT(col, m_columns.size());
+    const ColumnData& cd = m_columns[col];
+    switch (cd.meta.type) {
+    default:
+        THROW_STD(invalid_argument, "column %zd is not a uint column", col);
+    case kUint:
+        return cd.meta.minVal + cd.uints.get(recID);
+    case kSortedUint:
+        return cd.sorted.get(recID);
+    }
+}
+
+void ColumnBlobStore::reorder_zip_data(ZReorderMap& newToOld,
+        function<void(const void* data, size_t size)> writeAppend,
+        fstring tmpFile)
+const {
+    FunctionAdaptBuffer adaptBuffer(writeAppend);
+    OutputBuffer buffer(&adaptBuffer);
+
+    size_t recNum = m_numRecords;
+    size_t columns = m_columns.size();
+    TERARK_VERIFY_EQ(newToOld.size(), recNum);
+    FileHeader header = *(const FileHeader*)m_mmapBase;
+    valvec<ColumnMeta> metas(columns, valvec_reserve());
+    valvec<fstring> mems(columns, valvec_reserve());
+    valvec<BigUintVecMin0> uints(columns);
+    valvec<SortedUintVec> sorted(columns);
+    valvec<MmapWholeFile> nested(columns);
+    std::vector<std::string> nestedFile(columns);
+    for (size_t i = 0; i < columns; ++i) {
+        const ColumnData& col = m_columns[i];
+        metas.push_back(col.meta);
+        if (0 == recNum) {
+            mems.push_back(col.mem);
+            continue;
+        }
+        switch (col.meta.type) {
+        default:
+            THROW_STD(invalid_argument, "bad column type = %d", col.meta.type);
+        case kUint: // min value and uintbits are not changed
+            uints[i].resize_with_uintbits(recNum, col.meta.uintbits);
+            for (newToOld.rewind(); !newToOld.eof(); ++newToOld) {
+                uints[i].set_wire(newToOld.index(), col.uints.get(*newToOld));
+            }
+            TERARK_VERIFY_EQ(uints[i].mem_size(), col.mem.size());
+            mems.push_back(fstring(uints[i].data(), uints[i].mem_size()));
+            break;
+        case kSortedUint: {
+            std::unique_ptr<SortedUintVec::Builder> builder(
+                SortedUintVec::createBuilder(false, col.sorted.block_units()));
+            for (newToOld.rewind(); !newToOld.eof(); ++newToOld) {
+                builder->push_back(col.sorted.get(*newToOld));
+            }
+            builder->finish(&sorted[i]);
+            mems.push_back(fstring(sorted[i].data(), sorted[i].mem_size()));
+            break; }
+        case kBytes: {
+            nestedFile[i] = tmpFile + ".col-" + std::to_string(i);
+            {
+                FileStream fp(nestedFile[i], "wb");
+                newToOld.rewind();
+                col.store->reorder_zip_data(newToOld,
+                    [&fp](const void* data, size_t size) {
+                        fp.ensureWrite(data, size);
+                    }, nestedFile[i] + ".tmp");
+            }
+            MmapWholeFile(nestedFile[i]).swap(nested[i]);
+            mems.push_back(fstring((const char*)nested[i].base, nested[i].size));
+            break; }
+        }
+    }
+    write_columns(header, metas, mems.data(), buffer);
+    for (size_t i = 0; i < columns; ++i) {
+        if (!nestedFile[i].empty()) {
+            MmapWholeFile().swap(nested[i]);
+            ::remove(nestedFile[i].c_str());
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+class ColumnBlobStore::MyBuilder::Impl : boost::noncopyable {
+    Schema m_schema;
+    Options m_opt;
+    std::string m_fpath;
+    size_t m_bytesColumn; // for split by layout
+    size_t m_fixedLen;    // for split by layout
+    size_t m_numRecords;
+    uint64_t m_unzipSize;
+    valvec<fstring> m_fields;
+    valvec<valvec<uint64_t> > m_uints;
+    // kBytes fields are saved to tmp files as var_uint len + data
+    std::vector<std::string> m_tmpFpath;
+    valvec<std::unique_ptr<FileStream> > m_tmpFile;
+    valvec<std::unique_ptr<NativeDataOutput<OutputBuffer> > > m_tmpWriter;
+
+    void split_by_layout(fstring rec) {
+        size_t bytesLen = rec.size() - m_fixedLen;
+        if (rec.size() < m_fixedLen ||
+                (size_t(-1) == m_bytesColumn && rec.size() != m_fixedLen)) {
+            THROW_STD(invalid_argument,
+                "rec.size = %zd mismatch with schema fixed len = %zd",
+                rec.size(), m_fixedLen);
+        }
+        const char* pos = rec.data();
+        for (size_t i = 0; i < m_schema.columns.size(); ++i) {
+            size_t len = i == m_bytesColumn ? bytesLen : m_schema.columns[i].width;
+            m_fields[i] = fstring(pos, len);
+            pos += len;
+        }
+    }
+
+    template<class OnField>
+    void for_each_field(size_t col, OnField onField) const {
+        MmapWholeFile mmap(m_tmpFpath[col]);
+        auto pos = (const byte_t*)mmap.base;
+        auto end = pos + mmap.size;
+        while (pos < end) {
+            size_t len = gg_load_var_uint<size_t>(pos, &pos, BOOST_CURRENT_FUNCTION);
+            TERARK_VERIFY_LE(pos + len, end);
+            onField(fstring(pos, len));
+            pos += len;
+        }
+    }
+
+    // returns the real codec
+    BytesCodec build_bytes(size_t col, BytesCodec codec, FileMemIO& mem) {
+        if (kDictZip == codec) {
+            DictZipBlobStore::Options dzopt;
+            dzopt.embeddedDict = true;
+            dzopt.offsetArrayBlockUnits = m_opt.block_units;
+            std::unique_ptr<DictZipBlobStore::ZipBuilder> builder(
+                DictZipBlobStore::createZipBuilder(dzopt));
+            double ratio = m_opt.dict_sample_ratio, budget = 0;
+            size_t sampled = 0;
+            for_each_field(col, [&](fstring field) {
+                budget += ratio * field.size();
+                if (budget >= field.size() && field.size()) {
+                    builder->addSample(field);
+                    budget -= field.size();
+                    sampled += field.size();
+                }
+            });
+            if (sampled) {
+                builder->finishSample();
+                builder->prepare(m_numRecords, mem);
+                for_each_field(col, [&](fstring field) {
+                    builder->addRecord(field);
+                });
+                builder->finish(DictZipBlobStore::ZipBuilder::FinishFreeDict);
+                return kDictZip;
+            }
+            codec = kZipOffset; // empty sample, data is too small
+        }
+        if (kEntropy == codec) {
+            freq_hist_o1 freq;
+            for_each_field(col, [&](fstring field) {
+                freq.add_record(field);
+            });
+            freq.finish();
+            EntropyZipBlobStore::MyBuilder builder(freq, m_opt.block_units,
+                                                   mem, m_opt.checksum_level);
+            for_each_field(col, [&](fstring field) {
+                builder.addRecord(field);
+            });
+            builder.finish();
+            return kEntropy;
+        }
+        TERARK_VERIFY(kZipOffset == codec);
+        ZipOffsetBlobStore::Options zoopt;
+        zoopt.block_units = m_opt.block_units;
+        zoopt.checksum_level = m_opt.checksum_level;
+        ZipOffsetBlobStore::MyBuilder builder(mem, zoopt);
+        for_each_field(col, [&](fstring field) {
+            builder.addRecord(field);
+        });
+        builder.finish();
+        return kZipOffset;
+    }
+
+public:
+    Impl(const Schema& schema, fstring fpath, Options opt)
+        : m_schema(schema)
+        , m_opt(opt)
+        , m_fpath(fpath.begin(), fpath.end())
+        , m_bytesColumn(size_t(-1))
+        , m_fixedLen(0)
+        , m_numRecords(0)
+        , m_unzipSize(0) {
+        size_t columns = schema.columns.size();
+        if (0 == columns) {
+            THROW_STD(invalid_argument, "schema has no columns");
+        }
+        m_fields.resize(columns);
+        m_uints.resize(columns);
+        m_tmpFpath.resize(columns);
+        m_tmpFile.resize(columns);
+        m_tmpWriter.resize(columns);
+        for (size_t i = 0; i < columns; ++i) {
+            const Column& c = schema.columns[i];
+            if (kBytes == c.type) {
+                if (!schema.split && size_t(-1) != m_bytesColumn) {
+                    THROW_STD(invalid_argument,
+                        "schema.split is required for multiple kBytes columns");
+                }
+                m_bytesColumn = i;
+                m_tmpFpath[i] = m_fpath + ".col-" + std::to_string(i);
+                m_tmpFile[i].reset(new FileStream(m_tmpFpath[i], "wb"));
+                m_tmpFile[i]->disbuf();
+                m_tmpWriter[i].reset(new NativeDataOutput<OutputBuffer>(m_tmpFile[i].get()));
+            }
+            else {
+                TERARK_VERIFY_F(c.width >= 1 && c.width <= 8, "width = %d", c.width);
+                m_fixedLen += c.width;
+            }
+        }
+    }
+    ~Impl() {
+        m_tmpWriter.clear();
+        m_tmpFile.clear();
+        for (auto& fpath : m_tmpFpath) {
+            if (!fpath.empty())
+                ::remove(fpath.c_str());
+        }
+    }
+    void add_record(fstring rec) {
+        if (m_schema.split)
+            m_schema.split(rec, m_fields.data());
+        else
+            split_by_layout(rec);
+        // validate all fields before writing any column, an invalid record
+        // must not leave the columns out of row alignment
+        const size_t columns = m_schema.columns.size();
+        const char* pos = rec.data();
+        for (size_t i = 0; i < columns; ++i) {
+            const Column& c = m_schema.columns[i];
+            fstring field = m_fields[i];
+            if (field.data() != pos) {
+                THROW_STD(invalid_argument,
+                    "field %zd is not consecutive to its previous field", i);
+            }
+            if (kBytes != c.type && field.size() != c.width) {
+                THROW_STD(invalid_argument,
+                    "field %zd: size = %zd, width = %d", i, field.size(), c.width);
+            }
+            pos = field.end();
+        }
+        if (pos != rec.end()) {
+            THROW_STD(invalid_argument,
+                "fields size sum = %zd, rec.size = %zd", pos - rec.data(), rec.size());
+        }
+        for (size_t i = 0; i < columns; ++i) {
+            const Column& c = m_schema.columns[i];
+            fstring field = m_fields[i];
+            if (kBytes == c.type) {
+                *m_tmpWriter[i] << var_size_t(field.size());
+                m_tmpWriter[i]->ensureWrite(field.data(), field.size());
+            }
+            else {
+                uint64_t val = 0;
+                memcpy(&val, field.data(), c.width); // little endian
+                m_uints[i].push_back(val);
+            }
+        }
+        m_numRecords++;
+        m_unzipSize += rec.size();
+    }
+    void finish() {
+        size_t columns = m_schema.columns.size();
+        for (size_t i = 0; i < columns; ++i) {
+            if (m_tmpWriter[i]) {
+                m_tmpWriter[i]->flush_buffer();
+                m_tmpWriter[i].reset();
+                m_tmpFile[i].reset();
+            }
+        }
+        FileStream file(m_fpath, "wb");
+        file.disbuf();
+        NativeDataOutput<OutputBuffer> writer(&file);
+        size_t offset = columns_begin(columns);
+        valvec<ColumnMeta> metas(columns);
+        valvec<byte_t> zeros(offset, 0);
+        writer.ensureWrite(zeros.data(), offset); // header and metas
+        for (size_t i = 0; i < columns; ++i) {
+            const Column& c = m_schema.columns[i];
+            ColumnMeta& meta = metas[i];
+            memset(&meta, 0, sizeof meta);
+            meta.type = c.type;
+            meta.codec = kBytes == c.type ? c.codec : kZipOffset;
+            meta.width = c.width;
+            meta.offset = offset;
+            if (0 == m_numRecords) {
+                continue;
+            }
+            if (kUint == c.type) {
+                BigUintVecMin0 uints;
+                meta.minVal = uints.build_from(m_uints[i]);
+                meta.uintbits = uint08_t(uints.uintbits());
+                meta.size = uints.mem_size();
+                writer.ensureWrite(uints.data(), uints.mem_size());
+            }
+            else if (kSortedUint == c.type) {
+                SortedUintVec sorted;
+                std::unique_ptr<SortedUintVec::Builder> builder(
+                    SortedUintVec::createBuilder(false, m_opt.block_units));
+                for (uint64_t val : m_uints[i]) {
+                    builder->push_back(val);
+                }
+                builder->finish(&sorted);
+                meta.size = sorted.mem_size();
+                writer.ensureWrite(sorted.data(), sorted.mem_size());
+            }
+            else {
+                FileMemIO mem;
+                meta.codec = build_bytes(i, c.codec, mem);
+                meta.size = mem.size();
+                writer.ensureWrite(mem.begin(), mem.size());
+                ::remove(m_tmpFpath[i].c_str());
+                m_tmpFpath[i].clear();
+            }
+            m_uints[i].clear();
+            PadzeroForAlign<64>(writer, meta.size);
+            offset = align_up(offset + meta.size, 64);
+        }
+        BlobStoreFileFooter footer;
+        writer.ensureWrite(&footer, sizeof footer);
+        writer.flush_buffer();
+        file.close();
+
+        size_t file_size = offset + sizeof(BlobStoreFileFooter);
+        MmapWholeFile mmap(m_fpath, true);
+        TERARK_VERIFY_EQ(mmap.size, file_size);
+        FileHeader* header = new(mmap.base) FileHeader();
+        header->fileSize = file_size;
+        header->unzipSize = m_unzipSize;
+        header->records = m_numRecords;
+        header->columns = uint32_t(columns);
+        header->checksumLevel = uint08_t(m_opt.checksum_level);
+        memcpy((byte_t*)(header + 1), metas.data(), sizeof(ColumnMeta) * columns);
+
+        XXHash64 xxhash64(g_cbs_seed);
+        xxhash64.update(mmap.base, file_size - sizeof(BlobStoreFileFooter));
+        footer.fileXXHash = xxhash64.digest();
+        ((BlobStoreFileFooter*)((byte_t*)mmap.base + file_size))[-1] = footer;
+    }
+};
+
+ColumnBlobStore::MyBuilder::MyBuilder(const Schema& schema, fstring fpath,
+                                      Options options) {
+    impl = new Impl(schema, fpath, options);
+}
+ColumnBlobStore::MyBuilder::~MyBuilder() {
+    delete impl;
+}
+void ColumnBlobStore::MyBuilder::addRecord(fstring rec) {
+    assert(NULL != impl);
+    impl->add_record(rec);
+}
+void ColumnBlobStore::MyBuilder::finish() {
+    assert(NULL != impl);
+    impl->finish();
+}
+
+} // namespace terark
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "abstract_blob_store.hpp"
+#include <terark/int_vector.hpp>
+#include <terark/util/sorted_uint_vec.hpp>
+#include <memory>
+
+namespace terark {
+
+/// Records of a fixed schema(such as serialized rows) are split into fields,
+/// each field column is stored with its own codec:
+///   kUint       : BigUintVecMin0 of (value - minVal)
+///   kSortedUint : SortedUintVec
+///   kBytes      : nested ZipOffsetBlobStore, EntropyZipBlobStore or
+///                 DictZipBlobStore(embedded dict)
+/// get_record_append concats all fields of the record, get_field_append and
+/// get_uint just decode the requested column.
+class TERARK_DLL_EXPORT ColumnBlobStore : public AbstractBlobStore {
+public:
+    enum ColumnType : uint08_t {
+        kUint,       // little endian unsigned int of `width` bytes
+        kSortedUint, // same as kUint, but values are mostly ascending
+        kBytes,      // variable length bytes
+    };
+    enum BytesCodec : uint08_t {
+        kZipOffset,  // raw data, zipped offsets
+        kEntropy,    // huffman order 1
+        kDictZip,    // global dictionary compression
+    };
+    struct Column {
+        ColumnType type;
+        BytesCodec codec; // for kBytes
+        uint08_t   width; // for kUint and kSortedUint, 1 ~ 8 bytes
+    };
+    struct TERARK_DLL_EXPORT Schema {
+        valvec<Column> columns;
+        /// split rec into columns.size() fields, fields must be consecutive
+        /// pieces of rec, thus a record is the concat of its fields.
+        /// if split is null, uint fields are split by width, and there can
+        /// be at most one kBytes column, it takes all the remaining bytes
+        function<void(fstring rec, fstring* fields)> split;
+
+        Schema& add_uint(size_t width);
+        Schema& add_sorted_uint(size_t width);
+        Schema& add_bytes(BytesCodec codec);
+    };
+    struct Options {
+      Options() : block_units(128), checksum_level(3), dict_sample_ratio(0.05) {}
+      int block_units;          // of SortedUintVec and zipped offsets
+      int checksum_level;
+      double dict_sample_ratio; // of kDictZip columns
+    };
+
+private:
+    struct FileHeader; friend struct FileHeader;
+    struct ColumnMeta {
+        uint08_t  type;
+        uint08_t  codec;
+        uint08_t  width;
+        uint08_t  uintbits; // of kUint
+        uint32_t  padding;
+        uint64_t  minVal;   // of kUint
+        uint64_t  offset;   // from store begin
+        uint64_t  size;
+    };
+    // memory of columns are owned by the store(mmap or user mem), or by the
+    // caller of detach_meta_blocks
+    struct ColumnData {
+        ColumnMeta     meta;
+        fstring        mem;
+        BigUintVecMin0 uints;
+        SortedUintVec  sorted;
+        std::unique_ptr<AbstractBlobStore> store;
+        ColumnData();
+        ~ColumnData();
+    };
+    valvec<ColumnData> m_columns;
+
+    template<bool FiberVmPrefetch>
+    void get_record_append_imp(size_t recID, valvec<byte_t>* recData) const;
+    void fspread_record_append_imp(pread_func_t fspread, void* lambda,
+                                   size_t baseOffset, size_t recID,
+                                   valvec<byte_t>* recData,
+                                   valvec<byte_t>* rdbuf) const;
+    void get_field_append_imp(const ColumnData&, size_t recID,
+                              valvec<byte_t>* field) const;
+    void set_column_mem(ColumnData&, fstring mem);
+    static size_t columns_begin(size_t columns);
+    static void write_columns(FileHeader&, valvec<ColumnMeta>& metas,
+                              const fstring* mems, OutputBuffer&);
+public:
+    void init_from_memory(fstring dataMem, Dictionary dict) override;
+    void get_meta_blocks(valvec<Block>* blocks) const override;
+    void get_data_blocks(valvec<Block>* blocks) const override;
+    void detach_meta_blocks(const valvec<Block>& blocks) override;
+    void save_mmap(function<void(const void*, size_t)> write) const override;
+    using AbstractBlobStore::save_mmap;
+
+    ColumnBlobStore();
+    ~ColumnBlobStore();
+
+    size_t num_columns() const { return m_columns.size(); }
+    Column column(size_t col) const;
+
+    /// append field `col` of record `recID`, other columns are not touched
+    void get_field_append(size_t recID, size_t col, valvec<byte_t>* field) const;
+    /// value of field `col` of record `recID`, col must be a uint column
+    uint64_t get_uint(size_t recID, size_t col) const;
+
+    size_t mem_size() const override;
+    void reorder_zip_data(ZReorderMap& newToOld,
+        function<void(const void* data, size_t size)> writeAppend,
+        fstring tmpFile) const override;
+
+    struct TERARK_DLL_EXPORT MyBuilder : public AbstractBlobStore::Builder {
+        class TERARK_DLL_EXPORT Impl; Impl* impl;
+    public:
+        MyBuilder(const Schema&, fstring fpath, Options options = Options());
+        virtual ~MyBuilder();
+        void addRecord(fstring rec) override;
+        void finish() override;
+    };
+};
+
+} // namespace terark
@@ -23,6 +23,8 @@
 #include <zstd/dictBuilder/divsufsort.h>
 #include "sufarr_inducedsort.h"
 #include <terark/thread/pipeline.hpp>
+#include <terark/thread/weighted_round_robin.hpp>
+#include <terark/thread/work_stealing_executor.hpp>
 #include <terark/thread/fiber_aio.hpp>
 #include <terark/util/autofree.hpp>
 #include <terark/util/crc.hpp>
@@ -33,9 +35,14 @@
 #include <terark/util/small_memcpy.hpp>
 #include <terark/util/hugepage.hpp>
 #include <terark/util/vm_util.hpp>
+#include <terark/util/auto_grow_circular_queue.hpp>
+#include <terark/util/atomic.hpp>
 #include <random>
 #include <zstd/common/fse.h>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include "blob_store_file_header.hpp"
 #include <terark/entropy/huffman_encoding.hpp>
@@ -611,6 +618,7 @@ static bool g_isPipelineStarted = false;
 static int g_debugLevel = (int)getEnvLong("DictZipBlobStore_debugLevel", 0);
 static int g_pipelineLogLevel = (int)getEnvLong("DictZipBlobStore_pipelineLogLevel", 1);
 static bool g_printEntropyCount = getEnvBool("DictZipBlobStore_printEntropyCount", false);
+static bool g_useExecutor = getEnvBool("DictZipBlobStore_useExecutor", false);
 
 TERARK_DLL_EXPORT void DictZipBlobStore_setZipThreads(int zipThreads) {
 	if (g_isPipelineStarted) {
@@ -625,6 +633,8 @@ TERARK_DLL_EXPORT int DictZipBlobStore_getZipThreads() {
   return g_zipThreads();
 }
 
+TERARK_DLL_EXPORT std::string DictZipBlobStore_getPipelineStat();
+
 TERARK_DLL_EXPORT void DictZipBlobStore_setPipelineLogLevel(int level) {
   if (g_isPipelineStarted) {
     fprintf(stderr,
@@ -697,7 +707,19 @@ class DictZipBlobStoreBuilder::MultiThread : public DictZipBlobStoreBuilder {
 		MyPipeline() {
 			using namespace std;
 			int cpuCount = this->sysCpuCount();
-			if (g_zipThreads() > 0) {
+			if (g_useExecutor) {
+				// all concurrent builders share the executor workers, the
+				// running threads are bounded by the executor, so zip stage
+				// can have as many runners as the workers
+				auto& exe = WorkStealingExecutor::global();
+				this->setExecutor(&exe);
+				cpuCount = exe.num_workers();
+				if (g_zipThreads() > 0)
+					zipThreads = min(cpuCount, g_zipThreads());
+				else
+					zipThreads = cpuCount;
+			}
+			else if (g_zipThreads() > 0) {
 				zipThreads = min(cpuCount, g_zipThreads());
 			}
 			else {
@@ -736,22 +758,162 @@ class DictZipBlobStoreBuilder::MultiThread : public DictZipBlobStoreBuilder {
     }
 	static MyPipeline& getPipeline() { static MyPipeline p; return p; }
 
+	// All MultiThread builders share one pipeline, tasks of builders are
+	// not enqueued to the pipeline directly, they are first put into the
+	// builder's pending queue, then fed into the pipeline by smooth
+	// weighted round robin, thus a high priority builder(such as flush)
+	// is not starved by a low priority builder(such as large compaction)
+	// which adds records faster.
+	//
+	// Tasks in the pipeline are bounded by m_maxInflight in total and by
+	// Options::threadBudget per builder, a builder whose pending queue is
+	// too long blocks in addRecord, which is the back pressure.
+	class MyScheduler {
+	public:
+		std::mutex m_mtx;
+		valvec<MultiThread*> m_builders;
+		size_t m_inflight = 0;
+		size_t m_maxInflight;
+		MyPipeline* m_pipeline;
+
+		MyScheduler() {
+			m_pipeline = &getPipeline();
+			m_maxInflight = m_pipeline->getQueueSize();
+		}
+		static int weight(uint08_t priority) {
+			switch (priority) {
+			case DictZipBlobStore::Options::kPriorityLow : return 1;
+			default:
+			case DictZipBlobStore::Options::kPriorityNormal: return 4;
+			case DictZipBlobStore::Options::kPriorityHigh: return 16;
+			}
+		}
+		void add(MultiThread* b) {
+			std::lock_guard<std::mutex> lock(m_mtx);
+			if (std::find(m_builders.begin(), m_builders.end(), b) != m_builders.end())
+				return;
+			b->m_sched = WeightedRoundRobinClient();
+			b->m_sched.weight = weight(b->m_opt.priority);
+			b->m_sched.budget = b->m_opt.threadBudget;
+			m_builders.push_back(b);
+		}
+		void remove(MultiThread* b) {
+			std::lock_guard<std::mutex> lock(m_mtx);
+			auto iter = std::find(m_builders.begin(), m_builders.end(), b);
+			if (m_builders.end() != iter) {
+				assert(b->m_schedPending.empty());
+				assert(0 == b->m_sched.inflight);
+				m_builders.erase_i(iter - m_builders.begin(), 1);
+			}
+		}
+		void submit(MultiThread* b, MyTask** tasks, size_t num) {
+			std::unique_lock<std::mutex> lock(m_mtx);
+			for (size_t i = 0; i < num; ++i)
+				b->m_schedPending.push_back(tasks[i]);
+			pump();
+			if (b->m_schedPending.size() > m_maxInflight) {
+				ullong t0 = g_pf.now();
+				do b->m_schedCond.wait(lock);
+				while (b->m_schedPending.size() > m_maxInflight);
+				b->m_schedWaitTime += g_pf.now() - t0;
+			}
+		}
+		// called by write stage, the task is still in the pipeline
+		void onTaskDone(MultiThread* b, size_t bytes) {
+			std::lock_guard<std::mutex> lock(m_mtx);
+			assert(m_inflight > 0);
+			b->m_sched.done();
+			b->m_schedDoneTasks++;
+			b->m_schedDoneBytes += bytes;
+			m_inflight--;
+			pump();
+		}
+		// m_mtx must be locked, tasks of a builder must be enqueued in
+		// the order they were picked, so enqueue is also under m_mtx,
+		// m_inflight <= queue size, thus pipeline enqueue never blocks
+		void pump() {
+			MyTask* todo[64];
+			size_t n;
+			do {
+				n = pick(todo, 64);
+				if (n)
+					m_pipeline->enqueue((PipelineTask**)todo, n);
+			} while (64 == n);
+		}
+		size_t pick(MyTask** todo, size_t cap) {
+			size_t n = 0;
+			while (n < cap && m_inflight < m_maxInflight) {
+				auto iter = weighted_round_robin_pick(
+					m_builders.begin(), m_builders.end(),
+					[](MultiThread* b) -> WeightedRoundRobinClient* {
+						return b->m_schedPending.empty() ? nullptr : &b->m_sched;
+					});
+				if (m_builders.end() == iter)
+					break;
+				MultiThread* best = *iter;
+				todo[n++] = best->m_schedPending.pop_front_val();
+				m_inflight++;
+				if (best->m_schedPending.size() <= m_maxInflight)
+					best->m_schedCond.notify_one();
+			}
+			return n;
+		}
+		std::string stat() {
+			std::string s;
+			char buf[256];
+			std::lock_guard<std::mutex> lock(m_mtx);
+			snprintf(buf, sizeof(buf),
+				"DictZipBlobStore pipeline: builders = %zd, inflight = %zd / %zd\n",
+				m_builders.size(), m_inflight, m_maxInflight);
+			s += buf;
+			ullong now = g_pf.now();
+			for (MultiThread* b : m_builders) {
+				double sec = g_pf.sf(b->m_schedStartTime, now);
+				snprintf(buf, sizeof(buf),
+					"  builder %p: priority = %d, budget = %d, inflight = %zd, "
+					"pending = %zd, tasks = %zd, bytes = %llu, %.3f MB/s, wait = %.3f sec\n",
+					b, b->m_opt.priority, b->m_opt.threadBudget, b->m_sched.inflight,
+					b->m_schedPending.size(), b->m_schedDoneTasks, b->m_schedDoneBytes,
+					sec > 0 ? b->m_schedDoneBytes / sec / 1e6 : 0.0,
+					g_pf.sf(0, b->m_schedWaitTime));
+				s += buf;
+			}
+			return s;
+		}
+	};
+	static MyScheduler& getScheduler() { static MyScheduler s; return s; }
+	friend std::string DictZipBlobStore_getPipelineStat();
+
 	valvec<HashTable> m_hash;
 	size_t m_inputRecords;
 	MyTask* m_curTask;
 	MyPipeline* m_pipeline;
+	MyScheduler* m_scheduler;
 	valvec<MyTask*> m_lake;
 	size_t m_lakeBytes = 0;
 
+	// guarded by MyScheduler::m_mtx
+	AutoGrowCircularQueue<MyTask*> m_schedPending{16};
+	std::condition_variable m_schedCond;
+	WeightedRoundRobinClient m_sched;
+	size_t m_schedDoneTasks = 0;
+	ullong m_schedDoneBytes = 0;
+	ullong m_schedWaitTime = 0;
+	ullong m_schedStartTime = 0;
+
 public:
 	explicit MultiThread(const DictZipBlobStore::Options& opt)
 	: DictZipBlobStoreBuilder(opt) {
 		m_curTask = nullptr;
 		m_pipeline = &getPipeline(); // access m_pipeline is faster
+		m_scheduler = &getScheduler();
 		if (opt.enableLake) {
 			m_lake.reserve(m_pipeline->getQueueSize());
 		}
 	}
+	~MultiThread() override {
+		m_scheduler->remove(this); // if finishZip was not called
+	}
 	void finishZip() override {
 		if (m_opt.enableLake) {
 			if (m_curTask && m_curTask->num) {
@@ -761,10 +923,10 @@ public:
 			drainLake();
 		} else {
 			if (m_curTask && m_curTask->num) {
-				m_pipeline->enqueue(m_curTask);
+				m_scheduler->submit(this, &m_curTask, 1);
 			}
 		}
-		while (m_lengthCount < m_inputRecords) {
+		while (as_atomic(m_lengthCount).load(std::memory_order_acquire) < m_inputRecords) {
 #if defined(_WIN32) || defined(_WIN64)
 			::Sleep(20);
 #else
@@ -773,6 +935,10 @@ public:
 		//  pre g++-4.8 has no sleep_for
 		//	std::this_thread::sleep_for(std::chrono::microseconds(20));
 		}
+		m_scheduler->remove(this);
+		m_zipStat.builderThroughBytes = m_schedDoneBytes;
+		m_zipStat.pipelineWaitTime = g_pf.sf(0, m_schedWaitTime);
+		m_zipStat.pipelineMaxInflight = m_sched.maxInflight;
 		m_curTask = NULL;
 		m_hash.clear();
 	}
@@ -780,6 +946,11 @@ public:
 		m_inputRecords = 0;
 		m_hash.resize(m_pipeline->zipThreads);
         m_xxhash64.reset(g_dzbsnark_seed);
+		m_schedDoneTasks = 0;
+		m_schedDoneBytes = 0;
+		m_schedWaitTime = 0;
+		m_schedStartTime = g_pf.now();
+		m_scheduler->add(this);
 	}
 
 	void drainLake() {
@@ -791,7 +962,7 @@ public:
 			// for these builders, each builder consumes many CPU Cache
 			// especially L3 cache which shared by multiple CPU core on
 			// one CPU socket/die!
-			m_pipeline->enqueue((PipelineTask**)m_lake.data(), m_lake.size());
+			m_scheduler->submit(this, m_lake.data(), m_lake.size());
 		}
 		m_lake.erase_all();
 		m_lakeBytes = 0;
@@ -845,7 +1016,7 @@ public:
 				m_lakeBytes += task->ibuf.size();
 				m_lake.push_back(task);
 			} else {
-				m_pipeline->enqueue(task);
+				m_scheduler->submit(this, &task, 1);
 			}
 			m_curTask = task = newTask(rData);
 		}
@@ -856,6 +1027,10 @@ public:
     bool isMultiThread() const final { return true; }
 };
 
+TERARK_DLL_EXPORT std::string DictZipBlobStore_getPipelineStat() {
+	return DictZipBlobStoreBuilder::MultiThread::getScheduler().stat();
+}
+
 void
 DictZipBlobStoreBuilder::MultiThread::
 MyZipStage::process(int tno, PipelineQueueItem* item) {
@@ -958,7 +1133,9 @@ MyWriteStage::process(int tno, PipelineQueueItem* item) {
         builder->m_lengthWriter << var_uint64_t(taskOffsets[i] - taskOffsets[i - 1]);
 	}
 	builder->m_zipDataSize += taskZipSize;
-    builder->m_lengthCount += taskRecNum;
+	builder->m_scheduler->onTaskDone(builder, task->ibuf.size());
+	// finishZip polls m_lengthCount, this is the last access to builder
+	as_atomic(builder->m_lengthCount).fetch_add(taskRecNum, std::memory_order_release);
 }
 
 bool
@@ -1343,6 +1520,8 @@ DictZipBlobStore::Options::Options() {
     // the real max is greater or equal than recordsPerBatch
     recordsPerBatch = getEnvLong("DictZipBlobStore_recordsPerBatch", 500);
     bytesPerBatch = getEnvLong("DictZipBlobStore_bytesPerBatch", 256*1024);
+    priority = kPriorityNormal;
+    threadBudget = (int)getEnvLong("DictZipBlobStore_threadBudget", 0);
 }
 
 DictZipBlobStore::ZipStat::ZipStat() {
@@ -1353,6 +1532,9 @@ DictZipBlobStore::ZipStat::ZipStat() {
 	entropyBuildTime = 0;
 	entropyZipTime = 0;
 	pipelineThroughBytes = 0;
+	builderThroughBytes = 0;
+	pipelineWaitTime = 0;
+	pipelineMaxInflight = 0;
 }
 
 void DictZipBlobStore::ZipStat::print(FILE* fp) const {
@@ -1376,6 +1558,11 @@ void DictZipBlobStore::ZipStat::print(FILE* fp) const {
     fprintf(fp, "  embedDict     %9.3f     %6.2f%%\n", embedDictTime   , 100*embedDictTime   /sum);
 	fprintf(fp, "  sum of all    %9.3f     %6.2f%%\n", sum, 100.0);
 	fprintf(fp, "-----------------------------------------\n");
+	if (builderThroughBytes) {
+		fprintf(fp, "  pipelineWait  %9.3f     builderBytes %llu of %llu, maxInflight %zd\n",
+				pipelineWaitTime, builderThroughBytes, pipelineThroughBytes,
+				pipelineMaxInflight);
+	}
 }
 
 ///@param crc32cLevel
@@ -3226,6 +3413,40 @@ DictZipBlobStore::reorder_and_load(ZReorderMap& newToOld,
     this->load_mmap(newFile);
 }
 
+// purge/reorder process records by chunks in parallel, chunk boundaries are
+// aligned to kPurgeAlign records, so chunks never share a word of bitmaps
+static const size_t kPurgeAlign = 128;
+
+static int& g_purgeThreads() {
+    static int s_purgeThreads = (int)getEnvLong("DictZipBlobStore_purgeThreads", 0);
+    return s_purgeThreads;
+}
+TERARK_DLL_EXPORT void DictZipBlobStore_setPurgeThreads(int threads) {
+    g_purgeThreads() = threads;
+}
+TERARK_DLL_EXPORT int DictZipBlobStore_getPurgeThreads() {
+    return g_purgeThreads();
+}
+
+// small stores are processed by the calling thread only
+static size_t purge_threads(size_t recNum) {
+    int threads = g_purgeThreads();
+    if (threads <= 0)
+        threads = std::min(8, (int)std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min<size_t>(threads, recNum / 16384));
+}
+
+// run fn(i) for i in [0, num) on the shared executor, fn(0) is run by the
+// calling thread
+template<class Fn>
+static void run_parallel(size_t num, Fn fn) {
+    if (num <= 1) {
+        if (num) fn(0);
+        return;
+    }
+    WorkStealingExecutor::global().parallel_for(num, fn);
+}
+
 void DictZipBlobStore::reorder_zip_data(ZReorderMap& newToOld,
         function<void(const void* data, size_t size)> writeAppend,
         fstring tmpFile)
@@ -3242,24 +3463,55 @@ const {
     SortedUintVec newZipOffsets;
     febitvec newEntropyBitmap;
     if (hasEntropy) {
-        newEntropyBitmap.resize(recNum);
-    }
+        newEntropyBitmap.resize(align_up(recNum, kPurgeAlign));
+    }
+    TERARK_VERIFY_EQ(newToOld.size(), recNum);
+
+    // each batch of new ids is split into chunks, a chunk reads its part of
+    // newToOld by an independent iterator and gets zipped ranges of old
+    // records(random access on offsets is the slow part), then the batch is
+    // consumed in order by fn(newIdBase, num)
+    const size_t threads = purge_threads(recNum);
+    const size_t batchSize = kPurgeAlign * 2048 * threads;
+    valvec<size_t> batchOld(batchSize, valvec_no_init());
+    valvec<size_t> batchBeg(batchSize, valvec_no_init());
+    valvec<size_t> batchLen(batchSize, valvec_no_init());
+    auto forEachBatch = [&](bool setEntropyBits, auto fn) {
+        for (size_t newIdBase = 0; newIdBase < recNum; ) {
+            size_t num = std::min(batchSize, recNum - newIdBase);
+            size_t chunks = std::min(threads, ceiled_div(num, kPurgeAlign));
+            size_t chunkSize = align_up(ceiled_div(num, chunks), kPurgeAlign);
+            run_parallel(chunks, [&](size_t c) {
+                size_t beg = std::min(num, chunkSize * c);
+                size_t end = std::min(num, chunkSize * (c + 1));
+                if (beg == end)
+                    return;
+                auto iter = newToOld.iter(newIdBase + beg);
+                for (size_t i = beg; i < end; ++i, ++iter) {
+                    size_t oldId = *iter;
+                    TERARK_VERIFY_LT(oldId, recNum);
+                    auto BegEnd = offsetGet2(oldId, isOffsetsZipped);
+                    TERARK_ASSERT_LE(BegEnd[0], BegEnd[1]);
+                    batchOld[i] = oldId;
+                    batchBeg[i] = BegEnd[0];
+                    batchLen[i] = BegEnd[1] - BegEnd[0];
+                    if (setEntropyBits)
+                        newEntropyBitmap.set(newIdBase + i, m_entropyBitmap[oldId]);
+                }
+            });
+            fn(newIdBase, num);
+            newIdBase += num;
+        }
+    };
     if (isOffsetsZipped) {
         auto zipOffsetBuilder = std::unique_ptr<SortedUintVec::Builder>(
             SortedUintVec::createBuilder(m_zOffsets.block_units(), tmpFile.c_str()));
-        TERARK_VERIFY_EQ(newToOld.size(), recNum);
-        for (; !newToOld.eof(); ++newToOld) {
-            size_t newId = newToOld.index();
-            size_t oldId = *newToOld;
-            assert(oldId < recNum);
-            auto BegEnd = offsetGet2(oldId, isOffsetsZipped);
-            zipOffsetBuilder->push_back(offset);
-            assert(BegEnd[0] <= BegEnd[1]);
-            offset += BegEnd[1] - BegEnd[0];
-            if (hasEntropy) {
-                newEntropyBitmap.set(newId, m_entropyBitmap[oldId]);
+        forEachBatch(hasEntropy, [&](size_t, size_t num) {
+            for (size_t i = 0; i < num; ++i) {
+                zipOffsetBuilder->push_back(offset);
+                offset += batchLen[i];
             }
-        }
+        });
         TERARK_VERIFY_EQ(offset, maxOffsetEnt);
         zipOffsetBuilder->push_back(maxOffsetEnt);
         zipOffsetBuilder->finish(nullptr);
@@ -3276,26 +3528,19 @@ const {
         size_t flush_count = 0;
         TERARK_VERIFY_EQ(align_up(maxOffsetEnt, 16), m_ptrList.size());
         TERARK_VERIFY_EQ(tmpOffsets.uintbits(), m_offsets.uintbits());
-        TERARK_VERIFY_EQ(newToOld.size(), recNum);
-        for (; !newToOld.eof(); ++newToOld) {
-            size_t newId = newToOld.index() - flush_count;
-            size_t oldId = *newToOld;
-            TERARK_ASSERT_LT(oldId, recNum);
-            if (newId == offset_flush_size) {
-                size_t byte_count = tmpOffsets.uintbits() * offset_flush_size / 8;
-                m_writer_offset.ensureWrite(tmpOffsets.data(), byte_count);
-                flush_count += offset_flush_size;
-                newId = 0;
-            }
-            auto BegEnd = offsetGet2(oldId, isOffsetsZipped);
-            tmpOffsets.set_wire(newId, offset);
-            size_t zippedLen = BegEnd[1] - BegEnd[0];
-            TERARK_ASSERT_LE(BegEnd[0], BegEnd[1]);
-            offset += zippedLen;
-            if (hasEntropy) {
-                newEntropyBitmap.set(newToOld.index(), m_entropyBitmap[oldId]);
+        forEachBatch(hasEntropy, [&](size_t newIdBase, size_t num) {
+            for (size_t i = 0; i < num; ++i) {
+                size_t newId = newIdBase + i - flush_count;
+                if (newId == offset_flush_size) {
+                    size_t byte_count = tmpOffsets.uintbits() * offset_flush_size / 8;
+                    m_writer_offset.ensureWrite(tmpOffsets.data(), byte_count);
+                    flush_count += offset_flush_size;
+                    newId = 0;
+                }
+                tmpOffsets.set_wire(newId, offset);
+                offset += batchLen[i];
             }
-        }
+        });
         TERARK_VERIFY_EQ(offset, maxOffsetEnt);
         tmpOffsets.resize(recNum - flush_count + 1);
         tmpOffsets.set_wire(recNum - flush_count, maxOffsetEnt);
@@ -3339,25 +3584,27 @@ const {
     XXHash64 xxhash64(g_dzbsnark_seed);
     const byte_t* gatherPtr = nullptr;
     size_t gatherLen = 0;
-    for (newToOld.rewind(); !newToOld.eof(); ++newToOld) {
-        size_t oldId = *newToOld;
-		auto BegEnd = offsetGet2(oldId, isOffsetsZipped);
-		size_t zippedLen = BegEnd[1] - BegEnd[0];
-		TERARK_ASSERT_LE(BegEnd[0], BegEnd[1]);
-		const byte* beg = m_ptrList.data() + BegEnd[0];
-		xxhash64.update(beg, zippedLen);
-		if (gatherPtr + gatherLen == beg) {
-			gatherLen += zippedLen;
-		} else {
-			if (gatherLen)
-				writeAppend(gatherPtr, gatherLen);
-			gatherPtr = beg;
-			gatherLen = zippedLen;
-		}
-		TERARK_ASSERT_F(rbits.is0(oldId), "oldId = %zd", oldId);
-		TERARK_IF_DEBUG(rbits.set1(oldId), ;);
-	}
+    // unchanged zipped bytes of adjacent records are copied as one run
+    forEachBatch(false, [&](size_t, size_t num) {
+        for (size_t i = 0; i < num; ++i) {
+            const byte* beg = m_ptrList.data() + batchBeg[i];
+            size_t zippedLen = batchLen[i];
+            if (gatherPtr + gatherLen == beg) {
+                gatherLen += zippedLen;
+            } else {
+                if (gatherLen) {
+                    xxhash64.update(gatherPtr, gatherLen);
+                    writeAppend(gatherPtr, gatherLen);
+                }
+                gatherPtr = beg;
+                gatherLen = zippedLen;
+            }
+            TERARK_ASSERT_F(rbits.is0(batchOld[i]), "oldId = %zd", batchOld[i]);
+            TERARK_IF_DEBUG(rbits.set1(batchOld[i]), ;);
+        }
+    });
 	if (gatherLen) {
+		xxhash64.update(gatherPtr, gatherLen);
 		writeAppend(gatherPtr, gatherLen);
 	}
     static const byte zeros[16] = { 0 };
@@ -3438,60 +3685,121 @@ void DictZipBlobStore::purge_zip_data(const bm_uint_t* isDel,
 const {
 	purge_zip_data_impl(
 		[=](size_t id){ return terark_bit_test(isDel, baseId_of_isDel + id); },
-		writeAppend);
+		purge_threads(m_numRecords), writeAppend);
 }
 
 
 void DictZipBlobStore::purge_zip_data(function<bool(size_t id)> isDel,
 		function<void(const void* data, size_t size)> writeAppend)
 const {
-	purge_zip_data_impl(isDel, writeAppend);
+	// isDel is a user callback which may not be thread safe
+	purge_zip_data_impl(isDel, 1, writeAppend);
 }
 
 template<class IsDel>
-void DictZipBlobStore::purge_zip_data_impl(IsDel isDel,
+void DictZipBlobStore::purge_zip_data_impl(IsDel isDel, size_t threads,
 		function<void(const void* data, size_t size)> writeAppend)
 const {
 	assert(nullptr != m_mmapBase);
 	size_t recNum = m_numRecords;
-	size_t offset = 0;
 	const bool isOffsetsZipped = offsetsIsSortedUintVec();
     const bool hasEntropy = Options::kNoEntropy != m_entropyAlgo;
 	size_t maxOffsetEnt = isOffsetsZipped ? m_zOffsets[recNum] : m_offsets[recNum];
+	assert(align_up(maxOffsetEnt, 16) == m_ptrList.size());
+    auto offsetGet = [&](size_t id) {
+        return isOffsetsZipped ? m_zOffsets[id] : m_offsets[id];
+    };
 
-#if !defined(NDEBUG)
-	size_t maxOffset = maxOffsetEnt;
-	assert(align_up(maxOffset, 16) == m_ptrList.size());
-#endif
-	UintVecMin0 newOffsets(recNum + 1, maxOffsetEnt);
+    // old id range is split into chunks, each chunk finds its runs of kept
+    // records, zipped data of a run is contiguous and copied as a whole
+    struct PurgeChunk {
+        size_t oldBeg, oldEnd;
+        size_t newBeg, newNum;
+        size_t zipBeg, zipLen; // in new zip data
+        valvec<std::pair<size_t, size_t> > runs; // [oldBeg, oldEnd) of runs
+        valvec<std::pair<size_t, bool> > tail; // (offset, entropy bit)
+    };
+    const size_t chunkSize = align_up(ceiled_div(recNum, threads), kPurgeAlign);
+    valvec<PurgeChunk> chunks(threads);
+    run_parallel(threads, [&](size_t c) {
+        PurgeChunk& chunk = chunks[c];
+        chunk.oldBeg = std::min(recNum, chunkSize * c);
+        chunk.oldEnd = std::min(recNum, chunkSize * (c + 1));
+        chunk.newNum = chunk.zipLen = 0;
+        size_t runBeg = size_t(-1);
+        for (size_t oldId = chunk.oldBeg; oldId < chunk.oldEnd; oldId++) {
+            if (!isDel(oldId)) {
+                if (size_t(-1) == runBeg)
+                    runBeg = oldId;
+            }
+            else if (size_t(-1) != runBeg) {
+                chunk.runs.emplace_back(runBeg, oldId);
+                runBeg = size_t(-1);
+            }
+        }
+        if (size_t(-1) != runBeg)
+            chunk.runs.emplace_back(runBeg, chunk.oldEnd);
+        for (auto& run : chunk.runs) {
+            chunk.newNum += run.second - run.first;
+            chunk.zipLen += offsetGet(run.second) - offsetGet(run.first);
+        }
+    });
+	size_t newNum = 0;
+	size_t offset = 0;
+    for (auto& chunk : chunks) {
+        chunk.newBeg = newNum;
+        chunk.zipBeg = offset;
+        newNum += chunk.newNum;
+        offset += chunk.zipLen;
+    }
+	assert(offset <= maxOffsetEnt);
+	UintVecMin0 newOffsets(newNum + 1, maxOffsetEnt);
     febitvec newEntropyBitmap;
     if (hasEntropy) {
-        newEntropyBitmap.reserve(recNum);
+        newEntropyBitmap.resize(align_up(newNum, 16 * 8));
     }
 	assert(newOffsets.uintbits() <= m_offsets.uintbits());
-	assert(newOffsets.mem_size() <= m_offsets.mem_size());
-	size_t newId = 0;
-	for(size_t oldId = 0; oldId < recNum; oldId++) {
-		if (!isDel(oldId)) {
-			auto BegEnd = offsetGet2(oldId, isOffsetsZipped);
-			newOffsets.set_wire(newId, offset);
-			size_t zippedLen = BegEnd[1] - BegEnd[0];
-			assert(BegEnd[0] <= BegEnd[1]);
-			offset += zippedLen;
-            if (hasEntropy) {
-                newEntropyBitmap.push_back(m_entropyBitmap[oldId]);
+    // new id ranges of chunks are not aligned, the last kPurgeAlign records
+    // of a chunk may share words with the next chunk, they are set later
+    run_parallel(threads, [&](size_t c) {
+        PurgeChunk& chunk = chunks[c];
+        size_t newId = chunk.newBeg;
+        size_t newOffset = chunk.zipBeg;
+        size_t tailBeg = chunk.newBeg + chunk.newNum
+                       - std::min(chunk.newNum, kPurgeAlign);
+        chunk.tail.reserve(std::min(chunk.newNum, kPurgeAlign));
+        for (auto& run : chunk.runs) {
+            size_t runOffset = offsetGet(run.first);
+            for (size_t oldId = run.first; oldId < run.second; oldId++) {
+                size_t off = newOffset + offsetGet(oldId) - runOffset;
+                bool entropyBit = hasEntropy && m_entropyBitmap[oldId];
+                if (newId < tailBeg) {
+                    newOffsets.set_wire(newId, off);
+                    if (hasEntropy)
+                        newEntropyBitmap.set(newId, entropyBit);
+                }
+                else {
+                    chunk.tail.emplace_back(off, entropyBit);
+                }
+                newId++;
             }
-			newId++;
-		}
-	}
-	assert(offset <= maxOffset);
-	size_t newNum = newId;
-	newOffsets.resize(newNum+1);
+            newOffset += offsetGet(run.second) - runOffset;
+        }
+        assert(newId == chunk.newBeg + chunk.newNum);
+    });
+    for (auto& chunk : chunks) {
+        size_t newId = chunk.newBeg + chunk.newNum - chunk.tail.size();
+        for (auto& x : chunk.tail) {
+            newOffsets.set_wire(newId, x.first);
+            if (hasEntropy)
+                newEntropyBitmap.set(newId, x.second);
+            newId++;
+        }
+    }
 	newOffsets.set_wire(newNum, offset);
     auto mmapBase = (const FileHeader*)m_mmapBase;
 
     if (hasEntropy) {
-        newEntropyBitmap.resize(align_up(newNum, 16 * 8));
         auto entropyMem = m_offsets.data() + m_offsets.mem_size()
                         + febitvec::s_mem_size(align_up(recNum, 16 * 8));
         auto entropyLen = ((const FileHeader*)m_mmapBase)->entropyTableSize;
@@ -3499,7 +3807,7 @@ const {
         Dictionary dict(m_strDict.size(), ((const FileHeader*)m_mmapBase)->dictXXHash);
         FileHeader h(this, offset, dict, newOffsets,
                      fstring((char*)newEntropyBitmap.data(), newEntropyBitmap.mem_size()),
-                     entropy, maxOffsetEnt);
+                     entropy, mmapBase->entropyTableNoCompress, maxOffsetEnt);
         if (mmapBase->embeddedDict != (uint8_t)EmbeddedDictType::kExternal) {
             h.setEmbeddedDictType(mmapBase->getEmbeddedDict().size(),
                                   (EmbeddedDictType)mmapBase->embeddedDict);
@@ -3517,25 +3825,30 @@ const {
         writeAppend(&h, sizeof(h));
     }
 	XXHash64 xxhash64(g_dzbsnark_seed);
-	newId = 0;
-	offset = 0;
-	for(size_t oldId = 0; oldId < recNum; oldId++) {
-		if (!isDel(oldId)) {
-			auto BegEnd = offsetGet2(oldId, isOffsetsZipped);
-			newOffsets.set_wire(newId, offset);
-			size_t zippedLen = BegEnd[1] - BegEnd[0];
-			assert(BegEnd[0] <= BegEnd[1]);
-			const  byte* beg = m_ptrList.data() + BegEnd[0];
-			xxhash64.update(beg, zippedLen);
-			writeAppend(beg, zippedLen);
-			offset += zippedLen;
-			newId++;
-		}
-	}
-	assert(newId == newNum);
-	if (newId != newNum) {
-		THROW_STD(logic_error, "isDel was changed during purge");
-	}
+    // runs of adjacent chunks may be contiguous, gather them
+    const byte_t* gatherPtr = nullptr;
+    size_t gatherLen = 0;
+    for (auto& chunk : chunks) {
+        for (auto& run : chunk.runs) {
+            size_t runOffset = offsetGet(run.first);
+            const byte* beg = m_ptrList.data() + runOffset;
+            size_t runLen = offsetGet(run.second) - runOffset;
+            if (gatherPtr + gatherLen == beg) {
+                gatherLen += runLen;
+            } else {
+                if (gatherLen) {
+                    xxhash64.update(gatherPtr, gatherLen);
+                    writeAppend(gatherPtr, gatherLen);
+                }
+                gatherPtr = beg;
+                gatherLen = runLen;
+            }
+        }
+    }
+    if (gatherLen) {
+        xxhash64.update(gatherPtr, gatherLen);
+        writeAppend(gatherPtr, gatherLen);
+    }
 	static const byte zeros[16] = {0};
 	if (offset % 16 != 0) {
 		xxhash64.update(zeros, 16 - offset % 16);
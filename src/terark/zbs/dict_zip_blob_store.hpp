@@ -30,6 +30,11 @@ public:
 			kSortRight,
 			kSortBoth,
 		};
+		enum Priority : uint08_t {
+			kPriorityLow,    // weight 1,  such as large compactions
+			kPriorityNormal, // weight 4
+			kPriorityHigh,   // weight 16, such as flush
+		};
 		int checksumLevel; // default 1
 		int maxMatchProbe; // default 5 for local hash
 						   //        30 for local suffix array
@@ -47,6 +52,13 @@ public:
         int  recordsPerBatch;
         int  bytesPerBatch;
 
+        // for MultiThread builders which share the global pipeline:
+        // tasks of builders are fed into pipeline by weighted round robin,
+        // threadBudget limits tasks of this builder in the pipeline, which
+        // is the max zip threads used by this builder, 0 for no limit
+        Priority priority;
+        int  threadBudget;
+
 		Options();
 	};
     typedef Options::EntropyAlgo EntropyAlgo;
@@ -64,6 +76,9 @@ public:
 		double entropyZipTime;
         double embedDictTime;
 		ullong pipelineThroughBytes; // including other ZipBuilder's
+		ullong builderThroughBytes;  // this ZipBuilder's pipeline bytes
+		double pipelineWaitTime;     // addRecord blocked by pipeline
+		size_t pipelineMaxInflight;  // max tasks of this ZipBuilder in pipeline
 		ZipStat();
 		void print(FILE*) const;
 	};
@@ -221,6 +236,8 @@ public:
         function<void(const void* data, size_t size)> writeAppend,
         fstring tmpFile) const override;
 
+	/// purge by bitmap and reorder run on DictZipBlobStore_setPurgeThreads()
+	/// threads, purge by function<bool(size_t)> calls isDel in one thread
 	void purge_and_load(const bm_uint_t* isDel, size_t baseId_of_isDel, fstring newFile, bool keepOldFile);
 	void purge_zip_data(const bm_uint_t* isDel, size_t baseId_of_isDel,
 			function<void(const void* data, size_t size)> writeAppend
@@ -230,10 +247,16 @@ public:
 		 ) const;
 private:
 	template<class IsDel>
-	void purge_zip_data_impl(IsDel isDel,
+	void purge_zip_data_impl(IsDel isDel, size_t threads,
 			function<void(const void* data, size_t size)> writeAppend
 		 ) const;
 };
 
+/// threads for purge_zip_data/reorder_zip_data, tasks are run on
+/// WorkStealingExecutor::global(), <= 0 means min(8, cpu num),
+/// default is env DictZipBlobStore_purgeThreads
+TERARK_DLL_EXPORT void DictZipBlobStore_setPurgeThreads(int threads);
+TERARK_DLL_EXPORT int  DictZipBlobStore_getPurgeThreads();
+
 } // namespace terark
 
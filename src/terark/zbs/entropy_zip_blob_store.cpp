@@ -7,6 +7,7 @@
 
 #include "entropy_zip_blob_store.hpp"
 #include "blob_store_file_header.hpp"
+#include "record_batch_pipeline.hpp"
 #include "zip_reorder_map.hpp"
 #include <terark/entropy/huffman_encoding.hpp>
 #include <terark/io/FileStream.hpp>
@@ -607,6 +608,7 @@ class EntropyZipBlobStore::MyBuilder::Impl : boost::noncopyable {
     std::function<void(const void*, size_t)> m_output;
     EntropyBitsWriter<std::function<void(const void*, size_t)>> m_bitWriter;
     TerarkContext m_ctx;
+    std::unique_ptr<RecordBatchPipeline> m_pipeline;
     size_t m_offset;
     size_t m_raw_size;
     size_t m_output_size;
@@ -617,7 +619,8 @@ class EntropyZipBlobStore::MyBuilder::Impl : boost::noncopyable {
 
 public:
     Impl(freq_hist_o1& freq, size_t blockUnits, fstring fpath, size_t offset,
-         int checksumLevel, int checksumType, bool entropyTableCompress)
+         int checksumLevel, int checksumType, bool entropyTableCompress,
+         int threads)
         : m_fpath(fpath.begin(), fpath.end())
         , m_fpath_offset(fpath + ".offset")
         , m_builder(SortedUintVec::createBuilder(blockUnits, m_fpath_offset.c_str()))
@@ -641,10 +644,11 @@ public:
           m_file.seek(offset);
         }
         m_file.disbuf();
-        init(freq);
+        init(freq, threads);
     }
     Impl(freq_hist_o1& freq, size_t blockUnits, FileMemIO& mem,
-         int checksumLevel, int checksumType, bool entropyTableCompress)
+         int checksumLevel, int checksumType, bool entropyTableCompress,
+         int threads)
         : m_fpath()
         , m_fpath_offset()
         , m_builder(SortedUintVec::createBuilder(blockUnits))
@@ -659,9 +663,9 @@ public:
         , m_checksumLevel(checksumLevel)
         , m_checksumType(checksumType)
         , m_entropyTableCompress(entropyTableCompress) {
-        init(freq);
+        init(freq, threads);
     }
-    void init(freq_hist_o1& freq) {
+    void init(freq_hist_o1& freq, int threads) {
         // BlobStore is used for random access, DTable is resident in memory,
         // so we need to take uncompressed DTable size into account
         size_t entropy_len_o0 = freq_hist::estimate_size(freq.histogram()) + sizeof(Huffman::decoder);
@@ -679,35 +683,78 @@ public:
         std::aligned_storage<sizeof(FileHeader)>::type header;
         memset(&header, 0, sizeof header);
         m_writer.ensureWrite(&header, sizeof header);
+        if (threads > 0) {
+            // records are encoded in parallel, the bits of each record are
+            // saved in batch->obuf, ooffsets are {offset, skip, bits} of
+            // records, then the writer appends bits in order
+            m_pipeline.reset(new RecordBatchPipeline(threads,
+                [this](int, RecordBatchPipeline::Batch* batch) {
+                    auto ctx = GetTlsTerarkContext();
+                    auto& obuf = batch->obuf;
+                    size_t num = batch->num();
+                    obuf.reserve(batch->data.size());
+                    batch->ooffsets.resize_no_init(3 * num);
+                    for (size_t i = 0; i < num; ++i) {
+                        EntropyBits bits = encode(batch->nth(i), ctx);
+                        size_t skip = bits.skip % 8;
+                        size_t len = (skip + bits.size + 7) / 8;
+                        batch->ooffsets[3*i+0] = obuf.size();
+                        batch->ooffsets[3*i+1] = skip;
+                        batch->ooffsets[3*i+2] = bits.size;
+                        obuf.append(bits.data + bits.skip / 8, len);
+                    }
+                },
+                [this](RecordBatchPipeline::Batch* batch) {
+                    const size_t* offs = batch->ooffsets.data();
+                    for (size_t i = 0, num = batch->num(); i < num; ++i) {
+                        EntropyBits bits = {batch->obuf.data() + offs[3*i],
+                                            offs[3*i+1], offs[3*i+2], {}};
+                        write_record(batch->nth(i), bits);
+                    }
+                }));
+        }
     }
-    void add_record(fstring rec) {
-        EntropyBits bits;
+    EntropyBits encode(fstring rec, TerarkContext* ctx) const {
         if (m_encoder_o0) {
-            bits = m_encoder_o0->bitwise_encode(rec, &m_ctx);
+            return m_encoder_o0->bitwise_encode(rec, ctx);
         } else {
-            bits = m_encoder_o1->bitwise_encode_x1(rec, &m_ctx);
+            return m_encoder_o1->bitwise_encode_x1(rec, ctx);
         }
+    }
+    void write_record(fstring rec, const EntropyBits& bits) {
         m_builder->push_back(m_entropy_bits);
         m_bitWriter.write(bits);
         m_raw_size += rec.size();
         m_entropy_bits += bits.size;
         if (2 == m_checksumLevel) {
+            EntropyBits crcBits;
             if (kCRC16C == m_checksumType) {
                 uint16_t crc = Crc16c_update(0, rec.data(), rec.size());
-                bits = {reinterpret_cast<byte*>(&crc), 0, 16, {}};
-                m_bitWriter.write(bits);
+                crcBits = {reinterpret_cast<byte*>(&crc), 0, 16, {}};
+                m_bitWriter.write(crcBits);
                 m_raw_size += sizeof(crc);
-                m_entropy_bits += bits.size;
+                m_entropy_bits += crcBits.size;
             } else {
                 uint32_t crc = Crc32c_update(0, rec.data(), rec.size());
-                bits = {reinterpret_cast<byte*>(&crc), 0, 32, {}};
-                m_bitWriter.write(bits);
+                crcBits = {reinterpret_cast<byte*>(&crc), 0, 32, {}};
+                m_bitWriter.write(crcBits);
                 m_raw_size += sizeof(crc);
-                m_entropy_bits += bits.size;
+                m_entropy_bits += crcBits.size;
             }
         }
     }
+    void add_record(fstring rec) {
+        if (m_pipeline) {
+            m_pipeline->add_record(rec);
+            return;
+        }
+        write_record(rec, encode(rec, &m_ctx));
+    }
     void finish() {
+        if (m_pipeline) {
+            m_pipeline->finish();
+            m_pipeline.reset();
+        }
         auto bits = m_bitWriter.finish();
         assert(bits.size == m_entropy_bits); (void)bits;
         assert(m_output_size == (m_entropy_bits + 7) / 8);
@@ -812,16 +859,16 @@ EntropyZipBlobStore::MyBuilder::~MyBuilder() {
 EntropyZipBlobStore::MyBuilder::MyBuilder(freq_hist_o1& freq, size_t blockUnits,
                                           fstring fpath, size_t offset,
                                           int checksumLevel, int checksumType,
-                                          bool entropyTableCompress) {
+                                          bool entropyTableCompress, int threads) {
   impl = new Impl(freq, blockUnits, fpath, offset, checksumLevel, checksumType,
-                  entropyTableCompress);
+                  entropyTableCompress, threads);
 }
 EntropyZipBlobStore::MyBuilder::MyBuilder(freq_hist_o1& freq, size_t blockUnits,
                                           FileMemIO& mem, int checksumLevel,
                                           int checksumType,
-                                          bool entropyTableCompress) {
+                                          bool entropyTableCompress, int threads) {
   impl = new Impl(freq, blockUnits, mem, checksumLevel, checksumType,
-                  entropyTableCompress);
+                  entropyTableCompress, threads);
 }
 void EntropyZipBlobStore::MyBuilder::addRecord(fstring rec) {
     assert(NULL != impl);
@@ -832,4 +879,49 @@ void EntropyZipBlobStore::MyBuilder::finish() {
     return impl->finish();
 }
 
+class EntropyZipBlobStore::FreqHistBuilder::Impl {
+public:
+    freq_hist_o1& m_freq;
+    valvec<std::unique_ptr<freq_hist_o1> > m_local;
+    RecordBatchPipeline m_pipeline;
+
+    Impl(freq_hist_o1& freq, int threads)
+        : m_freq(freq)
+        , m_pipeline(threads,
+            [this](int tno, RecordBatchPipeline::Batch* batch) {
+                freq_hist_o1& local = *m_local[tno];
+                for (size_t i = 0, num = batch->num(); i < num; ++i) {
+                    local.add_record(batch->nth(i));
+                }
+            },
+            [](RecordBatchPipeline::Batch*) {}) {
+        m_local.resize(threads);
+        for (auto& local : m_local) {
+            local.reset(new freq_hist_o1(freq)); // copy min/max len
+            local->clear();
+        }
+    }
+    void finish() {
+        m_pipeline.finish();
+        for (auto& local : m_local) {
+            m_freq.add_hist(*local);
+        }
+        m_freq.finish();
+    }
+};
+
+EntropyZipBlobStore::FreqHistBuilder::FreqHistBuilder(freq_hist_o1& freq,
+                                                      int threads) {
+    impl = new Impl(freq, threads);
+}
+EntropyZipBlobStore::FreqHistBuilder::~FreqHistBuilder() {
+    delete impl;
+}
+void EntropyZipBlobStore::FreqHistBuilder::add_record(fstring rec) {
+    impl->m_pipeline.add_record(rec);
+}
+void EntropyZipBlobStore::FreqHistBuilder::finish() {
+    impl->finish();
+}
+
 } // namespace terark
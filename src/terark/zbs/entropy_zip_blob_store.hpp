@@ -54,17 +54,33 @@ public:
         function<void(const void* data, size_t size)> writeAppend,
         fstring tmpFile) const override;
 
+    /// threads > 0: records are encoded by a pipeline of `threads` threads,
+    /// the output is same as threads = 0, which encodes in caller's thread
     struct TERARK_DLL_EXPORT MyBuilder : public AbstractBlobStore::Builder {
         class TERARK_DLL_EXPORT Impl; Impl* impl;
     public:
         MyBuilder(freq_hist_o1& freq, size_t blockUnits, fstring fpath, size_t offset = 0,
-                  int checksumLevel = 3, int checksumType = 0, bool entropyTableCompress = false);
+                  int checksumLevel = 3, int checksumType = 0, bool entropyTableCompress = false,
+                  int threads = 0);
         MyBuilder(freq_hist_o1& freq, size_t blockUnits, FileMemIO& mem,
-                  int checksumLevel = 3, int checksumType = 0, bool entropyTableCompress = false);
+                  int checksumLevel = 3, int checksumType = 0, bool entropyTableCompress = false,
+                  int threads = 0);
         virtual ~MyBuilder();
         void addRecord(fstring rec) override;
         void finish() override;
     };
+
+    /// add records to freq by a pipeline of `threads` threads, each thread
+    /// has its own freq_hist_o1, they are merged to freq by add_hist, the
+    /// result is same as freq.add_record for each record
+    class TERARK_DLL_EXPORT FreqHistBuilder : boost::noncopyable {
+        class Impl; Impl* impl;
+    public:
+        FreqHistBuilder(freq_hist_o1& freq, int threads);
+        ~FreqHistBuilder();
+        void add_record(fstring rec);
+        void finish(); // also calls freq.finish()
+    };
 };
 
 } // namespace terark
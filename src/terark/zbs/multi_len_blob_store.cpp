@@ -0,0 +1,734 @@
+#include "multi_len_blob_store.hpp"
+#include "blob_store_file_header.hpp"
+#include "zip_reorder_map.hpp"
+#include <terark/io/FileStream.hpp>
+#include <terark/io/StreamBuffer.hpp>
+#include <terark/thread/fiber_aio.hpp>
+#include <terark/util/checksum_exception.hpp>
+#include <terark/util/crc.hpp>
+#include <terark/util/mmap.hpp>
+#include <terark/util/throw.hpp>
+#include <terark/util/vm_util.hpp>
+#include <terark/zbs/xxhash_helper.hpp>
+#include <algorithm>
+
+namespace terark {
+
+REGISTER_BlobStore(MultiLenBlobStore);
+
+static const uint64_t g_mlbs_seed = 0x6e654c69746c754dull; // echo MultiLen | od -t x8
+
+struct MultiLenBlobStore::FileHeader : public FileHeaderBase {
+    uint08_t  offsetsUintBits;
+    uint08_t  checksumLevel;
+    uint08_t  numClasses;
+    uint08_t  padding21[5];
+
+    uint64_t  varLenBytes;
+    uint64_t  varNum;
+    uint64_t  padding22[3];
+
+    FileHeader();
+    FileHeader(const MultiLenBlobStore* store);
+};
+
+// ClassMeta[numClasses] are at the end of file, just before the footer,
+// builder knows which classes are not empty only on finish
+struct MultiLenBlobStore::ClassMeta {
+    uint32_t  fixedLen; // include crc
+    uint32_t  isClassBytesDiv8;
+    uint64_t  num;
+};
+
+MultiLenBlobStore::FileHeader::FileHeader() {
+    memset(this, 0, sizeof(*this));
+    magic_len = MagicStrLen;
+    strcpy(magic, MagicString);
+    strcpy(className, "MultiLenBlobStore");
+}
+
+MultiLenBlobStore::FileHeader::FileHeader(const MultiLenBlobStore* store)
+  : FileHeader() {
+    fileSize = sizeof(FileHeader);
+    for (auto& c : store->m_classes) {
+        fileSize += align_up(c.values.size(), 16);
+        fileSize += align_up(c.isClass.mem_size(), 16);
+    }
+    fileSize += align_up(store->m_varLenValues.size(), 16);
+    fileSize += store->m_varLenOffsets.mem_size();
+    fileSize += sizeof(ClassMeta) * store->m_classes.size();
+    fileSize += sizeof(BlobStoreFileFooter);
+    unzipSize = store->m_unzipSize;
+    records = store->m_numRecords;
+    numClasses = uint08_t(store->m_classes.size());
+    if (store->m_varLenOffsets.size()) {
+        offsetsUintBits = uint08_t(store->m_varLenOffsets.uintbits());
+        varLenBytes = store->m_varLenValues.size();
+        varNum = store->m_varLenOffsets.size() - 1;
+    }
+    checksumLevel = static_cast<uint08_t>(store->m_checksumLevel);
+    checksumType = static_cast<uint08_t>(store->m_checksumType);
+}
+
+MultiLenBlobStore::MultiLenBlobStore() {
+    BOOST_STATIC_ASSERT(sizeof(FileHeader) == 128);
+    BOOST_STATIC_ASSERT(sizeof(ClassMeta) == 16);
+    m_unzipSize = 0;
+    m_supportZeroCopy = true;
+    m_crcLen = 0;
+    m_checksumLevel = 3;
+    m_checksumType = 0;
+}
+
+MultiLenBlobStore::~MultiLenBlobStore() {
+    if (m_isDetachMeta) {
+        for (auto& c : m_classes)
+            c.isClass.risk_release_ownership();
+        m_varLenOffsets.risk_release_ownership();
+    }
+    if (m_isUserMem) {
+        if (m_isMmapData) {
+            mmap_close((void*)m_mmapBase, m_mmapBase->fileSize);
+        }
+        m_mmapBase = nullptr;
+        m_isMmapData = false;
+        m_isUserMem = false;
+        for (auto& c : m_classes) {
+            c.isClass.risk_release_ownership();
+            c.values.risk_release_ownership();
+        }
+        m_varLenValues.risk_release_ownership();
+        m_varLenOffsets.risk_release_ownership();
+    }
+    else {
+        m_classes.clear();
+        m_varLenValues.clear();
+        m_varLenOffsets.clear();
+    }
+}
+
+size_t MultiLenBlobStore::mem_size() const {
+    size_t size = m_varLenValues.size() + m_varLenOffsets.mem_size();
+    for (auto& c : m_classes)
+        size += c.values.size() + c.isClass.mem_size();
+    return size;
+}
+
+void MultiLenBlobStore::set_func_ptr() {
+    m_get_record_append = BlobStoreStaticCastPMF(get_record_append_func_t,
+              &MultiLenBlobStore::get_record_append_imp<false>);
+    m_get_record_append_fiber_vm_prefetch = BlobStoreStaticCastPMF(
+              get_record_append_func_t,
+              &MultiLenBlobStore::get_record_append_imp<true>);
+    m_fspread_record_append = BlobStoreStaticCastPMF(fspread_record_append_func_t,
+              &MultiLenBlobStore::fspread_record_append_imp);
+    m_get_zipped_size = BlobStoreStaticCastPMF(get_zipped_size_func_t,
+              &MultiLenBlobStore::get_zipped_size_imp);
+    // binary compatible:
+    m_get_record_append_CacheOffsets =
+        reinterpret_cast<get_record_append_CacheOffsets_func_t>
+        (m_get_record_append);
+}
+
+// returns class of recID, m_classes.size() for var len records
+inline size_t MultiLenBlobStore::locate(size_t recID, size_t* idInClass) const {
+    TERARK_ASSERT_LT(recID, m_numRecords);
+    size_t id = recID, k = 0;
+    for (; k < m_classes.size(); ++k) {
+        auto& isClass = m_classes[k].isClass;
+        if (isClass.empty()) {
+            break; // all remain records are in class k
+        }
+        if (isClass.is1(id)) {
+            id = isClass.rank1(id);
+            break;
+        }
+        id = isClass.rank0(id);
+    }
+    *idInClass = id;
+    return k;
+}
+
+// include crc
+inline fstring MultiLenBlobStore::var_record(size_t varLenRecID) const {
+    TERARK_ASSERT_LT(varLenRecID + 1, m_varLenOffsets.size());
+    size_t offset0 = m_varLenOffsets[varLenRecID + 0];
+    size_t offset1 = m_varLenOffsets[varLenRecID + 1];
+    TERARK_ASSERT_LE(offset0, offset1);
+    TERARK_ASSERT_LE(offset1, m_varLenValues.size());
+    return fstring(m_varLenValues.data() + offset0, offset1 - offset0);
+}
+
+// len is without crc
+inline void MultiLenBlobStore::verify_crc(const byte_t* pData, size_t len) const {
+    if (kCRC16C == m_checksumType) {
+        uint16_t crc1 = unaligned_load<uint16_t>(pData + len);
+        uint16_t crc2 = Crc16c_update(0, pData, len);
+        if (crc2 != crc1) {
+            throw BadCrc16cException(BOOST_CURRENT_FUNCTION, crc1, crc2);
+        }
+    } else {
+        uint32_t crc1 = unaligned_load<uint32_t>(pData + len);
+        uint32_t crc2 = Crc32c_update(0, pData, len);
+        if (crc2 != crc1) {
+            throw BadCrc32cException(BOOST_CURRENT_FUNCTION, crc1, crc2);
+        }
+    }
+}
+
+template<bool FiberVmPrefetch>
+void MultiLenBlobStore::get_record_append_imp(size_t recID, valvec<byte_t>* recData)
+const {
+    size_t id;
+    size_t k = locate(recID, &id);
+    const byte_t* pData;
+    size_t        nData;
+    if (k < m_classes.size()) {
+        auto& c = m_classes[k];
+        TERARK_ASSERT_LT(id, c.num);
+        pData = c.values.data() + c.fixedLen * id;
+        nData = c.fixedLen;
+    }
+    else {
+        fstring rec = var_record(id);
+        pData = rec.udata();
+        nData = rec.size();
+    }
+    if (FiberVmPrefetch) {
+        fiber_aio_vm_prefetch(pData, nData);
+    }
+    else {
+        if (m_min_prefetch_pages >= g_min_prefault_pages) {
+            vm_prefetch(pData, nData, m_min_prefetch_pages);
+        }
+    }
+    if (2 == m_checksumLevel) {
+        nData -= m_crcLen;
+        verify_crc(pData, nData);
+    }
+    TERARK_VERIFY_EQ(recData->capacity(), 0);
+    recData->risk_set_data((byte_t*)pData);
+    recData->risk_set_size(nData);
+}
+
+void MultiLenBlobStore::fspread_record_append_imp(
+                                   pread_func_t fspread, void* lambda,
+                                   size_t baseOffset, size_t recID,
+                                   valvec<byte_t>* recData,
+                                   valvec<byte_t>* rdbuf)
+const {
+    size_t id;
+    size_t k = locate(recID, &id);
+    size_t offset, len;
+    if (k < m_classes.size()) {
+        auto& c = m_classes[k];
+        TERARK_ASSERT_LT(id, c.num);
+        offset = c.values.data() - (byte_t*)m_mmapBase + c.fixedLen * id;
+        len = c.fixedLen;
+    }
+    else {
+        fstring rec = var_record(id);
+        offset = rec.udata() - (byte_t*)m_mmapBase;
+        len = rec.size();
+    }
+    // recData is likely prepared
+    bool recDataIsEmtpy = recData->empty();
+    if (terark_likely(recDataIsEmtpy)) {
+        rdbuf->erase_all();
+        recData->swap(*rdbuf);
+    }
+    auto pData = fspread(lambda, baseOffset + offset, len, rdbuf);
+    if (2 == m_checksumLevel) {
+        len -= m_crcLen;
+        verify_crc(pData, len);
+    }
+    if (terark_likely(recDataIsEmtpy && rdbuf->data() == pData)) {
+        recData->swap(*rdbuf);
+        recData->risk_set_size(len);
+    } else {
+        recData->append(pData, len);
+    }
+}
+
+size_t MultiLenBlobStore::get_zipped_size_imp(size_t recID, CacheOffsets*) const {
+    size_t id;
+    size_t k = locate(recID, &id);
+    if (k < m_classes.size()) {
+        return m_classes[k].fixedLen;
+    }
+    return var_record(id).size();
+}
+
+void MultiLenBlobStore::init_from_memory(fstring dataMem, Dictionary/*dict*/) {
+    auto mmapBase = (const FileHeader*)dataMem.p;
+    m_mmapBase = mmapBase;
+    m_numRecords = mmapBase->records;
+    m_unzipSize = mmapBase->unzipSize;
+    m_checksumLevel = mmapBase->checksumLevel;
+    m_checksumType = mmapBase->checksumType;
+    m_crcLen = 2 == m_checksumLevel
+             ? (kCRC16C == m_checksumType ? sizeof(uint16_t) : sizeof(uint32_t))
+             : 0;
+    if (m_checksumLevel == 3 && isChecksumVerifyEnabled()) {
+        XXHash64 hash(g_mlbs_seed);
+        hash.update(mmapBase, mmapBase->fileSize - sizeof(BlobStoreFileFooter));
+        const uint64_t hashVal = hash.digest();
+        auto &footer = ((const BlobStoreFileFooter*)((const byte_t*)(mmapBase)+mmapBase->fileSize))[-1];
+        if (hashVal != footer.fileXXHash) {
+            std::string msg = "MultiLenBlobStore::load_mmap(\"" + get_fpath() + "\")";
+            throw BadChecksumException(msg, footer.fileXXHash, hashVal);
+        }
+    }
+    const size_t numClasses = mmapBase->numClasses;
+    TERARK_VERIFY_LE(numClasses, MaxClasses);
+    auto metas = (const ClassMeta*)((const byte_t*)mmapBase + mmapBase->fileSize
+                                  - sizeof(BlobStoreFileFooter)) - numClasses;
+    m_classes.resize(numClasses);
+    byte_t* curr = (byte_t*)(mmapBase + 1);
+    for (size_t k = 0; k < numClasses; ++k) {
+        auto& c = m_classes[k];
+        c.fixedLen = metas[k].fixedLen;
+        c.num = metas[k].num;
+        c.values.risk_set_data(curr, c.fixedLen * c.num);
+        curr += align_up(c.values.size(), 16);
+    }
+    if (mmapBase->varNum) {
+        m_varLenValues.risk_set_data(curr, mmapBase->varLenBytes);
+        curr += align_up(mmapBase->varLenBytes, 16);
+        m_varLenOffsets.risk_set_data(curr, mmapBase->varNum + 1, mmapBase->offsetsUintBits);
+        assert(m_varLenOffsets.mem_size() % 16 == 0);
+        assert(m_varLenOffsets.back() == mmapBase->varLenBytes);
+        curr += m_varLenOffsets.mem_size();
+    }
+    for (size_t k = 0; k < numClasses; ++k) {
+        if (size_t size = metas[k].isClassBytesDiv8 * 8) {
+            m_classes[k].isClass.risk_mmap_from(curr, size);
+            curr += align_up(size, 16);
+        }
+    }
+    assert((const ClassMeta*)curr == metas);
+    set_func_ptr();
+}
+
+void MultiLenBlobStore::get_meta_blocks(valvec<Block>* blocks) const {
+    blocks->erase_all();
+    for (auto& c : m_classes) {
+        if (c.isClass.size()) {
+            blocks->push_back({"isClass", {(char*)c.isClass.data(), (ptrdiff_t)c.isClass.mem_size()}});
+        }
+    }
+    if (m_varLenOffsets.size()) {
+        blocks->push_back({"varLenOffsets", {m_varLenOffsets.data(), (ptrdiff_t)m_varLenOffsets.mem_size()}});
+    }
+}
+
+void MultiLenBlobStore::get_data_blocks(valvec<Block>* blocks) const {
+    blocks->erase_all();
+    for (auto& c : m_classes) {
+        if (!c.values.empty()) {
+            blocks->push_back({"fixedLenValues", c.values});
+        }
+    }
+    if (!m_varLenValues.empty()) {
+        blocks->push_back({"varLenValues", m_varLenValues});
+    }
+}
+
+void MultiLenBlobStore::detach_meta_blocks(const valvec<Block>& blocks) {
+    assert(!m_isDetachMeta);
+    size_t i = 0;
+    for (auto& c : m_classes) {
+        if (c.isClass.size()) {
+            auto mem = blocks[i++].data;
+            assert(mem.size() == c.isClass.mem_size());
+            if (m_isUserMem) {
+                c.isClass.risk_release_ownership();
+            } else {
+                c.isClass.clear();
+            }
+            c.isClass.risk_mmap_from((byte_t*)mem.data(), mem.size());
+        }
+    }
+    if (m_varLenOffsets.size()) {
+        auto mem = blocks[i++].data;
+        assert(mem.size() == m_varLenOffsets.mem_size());
+        size_t size = m_varLenOffsets.size();
+        size_t uintbits = m_varLenOffsets.uintbits();
+        if (m_isUserMem) {
+            m_varLenOffsets.risk_release_ownership();
+        } else {
+            m_varLenOffsets.clear();
+        }
+        m_varLenOffsets.risk_set_data((byte_t*)mem.data(), size, uintbits);
+    }
+    assert(blocks.size() == i);
+    m_isDetachMeta = true;
+}
+
+void MultiLenBlobStore::save_mmap(function<void(const void* data, size_t size)> write) const {
+    FunctionAdaptBuffer adaptBuffer(write);
+    OutputBuffer buffer(&adaptBuffer);
+    XXHash64 xxhash64(g_mlbs_seed);
+    auto writeMem = [&](const void* data, size_t size) {
+        xxhash64.update(data, size);
+        buffer.ensureWrite(data, size);
+    };
+
+    FileHeader header(this);
+    writeMem(&header, sizeof header);
+    for (auto& c : m_classes) {
+        writeMem(c.values.data(), c.values.size());
+        PadzeroForAlign<16>(buffer, xxhash64, c.values.size());
+    }
+    if (m_varLenOffsets.size()) {
+        writeMem(m_varLenValues.data(), m_varLenValues.size());
+        PadzeroForAlign<16>(buffer, xxhash64, m_varLenValues.size());
+        assert(m_varLenOffsets.mem_size() % 16 == 0);
+        writeMem(m_varLenOffsets.data(), m_varLenOffsets.mem_size());
+    }
+    valvec<ClassMeta> metas(m_classes.size(), valvec_reserve());
+    for (auto& c : m_classes) {
+        if (c.isClass.size()) {
+            assert(c.isClass.mem_size() % 8 == 0);
+            writeMem(c.isClass.data(), c.isClass.mem_size());
+            PadzeroForAlign<16>(buffer, xxhash64, c.isClass.mem_size());
+        }
+        metas.push_back({uint32_t(c.fixedLen), uint32_t(c.isClass.mem_size() / 8), c.num});
+    }
+    writeMem(metas.data(), metas.used_mem_size());
+    BlobStoreFileFooter footer;
+    footer.fileXXHash = xxhash64.digest();
+    buffer.ensureWrite(&footer, sizeof footer);
+}
+
+void MultiLenBlobStore::reorder_zip_data(ZReorderMap& newToOld,
+        function<void(const void* data, size_t size)> writeAppend,
+        fstring tmpFile)
+const {
+    FunctionAdaptBuffer adaptBuffer(writeAppend);
+    OutputBuffer buffer(&adaptBuffer);
+    XXHash64 xxhash64(g_mlbs_seed);
+    auto writeMem = [&](const void* data, size_t size) {
+        xxhash64.update(data, size);
+        buffer.ensureWrite(data, size);
+    };
+    assert(newToOld.size() == m_numRecords);
+
+    // permutation does not change sizes, so the header is unchanged
+    FileHeader header(this);
+    writeMem(&header, sizeof header);
+
+    // one pass of newToOld for each class, new bitmaps are built in the
+    // first pass, bitmap k is not rebuilt if it is empty(all ones)
+    const size_t numClasses = m_classes.size();
+    std::vector<rank_select_il> newIsClass(numClasses);
+    for (size_t k = 0; k < numClasses; ++k) {
+        auto& c = m_classes[k];
+        for (newToOld.rewind(); !newToOld.eof(); ++newToOld) {
+            size_t id;
+            size_t oldClass = locate(*newToOld, &id);
+            if (0 == k) {
+                for (size_t j = 0; j <= oldClass && j < numClasses; ++j) {
+                    if (m_classes[j].isClass.size())
+                        newIsClass[j].push_back(j == oldClass);
+                }
+            }
+            if (oldClass == k) {
+                writeMem(c.values.data() + c.fixedLen * id, c.fixedLen);
+            }
+        }
+        PadzeroForAlign<16>(buffer, xxhash64, c.values.size());
+    }
+    if (m_varLenOffsets.size()) {
+        std::unique_ptr<UintVecMin0::Builder> offsetsBuilder(
+            UintVecMin0::create_builder_by_max_value(m_varLenOffsets.back(), tmpFile.c_str()));
+        size_t vOffset = 0;
+        for (newToOld.rewind(); !newToOld.eof(); ++newToOld) {
+            size_t id;
+            if (locate(*newToOld, &id) == numClasses) {
+                fstring rec = var_record(id);
+                offsetsBuilder->push_back(vOffset);
+                writeMem(rec.data(), rec.size());
+                vOffset += rec.size();
+            }
+        }
+        assert(vOffset == m_varLenValues.size());
+        PadzeroForAlign<16>(buffer, xxhash64, vOffset);
+        offsetsBuilder->push_back(vOffset);
+        auto buildResult = offsetsBuilder->finish();
+        offsetsBuilder.reset();
+        {
+            MmapWholeFile mmapOffsets(tmpFile);
+            TERARK_VERIFY_EQ(mmapOffsets.size, m_varLenOffsets.mem_size());
+            TERARK_VERIFY_EQ(buildResult.uintbits, m_varLenOffsets.uintbits());
+            writeMem(mmapOffsets.base, mmapOffsets.size);
+        }
+        ::remove(tmpFile.c_str());
+    }
+    valvec<ClassMeta> metas(numClasses, valvec_reserve());
+    for (size_t k = 0; k < numClasses; ++k) {
+        auto& c = m_classes[k];
+        auto& isClass = newIsClass[k];
+        if (isClass.size()) {
+            isClass.build_cache(false, false);
+            assert(isClass.mem_size() == c.isClass.mem_size());
+            writeMem(isClass.data(), isClass.mem_size());
+            PadzeroForAlign<16>(buffer, xxhash64, isClass.mem_size());
+        }
+        metas.push_back({uint32_t(c.fixedLen), uint32_t(isClass.mem_size() / 8), c.num});
+    }
+    writeMem(metas.data(), metas.used_mem_size());
+    BlobStoreFileFooter footer;
+    footer.fileXXHash = xxhash64.digest();
+    buffer.ensureWrite(&footer, sizeof footer);
+}
+
+valvec<size_t>
+MultiLenBlobStore::choose_fixed_lens(const std::map<size_t, size_t>& lenHist,
+                                     size_t maxClasses) {
+    valvec<std::pair<size_t, size_t> > lens; // {count, len}
+    size_t remain = 0, bytes = 0;
+    for (auto& kv : lenHist) {
+        lens.push_back({kv.second, kv.first});
+        remain += kv.second;
+        bytes += kv.first * kv.second;
+    }
+    std::sort(lens.begin(), lens.end(), [](auto& x, auto& y) {
+        return x.first != y.first ? x.first > y.first : x.second < y.second;
+    });
+    // offset bits of var len records, rank_select_il takes 1.25 bits per bit
+    size_t offsetBits = UintVecMin0::compute_uintbits(bytes);
+    valvec<size_t> fixedLens;
+    for (auto& x : lens) {
+        if (fixedLens.size() >= std::min(maxClasses, MaxClasses))
+            break;
+        if (x.first * offsetBits <= remain * 5 / 4)
+            break;
+        fixedLens.push_back(x.second);
+        remain -= x.first;
+    }
+    return fixedLens;
+}
+
+/////////////////////////////////////////////////////////////////////////
+class MultiLenBlobStore::MyBuilder::Impl : boost::noncopyable {
+    // values of a fixed len class are written to a tmp file
+    struct ClassFile {
+        size_t         fixedLen; // without crc
+        size_t         num;
+        rank_select_il isClass;
+        std::string    fpath;
+        FileStream     file;
+        NativeDataOutput<OutputBuffer> writer;
+        ClassFile(size_t len, std::string path)
+          : fixedLen(len), num(0), fpath(std::move(path)), writer(&file) {
+            file.open(fpath, "wb+");
+            file.disbuf();
+        }
+        ~ClassFile() {
+            file.close();
+            ::remove(fpath.c_str());
+        }
+    };
+    std::vector<std::unique_ptr<ClassFile> > m_classes;
+    std::string m_fpath;
+    std::string m_fpath_var_len_offset;
+    FileStream m_file;
+    NativeDataOutput<OutputBuffer> m_writer;
+    std::unique_ptr<ClassFile> m_var_len; // fixedLen, isClass are unused
+    std::unique_ptr<UintVecMin0::Builder> m_var_len_offset_builder;
+    size_t m_offset;
+    size_t m_content_size_var_len;
+    size_t m_content_input_size_var_len;
+    size_t m_num_records;
+    int m_checksumLevel;
+    int m_checksumType;
+
+    size_t crc_len() const {
+        return 2 == m_checksumLevel
+             ? (kCRC16C == m_checksumType ? sizeof(uint16_t) : sizeof(uint32_t))
+             : 0;
+    }
+    void write_rec(NativeDataOutput<OutputBuffer>& writer, fstring rec) {
+        writer.ensureWrite(rec.data(), rec.size());
+        if (2 == m_checksumLevel) {
+            if (kCRC16C == m_checksumType) {
+                uint16_t crc = Crc16c_update(0, rec.data(), rec.size());
+                writer.ensureWrite(&crc, sizeof(crc));
+            } else {
+                uint32_t crc = Crc32c_update(0, rec.data(), rec.size());
+                writer.ensureWrite(&crc, sizeof(crc));
+            }
+        }
+    }
+    // append tmp file to m_file
+    size_t cat_file(ClassFile& f) {
+        f.writer.flush_buffer();
+        size_t size = f.file.tell();
+        f.file.rewind();
+        m_writer.flush_buffer();
+        m_file.cat(f.file.fp());
+        PadzeroForAlign<16>(m_writer, size);
+        return size;
+    }
+public:
+    Impl(const valvec<size_t>& fixedLens, size_t varLenContentSize, fstring fpath,
+         size_t offset, int checksumLevel, int checksumType)
+        : m_fpath(fpath.begin(), fpath.end())
+        , m_fpath_var_len_offset(m_fpath + ".varlen-offset")
+        , m_writer(&m_file)
+        , m_var_len_offset_builder(UintVecMin0::create_builder_by_max_value(
+            varLenContentSize, m_fpath_var_len_offset.c_str()))
+        , m_offset(offset)
+        , m_content_size_var_len(0)
+        , m_content_input_size_var_len(varLenContentSize)
+        , m_num_records(0)
+        , m_checksumLevel(checksumLevel)
+        , m_checksumType(checksumType) {
+        assert(offset % 8 == 0);
+        TERARK_VERIFY_LE(fixedLens.size(), MaxClasses);
+        for (size_t k = 0; k < fixedLens.size(); ++k) {
+            TERARK_VERIFY_LT(fixedLens[k] + crc_len(), UINT32_MAX);
+            for (size_t j = 0; j < k; ++j) {
+                TERARK_VERIFY_NE(fixedLens[j], fixedLens[k]);
+            }
+            m_classes.emplace_back(new ClassFile(fixedLens[k],
+                m_fpath + ".fixlen-" + std::to_string(k)));
+        }
+        m_var_len.reset(new ClassFile(size_t(-1), m_fpath + ".varlen"));
+        if (offset == 0) {
+            m_file.open(fpath, "wb");
+        }
+        else {
+            m_file.open(fpath, "rb+");
+            m_file.seek(offset);
+        }
+        FileHeader header;
+        m_writer.ensureWrite(&header, sizeof header);
+    }
+    ~Impl() {
+        m_var_len_offset_builder.reset();
+        ::remove(m_fpath_var_len_offset.c_str());
+    }
+    void add_record(fstring rec) {
+        size_t k = 0;
+        for (; k < m_classes.size(); ++k) {
+            auto& c = *m_classes[k];
+            if (c.fixedLen == rec.size()) {
+                c.isClass.push_back(true);
+                write_rec(c.writer, rec);
+                c.num++;
+                break;
+            }
+            c.isClass.push_back(false);
+        }
+        if (k == m_classes.size()) {
+            m_var_len_offset_builder->push_back(m_content_size_var_len);
+            write_rec(m_var_len->writer, rec);
+            m_content_size_var_len += rec.size() + crc_len();
+            m_var_len->num++;
+        }
+        ++m_num_records;
+    }
+    void finish() {
+        TERARK_VERIFY_LT(m_num_records, UINT32_MAX);
+        assert(m_content_size_var_len <= m_content_input_size_var_len);
+        const size_t crcLen = crc_len();
+        // bitmap of an empty class is all zero, dropping it does not change
+        // bitmaps of other classes
+        m_classes.erase(std::remove_if(m_classes.begin(), m_classes.end(),
+            [](const std::unique_ptr<ClassFile>& c) { return 0 == c->num; }),
+            m_classes.end());
+        if (0 == m_var_len->num && !m_classes.empty()) {
+            m_classes.back()->isClass.clear(); // all ones
+        }
+        size_t unzip_size = m_content_size_var_len;
+        valvec<ClassMeta> metas(m_classes.size(), valvec_reserve());
+        for (auto& c : m_classes) {
+            size_t size = cat_file(*c);
+            TERARK_VERIFY_EQ(size, (c->fixedLen + crcLen) * c->num);
+            unzip_size += size;
+            metas.push_back({uint32_t(c->fixedLen + crcLen), 0, c->num});
+        }
+        size_t var_len_uintbits = 0;
+        if (m_var_len->num) {
+            size_t size = cat_file(*m_var_len);
+            TERARK_VERIFY_EQ(size, m_content_size_var_len);
+            m_var_len_offset_builder->push_back(m_content_size_var_len);
+            auto build_result = m_var_len_offset_builder->finish();
+            var_len_uintbits = build_result.uintbits;
+            m_writer.flush_buffer();
+            m_file.cat(m_fpath_var_len_offset);
+        }
+        m_var_len_offset_builder.reset();
+        ::remove(m_fpath_var_len_offset.c_str());
+        for (size_t k = 0; k < m_classes.size(); ++k) {
+            auto& isClass = m_classes[k]->isClass;
+            if (isClass.size()) {
+                isClass.build_cache(false, false);
+                assert(isClass.mem_size() % 8 == 0);
+                m_writer.ensureWrite(isClass.data(), isClass.mem_size());
+                PadzeroForAlign<16>(m_writer, isClass.mem_size());
+                metas[k].isClassBytesDiv8 = uint32_t(isClass.mem_size() / 8);
+            }
+        }
+        m_writer.ensureWrite(metas.data(), metas.used_mem_size());
+        m_writer.flush_buffer();
+        size_t file_size = m_file.tell() + sizeof(BlobStoreFileFooter);
+        m_file.close();
+        FileStream(m_fpath, "rb+").chsize(file_size);
+
+        MmapWholeFile mmap(m_fpath, true);
+        fstring mem((const char*)mmap.base + m_offset, (ptrdiff_t)(file_size - m_offset));
+        FileHeader& header = *(FileHeader*)mem.data();
+        header = FileHeader();
+        header.fileSize = file_size - m_offset;
+        header.unzipSize = unzip_size;
+        header.records = m_num_records;
+        header.numClasses = uint08_t(m_classes.size());
+        if (m_var_len->num) {
+            header.offsetsUintBits = uint08_t(var_len_uintbits);
+            header.varLenBytes = m_content_size_var_len;
+            header.varNum = m_var_len->num;
+        }
+        header.checksumLevel = static_cast<uint8_t>(m_checksumLevel);
+        header.checksumType = static_cast<uint8_t>(m_checksumType);
+
+        BlobStoreFileFooter footer;
+        footer.fileXXHash =
+            XXHash64(g_mlbs_seed).update(mem.data(), mem.size() - sizeof(BlobStoreFileFooter)).digest();
+        ((BlobStoreFileFooter*)(mem.data() + mem.size()))[-1] = footer;
+        m_classes.clear();
+        m_var_len.reset();
+    }
+};
+
+MultiLenBlobStore::MyBuilder::~MyBuilder() {
+    delete impl;
+}
+MultiLenBlobStore::MyBuilder::MyBuilder(const valvec<size_t>& fixedLens,
+                                        size_t varLenContentSize,
+                                        size_t varLenContentCnt,
+                                        fstring fpath,
+                                        size_t offset,
+                                        int checksumLevel,
+                                        int checksumType) {
+    if (2 == checksumLevel) { // record level crc
+        if (kCRC16C == checksumType) {
+            varLenContentSize += sizeof(uint16_t) * varLenContentCnt;
+        } else {
+            varLenContentSize += sizeof(uint32_t) * varLenContentCnt;
+        }
+    }
+    impl = new Impl(fixedLens, varLenContentSize, fpath, offset, checksumLevel, checksumType);
+}
+void MultiLenBlobStore::MyBuilder::addRecord(fstring rec) {
+    assert(NULL != impl);
+    impl->add_record(rec);
+}
+void MultiLenBlobStore::MyBuilder::finish() {
+    assert(NULL != impl);
+    return impl->finish();
+}
+
+} // namespace terark
@@ -0,0 +1,92 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <terark/int_vector.hpp>
+#include <terark/zbs/abstract_blob_store.hpp>
+#include <terark/succinct/rank_select_il_256.hpp>
+
+namespace terark {
+
+/// Generalization of MixedLenBlobStore to multiple fixed length classes:
+/// records of each fixed length class are stored in a plain array without
+/// offsets, other records are stored as var length records with offsets.
+///
+/// The class of a record is found by a chain of rank select bitmaps: bitmap
+/// k is over records which are not in class 0..k-1, thus the total size of
+/// bitmaps is small when classes are ordered by record count descending,
+/// and accessing class k needs k + 1 rank ops, so classes are limited to
+/// MaxClasses.
+///
+/// Max records is limited by rank_select_il to 4G.
+class TERARK_DLL_EXPORT MultiLenBlobStore : public AbstractBlobStore {
+public:
+    static const size_t MaxClasses = 8;
+
+private:
+    struct FileHeader; friend struct FileHeader;
+    struct ClassMeta;
+    struct FixedLenClass {
+        size_t         fixedLen;      // include crc
+        size_t         num;
+        rank_select_il isClass;       // empty means all remain records
+        valvec<byte_t> values;
+    };
+    std::vector<FixedLenClass> m_classes;
+    size_t         m_crcLen;
+    valvec<byte_t> m_varLenValues;
+    UintVecMin0    m_varLenOffsets;
+
+    size_t locate(size_t recID, size_t* idInClass) const;
+    fstring var_record(size_t varLenRecID) const;
+    void verify_crc(const byte_t* pData, size_t len) const;
+    template<bool FiberVmPrefetch>
+    void get_record_append_imp(size_t recID, valvec<byte_t>* recData) const;
+    void fspread_record_append_imp(pread_func_t fspread, void* lambda,
+                                   size_t baseOffset, size_t recID,
+                                   valvec<byte_t>* recData,
+                                   valvec<byte_t>* rdbuf) const;
+    size_t get_zipped_size_imp(size_t recID, CacheOffsets*) const;
+    void set_func_ptr();
+
+public:
+    void init_from_memory(fstring dataMem, Dictionary dict) override;
+    void get_meta_blocks(valvec<Block>* blocks) const override;
+    void get_data_blocks(valvec<Block>* blocks) const override;
+    void detach_meta_blocks(const valvec<Block>& blocks) override;
+    void save_mmap(function<void(const void*, size_t)> write) const override;
+    using AbstractBlobStore::save_mmap;
+    size_t mem_size() const override;
+
+    MultiLenBlobStore();
+    ~MultiLenBlobStore();
+
+    size_t num_classes() const { return m_classes.size(); }
+    /// without crc
+    size_t class_fixed_len(size_t k) const { return m_classes[k].fixedLen - m_crcLen; }
+    size_t class_num(size_t k) const { return m_classes[k].num; }
+    size_t var_num() const { return m_varLenOffsets.size() ? m_varLenOffsets.size() - 1 : 0; }
+
+    void reorder_zip_data(ZReorderMap& newToOld,
+        function<void(const void* data, size_t size)> writeAppend,
+        fstring tmpFile) const override;
+
+    /// choose fixed lens from histogram of record lens, by count descending,
+    /// a len is chosen if its offsets cost more than the bitmap of its level
+    static valvec<size_t> choose_fixed_lens(const std::map<size_t, size_t>& lenHist,
+                                            size_t maxClasses = 8);
+
+    struct TERARK_DLL_EXPORT MyBuilder : public AbstractBlobStore::Builder {
+        class Impl; Impl* impl;
+    public:
+        /// fixedLens should be ordered by record count descending, fixed len
+        /// classes which have no records are dropped on finish
+        MyBuilder(const valvec<size_t>& fixedLens, size_t varLenContentSize,
+                  size_t varLenContentCnt, fstring fpath, size_t offset = 0,
+                  int checksumLevel = 3, int checksumType = 0);
+        virtual ~MyBuilder();
+        void addRecord(fstring rec) override;
+        void finish() override;
+    };
+};
+
+} // namespace terark
@@ -0,0 +1,82 @@
+#include "record_batch_pipeline.hpp"
+
+namespace terark {
+
+RecordBatchPipeline::Batch::~Batch() {}
+
+RecordBatchPipeline::RecordBatchPipeline(int threads,
+                                         const process_func_t& process,
+                                         const write_func_t& write,
+                                         size_t batchBytes,
+                                         size_t batchRecords)
+    : m_process(process)
+    , m_write(write)
+    , m_curr(nullptr)
+    , m_batchBytes(batchBytes)
+    , m_batchRecords(batchRecords)
+    , m_finished(false) {
+    TERARK_VERIFY_GT(threads, 0);
+    m_pipeline.setLogLevel(0);
+    m_pipeline.setQueueSize(2 * threads);
+    m_pipeline
+      | new FunPipelineStage(threads,
+        [this](PipelineStage*, int tno, PipelineQueueItem* item) {
+            m_errors.run([&]{ m_process(tno, static_cast<Batch*>(item->task)); });
+        }, "process")
+      | new FunPipelineStage(0, // 0 threads: serial, keep input order
+        [this](PipelineStage*, int, PipelineQueueItem* item) {
+            m_errors.run([&]{ m_write(static_cast<Batch*>(item->task)); });
+        }, "write");
+    m_pipeline.compile();
+}
+
+RecordBatchPipeline::~RecordBatchPipeline() {
+    if (!m_finished) {
+        m_errors.set_failed(); // discard pending batches
+        delete m_curr;
+        m_pipeline.stop();
+        m_pipeline.wait();
+    }
+}
+
+void RecordBatchPipeline::submit() {
+    Batch* batch = m_curr;
+    m_curr = nullptr;
+    m_pipeline.enqueue(batch);
+}
+
+void RecordBatchPipeline::add_record(fstring rec) {
+    assert(!m_finished);
+    if (terark_unlikely(m_errors.failed())) {
+        finish(); // rethrow
+    }
+    if (!m_curr) {
+        m_curr = new Batch();
+        m_curr->data.reserve(m_batchBytes);
+    }
+    m_curr->data.append(rec.data(), rec.size());
+    m_curr->offsets.push_back(m_curr->data.size());
+    if (m_curr->data.size() >= m_batchBytes || m_curr->num() >= m_batchRecords) {
+        submit();
+    }
+}
+
+void RecordBatchPipeline::finish() {
+    if (m_finished) {
+        return;
+    }
+    if (m_curr) {
+        if (m_errors.failed()) {
+            delete m_curr;
+            m_curr = nullptr;
+        } else {
+            submit();
+        }
+    }
+    m_pipeline.stop();
+    m_pipeline.wait();
+    m_finished = true;
+    m_errors.rethrow_first();
+}
+
+} // namespace terark
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <terark/fstring.hpp>
+#include <terark/valvec.hpp>
+#include <terark/thread/pipeline.hpp>
+#include <terark/util/function.hpp>
+
+namespace terark {
+
+/// Private pipeline of a blob store builder: records are batched, batches
+/// are processed(such as compressed) by `threads` threads, then written by
+/// one writer thread in input order, thus the output is same as the serial
+/// builder which processes and writes records one by one.
+class TERARK_DLL_EXPORT RecordBatchPipeline : boost::noncopyable {
+public:
+    class TERARK_DLL_EXPORT Batch : public PipelineTask {
+    public:
+        valvec<byte_t> data;     ///< input records
+        valvec<size_t> offsets;  ///< of records in data, size = num + 1
+        valvec<byte_t> obuf;     ///< output of process
+        valvec<size_t> ooffsets; ///< output of process, defined by user
+        Batch() { offsets.push_back(0); }
+        ~Batch() override;
+        size_t num() const { return offsets.size() - 1; }
+        fstring nth(size_t i) const {
+            assert(i < num());
+            return fstring(data.data() + offsets[i], offsets[i+1] - offsets[i]);
+        }
+    };
+    typedef function<void(int threadno, Batch*)> process_func_t;
+    typedef function<void(Batch*)> write_func_t;
+
+    RecordBatchPipeline(int threads, const process_func_t&, const write_func_t&,
+                        size_t batchBytes = 256*1024, size_t batchRecords = 4096);
+    ~RecordBatchPipeline();
+
+    void add_record(fstring rec);
+
+    /// process and write all records, rethrow the first exception of stages
+    void finish();
+
+private:
+    void submit();
+    PipelineProcessor m_pipeline;
+    process_func_t m_process;
+    write_func_t   m_write;
+    Batch*  m_curr;
+    size_t  m_batchBytes;
+    size_t  m_batchRecords;
+    bool    m_finished;
+    PipelineStageErrors m_errors;
+};
+
+} // namespace terark
@@ -7,6 +7,7 @@
 
 #include "zip_offset_blob_store.hpp"
 #include "blob_store_file_header.hpp"
+#include "record_batch_pipeline.hpp"
 #include "zip_reorder_map.hpp"
 #include <terark/io/FileStream.hpp>
 #include <terark/io/MemStream.hpp>
@@ -477,9 +478,79 @@ class ZipOffsetBlobStore::MyBuilder::Impl : boost::noncopyable {
     SeekableOutputStreamWrapper<FileMemIO*> m_memStream;
     NativeDataOutput<OutputBuffer> m_writer;
     valvec<byte_t> m_compressBuffer;
+    valvec<ZSTD_CCtx*> m_cctx; // one for each pipeline thread
+    std::unique_ptr<RecordBatchPipeline> m_pipeline;
     size_t m_offset;
     size_t m_content_size;
     Options m_options;
+
+    void init() {
+        std::aligned_storage<sizeof(FileHeader)>::type header;
+        memset(&header, 0, sizeof header);
+        m_writer.ensureWrite(&header, sizeof header);
+        if (m_options.compress_level <= 0) {
+            return;
+        }
+        // the pipeline is just for compression, same result as serial
+        m_cctx.resize(std::max(m_options.threads, 1), nullptr);
+        for (auto& cctx : m_cctx) {
+            cctx = ZSTD_createCCtx();
+            TERARK_VERIFY(nullptr != cctx);
+        }
+        if (m_options.threads > 0) {
+            m_pipeline.reset(new RecordBatchPipeline(m_options.threads,
+                [this](int tno, RecordBatchPipeline::Batch* batch) {
+                    auto& obuf = batch->obuf;
+                    obuf.reserve(batch->data.size() / 2);
+                    batch->ooffsets.resize_no_init(batch->num() + 1);
+                    batch->ooffsets[0] = 0;
+                    for (size_t i = 0, n = batch->num(); i < n; ++i) {
+                        fstring zrec = compress(tno, batch->nth(i));
+                        obuf.append(zrec.udata(), zrec.size());
+                        batch->ooffsets[i+1] = obuf.size();
+                    }
+                },
+                [this](RecordBatchPipeline::Batch* batch) {
+                    auto& offs = batch->ooffsets;
+                    for (size_t i = 0, n = batch->num(); i < n; ++i) {
+                        write_record(fstring(batch->obuf.data() + offs[i],
+                                             offs[i+1] - offs[i]));
+                    }
+                }));
+        }
+    }
+    // compress to m_compressBuffer of thread tno
+    fstring compress(int tno, fstring rec) {
+        thread_local valvec<byte_t> tls_buf;
+        auto& buf = m_pipeline ? tls_buf : m_compressBuffer;
+        buf.resize_no_init(ZSTD_compressBound(rec.size()));
+        // same as ZSTD_compress, which creates a context for each call
+        size_t zstd_size = ZSTD_compressCCtx(m_cctx[tno], buf.data(), buf.size(),
+                                             rec.data(), rec.size(),
+                                             m_options.compress_level - 1);
+        if (ZSTD_isError(zstd_size)) {
+              TERARK_THROW(std::logic_error
+                  , "ZipOffsetBlobStore::MyBuilder::add_record: error %s"
+                  , ZSTD_getErrorName(zstd_size));
+        }
+        return fstring(buf.data(), zstd_size);
+    }
+    void write_record(fstring rec) {
+        m_builder->push_back(m_content_size);
+        m_writer.ensureWrite(rec.data(), rec.size());
+        m_content_size += rec.size();
+        if (2 == m_options.checksum_level) {
+            if (kCRC16C == m_options.checksum_type) {
+                uint16_t crc = Crc16c_update(0, rec.data(), rec.size());
+                m_writer.ensureWrite(&crc, sizeof(crc));
+                m_content_size += sizeof(crc);
+            } else {
+                uint32_t crc = Crc32c_update(0, rec.data(), rec.size());
+                m_writer.ensureWrite(&crc, sizeof(crc));
+                m_content_size += sizeof(crc);
+            }
+        }
+    }
 public:
     Impl(fstring fpath, size_t offset, Options options)
         : m_fpath(fpath.begin(), fpath.end())
@@ -500,9 +571,7 @@ public:
           m_file.seek(offset);
         }
         m_file.disbuf();
-        std::aligned_storage<sizeof(FileHeader)>::type header;
-        memset(&header, 0, sizeof header);
-        m_writer.ensureWrite(&header, sizeof header);
+        init();
     }
     Impl(FileMemIO& mem, Options options)
         : m_fpath()
@@ -514,38 +583,28 @@ public:
         , m_offset(0)
         , m_content_size(0)
         , m_options(options) {
-        std::aligned_storage<sizeof(FileHeader)>::type header;
-        memset(&header, 0, sizeof header);
-        m_writer.ensureWrite(&header, sizeof header);
+        init();
+    }
+    ~Impl() {
+        m_pipeline.reset(); // before m_cctx
+        for (auto cctx : m_cctx) {
+            ZSTD_freeCCtx(cctx);
+        }
     }
     void add_record(fstring rec) {
-        if (m_options.compress_level > 0) {
-            m_compressBuffer.resize_no_init(ZSTD_compressBound(rec.size()));
-            size_t zstd_size = ZSTD_compress(m_compressBuffer.data(), m_compressBuffer.size(), rec.data(), rec.size(),
-                                             m_options.compress_level - 1);
-            if (ZSTD_isError(zstd_size)) {
-                  TERARK_THROW(std::logic_error
-                      , "ZipOffsetBlobStore::MyBuilder::add_record: error %s"
-                      , ZSTD_getErrorName(zstd_size));
-            }
-            rec = fstring(m_compressBuffer.data(), zstd_size);
+        if (m_pipeline) {
+            m_pipeline->add_record(rec);
+            return;
         }
-        m_builder->push_back(m_content_size);
-        m_writer.ensureWrite(rec.data(), rec.size());
-        m_content_size += rec.size();
-        if (2 == m_options.checksum_level) {
-            if (kCRC16C == m_options.checksum_type) {
-                uint16_t crc = Crc16c_update(0, rec.data(), rec.size());
-                m_writer.ensureWrite(&crc, sizeof(crc));
-                m_content_size += sizeof(crc);
-            } else {
-                uint32_t crc = Crc32c_update(0, rec.data(), rec.size());
-                m_writer.ensureWrite(&crc, sizeof(crc));
-                m_content_size += sizeof(crc);
-            }
+        if (m_options.compress_level > 0) {
+            rec = compress(0, rec);
         }
+        write_record(rec);
     }
     void finish() {
+        if (m_pipeline) {
+            m_pipeline->finish();
+        }
         PadzeroForAlign<16>(m_writer, m_content_size);
         m_builder->push_back(m_content_size);
         if (m_file.fp() == nullptr) {
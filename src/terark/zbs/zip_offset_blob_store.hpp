@@ -36,11 +36,12 @@ public:
     ~ZipOffsetBlobStore();
 
     struct Options {
-      Options() : block_units(128), compress_level(0), checksum_level(3), checksum_type(0) {}
+      Options() : block_units(128), compress_level(0), checksum_level(3), checksum_type(0), threads(0) {}
       int block_units;
       int compress_level;
       int checksum_level;
       int checksum_type;
+      int threads; // compress records by a pipeline, 0 means in the caller's thread
     };
 
     void swap(ZipOffsetBlobStore& other);
@@ -1,25 +1,144 @@
-
 #include "zip_reorder_map.hpp"
 
 namespace terark {
 
+void ZReorderMap::init_() {
+    fstring data = data_();
+    if (data.size() < 16) {
+        THROW_STD(out_of_range, "ZReorderMap rewind out_of_range");
+    }
+    it_.end_ = (const byte_t*)data.end();
+    memcpy(&it_.size_, data.data(), sizeof(size_t));
+    memcpy(&it_.sign_, data.data() + sizeof(size_t), sizeof(intptr_t));
+    index_.reset(new SampleIndex());
+    rewind();
+}
+
+ZReorderMap::ZReorderMap(Builder& finished) {
+    TERARK_VERIFY(finished.in_memory_);
+    TERARK_VERIFY_EZ(finished.size_);
+    auto& mem = finished.mem_writer_;
+    mem_.risk_set_data(mem.begin(), mem.tell());
+    mem_.risk_set_capacity(mem.capacity());
+    mem.risk_release_ownership();
+    init_();
+}
+
+ZReorderMap::ZReorderMap(ZReorderMap&& y) noexcept
+    : it_(y.it_), index_(std::move(y.index_)) {
+    file_.swap(y.file_);
+    mem_.swap(y.mem_);
+    y.it_ = Iterator();
+}
+
+ZReorderMap& ZReorderMap::operator=(ZReorderMap&& y) noexcept {
+    if (this != &y) {
+        file_.swap(y.file_);
+        mem_.swap(y.mem_);
+        std::swap(it_, y.it_);
+        index_.swap(y.index_);
+    }
+    return *this;
+}
+
+ZReorderMap::~ZReorderMap() {
+}
+
+const ZReorderMap::SampleIndex& ZReorderMap::index_ref_() const {
+    TERARK_VERIFY(nullptr != index_); // moved from
+    SampleIndex& x = *index_;
+    std::call_once(x.once, [&]() {
+        auto id_builder = std::unique_ptr<SortedUintVec::Builder>(
+            SortedUintVec::createBuilder(64));
+        auto pos_builder = std::unique_ptr<SortedUintVec::Builder>(
+            SortedUintVec::createBuilder(64));
+        fstring data = data_();
+        Iterator it = it_;
+        it.pos_ = (const byte_t*)data.data() + 16;
+        size_t runs = 0;
+        for (size_t id = 0; id < it.size_; id += it.seq_length_, runs++) {
+            if (runs % kSampleRuns == 0) {
+                id_builder->push_back(id);
+                pos_builder->push_back(it.pos_ - (const byte_t*)data.data());
+            }
+            it.read_();
+        }
+        id_builder->finish(&x.id);
+        pos_builder->finish(&x.pos);
+        x.num_runs = runs;
+    });
+    return x;
+}
+
+ZReorderMap::Iterator ZReorderMap::iter(size_t i) const {
+    TERARK_VERIFY_LE(i, it_.size_);
+    fstring data = data_();
+    Iterator it = it_;
+    it.pos_ = (const byte_t*)data.data() + 16;
+    it.i_ = 0;
+    if (0 == i) {
+        if (it.size_)
+            it.read_();
+        return it;
+    }
+    const SampleIndex& x = index_ref_();
+    size_t k = x.id.upper_bound(0, x.id.size(), i) - 1;
+    size_t id = x.id[k];
+    it.pos_ = (const byte_t*)data.data() + x.pos[k];
+    it.read_();
+    while (id + it.seq_length_ <= i && id + it.seq_length_ < it.size_) {
+        id += it.seq_length_;
+        it.read_();
+    }
+    if (i == it.size_) { // eof
+        it.i_ = i;
+        return it;
+    }
+    it.current_value_ += (i - id) * it.sign_;
+    it.seq_length_ -= i - id;
+    it.i_ = i;
+    return it;
+}
+
+size_t ZReorderMap::num_runs() const {
+    return index_ref_().num_runs;
+}
+
+ZReorderMap::Builder::Builder(size_t size, int sign)
+    : writer_(&file_)
+    , base_value_(SIZE_MAX)
+    , seq_length_(0)
+    , sign_(sign)
+    , size_(size)
+    , in_memory_(true) {
+    TERARK_VERIFY_F(sign == 1 || sign == -1, "real: %d", sign);
+    mem_writer_ << size << sign_;
+}
 
 ZReorderMap::Builder::~Builder() {
 }
 
+void ZReorderMap::Builder::put_run_() {
+    size_t current_value = base_value_ << 1 | (seq_length_ == 1 ? 1 : 0);
+    if (in_memory_) {
+        mem_writer_.ensureWrite(&current_value, 5);
+        if (seq_length_ > 1)
+            mem_writer_ << var_uint64_t(seq_length_);
+    }
+    else {
+        writer_.ensureWrite(&current_value, 5);
+        if (seq_length_ > 1)
+            writer_ << var_uint64_t(seq_length_);
+    }
+}
+
 void ZReorderMap::Builder::push_back(size_t value) {
     assert(size_ > 0);
     assert(value <= 0x7FFFFFFFFFULL);
     size_t next_value = size_t(intptr_t(base_value_) + intptr_t(seq_length_) * sign_);
     if (value != next_value) {
-        if (seq_length_ > 1) {
-            size_t current_value = base_value_ << 1;
-            writer_.ensureWrite(&current_value, 5);
-            writer_ << var_uint64_t(seq_length_);
-        }
-        else if (seq_length_ == 1) {
-            size_t current_value = (base_value_ << 1) | 1;
-            writer_.ensureWrite(&current_value, 5);
+        if (seq_length_ > 0) {
+            put_run_();
         }
         base_value_ = value;
         seq_length_ = 1;
@@ -32,17 +151,13 @@ void ZReorderMap::Builder::push_back(size_t value) {
 
 void ZReorderMap::Builder::finish() {
     assert(size_ == 0);
-    if (seq_length_ > 1) {
-        size_t current_value = base_value_ << 1;
-        writer_.ensureWrite(&current_value, 5);
-        writer_ << var_uint64_t(seq_length_);
+    if (seq_length_ > 0) {
+        put_run_();
     }
-    else if (seq_length_ == 1) {
-        size_t current_value = (base_value_ << 1) | 1;
-        writer_.ensureWrite(&current_value, 5);
+    if (!in_memory_) {
+        writer_.flush_buffer();
+        file_.flush();
     }
-    writer_.flush_buffer();
-    file_.flush();
 }
 
 } // namespace terark
@@ -3,92 +3,145 @@
 #include <terark/io/DataOutput.hpp>
 #include <terark/io/StreamBuffer.hpp>
 #include <terark/io/FileStream.hpp>
+#include <terark/io/MemStream.hpp>
 #include <terark/io/var_int_inline.hpp>
 #include <terark/util/mmap.hpp>
+#include <terark/util/sorted_uint_vec.hpp>
+#include <memory>
+#include <mutex>
 
 namespace terark {
 
+/// new id to old id map, stored as runs: 5 bytes (value << 1 | isSingle),
+/// followed by var_uint run length if the run is not single, each run is
+/// value, value + sign, value + 2*sign, ...
+///
+/// The map is used as a forward cursor(eof, *, ++, rewind), and also can be
+/// random accessed by operator[], seek and iter, which use a sample index
+/// (run start ids and positions of every kSampleRuns runs in SortedUintVec)
+/// built on first random access, so chunks can be iterated in parallel.
+/// The sample index is not persisted, the file format is unchanged, it is
+/// rebuilt in memory by one scan of runs after each open.
+///
+/// Movable, not copyable.
 class TERARK_DLL_EXPORT ZReorderMap {
-private:
-    terark::MmapWholeFile file_;
-    const byte_t *pos_ = nullptr;
-    size_t current_value_ = SIZE_MAX;
-    size_t seq_length_ = 0;
-    size_t size_ = 0;
-    size_t i_ = 0;
-    intptr_t sign_ = 0;
-private:
-    void read_() {
-        current_value_ = 0;
-        if (pos_ + 5 > (const byte_t*)file_.base + file_.size) {
-            THROW_STD(out_of_range, "ZReorderMap read value out of range");
-        }
-        memcpy(&current_value_, pos_, 5);
-        pos_ += 5;
-        if (current_value_ & 1) {
-            seq_length_ = 1;
-        }
-        else {
-            seq_length_ = gg_load_var_uint<size_t>(pos_, &pos_, BOOST_CURRENT_FUNCTION);
-            if (pos_ > (const byte_t*)file_.base + file_.size) {
-                THROW_STD(out_of_range, "ZReorderMap read seq out of range");
+public:
+    static const size_t kSampleRuns = 64;
+
+    /// independent cursor, multiple iterators can be used concurrently
+    class TERARK_DLL_EXPORT Iterator {
+        friend class ZReorderMap;
+        const byte_t* pos_ = nullptr;
+        const byte_t* end_ = nullptr;
+        size_t current_value_ = SIZE_MAX;
+        size_t seq_length_ = 0;
+        size_t size_ = 0;
+        size_t i_ = 0;
+        intptr_t sign_ = 0;
+        void read_() {
+            current_value_ = 0;
+            if (pos_ + 5 > end_) {
+                THROW_STD(out_of_range, "ZReorderMap read value out of range");
+            }
+            memcpy(&current_value_, pos_, 5);
+            pos_ += 5;
+            if (current_value_ & 1) {
+                seq_length_ = 1;
             }
+            else {
+                seq_length_ = gg_load_var_uint<size_t>(pos_, &pos_, BOOST_CURRENT_FUNCTION);
+                if (pos_ > end_) {
+                    THROW_STD(out_of_range, "ZReorderMap read seq out of range");
+                }
+            }
+            current_value_ >>= 1;
         }
-        current_value_ >>= 1;
-    }
-public:
-    bool eof() const {
-        assert(i_ <= size_);
-        return i_ == size_;
-    }
-    size_t size() const {
-        return size_;
-    }
-    size_t index() const {
-        assert(i_ < size_);
-        return i_;
-    }
-    size_t operator*() const {
-        return current_value_;
-    }
-    ZReorderMap& operator++() {
-        assert(i_ < size_);
-        assert(seq_length_ > 0);
-        ++i_;
-        (intptr_t&)current_value_ += sign_;
-        if (--seq_length_ == 0 && i_ < size_) {
-            read_();
+    public:
+        bool eof() const {
+            assert(i_ <= size_);
+            return i_ == size_;
         }
-        return *this;
-    }
-    void rewind() {
-        if (file_.size < 16) {
-            THROW_STD(out_of_range, "ZReorderMap rewind out_of_range");
+        size_t index() const {
+            assert(i_ < size_);
+            return i_;
+        }
+        size_t operator*() const {
+            return current_value_;
         }
-        pos_ = (const byte_t*)file_.base;
-        memcpy(&size_, pos_, sizeof(size_t));
-        pos_ += sizeof(size_t);
-        memcpy(&sign_, pos_, sizeof(ptrdiff_t));
-        pos_ += sizeof(ptrdiff_t);
-        i_ = 0;
-        if (i_ < size_) {
-            read_();
+        Iterator& operator++() {
+            assert(i_ < size_);
+            assert(seq_length_ > 0);
+            ++i_;
+            (intptr_t&)current_value_ += sign_;
+            if (--seq_length_ == 0 && i_ < size_) {
+                read_();
+            }
+            return *this;
         }
+    };
+
+private:
+    terark::MmapWholeFile file_;
+    valvec<byte_t> mem_; // data of in memory builder
+    Iterator it_;
+    struct SampleIndex {
+        std::once_flag once;
+        SortedUintVec  id;  // start id of every kSampleRuns runs
+        SortedUintVec  pos; // start position of these runs
+        size_t         num_runs = 0;
+    };
+    std::unique_ptr<SampleIndex> index_; // built by first random access
+    void init_();
+    const SampleIndex& index_ref_() const;
+    fstring data_() const {
+        return mem_.empty() ? fstring((const char*)file_.base, file_.size)
+                            : fstring(mem_);
     }
+public:
+    class Builder;
+
+    bool eof() const { return it_.eof(); }
+    size_t size() const { return it_.size_; }
+    size_t index() const { return it_.index(); }
+    size_t operator*() const { return *it_; }
+    ZReorderMap& operator++() { ++it_; return *this; }
+    void rewind() { it_ = iter(0); }
+
+    /// move the cursor to new id i, i == size() is eof
+    void seek(size_t i) { it_ = iter(i); }
+
+    /// an independent cursor at new id i, O(log(runs) + kSampleRuns)
+    Iterator iter(size_t i) const;
+
+    /// old id of new id i
+    size_t operator[](size_t i) const { return *iter(i); }
+
+    /// number of runs, generally a reordered map has far fewer runs than ids
+    size_t num_runs() const;
+
     template<class ...args_t>
     ZReorderMap(args_t&& ...args)
         : file_(std::forward<args_t>(args)...) {
-        rewind();
+        init_();
     }
+    /// take the data of a finished in memory Builder
+    explicit ZReorderMap(Builder& finished);
+    ZReorderMap(ZReorderMap&& y) noexcept;
+    ZReorderMap& operator=(ZReorderMap&& y) noexcept;
+    ~ZReorderMap();
 
     class TERARK_DLL_EXPORT Builder {
       private:
         FileStream file_;
         NativeDataOutput<OutputBuffer> writer_;
+        NativeDataOutput<AutoGrownMemIO> mem_writer_; // in memory builder
         size_t base_value_;
         size_t seq_length_;
         intptr_t sign_;
         size_t size_;
+        bool in_memory_;
+        void put_run_();
+        friend class ZReorderMap;
         public:
         template<class ...args_t>
         Builder(size_t size, int sign, args_t&& ...args)
@@ -97,11 +150,15 @@ public:
             , base_value_(SIZE_MAX)
             , seq_length_(0)
             , sign_(sign)
-            , size_(size) {
+            , size_(size)
+            , in_memory_(false) {
             TERARK_VERIFY_F(sign == 1 || sign == -1, "real: %d", sign);
             file_.disbuf();
             writer_ << size << sign_;
         }
+        /// in memory builder, no tmp file, use ZReorderMap(Builder&) after
+        /// finish, for small maps
+        Builder(size_t size, int sign);
         ~Builder();
         void push_back(size_t value);
         void finish();
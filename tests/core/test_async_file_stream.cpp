@@ -0,0 +1,130 @@
+#include <terark/io/AsyncFileStream.hpp>
+#include <terark/io/FileStream.hpp>
+#include <terark/util/throw.hpp>
+#include <atomic>
+#include <random>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+using namespace terark;
+
+// interposes libc pread, when enabled, a read returns at most 1/3 of len
+// (4K aligned for O_DIRECT), the io thread engine then sees short reads
+static std::atomic<bool> g_short_read{false};
+static std::atomic<size_t> g_short_read_cnt{0};
+extern "C" ssize_t pread(int fd, void* buf, size_t len, off_t offset) {
+    if (g_short_read && len > 4096) {
+        len = std::max<size_t>(4096, len / 3 / 4096 * 4096);
+        g_short_read_cnt++;
+    }
+    return syscall(SYS_pread64, fd, buf, len, offset);
+}
+
+static void check_file(const char* fpath, const valvec<byte_t>& data) {
+    FileStream fp(fpath, "rb");
+    TERARK_VERIFY_EQ(fp.fsize(), data.size());
+    valvec<byte_t> got(data.size());
+    fp.ensureRead(got.data(), got.size());
+    TERARK_VERIFY(memcmp(got.data(), data.data(), data.size()) == 0);
+}
+
+static void test_write_read(const char* fpath, const valvec<byte_t>& data,
+                            bool direct) {
+    std::mt19937 rng(direct);
+    {
+        AsyncFileOutputStream os(fpath, 64*1024, 3, direct);
+        printf("direct = %d, uring = %d\n", os.isDirect(), os.isUring());
+        for (size_t pos = 0; pos < data.size(); ) {
+            size_t len = std::min<size_t>(rng() % 100000, data.size() - pos);
+            os.ensureWrite(data.data() + pos, len);
+            pos += len;
+            if (rng() % 16 == 0)
+                os.flush(); // partial and unaligned buffer
+        }
+        TERARK_VERIFY_EQ(os.tell(), llong(data.size()));
+        os.close();
+    }
+    check_file(fpath, data);
+
+    AsyncFileInputStream is(fpath, 64*1024, 3, direct);
+    TERARK_VERIFY_EQ(is.fsize(), llong(data.size()));
+    valvec<byte_t> got(data.size() + 100);
+    size_t pos = 0;
+    while (!is.eof()) {
+        size_t len = rng() % 100000;
+        pos += is.read(got.data() + pos, std::min(len, got.size() - pos));
+    }
+    TERARK_VERIFY_EQ(pos, data.size());
+    TERARK_VERIFY(memcmp(got.data(), data.data(), data.size()) == 0);
+    is.close();
+}
+
+int main(int argc, char* argv[]) {
+    size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 3000000;
+    const char* fpath = "test_async_file_stream.bin";
+    valvec<byte_t> data(num);
+    std::mt19937 rng(12345);
+    for (auto& b : data) b = byte_t(rng());
+
+    test_write_read(fpath, data, false);
+    test_write_read(fpath, data, true);
+
+    // attached fd, writing and reading start at unaligned pos
+    for (int flags : {O_RDWR, O_RDWR|O_DIRECT}) {
+        int fd = ::open(fpath, flags);
+        if (fd < 0 && (flags & O_DIRECT))
+            continue; // O_DIRECT is not supported
+        TERARK_VERIFY_GE(fd, 0);
+        size_t len = std::min<size_t>(100000, num / 2);
+        size_t start = std::min<size_t>(5000, num - len);
+        AsyncFileOutputStream os(fd, start, 16*1024, 2);
+        os.ensureWrite(data.data() + num - len, len);
+        os.close();
+        memmove(data.data() + start, data.data() + num - len, len);
+        AsyncFileInputStream is(fd, start, 16*1024, 2);
+        valvec<byte_t> got(len);
+        is.ensureRead(got.data(), got.size());
+        TERARK_VERIFY(memcmp(got.data(), data.data() + start, len) == 0);
+        is.close();
+        ::close(fd);
+        check_file(fpath, data);
+    }
+
+    // short reads are completed, no bytes are skipped
+    for (bool direct : {false, true}) {
+        {
+            AsyncFileOutputStream os(fpath, 64*1024, 3, direct);
+            os.ensureWrite(data.data(), data.size());
+            os.close();
+        }
+        g_short_read = true;
+        g_short_read_cnt = 0;
+        AsyncFileInputStream is(fpath, 64*1024, 3, direct);
+        valvec<byte_t> got(data.size());
+        is.ensureRead(got.data(), got.size());
+        TERARK_VERIFY(memcmp(got.data(), data.data(), data.size()) == 0);
+        char c;
+        TERARK_VERIFY_EQ(is.read(&c, 1), 0);
+        is.close();
+        g_short_read = false;
+        printf("direct = %d, uring = %d, short reads = %zd\n",
+               is.isDirect(), is.isUring(), g_short_read_cnt.load());
+        if (!is.isUring() && data.size() > 4096)
+            TERARK_VERIFY_GT(g_short_read_cnt, 0);
+    }
+
+    // empty file
+    {
+        AsyncFileOutputStream os(fpath);
+        os.close();
+        AsyncFileInputStream is(fpath);
+        char buf[16];
+        TERARK_VERIFY_EQ(is.read(buf, sizeof(buf)), 0);
+        TERARK_VERIFY(is.eof());
+    }
+    ::remove(fpath);
+    printf("passed\n");
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <terark/concurrent_hash_strmap.hpp>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+using namespace terark;
+
+int main(int argc, char* argv[]) {
+    size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+    size_t thr = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+    concurrent_hash_strmap<uint32_t> map(16);
+    std::atomic<uint32_t> next_id{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thr; ++t) {
+        threads.emplace_back([&,t]() {
+            for (size_t i = 0; i < num; ++i) {
+                // all threads insert same keys in different order
+                std::string k = "key-" + std::to_string((i * 7 + t * 13) % num);
+                auto ib = map.lazy_insert(k, [&]{ return next_id++; });
+                TERARK_VERIFY(nullptr != ib.first);
+                TERARK_VERIFY(map.find(k) == ib.first);
+            }
+        });
+    }
+    // pure readers, tables they are scanning must not be freed by grow
+    std::atomic<bool> stop{false};
+    std::thread reader([&]() {
+        size_t i = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            std::string k = "key-" + std::to_string(i++ % num);
+            if (auto v = map.find(k))
+                TERARK_VERIFY_LT(*v, num);
+        }
+    });
+    for (auto& t : threads) t.join();
+    stop = true;
+    reader.join();
+    TERARK_VERIFY_EQ(map.size(), num);
+    TERARK_VERIFY_EQ(next_id.load(), num);
+    std::vector<bool> seen(num);
+    size_t cnt = 0;
+    map.for_each([&](fstring key, uint32_t id) {
+        TERARK_VERIFY_LT(id, num);
+        TERARK_VERIFY(!seen[id]);
+        TERARK_VERIFY_EQ(*map.find(key), id);
+        seen[id] = true;
+        cnt++;
+    });
+    TERARK_VERIFY_EQ(cnt, num);
+    TERARK_VERIFY(!map.exists("not-existed"));
+    auto ms = map.mem_stat();
+    TERARK_VERIFY_LT(ms.retired_size, ms.table_size);
+    map.reclaim_retired(); // no readers now, all are freed
+    TERARK_VERIFY_EQ(map.mem_stat().retired_size, 0);
+    // grow reclaims retired tables by itself when readers have quiesced
+    for (size_t i = 0; i < num; ++i)
+        map.insert("more-" + std::to_string(i), uint32_t(num + i));
+    TERARK_VERIFY_EQ(map.size(), 2 * num);
+    TERARK_VERIFY_EQ(map.mem_stat().retired_size, 0);
+    printf("passed\n");
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <terark/util/ext_sort.hpp>
+#include <terark/util/throw.hpp>
+#include <terark/util/profiling.hpp>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+using namespace terark;
+
+static void test(size_t num, size_t mem_limit, int max_ways, int threads) {
+	std::mt19937_64 rng(num + mem_limit);
+	std::vector<std::string> strs(num);
+	ExternalStrSorter::Options opt;
+	opt.mem_limit = mem_limit;
+	opt.max_ways = max_ways;
+	opt.threads = threads;
+	opt.read_buf_size = 16 << 10;
+	opt.tmp_dir = ".";
+	ExternalStrSorter sorter(opt);
+	for (auto& s : strs) {
+		size_t len = rng() % 20;
+		for (size_t j = 0; j < len; ++j)
+			s.push_back('a' + rng() % 4); // many dups and common prefixes
+		sorter.push_back(s);
+	}
+	TERARK_VERIFY_EQ(sorter.size(), num);
+	size_t runs = sorter.num_runs();
+	std::sort(strs.begin(), strs.end());
+	size_t i = 0;
+	sorter.merge([&](fstring s) {
+		TERARK_VERIFY_LT(i, num);
+		TERARK_VERIFY(s == strs[i]);
+		i++;
+	});
+	TERARK_VERIFY_EQ(i, num);
+	TERARK_VERIFY_EQ(sorter.size(), 0);
+	printf("num = %zd, mem_limit = %zd, max_ways = %d, threads = %d, runs = %zd\n",
+		num, mem_limit, max_ways, threads, runs);
+}
+
+static void test_strvec(size_t num) {
+	std::mt19937_64 rng(num);
+	FixedLenStrVec fixed(8);
+	SortableStrVec expected;
+	for (size_t i = 0; i < num; ++i) {
+		uint64_t x = rng() % 1000;
+		fixed.push_back(fstring((char*)&x, 8));
+		expected.push_back(fstring((char*)&x, 8));
+	}
+	expected.sort();
+	ExternalStrSorter::Options opt;
+	opt.mem_limit = 64 << 10;
+	opt.tmp_dir = ".";
+	ExternalStrSorter sorter(opt);
+	sorter.append(fixed);
+	SortableStrVec out;
+	sorter.merge(&out);
+	TERARK_VERIFY_EQ(out.size(), num);
+	for (size_t i = 0; i < num; ++i)
+		TERARK_VERIFY(out[i] == expected[i]);
+}
+
+int main(int argc, char* argv[]) {
+	for (size_t num : {0, 1, 10, 10000, 100000}) {
+		test(num, size_t(1) << 30, 128, 3); // in memory
+		test(num, 64 << 10, 128, 3);        // one merge pass
+		test(num, 64 << 10, 3, 1);          // multi pass
+	}
+	test_strvec(50000);
+	size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	for (int threads : {1, 4}) {
+		ExternalStrSorter::Options opt;
+		opt.mem_limit = 16 << 20;
+		opt.threads = threads;
+		opt.tmp_dir = ".";
+		ExternalStrSorter sorter(opt);
+		std::mt19937_64 rng(1);
+		profiling pf;
+		long long t0 = pf.now();
+		for (size_t i = 0; i < num; ++i) {
+			char buf[32];
+			int len = snprintf(buf, sizeof(buf), "%016llx", (long long)rng());
+			sorter.push_back(fstring(buf, len));
+		}
+		size_t runs = sorter.num_runs();
+		long long t1 = pf.now();
+		size_t cnt = 0;
+		sorter.merge([&](fstring) { cnt++; });
+		long long t2 = pf.now();
+		TERARK_VERIFY_EQ(cnt, num);
+		printf("bench: threads = %d, runs = %zd, push+spill %.3f sec, merge %.3f sec\n",
+			threads, runs, pf.sf(t0,t1), pf.sf(t1,t2));
+	}
+	printf("passed\n");
+	return 0;
+}
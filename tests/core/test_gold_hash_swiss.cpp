@@ -0,0 +1,65 @@
+#include <terark/gold_hash_swiss.hpp>
+#include <terark/fstring.hpp>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <stdio.h>
+
+using namespace terark;
+
+template<class Map>
+void check_same(const Map& m, const std::unordered_map<std::string, long>& ref) {
+    TERARK_VERIFY_EQ(m.size(), ref.size());
+    for (auto& kv : ref) {
+        size_t idx = m.find_i(kv.first);
+        TERARK_VERIFY_LT(idx, m.end_i());
+        TERARK_VERIFY_EQ(m.val(idx), kv.second);
+    }
+    size_t cnt = 0;
+    for (auto& kv : m) {
+        TERARK_VERIFY_EQ(ref.count(kv.first), 1);
+        cnt++;
+    }
+    TERARK_VERIFY_EQ(cnt, ref.size());
+}
+
+int main(int argc, char* argv[]) {
+    size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    std::mt19937_64 rnd(12345);
+    gold_swiss_map<std::string, long> m;
+    std::unordered_map<std::string, long> ref;
+    for (size_t i = 0; i < num; ++i) {
+        std::string k = std::to_string(rnd() % (num * 2));
+        long v = long(i);
+        switch (rnd() % 4) {
+        default:
+            m[k] = v;
+            ref[k] = v;
+            break;
+        case 3:
+            TERARK_VERIFY_EQ(m.erase(k), ref.erase(k));
+            break;
+        }
+    }
+    check_same(m, ref);
+
+    gold_swiss_map<std::string, long> m2 = m;
+    check_same(m2, ref);
+
+    m.revoke_deleted();
+    TERARK_VERIFY_EQ(m.delcnt(), 0);
+    check_same(m, ref);
+
+    for (auto& kv : ref) m.erase(kv.first);
+    TERARK_VERIFY(m.empty());
+    for (auto& kv : ref) TERARK_VERIFY(!m.exists(kv.first));
+
+    gold_swiss_set<long> s;
+    for (long i = 0; i < long(num); ++i) TERARK_VERIFY(s.insert_i(i).second);
+    for (long i = 0; i < long(num); ++i) TERARK_VERIFY(!s.insert_i(i).second);
+    for (long i = 0; i < long(num); i += 2) s.erase(i);
+    for (long i = 0; i < long(num); ++i) TERARK_VERIFY_EQ(s.exists(i), i % 2 == 1);
+
+    printf("passed\n");
+    return 0;
+}
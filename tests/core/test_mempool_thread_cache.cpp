@@ -0,0 +1,82 @@
+#include <terark/mempool_thread_cache.hpp>
+#include <terark/fstring.hpp>
+#include <terark/util/throw.hpp>
+#include <thread>
+#include <stdio.h>
+
+using namespace terark;
+
+int main(int argc, char* argv[]) {
+    size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    size_t len = 64;
+    if (!getEnvBool("ThreadCacheMemPool_remoteFree")) {
+        // by default, blocks freed by another thread stay in that thread
+        ThreadCacheMemPool<8> mp0(1024);
+        mp0.reserve(size_t(64) << 20);
+        size_t pos = mp0.alloc(len);
+        std::thread([&] {
+            mp0.sfree(pos, len);
+            TERARK_VERIFY_EQ(mp0.get_tls()->m_remote_out, 0);
+        }).join();
+        TERARK_VERIFY_EQ(mp0.get_tls()->remote_pending_len(), 0);
+        TERARK_VERIFY_EQ(mp0.get_depot_len(), 0);
+    }
+    ThreadCacheMemPool<8> mp(1024);
+    mp.m_remote_free = true; // opt-in
+    mp.m_fastbin_rebalance = true;
+    mp.reserve(size_t(1) << 30);
+    valvec<size_t> blocks(num, valvec_reserve());
+
+    // blocks freed by another thread go back to the allocating thread
+    for (size_t i = 0; i < num; ++i) {
+        blocks.push_back(mp.alloc(len));
+        memset(mp.data() + blocks.back(), 0xAB, len);
+    }
+    size_t size1 = mp.size();
+    std::thread([&] {
+        for (size_t pos : blocks) mp.sfree(pos, len);
+        TERARK_VERIFY_EQ(mp.get_tls()->m_remote_out, num * len);
+    }).join();
+    auto self = mp.get_tls();
+    TERARK_VERIFY_EQ(self->remote_pending_len(), num * len);
+    blocks.erase_all();
+    for (size_t i = 0; i < num; ++i) {
+        blocks.push_back(mp.alloc(len));
+    }
+    TERARK_VERIFY_EQ(self->remote_pending_len(), 0);
+    TERARK_VERIFY_EQ(self->m_remote_in, num * len);
+    TERARK_VERIFY_EQ(mp.size(), size1);
+
+    // surplus fastbin of this thread is shared to other threads by depot
+    for (size_t pos : blocks) mp.sfree(pos, len);
+    TERARK_VERIFY_GT(mp.get_depot_len(), 0);
+    std::thread([&] {
+        for (size_t i = 0; i < num / 2; ++i) mp.alloc(len);
+        TERARK_VERIFY_GT(mp.get_tls()->m_depot_get, 0);
+    }).join();
+    TERARK_VERIFY_EQ(mp.size(), size1);
+
+    valvec<size_t> each;
+    valvec<valvec<size_t> > fast;
+    size_t free_size = mp.slow_get_free_size(&each);
+    mp.get_fastbin(&fast);
+    TERARK_VERIFY_EQ(free_size, mp.slow_get_free_size());
+    TERARK_VERIFY_EQ(each.size(), 2);
+    TERARK_VERIFY_EQ(fast.size(), 2);
+    mp.print_stat(stdout);
+
+    // chunks are bound to numa node of the allocating thread
+    ThreadCacheMemPool<8> numa_mp(1024);
+    numa_mp.m_numa_local = true;
+    numa_mp.reserve(size_t(64) << 20);
+    numa_mp.alloc(len);
+    valvec<size_t> numa_len;
+    numa_mp.get_numa_stat(&numa_len);
+    size_t numa_sum = 0;
+    for (size_t x : numa_len) numa_sum += x;
+    TERARK_VERIFY(numa_sum > 0 || numa_mp.m_numa_bind_fail_cnt > 0);
+    numa_mp.print_stat(stdout);
+
+    printf("passed\n");
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <terark/util/mpmc_ring_queue.hpp>
+#include <terark/valvec.hpp>
+#include <atomic>
+#include <thread>
+#include <stdio.h>
+
+using namespace terark;
+
+int main(int argc, char* argv[]) {
+    size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    const size_t producers = 4, consumers = 4;
+    util::mpmc_ring_queue<size_t> q(100);
+    TERARK_VERIFY_EQ(q.capacity(), 128);
+
+    // single thread, fifo order and batch boundary
+    size_t buf[200];
+    for (size_t i = 0; i < 200; ++i) buf[i] = i;
+    TERARK_VERIFY_EQ(q.try_push_n(buf, 200), 128);
+    TERARK_VERIFY(!q.try_push(9999));
+    TERARK_VERIFY_EQ(q.peekSize(), 128);
+    size_t out[200];
+    TERARK_VERIFY_EQ(q.try_pop_n(out, 50), 50);
+    TERARK_VERIFY_EQ(q.try_pop_n(out + 50, 200), 78);
+    for (size_t i = 0; i < 128; ++i) TERARK_VERIFY_EQ(out[i], i);
+    TERARK_VERIFY(!q.try_pop(out));
+    TERARK_VERIFY(q.peekEmpty());
+
+    // multi producer multi consumer, each value is popped exactly once
+    valvec<std::thread> thr;
+    std::atomic<size_t> popped(0), sum(0);
+    for (size_t p = 0; p < producers; ++p) {
+        thr.emplace_back([&,p] {
+            size_t vals[8];
+            for (size_t i = p; i < num; ) {
+                size_t n = 0;
+                for (size_t j = i; j < num && n < 8; j += producers) vals[n++] = j;
+                size_t k = q.try_push_n(vals, n);
+                if (k) i += k * producers;
+                else std::this_thread::yield();
+            }
+        });
+    }
+    for (size_t c = 0; c < consumers; ++c) {
+        thr.emplace_back([&] {
+            size_t vals[8], local_sum = 0;
+            while (popped.load() < num) {
+                size_t k = q.try_pop_n(vals, 8);
+                if (k) {
+                    for (size_t j = 0; j < k; ++j) local_sum += vals[j];
+                    popped.fetch_add(k);
+                }
+                else std::this_thread::yield();
+            }
+            sum.fetch_add(local_sum);
+        });
+    }
+    for (auto& t : thr) t.join();
+    TERARK_VERIFY_EQ(popped.load(), num);
+    TERARK_VERIFY_EQ(sum.load(), num * (num - 1) / 2);
+    TERARK_VERIFY(q.peekEmpty());
+    printf("passed\n");
+    return 0;
+}
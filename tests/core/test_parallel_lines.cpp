@@ -0,0 +1,136 @@
+#include <terark/thread/parallel_lines.hpp>
+#include <terark/util/throw.hpp>
+#include <random>
+#include <string>
+#include <stdio.h>
+
+using namespace terark;
+
+static std::string gen_text(size_t num, bool last_eol) {
+	std::mt19937_64 rng(num);
+	std::string text;
+	for (size_t i = 0; i < num; ++i) {
+		size_t len = rng() % 100 == 0 ? 5000 + rng() % 5000 : rng() % 50;
+		for (size_t j = 0; j < len; ++j)
+			text.push_back('a' + rng() % 26);
+		static const char* eols[] = {"\r\n", "\r\r\n", "\n"};
+		text.append(eols[std::min<size_t>(rng() % 10, 2)]);
+	}
+	if (!last_eol && !text.empty()) {
+		text.append("no-eol");
+	}
+	return text;
+}
+
+static std::string serial(const std::string& text) {
+	std::string res;
+	size_t lineno = 0;
+	for (size_t pos = 0; pos < text.size(); ) {
+		size_t eol = text.find('\n', pos);
+		size_t next = eol == std::string::npos ? text.size() : eol + 1;
+		if (eol == std::string::npos) eol = text.size();
+		while (eol > pos && '\r' == text[eol-1]) eol--;
+		res += std::to_string(++lineno) + ":" + text.substr(pos, eol - pos) + "\n";
+		pos = next;
+	}
+	return res;
+}
+
+static void test(FILE* fp, const std::string& text, int threads, bool keep_order) {
+	ParallelLinesOptions opt;
+	opt.block_size = 1000; // smaller than long lines
+	opt.threads = threads;
+	opt.keep_order = keep_order;
+	std::string res;
+	size_t blocks = 0, nextLineno = 1;
+	size_t lines = parallel_ingest_lines(fp, opt,
+	[](int, LineBlockTask* task) {
+		task->for_each_line([&](size_t lineno, char* beg, char* end) {
+			task->out.append(std::to_string(lineno));
+			task->out.push_back(':');
+			task->out.append((byte_t*)beg, end - beg);
+			task->out.push_back('\n');
+		});
+	},
+	[&](LineBlockTask* task) {
+		if (keep_order) {
+			TERARK_VERIFY_EQ(task->lineno, nextLineno);
+			nextLineno += task->num_lines;
+		}
+		res.append((char*)task->out.data(), task->out.size());
+		blocks++;
+	});
+	std::string expected = serial(text);
+	TERARK_VERIFY_EQ(res.size(), expected.size());
+	if (keep_order)
+		TERARK_VERIFY(res == expected);
+	TERARK_VERIFY_EQ(lines, size_t(std::count(expected.begin(), expected.end(), '\n')));
+	printf("threads = %d, keep_order = %d, lines = %zd, blocks = %zd\n",
+			threads, keep_order, lines, blocks);
+}
+
+int main() {
+	const char* fpath = "test_parallel_lines.txt";
+	for (size_t num : {0, 1, 2, 100, 20000}) {
+		for (bool last_eol : {true, false}) {
+			std::string text = gen_text(num, last_eol);
+			FILE* fp = fopen(fpath, "wb");
+			fwrite(text.data(), 1, text.size(), fp);
+			fclose(fp);
+			for (int threads : {1, 3}) {
+				for (bool keep_order : {true, false}) {
+					fp = fopen(fpath, "rb");
+					test(fp, text, threads, keep_order);
+					fclose(fp);
+				}
+			}
+			// pipe input, not a regular file
+			std::string cmd = std::string("cat ") + fpath;
+			fp = popen(cmd.c_str(), "r");
+			test(fp, text, 2, true);
+			pclose(fp);
+		}
+	}
+	{ // exception in parse is re-thrown
+		FILE* fp = fopen(fpath, "rb");
+		ParallelLinesOptions opt;
+		opt.block_size = 1000;
+		bool thrown = false;
+		try {
+			parallel_ingest_lines(fp, opt,
+				[](int, LineBlockTask* task) {
+					if (task->lineno > 1) THROW_STD(logic_error, "parse error");
+				},
+				[](LineBlockTask*) {});
+		}
+		catch (const std::logic_error&) { thrown = true; }
+		TERARK_VERIFY(thrown);
+		fclose(fp);
+	}
+	{ // CRLF: all trailing '\r' are chomped, just as LineBuf::chomp
+		const char text[] = "a\r\nbb\r\r\n\r\n\r\r\nc\rd\r\n\ne\r";
+		FILE* fp = fopen(fpath, "wb");
+		fwrite(text, 1, sizeof(text) - 1, fp);
+		fclose(fp);
+		fp = fopen(fpath, "rb");
+		ParallelLinesOptions opt;
+		opt.block_size = 4; // a block may end between '\r' and '\n'
+		opt.threads = 2;
+		std::string res;
+		parallel_ingest_lines(fp, opt,
+			[](int, LineBlockTask* task) {
+				task->for_each_line([&](size_t, char* beg, char* end) {
+					task->out.append((byte_t*)beg, end - beg);
+					task->out.push_back('|');
+				});
+			},
+			[&](LineBlockTask* task) {
+				res.append((char*)task->out.data(), task->out.size());
+			});
+		fclose(fp);
+		TERARK_VERIFY(res == "a|bb|||c\rd||e|");
+	}
+	::remove(fpath);
+	printf("passed\n");
+	return 0;
+}
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <terark/num_to_str.hpp>
 #include <terark/thread/pipeline.hpp>
+#include <terark/thread/work_stealing_executor.hpp>
 #include <terark/stdtypes.hpp>
 #include <terark/util/profiling.hpp>
 
@@ -69,8 +70,11 @@ public:
 		PipelineLockGuard lock(*step->getMutex());
 		printf("step2: threadno=%d plserial=%06lu\n", threadno, task->plserial);
 	}
+	unsigned long serial3;
 	void step3(PipelineStage* step, int threadno, PipelineQueueItem* task)
 	{
+		TERARK_RT_assert(serial3 <= task->plserial, std::runtime_error);
+		serial3 = task->plserial + 1; // keep serial, null task is skipped
 		if (!G_bPrint) return;
 		PipelineLockGuard lock(*step->getMutex());
 		printf("step3: threadno=%d plserial=%06lu\n", threadno, task->plserial);
@@ -120,16 +124,28 @@ public:
 		int err1 = run_test(EUType::thread, 3, bcompile);
 		int err2 = run_test(EUType::fiber , 0, bcompile);
 		int err3 = run_test(EUType::mixed , 3, bcompile);
-		return err1 + err2 + err3;
+		int err4 = 0;
+		if (bcompile) { // executor mode requires compile
+			WorkStealingExecutor executor(3);
+			err4 = run_test(EUType::thread, 1, bcompile, &executor);
+			fprintf(stderr, "executor: exec_cnt = %zd, steal_cnt = %zd\n",
+					executor.exec_cnt(), executor.steal_cnt());
+		}
+		return err1 + err2 + err3 + err4;
     }
-    int run_test(EUType euType, int logLevel, int bcompile) {
+    int run_test(EUType euType, int logLevel, int bcompile,
+                 WorkStealingExecutor* executor = NULL) {
 		PipelineProcessor pipeline;
+		serial3 = 0;
+		pipeline.setExecutor(executor);
 		pipeline.setLogLevel(logLevel);
 		pipeline.setQueueTimeout(1);
 		pipeline.setQueueSize(4); // small queue is likely full
 		pipeline.setEUType(euType);
 
 		std::vector<int> bindArg1;
+		auto step2 = new FunPipelineStage(4, bind(&Main::step2, this, _1, _2, _3), "step2");
+		step2->setQueueType(PipelineStage::QueueType::mutex); // default is lock_free
 		// use the UNIX shell pipe denotation
 		if (!bcompile)
 			pipeline | new GeneratorStep(maxNum);
@@ -141,7 +157,7 @@ public:
 			)
 		// or PPL_STAGE_EX_1(this, Main, step1, 10, &bindArg1)
 
-		| new FunPipelineStage(4, bind(&Main::step2, this, _1, _2, _3), "step2")
+		| step2
 		// or PPL_STAGE_0(this, Main, step2, 2)
 
 		| PPL_STAGE(this, Main, step3, 0)
@@ -149,7 +165,7 @@ public:
 		| PPL_STAGE(this, Main, step5, 1, 2.0, std::string("abcd"))
 		;
 		terark::profiling pf;
-		const char* modeName = pipeline.euTypeName();
+		const char* modeName = executor ? "executor" : pipeline.euTypeName();
 		long long t0 = pf.now();
 		if (bcompile) {
     		fprintf(stderr, "%s pipeline test with compile\n", modeName);
@@ -176,6 +192,7 @@ public:
 		long long t1 = pf.now();
 		fprintf(stderr, "%s pipeline test passed, time=%ld'us, average=%f'us\n",
 		        modeName, (long)pf.us(t0, t1), (double)pf.ns(t0, t1)/1000/maxNum);
+		fprintf(stderr, "%s\n", pipeline.queueInfo().c_str());
 		return 0;
 	}
 };
@@ -0,0 +1,131 @@
+#include <terark/util/sortable_strvec.hpp>
+#include <terark/util/throw.hpp>
+#include <terark/util/profiling.hpp>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+
+using namespace terark;
+
+static std::string rand_str(std::mt19937_64& rng, int alpha, int maxlen) {
+	std::string s;
+	size_t len = rng() % (maxlen + 1);
+	for (size_t j = 0; j < len; ++j)
+		s.push_back(char('a' + rng() % alpha));
+	return s;
+}
+
+static void test_var(size_t num, int alpha, int maxlen, size_t threads) {
+	std::mt19937_64 rng(num * alpha + maxlen);
+	SortableStrVec sv1, sv2;
+	SortThinStrVec tv1, tv2;
+	for (size_t i = 0; i < num; ++i) {
+		std::string s = rand_str(rng, alpha, maxlen) + "VV"; // VV as value
+		sv1.push_back(s); sv2.push_back(s);
+		tv1.push_back(s); tv2.push_back(s);
+	}
+	sv1.sort();
+	sv2.sort_parallel(threads);
+	tv1.sort(2);
+	tv2.sort_parallel(threads, 2);
+	for (size_t i = 0; i < num; ++i) {
+		TERARK_VERIFY(sv1[i] == sv2[i]);
+		TERARK_VERIFY(tv1[i].substr(0, tv1[i].size()-2) ==
+					  tv2[i].substr(0, tv2[i].size()-2));
+	}
+}
+
+static void test_fixed(size_t num, size_t fixlen, size_t valuelen, size_t threads) {
+	std::mt19937_64 rng(num + fixlen);
+	FixedLenStrVec v1(fixlen), v2(fixlen);
+	std::string s(fixlen, '\0');
+	for (size_t i = 0; i < num; ++i) {
+		for (auto& c : s) c = char(rng() % 8); // many dups
+		v1.push_back(s); v2.push_back(s);
+	}
+	v1.sort(valuelen);
+	v2.sort_parallel(threads, valuelen);
+	for (size_t i = 1; i < num; ++i) {
+		TERARK_VERIFY(v1[i-1].substr(0, fixlen-valuelen) <= v1[i].substr(0, fixlen-valuelen));
+		TERARK_VERIFY(v1[i].substr(0, fixlen-valuelen) == v2[i].substr(0, fixlen-valuelen));
+	}
+	if (fixlen - valuelen <= 8) { // lsd is stable
+		FixedLenStrVec v3(fixlen);
+		std::vector<std::string> v4;
+		std::mt19937_64 rng2(num + fixlen);
+		for (size_t i = 0; i < num; ++i) {
+			for (auto& c : s) c = char(rng2() % 8);
+			v3.push_back(s);
+			v4.push_back(s);
+		}
+		const size_t keylen = fixlen - valuelen;
+		std::stable_sort(v4.begin(), v4.end(),
+			[keylen](const std::string& x, const std::string& y) {
+				return memcmp(x.data(), y.data(), keylen) < 0;
+			});
+		FixedLenStrVec::sort_raw_lsd(v3.m_strpool.data(), num, fixlen, valuelen, threads);
+		for (size_t i = 0; i < num; ++i)
+			TERARK_VERIFY(v3[i] == fstring(v4[i]));
+	}
+}
+
+static void bench(size_t num) {
+	std::mt19937_64 rng(1);
+	SortableStrVec sv;
+	for (size_t i = 0; i < num; ++i) {
+		char buf[64];
+		int len = snprintf(buf, sizeof(buf), "http://www.example.com/%llu", (llong)(rng() % num));
+		sv.push_back(fstring(buf, len));
+	}
+	profiling pf;
+	SortableStrVec v1; v1.m_strpool = sv.m_strpool; v1.m_index = sv.m_index;
+	long long t0 = pf.now();
+	v1.sort();
+	long long t1 = pf.now();
+	printf("SortableStrVec %zd: std::sort %.3f sec\n", num, pf.sf(t0,t1));
+	for (size_t threads : {1, 4}) {
+		SortableStrVec v2; v2.m_strpool = sv.m_strpool; v2.m_index = sv.m_index;
+		t0 = pf.now();
+		v2.sort_parallel(threads);
+		t1 = pf.now();
+		printf("SortableStrVec %zd: radix threads = %zd, %.3f sec\n", num, threads, pf.sf(t0,t1));
+		for (size_t i = 0; i < num; ++i)
+			TERARK_VERIFY(v1[i] == v2[i]);
+	}
+	for (size_t fixlen : {4, 8}) {
+		valvec<byte_t> a(num * fixlen), b;
+		for (auto& c : a) c = byte_t(rng());
+		b = a;
+		t0 = pf.now();
+		FixedLenStrVec::sort_raw_lsd(a.data(), num, fixlen, 0);
+		t1 = pf.now();
+		// sort_raw: sort as uint
+		if (4 == fixlen)
+			std::sort((uint32_t*)b.data(), (uint32_t*)b.data() + num);
+		else
+			std::sort((uint64_t*)b.data(), (uint64_t*)b.data() + num);
+		long long t2 = pf.now();
+		printf("fixlen %zd: lsd %.3f sec, std::sort as uint %.3f sec\n",
+			fixlen, pf.sf(t0,t1), pf.sf(t1,t2));
+	}
+}
+
+int main(int argc, char* argv[]) {
+	for (size_t num : {0, 1, 2, 100, 5000, 100000, 300000}) {
+		for (size_t threads : {1, 3}) {
+			test_var(num, 2, 40, threads);
+			test_var(num, 26, 12, threads);
+			test_var(num, 1, 20, threads);
+			test_fixed(num, 4, 0, threads);
+			test_fixed(num, 12, 4, threads);
+			test_fixed(num, 7, 2, threads);
+			test_fixed(num, 20, 0, threads);
+		}
+	}
+	bench(argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000);
+	printf("passed\n");
+	return 0;
+}
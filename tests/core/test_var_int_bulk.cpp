@@ -0,0 +1,201 @@
+#include <terark/io/var_int.hpp>
+#include <terark/io/stream_vbyte.hpp>
+#include <terark/io/int_diff_coding.hpp>
+#include <terark/io/DataIO.hpp>
+#include <terark/io/MemStream.hpp>
+#include <terark/io/FileStream.hpp>
+#include <terark/io/StreamBuffer.hpp>
+#include <terark/util/throw.hpp>
+#include <terark/util/profiling.hpp>
+#include <random>
+#include <stdio.h>
+
+using namespace terark;
+
+// mixed byte lengths, biased to small values as metadata usually are
+static uint64_t rand_val(std::mt19937_64& rng, int maxbits) {
+	int bits = rng() % (maxbits + 1);
+	if (rng() % 2)
+		bits = std::min(bits, 7);
+	return bits ? rng() & (uint64_t(-1) >> (64 - bits)) : 0;
+}
+
+static void test_codec(size_t num) {
+	std::mt19937_64 rng(num);
+	valvec<uint32_t> u32(num);
+	valvec<uint64_t> u64(num);
+	for (size_t i = 0; i < num; ++i) {
+		u32[i] = uint32_t(rand_val(rng, 32));
+		u64[i] = rand_val(rng, 64);
+	}
+	valvec<byte_t> buf(num * 10 + 16);
+	byte_t* end = encode_var_uint32_bulk(buf.data(), u32.data(), num);
+	byte_t* p = buf.data();
+	for (size_t i = 0; i < num; ++i) { // same layout as save_var_uint32
+		byte_t tmp[5];
+		size_t len = save_var_uint32(tmp, u32[i]) - tmp;
+		TERARK_VERIFY(memcmp(tmp, p, len) == 0);
+		p += len;
+	}
+	TERARK_VERIFY(p == end);
+	valvec<uint32_t> d32(num + 4);
+	const byte_t* endp = NULL;
+	TERARK_VERIFY_EQ(decode_var_uint32_bulk(buf.data(), end, d32.data(), num, &endp), num);
+	TERARK_VERIFY(endp == end);
+	TERARK_VERIFY(memcmp(d32.data(), u32.data(), 4 * num) == 0);
+	// truncated input: stop before the incomplete value
+	for (size_t cut = 1; cut < 6 && cut < size_t(end - buf.data()); ++cut) {
+		size_t k = decode_var_uint32_bulk(buf.data(), end - cut, d32.data(), num, &endp);
+		TERARK_VERIFY_LT(k, num);
+		TERARK_VERIFY(memcmp(d32.data(), u32.data(), 4 * k) == 0);
+		const byte_t* q = buf.data();
+		for (size_t i = 0; i < k; ++i) load_var_uint32(q, &q);
+		TERARK_VERIFY(q == endp);
+	}
+
+	end = encode_var_uint64_bulk(buf.data(), u64.data(), num);
+	valvec<uint64_t> d64(num);
+	TERARK_VERIFY_EQ(decode_var_uint64_bulk(buf.data(), end, d64.data(), num, &endp), num);
+	TERARK_VERIFY(endp == end);
+	TERARK_VERIFY(memcmp(d64.data(), u64.data(), 8 * num) == 0);
+
+	// stream vbyte
+	valvec<byte_t> svb(svb_max_encoded_size(num));
+	size_t len = svb_encode_uint32(u32.data(), num, svb.data());
+	TERARK_VERIFY_EQ(svb_data_size(svb.data(), num) + svb_control_size(num), len);
+	d32.fill(0);
+	TERARK_VERIFY_EQ(svb_decode_uint32(svb.data(), len, d32.data(), num), len);
+	TERARK_VERIFY(memcmp(d32.data(), u32.data(), 4 * num) == 0);
+	if (num) {
+		bool thrown = false;
+		try { svb_decode_uint32(svb.data(), len - 1, d32.data(), num); }
+		catch (const std::length_error&) { thrown = true; }
+		TERARK_VERIFY(thrown);
+	}
+}
+
+template<class VarInt, class Int>
+static void test_data_io(size_t num, int maxbits) {
+	std::mt19937_64 rng(num + maxbits);
+	valvec<VarInt> vv(num);
+	std::vector<VarInt> sv(num);
+	for (size_t i = 0; i < num; ++i) {
+		vv[i].t = Int(rand_val(rng, maxbits));
+		if (std::is_signed<Int>::value && rng() % 2)
+			vv[i].t = -vv[i].t;
+		sv[i] = vv[i];
+	}
+	NativeDataOutput<AutoGrownMemIO> dio;
+	dio << vv << sv << var_size_t(num);
+	for (size_t i = 0; i < num; ++i)
+		dio << vv[i]; // elem by elem is same layout
+	size_t len = dio.tell();
+	{
+		NativeDataInput<MemIO> dii;
+		dii.set(dio.begin(), len);
+		valvec<VarInt> vv2;
+		std::vector<VarInt> sv2;
+		dii >> vv2 >> sv2;
+		TERARK_VERIFY_EQ(vv2.size(), num);
+		TERARK_VERIFY_EQ(sv2.size(), num);
+		for (size_t i = 0; i < num; ++i) {
+			TERARK_VERIFY(vv2[i].t == vv[i].t);
+			TERARK_VERIFY(sv2[i].t == vv[i].t);
+		}
+		var_size_t n;
+		dii >> n;
+		TERARK_VERIFY_EQ(n.t, num);
+		vv2.resize(num);
+		dii.load_var_array(vv2.data(), num);
+		for (size_t i = 0; i < num; ++i)
+			TERARK_VERIFY(vv2[i].t == vv[i].t);
+		TERARK_VERIFY_EQ(size_t(dii.diff(dio.begin())), len);
+	}
+	// small buffer: values cross buffer boundary
+	const char* fpath = "test_var_int_bulk.bin";
+	{
+		FileStream fp(fpath, "wb");
+		fp.ensureWrite(dio.begin(), len);
+	}
+	{
+		FileStream fp(fpath, "rb");
+		NativeDataInput<InputBuffer> dii(&fp);
+		dii.set_bufsize(64);
+		valvec<VarInt> vv2;
+		std::vector<VarInt> sv2;
+		dii >> vv2 >> sv2;
+		for (size_t i = 0; i < num; ++i) {
+			TERARK_VERIFY(vv2[i].t == vv[i].t);
+			TERARK_VERIFY(sv2[i].t == vv[i].t);
+		}
+	}
+	::remove(fpath);
+}
+
+static void test_int_diff(size_t num) {
+	std::mt19937_64 rng(num);
+	valvec<uint64_t> a(num);
+	uint64_t cur = rng() % 1000;
+	for (auto& x : a) x = cur += rng() % 100000;
+	NativeDataOutput<AutoGrownMemIO> dio;
+	if (num) {
+		EncodeIntDiff<uint64_t> enc(dio, a[0]);
+		enc.save_array(dio, a.data() + 1, num - 1);
+		EncodeIntDiff<uint64_t> enc2(dio, a[0]);
+		for (size_t i = 1; i < num; ++i)
+			dio << enc2(a[i]);
+	}
+	NativeDataInput<MemIO> dii;
+	dii.set(dio.begin(), dio.tell());
+	valvec<uint64_t> b(num);
+	if (num) {
+		DecodeIntDiff<uint64_t> dec(dii);
+		b[0] = dec;
+		dec.load_array(dii, b.data() + 1, num - 1);
+		TERARK_VERIFY(b == a);
+		DecodeIntDiff<uint64_t> dec2(dii);
+		for (size_t i = 1; i < num; ++i) {
+			dii >> dec2;
+			TERARK_VERIFY_EQ(dec2.value(), a[i]);
+		}
+	}
+}
+
+static void bench(size_t num) {
+	std::mt19937_64 rng(1);
+	valvec<uint32_t> u32(num);
+	for (auto& x : u32) x = uint32_t(rand_val(rng, 21));
+	valvec<byte_t> buf(num * 5 + 16);
+	byte_t* end = encode_var_uint32_bulk(buf.data(), u32.data(), num);
+	valvec<uint32_t> d32(num + 4);
+	profiling pf;
+	long long t0 = pf.now();
+	const byte_t* p = buf.data();
+	for (size_t i = 0; i < num; ++i)
+		d32[i] = load_var_uint32(p, &p);
+	long long t1 = pf.now();
+	const byte_t* endp;
+	decode_var_uint32_bulk(buf.data(), end, d32.data(), num, &endp);
+	long long t2 = pf.now();
+	valvec<byte_t> svb(svb_max_encoded_size(num));
+	size_t len = svb_encode_uint32(u32.data(), num, svb.data());
+	long long t3 = pf.now();
+	svb_decode_uint32(svb.data(), len, d32.data(), num);
+	long long t4 = pf.now();
+	printf("decode %zd uint32: scalar %.3f ns, bulk %.3f ns, stream vbyte %.3f ns per value\n",
+		num, pf.nf(t0,t1)/num, pf.nf(t1,t2)/num, pf.nf(t3,t4)/num);
+}
+
+int main(int argc, char* argv[]) {
+	for (size_t num : {0, 1, 3, 4, 5, 15, 16, 17, 100, 1000, 100000}) {
+		test_codec(num);
+		test_data_io<var_uint32_t, uint32_t>(num, 32);
+		test_data_io<var_int32_t, int32_t>(num, 31);
+		test_data_io<var_uint64_t, uint64_t>(num, 64);
+		test_data_io<var_int64_t, int64_t>(num, 63);
+		test_int_diff(num);
+	}
+	bench(argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000);
+	printf("passed\n");
+	return 0;
+}
@@ -0,0 +1,113 @@
+#include <terark/thread/weighted_round_robin.hpp>
+#include <terark/stdtypes.hpp>
+#include <random>
+#include <vector>
+#include <stdio.h>
+
+using namespace terark;
+
+typedef WeightedRoundRobinClient Client;
+
+static size_t pick(std::vector<Client>& clients, const std::vector<size_t>& pending) {
+	auto iter = weighted_round_robin_pick(clients.begin(), clients.end(),
+		[&](Client& c) { return pending[&c - clients.data()] ? &c : nullptr; });
+	return iter - clients.begin();
+}
+
+// weights of DictZipBlobStore priority low/normal/high are 1/4/16
+static void test_share() {
+	std::vector<Client> clients(3);
+	clients[0].weight = 16;
+	clients[1].weight = 4;
+	clients[2].weight = 1;
+	std::vector<size_t> pending(3, 1);
+	std::vector<size_t> cnt(3, 0), win(3, 0);
+	const size_t rounds = 1000, sum = 21;
+	for (size_t i = 0; i < rounds * sum; ++i) {
+		size_t k = pick(clients, pending);
+		TERARK_VERIFY_LT(k, 3u);
+		clients[k].done();
+		cnt[k]++;
+		win[k]++;
+		if ((i + 1) % sum == 0) { // exact share in each window
+			TERARK_VERIFY_EQ(win[0], 16);
+			TERARK_VERIFY_EQ(win[1], 4);
+			TERARK_VERIFY_EQ(win[2], 1);
+			win.assign(3, 0);
+		}
+	}
+	TERARK_VERIFY_EQ(cnt[0], 16 * rounds);
+	TERARK_VERIFY_EQ(cnt[1], 4 * rounds);
+	TERARK_VERIFY_EQ(cnt[2], 1 * rounds);
+
+	// client which has nothing pending is skipped
+	pending[0] = 0;
+	cnt.assign(3, 0);
+	for (size_t i = 0; i < 5 * rounds; ++i) {
+		size_t k = pick(clients, pending);
+		clients[k].done();
+		cnt[k]++;
+	}
+	TERARK_VERIFY_EQ(cnt[0], 0);
+	TERARK_VERIFY_EQ(cnt[1], 4 * rounds);
+	TERARK_VERIFY_EQ(cnt[2], 1 * rounds);
+
+	pending.assign(3, 0);
+	TERARK_VERIFY_EQ(pick(clients, pending), 3);
+}
+
+// simulate a pipeline of capacity 8 shared by two clients, tasks complete
+// in random order, budget of heavy client must never be exceeded
+static void test_budget() {
+	std::vector<Client> clients(2);
+	clients[0].weight = 16;
+	clients[0].budget = 2;
+	clients[1].weight = 1;
+	std::vector<size_t> pending(2, 1);
+	std::vector<size_t> inflight; // client id of each task in pipeline
+	std::vector<size_t> cnt(2, 0);
+	std::mt19937_64 rng(12345);
+	const size_t capacity = 8;
+	for (size_t i = 0; i < 100000; ++i) {
+		while (inflight.size() < capacity) {
+			size_t k = pick(clients, pending);
+			if (k == clients.size())
+				break;
+			inflight.push_back(k);
+			cnt[k]++;
+			TERARK_VERIFY_LE(clients[0].inflight, 2);
+		}
+		// 1 has no budget, it fills the slots 0 can not take
+		TERARK_VERIFY_EQ(inflight.size(), capacity);
+		TERARK_VERIFY_EQ(clients[0].inflight + clients[1].inflight, capacity);
+		size_t j = rng() % inflight.size();
+		clients[inflight[j]].done();
+		inflight.erase(inflight.begin() + j);
+	}
+	TERARK_VERIFY_EQ(clients[0].maxInflight, 2);
+	TERARK_VERIFY_GE(clients[1].maxInflight, capacity - 2);
+	TERARK_VERIFY_GT(cnt[0], 0);
+	TERARK_VERIFY_GT(cnt[1], 0);
+
+	// when 1 has nothing pending, 0 is still bounded by its budget
+	pending[1] = 0;
+	while (!inflight.empty()) {
+		clients[inflight.back()].done();
+		inflight.pop_back();
+	}
+	for (size_t i = 0; i < 10; ++i) {
+		size_t k = pick(clients, pending);
+		if (k == clients.size())
+			break;
+		inflight.push_back(k);
+	}
+	TERARK_VERIFY_EQ(inflight.size(), 2);
+	TERARK_VERIFY_EQ(clients[0].inflight, 2);
+}
+
+int main() {
+	test_share();
+	test_budget();
+	printf("%s done\n", __FILE__);
+	return 0;
+}
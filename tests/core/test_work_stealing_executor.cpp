@@ -0,0 +1,64 @@
+#include <terark/thread/work_stealing_executor.hpp>
+#include <terark/stdtypes.hpp>
+#include <atomic>
+#include <stdexcept>
+#include <stdio.h>
+
+using namespace terark;
+
+static std::atomic<size_t> g_executed(0);
+
+// each task submits two children, so workers push/pop their own deques
+// deep enough to grow them, and idle workers steal
+static void fan_out(void* exe, size_t depth, size_t) {
+    g_executed++;
+    if (depth) {
+        ((WorkStealingExecutor*)exe)->submit(&fan_out, exe, depth - 1);
+        ((WorkStealingExecutor*)exe)->submit(&fan_out, exe, depth - 1);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t depth = argc > 1 ? strtoul(argv[1], NULL, 10) : 16;
+    WorkStealingExecutor exe(4);
+    TERARK_VERIFY_EQ(exe.num_workers(), 4);
+    TERARK_VERIFY_EQ(exe.current_worker(), -1);
+
+    // submitted from non-worker to inject queue, then fan out in workers
+    for (int round = 0; round < 4; ++round) {
+        g_executed = 0;
+        exe.submit(&fan_out, &exe, depth);
+        size_t expected = (size_t(2) << depth) - 1;
+        while (g_executed.load() < expected) {
+            exe.help_one();
+        }
+        TERARK_VERIFY_EQ(g_executed.load(), expected);
+    }
+
+    // parallel_for from non-worker and nested in workers
+    std::atomic<size_t> sum(0);
+    exe.parallel_for(100, [&](size_t i) {
+        exe.parallel_for(100, [&](size_t j) { sum += i * 100 + j; });
+    });
+    TERARK_VERIFY_EQ(sum.load(), size_t(10000 * 9999 / 2));
+
+    // first exception is rethrown after all are done
+    std::atomic<size_t> done(0);
+    bool caught = false;
+    try {
+        exe.parallel_for(1000, [&](size_t i) {
+            done++;
+            if (i % 100 == 7)
+                throw std::runtime_error("parallel_for error");
+        });
+    }
+    catch (const std::runtime_error&) {
+        caught = true;
+    }
+    TERARK_VERIFY(caught);
+    TERARK_VERIFY_EQ(done.load(), 1000);
+
+    printf("exec = %zd, steal = %zd\n", exe.exec_cnt(), exe.steal_cnt());
+    printf("passed\n");
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <terark/io/DataIO_ZeroCopy.hpp>
+#include <terark/io/FileStream.hpp>
+#include <terark/io/StreamBuffer.hpp>
+#include <terark/util/throw.hpp>
+#include <random>
+#include <stdio.h>
+
+using namespace terark;
+
+struct Rec {
+	uint64_t key;
+	uint32_t val;
+	uint16_t flag;
+};
+
+int main(int argc, char* argv[]) {
+	size_t num = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+	std::mt19937_64 rng(num);
+	valvec<uint64_t> u64(num);
+	valvec<Rec> recs(num);
+	valvec<byte_t> bytes(num * 3 + 1);
+	SortableStrVec ssv;
+	FixedLenStrVec flsv(8);
+	fstrvec fsv;
+	for (size_t i = 0; i < num; ++i) {
+		u64[i] = rng();
+		recs[i] = Rec{rng(), uint32_t(i), uint16_t(i % 7)};
+		char buf[32];
+		int len = snprintf(buf, sizeof(buf), "key-%zd", size_t(rng() % 1000000));
+		ssv.push_back(fstring(buf, len));
+		fsv.push_back(fstring(buf, len));
+		flsv.push_back(fstring((char*)&u64[i], 8));
+	}
+	for (auto& b : bytes) b = byte_t(rng());
+	const char* fpath = "test_zero_copy_data_io.bin";
+	{
+		NativeDataOutput<AutoGrownMemIO> dio;
+		dio << bytes; // normal DataIO, makes following payloads unaligned
+		dio << as_zero_copy(bytes);
+		dio << as_zero_copy(u64);
+		dio << as_zero_copy(recs);
+		dio << as_zero_copy(ssv);
+		dio << as_zero_copy(flsv);
+		dio << as_zero_copy(fsv);
+		dio << uint32_t(0xDEADBEEF);
+		FileStream fp(fpath, "wb");
+		fp.ensureWrite(dio.begin(), dio.tell());
+	}
+	auto check = [&](auto& dio, MemType expected) {
+		valvec<byte_t> bytes1, bytes2;
+		valvec<uint64_t> u64_2;
+		valvec<Rec> recs2;
+		SortableStrVec ssv2;
+		FixedLenStrVec flsv2;
+		fstrvec fsv2;
+		MemType mt1, mt2, mt3, mt4;
+		uint32_t tail = 0;
+		dio >> bytes1;
+		dio >> as_zero_copy(bytes2, &mt1);
+		dio >> as_zero_copy(u64_2, &mt2);
+		dio >> as_zero_copy(recs2, &mt3);
+		dio >> as_zero_copy(ssv2);
+		dio >> as_zero_copy(flsv2);
+		dio >> as_zero_copy(fsv2, &mt4);
+		dio >> tail;
+		TERARK_VERIFY_EQ(tail, 0xDEADBEEF);
+		TERARK_VERIFY(bytes1 == bytes);
+		TERARK_VERIFY(bytes2 == bytes);
+		TERARK_VERIFY(u64_2 == u64);
+		TERARK_VERIFY_EQ(recs2.size(), num);
+		TERARK_VERIFY(memcmp(recs2.data(), recs.data(), sizeof(Rec) * num) == 0);
+		TERARK_VERIFY_EQ(ssv2.size(), num);
+		TERARK_VERIFY_EQ(flsv2.size(), num);
+		TERARK_VERIFY_EQ(fsv2.size(), num);
+		for (size_t i = 0; i < num; ++i) {
+			TERARK_VERIFY(ssv2[i] == ssv[i]);
+			TERARK_VERIFY(flsv2[i] == flsv[i]);
+			TERARK_VERIFY(fsv2[i] == fsv[i]);
+		}
+		TERARK_VERIFY(mt1 == expected);
+		TERARK_VERIFY(mt2 == expected);
+		TERARK_VERIFY(mt3 == expected);
+		TERARK_VERIFY(mt4 == expected);
+		TERARK_VERIFY(ssv2.m_strpool_mem_type == expected);
+		TERARK_VERIFY(flsv2.m_strpool_mem_type == expected);
+		if (MemType::User == expected) {
+			TERARK_VERIFY_EQ(size_t(u64_2.data()) % 16, 0);
+			TERARK_VERIFY_EQ(size_t(recs2.data()) % 16, 0);
+		}
+		bytes2.risk_destroy(mt1);
+		u64_2.risk_destroy(mt2);
+		recs2.risk_destroy(mt3);
+		fsv2.strpool.risk_destroy(mt4);
+		fsv2.offsets.risk_destroy(mt4);
+	};
+	{ // zero copy on mmap
+		MmapDataInput dio(fpath);
+		check(dio, MemType::User);
+	}
+	{ // fallback to copy on a file stream
+		FileStream fp(fpath, "rb");
+		NativeDataInput<InputBuffer> dio(&fp);
+		check(dio, MemType::Malloc);
+	}
+	{ // corrupted length must not overflow the bounds check
+		NativeDataOutput<AutoGrownMemIO> dio;
+		dio << var_size_t(size_t(-1) / 8 + 1) << byte_t(0) << uint64_t(0);
+		for (size_t len : {size_t(-1), size_t(-1) - 3, dio.tell() + 1}) {
+			MemIO mem(dio.begin(), dio.tell());
+			bool thrown = false;
+			try { mem.zc_borrow(len); }
+			catch (const EndOfFileException&) { thrown = true; }
+			TERARK_VERIFY(thrown);
+			TERARK_VERIFY(mem.zc_borrow(dio.tell()) == dio.begin());
+		}
+		NativeDataInput<MemIO> din;
+		din.set(dio.begin(), dio.tell());
+		valvec<uint64_t> vec;
+		MemType mt;
+		bool thrown = false;
+		try { din >> as_zero_copy(vec, &mt); }
+		catch (const std::length_error&) { thrown = true; }
+		TERARK_VERIFY(thrown);
+		TERARK_VERIFY(vec.empty());
+	}
+	::remove(fpath);
+	printf("passed\n");
+	return 0;
+}
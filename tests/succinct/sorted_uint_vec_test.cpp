@@ -114,10 +114,45 @@ void unit_test_binary_search() {
     printf("done unit_test_binary_search!\n");
 }
 
+void unit_test_get_range() {
+    std::mt19937_64 rnd(46);
+    // diff spans 1, 2, 4 are blocks of all small units(fixed, 1 bit, 2 bit)
+    for (size_t span : {1, 2, 4, 0})
+    for (size_t blockUnits : {64, 128}) {
+        valvec<size_t> truth;
+        size_t val = 0;
+        for (size_t i = 0; i < 1000 + blockUnits/2; ++i) {
+            if (span)
+                truth.push_back(val += 100 + rnd() % span);
+            else
+                truth.push_back(val += rnd() % (i < 500 ? 8 : 100000));
+        }
+        SortedUintVec szip;
+        szip.build_from(truth, blockUnits);
+        valvec<size_t> out(truth.size() + 1, valvec_no_init());
+        for (size_t iter = 0; iter < 2000; ++iter) {
+            size_t lo = rnd() % (truth.size() + 1);
+            size_t hi = lo + rnd() % (truth.size() + 1 - lo);
+            out[hi - lo] = size_t(-1); // guard
+            szip.get_range(lo, hi, out.data());
+            assert(out[hi - lo] == size_t(-1));
+            for (size_t i = lo; i < hi; ++i) {
+                assert(out[i - lo] == truth[i]);
+            }
+        }
+        szip.get_range(0, truth.size(), out.data());
+        for (size_t i = 0; i < truth.size(); ++i) {
+            assert(out[i] == truth[i]);
+        }
+    }
+    printf("done unit_test_get_range!\n");
+}
+
 int main(int argc, char* argv[]) {
 	unit_test_bug1();
 	unit_test_small();
 	unit_test_binary_search();
+	unit_test_get_range();
 	size_t groupSize = 200;
 	if (argc >= 2) {
 		groupSize = atoi(argv[1]);
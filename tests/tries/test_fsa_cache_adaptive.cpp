@@ -0,0 +1,162 @@
+// test of adaptive FSA_Cache of NestTrieDAWG:
+//   1. lookups are sampled, hot deep subtree is covered after rebuild,
+//      hit depth of hot keys grows, cache size is kept
+//   2. lookups are always correct, including concurrent lookups by other
+//      threads while rebuild_fsa_cache_by_sample swaps the cache
+//   3. rebuild without a static cache uses the cacheRatio of sampling
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#define _SCL_SECURE_NO_WARNINGS
+#endif
+
+#include <terark/fsa/nest_trie_dawg.hpp>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace terark;
+
+// cold keys are spread over many short prefixes, hot keys are a few hundred
+// keys in a deep subtree "zz/hot/...", which is not covered by a BFS cache
+static std::vector<std::string> make_keys(size_t num, size_t seed) {
+	std::mt19937_64 rnd(seed);
+	std::vector<std::string> keys;
+	for (size_t i = 0; i < num; ++i) {
+		std::string k;
+		if (i % 16 == 0)
+			k = "zz/hot/deep/subtree/";
+		size_t len = 6 + rnd() % 10;
+		for (size_t j = 0; j < len; ++j)
+			k += char('a' + rnd() % 26);
+		keys.push_back(std::move(k));
+	}
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	return keys;
+}
+
+static double mean_depth(const NestLoudsTrieDAWG_SE_512& dawg) {
+	valvec<size_t> hist;
+	size_t samples = dawg.fsa_cache_hit_depth_hist(&hist);
+	TERARK_VERIFY_GT(samples, 0);
+	double sum = 0;
+	for (size_t d = 0; d < hist.size(); ++d)
+		sum += double(d) * hist[d];
+	return sum / samples;
+}
+
+static std::vector<size_t> ids; // word ids found without cache
+
+static void verify_all(const NestLoudsTrieDAWG_SE_512& dawg,
+					   const std::vector<std::string>& keys) {
+	for (size_t i = 0; i < keys.size(); ++i) {
+		TERARK_VERIFY_EQ(dawg.index(keys[i]), ids[i]);
+		std::string miss = keys[i] + "\x01";
+		TERARK_VERIFY_EQ(dawg.index(miss), size_t(-1));
+	}
+}
+
+int main() {
+	std::vector<std::string> keys = make_keys(200000, 20261019);
+	std::vector<size_t> hot;
+	for (size_t i = 0; i < keys.size(); ++i)
+		if (keys[i].compare(0, 3, "zz/") == 0 && i % 32 == 0)
+			hot.push_back(i);
+	TERARK_VERIFY_GT(hot.size(), 100);
+
+	NestLoudsTrieDAWG_SE_512 dawg;
+	{
+		SortableStrVec strVec;
+		for (const std::string& k : keys)
+			strVec.push_back(k);
+		NestLoudsTrieConfig conf;
+		conf.isInputSorted = true;
+		dawg.build_from(strVec, conf);
+	}
+	for (size_t i = 0; i < keys.size(); ++i) {
+		ids.push_back(dawg.index(keys[i]));
+		TERARK_VERIFY_S_EQ(dawg.nth_word(ids[i]), keys[i]);
+	}
+	TERARK_VERIFY(!dawg.rebuild_fsa_cache_by_sample(NULL)); // not sampling
+	TERARK_VERIFY(dawg.build_fsa_cache(0.01, "BFS"));
+	verify_all(dawg, keys);
+
+	std::mt19937_64 rnd(7);
+	auto hot_lookups = [&](size_t num) {
+		for (size_t i = 0; i < num; ++i) {
+			size_t k = hot[rnd() % hot.size()];
+			TERARK_VERIFY_EQ(dawg.index(keys[k]), ids[k]);
+		}
+	};
+	TERARK_VERIFY(dawg.start_fsa_cache_sampling(2, 0));
+	hot_lookups(100000);
+	double depth0 = mean_depth(dawg);
+	dawg.print_fsa_cache_stat(stderr);
+
+	// concurrent readers while rebuild swaps the cache
+	std::atomic<bool> done(false);
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 2; ++t) {
+		readers.emplace_back([&, t]() {
+			std::mt19937_64 rnd2(t);
+			while (!done.load(std::memory_order_relaxed)) {
+				size_t k = rnd2() % keys.size();
+				TERARK_VERIFY_EQ(dawg.index(keys[k]), ids[k]);
+			}
+		});
+	}
+	// replaced caches are freed while readers are running
+	TERARK_VERIFY(dawg.rebuild_fsa_cache_by_sample(NULL));
+	for (int r = 0; r < 4; ++r) {
+		hot_lookups(10000);
+		TERARK_VERIFY(dawg.rebuild_fsa_cache_by_sample(r % 2 ? "DFS" : NULL));
+	}
+	done = true;
+	for (auto& t : readers)
+		t.join();
+	verify_all(dawg, keys);
+
+	TERARK_VERIFY(dawg.start_fsa_cache_sampling(2, 0)); // reset counters
+	hot_lookups(100000);
+	double depth1 = mean_depth(dawg);
+	dawg.print_fsa_cache_stat(stderr);
+	printf("mean hit depth of hot keys: static cache = %.2f, adaptive cache = %.2f\n",
+		   depth0, depth1);
+	TERARK_VERIFY_GT(depth1, depth0 + 20); // "zz/hot/deep/subtree/" is 20 bytes
+
+	// rebuild again, previous cache is freed, keys are still found
+	hot_lookups(10000);
+	TERARK_VERIFY(dawg.rebuild_fsa_cache_by_sample("DFS"));
+	verify_all(dawg, keys);
+	dawg.stop_fsa_cache_sampling();
+	valvec<size_t> hist;
+	size_t samples = dawg.fsa_cache_hit_depth_hist(&hist);
+	hot_lookups(1000); // not sampled
+	TERARK_VERIFY_EQ(dawg.fsa_cache_hit_depth_hist(&hist), samples);
+
+	// no static cache: budget is from cacheRatio
+	NestLoudsTrieDAWG_SE_512 dawg2;
+	{
+		SortableStrVec strVec;
+		for (const std::string& k : keys)
+			strVec.push_back(k);
+		NestLoudsTrieConfig conf;
+		conf.isInputSorted = true;
+		dawg2.build_from(strVec, conf);
+	}
+	TERARK_VERIFY(!dawg2.has_fsa_cache());
+	TERARK_VERIFY(dawg2.start_fsa_cache_sampling(0, 0.02));
+	for (size_t i = 0; i < 20000; ++i) {
+		size_t k = hot[rnd() % hot.size()];
+		TERARK_VERIFY_EQ(dawg2.index(keys[k]), ids[k]);
+	}
+	TERARK_VERIFY(dawg2.rebuild_fsa_cache_by_sample(NULL));
+	TERARK_VERIFY(dawg2.has_fsa_cache());
+	verify_all(dawg2, keys);
+
+	printf("%s: all passed\n", __FILE__);
+	return 0;
+}
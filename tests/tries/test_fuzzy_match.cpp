@@ -0,0 +1,188 @@
+// test & benchmark of LevenshteinMatcher over NestLoudsTrieDAWG and Patricia,
+// results are verified by brute force scan of all keys, which is also the
+// baseline of the benchmark.
+//
+// usage: test_fuzzy_match [num_keys [num_queries]]
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#define _SCL_SECURE_NO_WARNINGS
+#endif
+
+#include <terark/fsa/fuzzy_match.hpp>
+#include <terark/fsa/nest_trie_dawg.hpp>
+#include <terark/fsa/cspptrie.hpp>
+#include <terark/util/profiling.hpp>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace terark;
+
+typedef std::vector<std::pair<std::string, size_t> > Result; // (word, dist)
+
+// small alphabet makes many keys in the neighborhood of a query
+static std::vector<std::string> make_keys(size_t num, size_t seed) {
+	std::mt19937_64 rnd(seed);
+	std::vector<std::string> keys;
+	keys.reserve(num + 3);
+	for (size_t i = 0; i < num; ++i) {
+		std::string k;
+		size_t len = 2 + rnd() % 10;
+		for (size_t j = 0; j < len; ++j)
+			k += char('a' + rnd() % 8);
+		keys.push_back(std::move(k));
+	}
+	keys.push_back(""); // empty key
+	keys.push_back("a");
+	keys.push_back("\xff\xfe");
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	return keys;
+}
+
+static std::vector<std::string>
+make_queries(const std::vector<std::string>& keys, size_t num, size_t seed) {
+	std::mt19937_64 rnd(seed);
+	std::vector<std::string> queries = {"", "a", "ab", "ba", "\xfe\xff"};
+	for (size_t i = 0; i < num; ++i) {
+		std::string q = keys[rnd() % keys.size()];
+		size_t edits = rnd() % 4;
+		for (size_t e = 0; e < edits; ++e) {
+			size_t pos = q.empty() ? 0 : rnd() % q.size();
+			switch (rnd() % 4) {
+			case 0: q.insert(q.begin() + pos, char('a' + rnd() % 9)); break;
+			case 1: if (!q.empty()) q.erase(pos, 1); break;
+			case 2: if (!q.empty()) q[pos] = char('a' + rnd() % 9); break;
+			case 3: if (pos + 1 < q.size()) std::swap(q[pos], q[pos+1]); break;
+			}
+		}
+		queries.push_back(std::move(q));
+	}
+	return queries;
+}
+
+static Result brute_force(const std::vector<std::string>& keys,
+						  const std::string& q, size_t k, bool trans) {
+	Result res;
+	for (const std::string& key : keys) {
+		size_t dist = LevenshteinMatcher::distance(key, q, k, trans);
+		if (dist <= k)
+			res.emplace_back(key, dist);
+	}
+	return res;
+}
+
+static Result trie_match(const BaseDFA* dfa, const std::string& q,
+						 size_t k, bool trans, size_t* visited) {
+	Result res;
+	LevenshteinMatcher lm(q, k, trans);
+	size_t n = lm.match(dfa, [&](fstring word, size_t, size_t dist) {
+		res.emplace_back(word.str(), dist);
+	});
+	TERARK_VERIFY_EQ(n, res.size());
+	*visited += lm.visited_nodes();
+	return res;
+}
+
+static void test_distance() {
+	auto dist = &LevenshteinMatcher::distance;
+	TERARK_VERIFY_EQ(dist("", "", 2, false), 0);
+	TERARK_VERIFY_EQ(dist("abc", "abc", 2, false), 0);
+	TERARK_VERIFY_EQ(dist("abc", "abd", 2, false), 1);
+	TERARK_VERIFY_EQ(dist("abc", "ab", 2, false), 1);
+	TERARK_VERIFY_EQ(dist("abc", "acb", 2, false), 2);
+	TERARK_VERIFY_EQ(dist("abc", "acb", 2, true), 1);
+	TERARK_VERIFY_EQ(dist("abcd", "badc", 2, true), 2);
+	TERARK_VERIFY_EQ(dist("abcdef", "a", 2, false), 3); // capped
+	TERARK_VERIFY_EQ(dist("kitten", "sitting", 2, false), 3); // capped
+	TERARK_VERIFY_EQ(dist("kitten", "sitting", 3, false), 3);
+}
+
+int main(int argc, char* argv[]) {
+	size_t num_keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+	size_t num_queries = argc > 2 ? strtoul(argv[2], NULL, 10) : 200;
+	test_distance();
+
+	std::vector<std::string> keys = make_keys(num_keys, 20261019);
+	std::vector<std::string> queries = make_queries(keys, num_queries, 7);
+
+	NestLoudsTrieDAWG_SE_512 dawg;
+	{
+		SortableStrVec strVec;
+		for (const std::string& k : keys)
+			strVec.push_back(k);
+		NestLoudsTrieConfig conf;
+		conf.isInputSorted = true;
+		dawg.build_from(strVec, conf);
+	}
+	TERARK_VERIFY_EQ(dawg.num_words(), keys.size());
+
+	std::unique_ptr<Patricia> pt(
+		Patricia::create(0, 4<<20, Patricia::MultiWriteMultiRead));
+	{
+		auto wtok = pt->tls_writer_token_nn();
+		wtok->acquire(pt.get());
+		for (const std::string& k : keys)
+			pt->insert(k, NULL, wtok);
+		wtok->release();
+	}
+
+	for (size_t k = 0; k <= 2; ++k) {
+	for (int trans = 0; trans < 2; ++trans) {
+		double t_bf = 0, t_dawg = 0, t_pt = 0;
+		size_t matched = 0, visited_dawg = 0, visited_pt = 0;
+		for (const std::string& q : queries) {
+			qtime t0 = qtime::now();
+			Result expected = brute_force(keys, q, k, trans != 0);
+			qtime t1 = qtime::now();
+			Result got_dawg = trie_match(&dawg, q, k, trans != 0, &visited_dawg);
+			qtime t2 = qtime::now();
+			Result got_pt = trie_match(pt.get(), q, k, trans != 0, &visited_pt);
+			qtime t3 = qtime::now();
+			t_bf += t0.mf(t1), t_dawg += t1.mf(t2), t_pt += t2.mf(t3);
+			TERARK_VERIFY(got_dawg == expected); // both in lexical order
+			TERARK_VERIFY(got_pt == expected);
+			matched += expected.size();
+
+			// word id and dict rank
+			LevenshteinMatcher lm(q, k, trans != 0);
+			size_t nth = 0;
+			lm.match_dawg(&dawg, [&](size_t rank, size_t dist) {
+				TERARK_VERIFY_LT(nth, expected.size());
+				TERARK_VERIFY_EQ(dist, expected[nth].second);
+				TERARK_VERIFY_S_EQ(keys[rank], expected[nth].first);
+				nth++;
+			}, true);
+			TERARK_VERIFY_EQ(nth, expected.size());
+			nth = 0;
+			lm.match_dawg(&dawg, [&](size_t word_id, size_t dist) {
+				TERARK_VERIFY_S_EQ(dawg.nth_word(word_id), expected[nth].first);
+				nth++;
+			});
+			TERARK_VERIFY_EQ(nth, expected.size());
+		}
+		printf("k = %zd, trans = %d, keys = %zd, queries = %zd, matched = %zd\n"
+			   "  brute force: %8.3f ms\n"
+			   "  dawg       : %8.3f ms, visited nodes = %zd\n"
+			   "  patricia   : %8.3f ms, visited nodes = %zd\n",
+			   k, trans, keys.size(), queries.size(), matched,
+			   t_bf, t_dawg, visited_dawg, t_pt, visited_pt);
+	}}
+
+	bool throwed = false;
+	try { LevenshteinMatcher("abc", LevenshteinMatcher::MAX_DIST + 1); }
+	catch (const std::invalid_argument&) { throwed = true; }
+	TERARK_VERIFY(throwed);
+
+	throwed = false;
+	try {
+		LevenshteinMatcher("abc", 1).match_dawg(pt.get(), [](size_t, size_t){});
+	}
+	catch (const std::invalid_argument&) { throwed = true; }
+	TERARK_VERIFY(throwed);
+
+	printf("%s: all passed\n", __FILE__);
+	return 0;
+}
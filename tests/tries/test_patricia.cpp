@@ -119,7 +119,116 @@ int main() {
     }
   }
 
+  // refresh token on each key boundary, the scan must be the same
+  iter->set_token_refresh(1);
+  {
+    size_t k = 0;
+    for (bool ok = iter->seek_begin(); ok; ok = iter->incr(), k++)
+      TERARK_VERIFY(iter->word() == keys_vec[k]);
+    TERARK_VERIFY_EQ(k, keys_vec.size());
+    TERARK_VERIFY(iter->seek_end());
+    for (bool ok = true; ok; ok = iter->decr())
+      TERARK_VERIFY(iter->word() == keys_vec[--k]);
+    TERARK_VERIFY_EQ(k, 0);
+  }
+  iter->set_token_refresh(0);
+
+  valvec<Patricia::TokenPinStat> pins;
+  trie->get_token_pin_stat(&pins);
+  TERARK_VERIFY_GE(pins.size(), 1);
+  TERARK_VERIFY(pins[0].is_head);
+
+  std::unique_ptr<Patricia> snap(trie->deep_copy());
+  TERARK_VERIFY(snap->is_readonly());
+  TERARK_VERIFY_EQ(snap->num_words(), keys_vec.size());
+  {
+    Patricia::IteratorPtr snap_iter(snap->new_iter());
+    size_t k = 0;
+    for (bool ok = snap_iter->seek_begin(); ok; ok = snap_iter->incr(), k++) {
+      TERARK_VERIFY(snap_iter->word() == keys_vec[k]);
+      TERARK_VERIFY(snap_iter->word() == aligned_load<const char*>(snap_iter->value()));
+    }
+    TERARK_VERIFY_EQ(k, keys_vec.size());
+  }
+
+  // refresh re-seeks: the iter is the head token, inserts by a writer move
+  // the node of current key, the scan after refresh must see new keys
   wtok->release();
+  iter->set_token_refresh(1);
+  {
+    auto insert = [&](const char* key) {
+      wtok->acquire(trie.get());
+      TERARK_VERIFY(trie->insert(key, val_of(key), wtok));
+      wtok->release();
+      stdset.insert(key);
+    };
+    TERARK_VERIFY(iter->seek_lower_bound("bb5"));
+    TERARK_VERIFY(iter->word() == "bb5");
+    trie->get_token_pin_stat(&pins);
+    TERARK_VERIFY_GE(pins.size(), 1);
+    TERARK_VERIFY(pins[0].is_head);
+    TERARK_VERIFY(pins[0].is_iter);
+    TERARK_VERIFY(pins[0].token == static_cast<const Patricia::TokenBase*>(iter));
+    insert("bb5x"); // child of current key, its node is moved
+    insert("aaaaz"); // before current key, must not be visited
+    std::vector<std::string> got;
+    for (bool ok = iter->incr(); ok; ok = iter->incr()) {
+      got.push_back(iter->word().str());
+      if (iter->word() == "cca") {
+        insert("ccaa");
+      }
+    }
+    std::vector<std::string> expected(stdset.upper_bound("bb5"), stdset.end());
+    TERARK_VERIFY_EQ(got.size(), expected.size());
+    for (size_t k = 0; k < got.size(); k++)
+      TERARK_VERIFY(got[k] == expected[k]);
+
+    // decr re-seeks to current key, then moves to the new prev key
+    TERARK_VERIFY(iter->seek_lower_bound("dda"));
+    insert("dd");
+    TERARK_VERIFY(iter->decr());
+    TERARK_VERIFY(iter->word() == "dd");
+  }
+  iter->set_token_refresh(0);
+
+  // refresh of a non-head token moves it to the queue tail
+  {
+    auto pin_of = [&](const Patricia::Iterator* it, size_t* pos) {
+      trie->get_token_pin_stat(&pins);
+      for (size_t k = 0; k < pins.size(); k++) {
+        if (pins[k].token == static_cast<const Patricia::TokenBase*>(it)) {
+          *pos = k;
+          return pins[k];
+        }
+      }
+      TERARK_DIE("token is not in queue");
+    };
+    TERARK_VERIFY(iter->seek_begin()); // iter is the head
+    Patricia::IteratorPtr iter2(trie->new_iter());
+    TERARK_VERIFY(iter2->seek_begin());
+    wtok->acquire(trie.get()); // iter2 is in the middle
+    size_t pos = 0;
+    auto pin = pin_of(iter2.get(), &pos);
+    TERARK_VERIFY(!pin.is_head);
+    TERARK_VERIFY_EQ(pos, 1);
+    iter2->set_token_refresh(1);
+    std::vector<std::string> got;
+    for (bool ok = true; ok; ok = iter2->incr()) {
+      got.push_back(iter2->word().str());
+      if (got.size() == 2) { // refreshed by incr
+        auto pin2 = pin_of(iter2.get(), &pos);
+        TERARK_VERIFY(!pin2.is_head);
+        TERARK_VERIFY_EQ(pos, pins.size() - 1);
+        TERARK_VERIFY_GT(pin2.verseq, pin.verseq);
+      }
+    }
+    wtok->release();
+    std::vector<std::string> expected(stdset.begin(), stdset.end());
+    TERARK_VERIFY_EQ(got.size(), expected.size());
+    for (size_t k = 0; k < got.size(); k++)
+      TERARK_VERIFY(got[k] == expected[k]);
+  }
+
   iter->dispose();
 
   return 0;
@@ -0,0 +1,240 @@
+// test & benchmark of PatternMatcher over NestLoudsTrieDAWG and Patricia,
+// expected results are computed by std::regex and fnmatch on all keys.
+//
+// usage: test_pattern_scan [num_users]
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#define _SCL_SECURE_NO_WARNINGS
+#endif
+
+#include <terark/fsa/pattern_scan.hpp>
+#include <terark/fsa/nest_trie_dawg.hpp>
+#include <terark/fsa/cspptrie.hpp>
+#include <terark/util/profiling.hpp>
+#include <fnmatch.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+using namespace terark;
+
+static std::vector<std::string> make_keys(size_t num_users, size_t seed) {
+	std::mt19937_64 rnd(seed);
+	std::vector<std::string> keys;
+	char buf[128];
+	for (size_t i = 0; i < num_users; ++i) {
+		size_t uid = rnd() % (num_users * 10);
+		snprintf(buf, sizeof(buf), "user:%zd:profile", uid);
+		keys.push_back(buf);
+		for (size_t j = rnd() % 4; j; --j) {
+			snprintf(buf, sizeof(buf), "user:%zd:session:%zd", uid, size_t(rnd() % 100000));
+			keys.push_back(buf);
+		}
+		if (rnd() % 8 == 0) {
+			snprintf(buf, sizeof(buf), "user:%zd:session:x%zd", uid, size_t(rnd() % 100));
+			keys.push_back(buf);
+		}
+		snprintf(buf, sizeof(buf), "order:%08zx:%s", size_t(rnd() % 0xFFFFFFFF),
+				 rnd() % 2 ? "paid" : "open");
+		keys.push_back(buf);
+	}
+	keys.push_back("");
+	keys.push_back("user:");
+	keys.push_back("\x01\xff");
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	return keys;
+}
+
+typedef std::vector<std::string> Result;
+
+static Result trie_scan(const BaseDFA* dfa, const PatternMatcher& pm) {
+	Result res;
+	size_t n = pm.scan(dfa, [&](fstring key, size_t state) {
+		TERARK_VERIFY(dfa->v_is_term(state));
+		res.push_back(key.str());
+		return true;
+	});
+	TERARK_VERIFY_EQ(n, res.size());
+	return res;
+}
+
+// scan by pages of page_size keys, each page resumes from the last key
+static Result paged_scan(const BaseDFA* dfa, const PatternMatcher& pm,
+						 size_t page_size) {
+	Result res;
+	std::string cursor;
+	bool first = true;
+	while (true) {
+		size_t cnt = 0;
+		auto fn = [&](fstring key, size_t) {
+			res.push_back(key.str());
+			return ++cnt < page_size;
+		};
+		if (first)
+			pm.scan(dfa, fn);
+		else
+			pm.scan_from(dfa, cursor, fn);
+		first = false;
+		if (cnt < page_size)
+			break;
+		cursor = res.back();
+	}
+	return res;
+}
+
+static void check_pattern(const std::vector<std::string>& keys,
+						  const BaseDFA* dawg, const BaseDFA* pt,
+						  const char* pattern, PatternMatcher::Syntax syntax,
+						  bool verbose) {
+	PatternMatcher pm(pattern, syntax);
+	qtime t0 = qtime::now();
+	Result expected;
+	if (PatternMatcher::Regex == syntax) {
+		std::regex re(pattern, std::regex::extended);
+		for (const std::string& k : keys)
+			if (std::regex_match(k, re))
+				expected.push_back(k);
+	} else {
+		for (const std::string& k : keys)
+			if (k.find('\0') == k.npos && 0 == fnmatch(pattern, k.c_str(), 0))
+				expected.push_back(k);
+	}
+	qtime t1 = qtime::now();
+	Result got_dawg = trie_scan(dawg, pm);
+	size_t visited_dawg = pm.visited_nodes();
+	qtime t2 = qtime::now();
+	Result got_pt = trie_scan(pt, pm);
+	size_t visited_pt = pm.visited_nodes();
+	qtime t3 = qtime::now();
+	for (const std::string& k : keys)
+		TERARK_VERIFY_EQ(pm.match(k), std::binary_search(
+						 expected.begin(), expected.end(), k));
+	TERARK_VERIFY(got_dawg == expected);
+	TERARK_VERIFY(got_pt == expected);
+	TERARK_VERIFY(paged_scan(dawg, pm, 7) == expected);
+	TERARK_VERIFY(paged_scan(pt, pm, 1) == expected);
+
+	size_t nth = 0;
+	pm.scan_dawg(dawg, [&](fstring key, size_t word_id) {
+		TERARK_VERIFY_S_EQ(key, expected[nth]);
+		TERARK_VERIFY_S_EQ(dawg->get_dawg()->nth_word(word_id), expected[nth]);
+		nth++;
+		return true;
+	});
+	TERARK_VERIFY_EQ(nth, expected.size());
+	if (expected.size() >= 2) {
+		nth = 1;
+		pm.scan_dawg_from(dawg, expected[0], [&](fstring key, size_t) {
+			TERARK_VERIFY_S_EQ(key, expected[nth]);
+			nth++;
+			return true;
+		});
+		TERARK_VERIFY_EQ(nth, expected.size());
+	}
+	if (verbose)
+		printf("%-32s states = %3zd, matched = %6zd, "
+			   "full scan: %8.3f ms, dawg: %8.3f ms(%zd nodes), "
+			   "patricia: %8.3f ms(%zd nodes)\n",
+			   pattern, pm.num_states(), expected.size(),
+			   t0.mf(t1), t1.mf(t2), visited_dawg, t2.mf(t3), visited_pt);
+}
+
+static void test_syntax() {
+	auto re = [](const char* p, const char* s) {
+		return PatternMatcher(p).match(s);
+	};
+	auto glob = [](const char* p, const char* s) {
+		return PatternMatcher(p, PatternMatcher::Glob).match(s);
+	};
+	TERARK_VERIFY(re("", ""));
+	TERARK_VERIFY(!re("", "a"));
+	TERARK_VERIFY(re("^abc$", "abc"));
+	TERARK_VERIFY(re("a(b|cd)*e", "abcdbe"));
+	TERARK_VERIFY(!re("a(b|cd)*e", "abce"));
+	TERARK_VERIFY(re("a{2,3}", "aaa"));
+	TERARK_VERIFY(!re("a{2,3}", "aaaa"));
+	TERARK_VERIFY(re("a{2,}", "aaaa"));
+	TERARK_VERIFY(!re("a{2}", "a"));
+	TERARK_VERIFY(re("\\d+\\.\\w\\s", "12.x "));
+	TERARK_VERIFY(re("[^a-c]x", "dx"));
+	TERARK_VERIFY(!re("[^a-c]x", "bx"));
+	TERARK_VERIFY(re("[]a]+", "]a]"));
+	TERARK_VERIFY(re("\\x41\\n", "A\n"));
+	TERARK_VERIFY(re("(?:ab)?c", "c"));
+	TERARK_VERIFY(!re("a[b-]c", "axc"));
+	TERARK_VERIFY(re("a[b-]c", "a-c"));
+	TERARK_VERIFY(glob("user:*:session:[0-9]*", "user:12:session:3x"));
+	TERARK_VERIFY(glob("*.{cpp,hpp}", "a.hpp"));
+	TERARK_VERIFY(!glob("*.{cpp,hpp}", "a.h"));
+	TERARK_VERIFY(glob("[!a]?\\*", "bc*"));
+	TERARK_VERIFY(!glob("[!a]?\\*", "ac*"));
+	TERARK_VERIFY(!re("[a-b]", "") && !re("x|y", "xy"));
+	for (const char* bad : {"(ab", "ab)", "*a", "a{3,2}", "[ab", "\\q", "a$b"}) {
+		bool throwed = false;
+		try { PatternMatcher pm(bad); }
+		catch (const std::invalid_argument&) { throwed = true; }
+		TERARK_VERIFY_F(throwed, "%s", bad);
+	}
+	bool throwed = false;
+	try { PatternMatcher pm("{a,b", PatternMatcher::Glob); }
+	catch (const std::invalid_argument&) { throwed = true; }
+	TERARK_VERIFY(throwed);
+	// never matches, all states are dead
+	TERARK_VERIFY_EQ(PatternMatcher("[^\\x00-\\xff]").num_states(), 1);
+}
+
+int main(int argc, char* argv[]) {
+	size_t num_users = argc > 1 ? strtoul(argv[1], NULL, 10) : 30000;
+	test_syntax();
+	std::vector<std::string> keys = make_keys(num_users, 20261019);
+
+	NestLoudsTrieDAWG_SE_512 dawg;
+	{
+		SortableStrVec strVec;
+		for (const std::string& k : keys)
+			strVec.push_back(k);
+		NestLoudsTrieConfig conf;
+		conf.isInputSorted = true;
+		dawg.build_from(strVec, conf);
+	}
+	std::unique_ptr<Patricia> pt(
+		Patricia::create(0, 4<<20, Patricia::MultiWriteMultiRead));
+	{
+		auto wtok = pt->tls_writer_token_nn();
+		wtok->acquire(pt.get());
+		for (const std::string& k : keys)
+			pt->insert(k, NULL, wtok);
+		wtok->release();
+	}
+	printf("keys = %zd\n", keys.size());
+	const char* regexes[] = {
+		"user:[0-9]+:session:[0-9]+",
+		"user:12[0-9]*:session:[0-9]+",
+		"user:1234[0-9]:(profile|session:x.*)",
+		"order:ff[0-9a-f]*:paid",
+		"(user|order):.*a.*",
+		".*:session:x[0-9]",
+		".*",
+		"",
+		"user:",
+		"nothing.*",
+	};
+	for (const char* re : regexes)
+		check_pattern(keys, &dawg, pt.get(), re, PatternMatcher::Regex, true);
+	const char* globs[] = {
+		"user:*:session:[0-9]*",
+		"user:99*:profile",
+		"order:????????:open",
+		"*x[5-7]",
+		"*",
+	};
+	for (const char* glob : globs)
+		check_pattern(keys, &dawg, pt.get(), glob, PatternMatcher::Glob, true);
+
+	printf("%s: all passed\n", __FILE__);
+	return 0;
+}
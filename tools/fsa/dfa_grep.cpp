@@ -0,0 +1,63 @@
+//
+// print keys of a dfa file matching a regex or glob pattern
+//
+
+#include <terark/fsa/pattern_scan.hpp>
+#include <getopt.h>
+
+int main(int argc, char* argv[]) {
+    using namespace terark;
+    PatternMatcher::Syntax syntax = PatternMatcher::Regex;
+    const char* cursor = NULL;
+    size_t limit = size_t(-1);
+    bool word_id = false;
+    for (int opt; (opt = getopt(argc, argv, "ga:n:i")) != -1; ) {
+        switch (opt) {
+        case 'g': syntax = PatternMatcher::Glob; break;
+        case 'a': cursor = optarg; break;
+        case 'n': limit = strtoul(optarg, NULL, 10); break;
+        case 'i': word_id = true; break;
+        default: goto Usage;
+        }
+    }
+    if (argc - optind < 2) {
+    Usage:
+        fprintf(stderr, "usage: %s [-g] [-a after-key] [-n limit] [-i] pattern dfa-file\n"
+                "  -g glob pattern, default is regex\n"
+                "  -a resume scan, print keys greater than after-key\n"
+                "  -n print at most limit keys\n"
+                "  -i print word id(dfa must be a dawg)\n", argv[0]);
+        return 1;
+    }
+    try {
+        PatternMatcher pm(argv[optind], syntax);
+        std::unique_ptr<BaseDFA> dfa(BaseDFA::load_from(argv[optind + 1]));
+        size_t cnt = 0;
+        auto print = [&](fstring key, size_t id) {
+            if (word_id)
+                printf("%zd\t%.*s\n", id, key.ilen(), key.data());
+            else
+                printf("%.*s\n", key.ilen(), key.data());
+            return ++cnt < limit;
+        };
+        if (0 == limit)
+            return 0;
+        if (word_id) {
+            if (cursor)
+                pm.scan_dawg_from(dfa.get(), cursor, print);
+            else
+                pm.scan_dawg(dfa.get(), print);
+        }
+        else {
+            if (cursor)
+                pm.scan_from(dfa.get(), cursor, print);
+            else
+                pm.scan(dfa.get(), print);
+        }
+        return 0;
+    }
+    catch (const std::exception& ex) {
+        fprintf(stderr, "%s\n", ex.what());
+        return 2;
+    }
+}
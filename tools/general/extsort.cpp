@@ -0,0 +1,53 @@
+#include <terark/util/ext_sort.hpp>
+#include <terark/util/linebuf.hpp>
+#include <getopt.h>
+
+// sort lines of stdin which may be larger than memory, write to stdout
+
+using namespace terark;
+
+static int usage(const char* prog) {
+	fprintf(stderr, "usage: %s [-m mem_limit_MB] [-t threads] [-T tmp_dir] < input > output\n", prog);
+	return 1;
+}
+
+int main(int argc, char* argv[]) {
+	ExternalStrSorter::Options opt;
+	for (;;) {
+		int ch = getopt(argc, argv, "m:t:T:");
+		switch (ch) {
+		case -1:
+			goto GetoptDone;
+		case 'm':
+			opt.mem_limit = size_t(atoi(optarg)) << 20;
+			break;
+		case 't':
+			opt.threads = std::max(atoi(optarg), 1);
+			break;
+		case 'T':
+			opt.tmp_dir = optarg;
+			break;
+		default:
+			return usage(argv[0]);
+		}
+	}
+GetoptDone:
+	try {
+		ExternalStrSorter sorter(opt);
+		LineBuf line;
+		while (line.getline(stdin) > 0) {
+			line.chomp();
+			sorter.push_back(line);
+		}
+		fprintf(stderr, "%zd lines, %zd runs\n", sorter.size(), sorter.num_runs());
+		sorter.merge([](fstring str) {
+			fwrite(str.data(), 1, str.size(), stdout);
+			putchar('\n');
+		});
+	}
+	catch (const std::exception& ex) {
+		fprintf(stderr, "ERROR: %s\n", ex.what());
+		return 2;
+	}
+	return 0;
+}
@@ -1,14 +1,32 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <algorithm>
-#include <terark/util/linebuf.hpp>
+#include <terark/thread/parallel_lines.hpp>
+
+using namespace terark;
 
 int main(int argc, char* argv[]) {
-	terark::LineBuf line;
-	FILE* fp = stdin;
-	while (line.getline(fp) >= 0) {
-		line.chomp();
-		std::reverse(line.begin(), line.end());
-		printf("%s\n", line.p);
+	ParallelLinesOptions opt;
+	if (argc >= 2) // optional parse threads
+		opt.threads = std::max(atoi(argv[1]), 1);
+	try {
+		parallel_ingest_lines(stdin, opt,
+		[](int, LineBlockTask* task) {
+			task->out.reserve(task->data.size() + 1);
+			task->for_each_line([&](size_t, const char* beg, const char* end) {
+				size_t pos = task->out.size();
+				task->out.append((const byte_t*)beg, end - beg);
+				std::reverse(task->out.begin() + pos, task->out.end());
+				task->out.push_back('\n');
+			});
+		},
+		[](LineBlockTask* task) {
+			fwrite(task->out.data(), 1, task->out.size(), stdout);
+		});
+	}
+	catch (const std::exception& ex) {
+		fprintf(stderr, "ERROR: %s\n", ex.what());
+		return 1;
 	}
 	return 0;
 }
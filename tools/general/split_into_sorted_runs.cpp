@@ -1,5 +1,8 @@
-#include <terark/util/linebuf.hpp>
+#include <terark/thread/parallel_lines.hpp>
+#include <terark/util/throw.hpp>
+#include <terark/fstring.hpp>
 #include <terark/valvec.hpp>
+#include <stdlib.h>
 
 // write sorted run filename to stdout
 // write sorted run content  to filename
@@ -8,7 +11,7 @@ using namespace terark;
 
 int main(int argc, char* argv[]) {
 	if (argc < 2) {
-		fprintf(stderr, "usage: %s fnamePrefix\n", argv[0]);
+		fprintf(stderr, "usage: %s fnamePrefix [parse_threads]\n", argv[0]);
 		return 1;
 	}
 	const char* fnamePrefix = argv[1];
@@ -16,37 +19,82 @@ int main(int argc, char* argv[]) {
 		fprintf(stderr, "ERROR: fnamePrefix = %s is too long(max 100)\n", fnamePrefix);
 		return 1;
 	}
+	ParallelLinesOptions opt;
+	if (argc >= 3)
+		opt.threads = std::max(atoi(argv[2]), 1);
+	opt.keep_order = true; // runs are continuous in input order
 	char fname[128];
-	LineBuf line;
 	valvec<byte_t> prev;
 	FILE* fo = NULL;
 	int fileIdx = 0;
-	while (line.getline(stdin) > 0) {
-		line.chomp();
-		if (NULL == fo || prev > fstring(line)) {
-			if (fo) {
-				fclose(fo);
-			}
-			sprintf(fname, "%s%06d", fnamePrefix, fileIdx++);
-			fo = fopen(fname, "w");
-			if (NULL == fo) {
-				fprintf(stderr, "ERROR: fopen(%s, w) = %s\n", fname, strerror(errno));
-				return 2;
+	auto new_run = [&]() {
+		if (fo) {
+			fclose(fo);
+		}
+		sprintf(fname, "%s%06d", fnamePrefix, fileIdx++);
+		fo = fopen(fname, "w");
+		if (NULL == fo) {
+			THROW_STD(runtime_error, "fopen(%s, w) = %s", fname, strerror(errno));
+		}
+		printf("%s\n", fname);
+		fflush(stdout);
+	};
+	auto write_run = [&](const byte_t* beg, const byte_t* end) {
+		size_t wn = fwrite(beg, 1, end - beg, fo);
+		if (wn != size_t(end - beg)) {
+			THROW_STD(runtime_error, "fwrite(%s, %zd) = %s", fname, end - beg, strerror(errno));
+		}
+	};
+	// parse: write chomped lines with '\n' to task->out, and find run
+	// breaks(a line less than its previous line) in the block as offsets
+	// in task->out, the first line of the block is checked by output stage
+	auto parse = [](int, LineBlockTask* task) {
+		fstring prevLine;
+		task->out.reserve(task->data.size() + 1);
+		task->for_each_line([&](size_t lineno, char* beg, char* end) {
+			fstring line(beg, end);
+			if (lineno != task->lineno && prevLine > line) {
+				size_t pos = task->out.size();
+				task->out2.append((const byte_t*)&pos, sizeof(pos));
 			}
-			printf("%s\n", fname);
-			fflush(stdout);
+			prevLine = line;
+			task->out.append((const byte_t*)beg, end - beg);
+			task->out.push_back('\n');
+		});
+	};
+	auto output = [&](LineBlockTask* task) {
+		const byte_t* data = task->out.data();
+		size_t  size = task->out.size();
+		const size_t* brk = (const size_t*)task->out2.data();
+		size_t  nbrk = task->out2.size() / sizeof(size_t);
+		if (0 == size)
+			return;
+		const byte_t* eol = (const byte_t*)memchr(data, '\n', size);
+		fstring first(data, eol);
+		if (NULL == fo || fstring(prev) > first) {
+			new_run();
 		}
-		prev.assign(line.p, line.n);
-		line.push_back('\n');
-		size_t wn = fwrite(line.p, 1, line.n, fo);
-		if (wn != line.n) {
-			fprintf(stderr, "ERROR: fwrite(%s, %zd) = %s\n", fname, line.n, strerror(errno));
-			return 3;
+		size_t pos = 0;
+		for (size_t i = 0; i < nbrk; ++i) {
+			write_run(data + pos, data + brk[i]);
+			new_run();
+			pos = brk[i];
 		}
+		write_run(data + pos, data + size);
+		// carry the last line for next block
+		const byte_t* last = data + size - 1;
+		while (last > data && '\n' != last[-1]) --last;
+		prev.assign(last, data + size - 1);
+	};
+	try {
+		parallel_ingest_lines(stdin, opt, parse, output);
+	}
+	catch (const std::exception& ex) {
+		fprintf(stderr, "ERROR: %s\n", ex.what());
+		return 2;
 	}
 	if (fo) {
 		fclose(fo);
 	}
 	return 0;
 }
-
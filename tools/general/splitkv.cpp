@@ -6,7 +6,8 @@
 
 #include <terark/util/autoclose.hpp>
 #include <terark/util/fstrvec.hpp>
-#include <terark/util/linebuf.hpp>
+#include <terark/thread/parallel_lines.hpp>
+#include <terark/util/throw.hpp>
 #include <terark/fstring.hpp>
 #include <terark/bitmap.hpp>
 #include <terark/valvec.hpp>
@@ -20,6 +21,7 @@ R"EOS(Usage: %s Options output-keys output-values
     -d delimeter
     -k fields: such as 0,1,2 or 4,2,3,0,1 ...
     -h Show this help information
+    -t parse threads, default 4
     -v Show verbose info
   Read input from stdin
 )EOS", prog);
@@ -31,8 +33,9 @@ int main(int argc, char* argv[]) {
 	febitvec isKey;
 	fstring delim = "\t";
 	valvec<size_t> keyFields;
+	ParallelLinesOptions plopt;
 	for (;;) {
-		int opt = getopt(argc, argv, "hd:k:v");
+		int opt = getopt(argc, argv, "hd:k:t:v");
 		switch (opt) {
 		case -1:
 			goto GetoptDone;
@@ -54,6 +57,9 @@ int main(int argc, char* argv[]) {
 				p = endp + 1;
 			}
 			break;
+		case 't':
+			plopt.threads = std::max(atoi(optarg), 1);
+			break;
 		case 'v':
 		//	verbose = true;
 			break;
@@ -80,53 +86,60 @@ GetoptDone:
 		fprintf(stderr, "FATAL: fopen(%s, wb) = %s\n", fnameVals, strerror(errno));
 		return 1;
 	}
-	size_t lineno = 0;
-	terark::LineBuf line;
-	valvec<fstring> F;
-	valvec<char> key, val;
-	while (line.getline(stdin) > 0) {
-		lineno++;
-		line.chomp();
-		line.split(delim, &F, isKey.size()+1);
-		key.erase_all();
-		val.erase_all();
-		// keyFields can be reordered, such as: 4,2,3,0,1
-		for(size_t i = 0; i < keyFields.size(); ++i) {
-			size_t j = keyFields[i];
-			if (j < F.size()) {
-				key.append(F[j]);
-				key.append(delim);
+	valvec<valvec<fstring> > threadF(plopt.threads);
+	auto parse = [&](int tno, LineBlockTask* task) {
+		valvec<fstring>& F = threadF[tno];
+		valvec<byte_t>& key = task->out;
+		valvec<byte_t>& val = task->out2;
+		task->for_each_line([&](size_t lineno, char* beg, char* end) {
+			*end = '\0';
+			fstring(beg, end).split(delim.p, &F, isKey.size()+1);
+			// keyFields can be reordered, such as: 4,2,3,0,1
+			size_t keypos = key.size();
+			for(size_t i = 0; i < keyFields.size(); ++i) {
+				size_t j = keyFields[i];
+				if (j < F.size()) {
+					key.append(F[j]);
+					key.append(delim);
+				}
+				else {
+					fprintf(stderr, "WARN: line: %zd: key field index = %zd out of range, insert an empty key field\n", lineno, j);
+					key.append(delim);
+				}
 			}
-			else {
-				fprintf(stderr, "WARN: line: %zd: key field index = %zd out of range, insert an empty key field\n", lineno, j);
-				key.append(delim);
+			size_t valpos = val.size();
+			for (size_t i = 0; i < F.size(); ++i) {
+				if (i >= isKey.size() || !isKey[i]) {
+					val.append(F[i]);
+					val.append(delim);
+				}
 			}
-		}
-		for (size_t i = 0; i < F.size(); ++i) {
-			if (i >= isKey.size() || !isKey[i]) {
-				val.append(F[i]);
-				val.append(delim);
+			if (key.size() > keypos) {
+				key.pop_n(delim.size());
 			}
+			key.push_back('\n');
+			if (val.size() > valpos) {
+				val.pop_n(delim.size());
+			}
+			val.push_back('\n');
+		});
+	};
+	auto output = [&](LineBlockTask* task) {
+		size_t n = fwrite(task->out.data(), 1, task->out.size(), ofkeys);
+		if (task->out.size() != n) {
+			THROW_STD(runtime_error, "lineno: %zd: fwrite(key, %zd) = %s", task->lineno, task->out.size(), strerror(errno));
 		}
-		if (!key.empty()) {
-			key.pop_n(delim.size());
-		}
-		key.push_back('\n');
-		if (!val.empty()) {
-			val.pop_n(delim.size());
-		}
-		val.push_back('\n');
-		size_t n = fwrite(key.data(), 1, key.size(), ofkeys);
-		if (key.size() != n) {
-			fprintf(stderr, "ERROR: lineno: %zd: fwrite(key, %zd) = %s\n", lineno, key.size(), strerror(errno));
-			return 1;
-		}
-		n = fwrite(val.data(), 1, val.size(), ofvals);
-		if (val.size() != n) {
-			fprintf(stderr, "ERROR: lineno: %zd: fwrite(val, %zd) = %s\n", lineno, val.size(), strerror(errno));
-			return 1;
+		n = fwrite(task->out2.data(), 1, task->out2.size(), ofvals);
+		if (task->out2.size() != n) {
+			THROW_STD(runtime_error, "lineno: %zd: fwrite(val, %zd) = %s", task->lineno, task->out2.size(), strerror(errno));
 		}
+	};
+	try {
+		parallel_ingest_lines(stdin, plopt, parse, output);
+	}
+	catch (const std::exception& ex) {
+		fprintf(stderr, "ERROR: %s\n", ex.what());
+		return 1;
 	}
 	return 0;
 }
-
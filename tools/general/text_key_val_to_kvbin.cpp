@@ -1,7 +1,8 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include <stdio.h>
+#include <stdlib.h>
 #include <algorithm>
-#include <terark/util/linebuf.hpp>
+#include <terark/thread/parallel_lines.hpp>
 #include <terark/util/throw.hpp>
 #include <boost/static_assert.hpp>
 #ifdef _MSC_VER
@@ -9,36 +10,45 @@
 	#include <io.h>
 #endif
 
+using namespace terark;
+
 int main(int argc, char* argv[]) {
 	BOOST_STATIC_ASSERT(sizeof(int) == 4);
-	int kvlen[2]; // int32
-	int lineno = 0;
 #ifdef _MSC_VER
 	if (_setmode(_fileno(stdout), _O_BINARY) < 0) {
 		THROW_STD(invalid_argument, "set stdout as binary mode failed");
 	}
 #endif
-	terark::LineBuf line;
-	while (line.getline(stdin) > 0) {
-		lineno++;
-		line.chomp();
-		if (line.empty()) {
-			fprintf(stderr, "line:%d is empty\n", lineno);
-			continue;
-		}
-		const char* beg = line.begin();
-		const char* end = line.end();
-		const char* tab = std::find(beg, end, '\t');
-		if (tab == end) {
-			kvlen[1] = 0;
-		} else {
-			kvlen[1] = end - tab - 1;
-		}
-		kvlen[0] = tab - beg;
-		fwrite(kvlen, 1, sizeof(kvlen), stdout);
-		fwrite(beg+0, 1, kvlen[0], stdout);
-		fwrite(tab+1, 1, kvlen[1], stdout);
+	ParallelLinesOptions opt;
+	if (argc >= 2) // optional parse threads
+		opt.threads = std::max(atoi(argv[1]), 1);
+	try {
+		parallel_ingest_lines(stdin, opt,
+		[](int, LineBlockTask* task) {
+			task->out.reserve(task->data.size() + 8 * task->num_lines);
+			task->for_each_line([&](size_t lineno, const char* beg, const char* end) {
+				if (beg == end) {
+					fprintf(stderr, "line:%zd is empty\n", lineno);
+					return;
+				}
+				const char* tab = std::find(beg, end, '\t');
+				int kvlen[2]; // int32
+				kvlen[0] = int(tab - beg);
+				kvlen[1] = tab == end ? 0 : int(end - tab - 1);
+				task->out.append((const byte_t*)kvlen, sizeof(kvlen));
+				task->out.append((const byte_t*)beg, kvlen[0]);
+				task->out.append((const byte_t*)tab + 1, kvlen[1]);
+			});
+		},
+		[](LineBlockTask* task) {
+			if (fwrite(task->out.data(), 1, task->out.size(), stdout) != task->out.size()) {
+				THROW_STD(runtime_error, "fwrite(stdout, %zd) = %s", task->out.size(), strerror(errno));
+			}
+		});
+	}
+	catch (const std::exception& ex) {
+		fprintf(stderr, "ERROR: %s\n", ex.what());
+		return 1;
 	}
 	return 0;
 }
-